@@ -0,0 +1,155 @@
+#ifndef VULKAN_TUT_ARENA_H
+#define VULKAN_TUT_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+#include "common.h"
+#include "jobs.h"
+
+namespace vk {
+
+// a linear allocator: an allocation bumps an offset into the current block, nothing is freed
+// on its own and reset() frees everything at once.
+//
+// it's a std::pmr::memory_resource, so the containers of std::pmr use it as they are. what does
+// get deallocated (e.g. the old storage of a growing vector) is only reclaimed by reset(), so
+// containers that are filled in one go should reserve() first.
+//
+// the blocks are kept across resets. when a reset finds that more than one block was needed,
+// they are replaced by a single block of their combined size, so after the first few frames
+// an arena that's used the same way every frame doesn't allocate at all.
+//
+// not thread safe, every thread needs its own (see FrameArenas)
+class LinearArena : public std::pmr::memory_resource {
+  struct Block {
+    ptr<std::byte[]> data;
+    size_t size;
+  };
+
+  vec<Block> blocks_;  // allocations come from the last one
+  size_t offset_ = 0;  // into the last block
+  size_t min_block_size_;
+
+  void add_block(size_t min_size) {
+    const size_t size = std::max({min_size, min_block_size_, blocks_.empty() ? 0 : 2 * blocks_.back().size});
+    // not value initialized, the memory is written by whoever allocates it
+    blocks_.push_back({ptr<std::byte[]>(new std::byte[size]), size});
+    offset_ = 0;
+  }
+
+  // nullptr if it doesn't fit into the last block
+  void *try_allocate(size_t bytes, size_t alignment) {
+    if (blocks_.empty()) {
+      return nullptr;
+    }
+
+    const Block &block = blocks_.back();
+    const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+    const uintptr_t p = (base + offset_ + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    if (p + bytes > base + block.size) {
+      return nullptr;
+    }
+
+    offset_ = p + bytes - base;
+    return reinterpret_cast<void *>(p);
+  }
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    if (void *p = try_allocate(bytes, alignment)) {
+      return p;
+    }
+
+    add_block(bytes + alignment);
+    return try_allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *, size_t, size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+public:
+  explicit LinearArena(size_t min_block_size = 64 * 1024) : min_block_size_(min_block_size) {}
+
+  LinearArena(const LinearArena &) = delete;
+  LinearArena &operator=(const LinearArena &) = delete;
+
+  // nothing that was allocated may be used anymore
+  void reset() {
+    if (blocks_.size() > 1) {
+      const size_t size = capacity();
+      blocks_.clear();
+      add_block(size);
+    }
+    offset_ = 0;
+  }
+
+  size_t capacity() const {
+    size_t size = 0;
+    for (const auto &block: blocks_) {
+      size += block.size;
+    }
+    return size;
+  }
+};
+
+// a LinearArena per frame in flight and thread, for CPU data that lives at most as long as the
+// frame it's made for: draw lists, culling results, the arrays of a submit, ...
+//
+// begin_frame() resets the arenas of a frame. it's called once the GPU is done with the frame's
+// previous use (its timeline value is complete), so even data the GPU reads while the frame is
+// in flight can live there. local() is the arena of the calling thread: one for the main thread
+// and one for every worker of the ThreadPool, so jobs that run for the frame (e.g. secondary
+// command buffers being recorded) allocate without any synchronization. jobs that outlive the
+// frame, like asset loading, must not use them
+class FrameArenas {
+  // arenas_[frame][0] is the main thread's, arenas_[frame][1 + i] worker i's
+  vec<vec<ptr<LinearArena>>> arenas_;
+  u32 frame_ = 0;
+
+public:
+  FrameArenas(u32 frames_in_flight, u32 workers) {
+    arenas_.resize(frames_in_flight);
+    for (auto &frame: arenas_) {
+      for (u32 i = 0; i < workers + 1; ++i) {
+        frame.push_back(std::make_unique<LinearArena>());
+      }
+    }
+  }
+
+  FrameArenas(const FrameArenas &) = delete;
+  FrameArenas &operator=(const FrameArenas &) = delete;
+
+  // no job may be using the arenas of the frame
+  void begin_frame(u32 frame) {
+    frame_ = frame;
+    for (auto &arena: arenas_[frame]) {
+      arena->reset();
+    }
+  }
+
+  LinearArena &local() {
+    const u32 worker = ThreadPool::worker_index();
+    return *arenas_[frame_][worker == ThreadPool::NO_WORKER ? 0 : 1 + worker];
+  }
+
+  // of all frames and threads
+  size_t capacity() const {
+    size_t size = 0;
+    for (const auto &frame: arenas_) {
+      for (const auto &arena: frame) {
+        size += arena->capacity();
+      }
+    }
+    return size;
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_ARENA_H
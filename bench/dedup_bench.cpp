@@ -0,0 +1,106 @@
+// measures vertex deduplication throughput on a synthetic mesh
+//
+// usage: vulkan_tut_dedup_bench [grid size] [repetitions]
+//
+// the mesh is a grid of size x size quads, emitted the way an obj loader hands them to us: every
+// quad as two triangles with the 4 corners referenced 6 times, so roughly every vertex is seen 6 times
+
+// must match main.cpp, they change the layout of the glm types
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+
+#include "../common.h"
+#include "../vertex.h"
+
+namespace {
+
+vec<Vertex> make_grid(u32 size) {
+  vec<Vertex> stream;
+  stream.reserve(size_t(size) * size * 6);
+
+  auto corner = [size](u32 x, u32 y) {
+    Vertex v {};
+    v.pos = {float(x), float(y), 0.0f};
+    v.color = {1.0f, 1.0f, 1.0f};
+    v.texCoord = {float(x) / size, 1.0f - float(y) / size};
+    return v;
+  };
+
+  for (u32 y = 0; y < size; ++y) {
+    for (u32 x = 0; x < size; ++x) {
+      stream.push_back(corner(x, y));
+      stream.push_back(corner(x + 1, y));
+      stream.push_back(corner(x + 1, y + 1));
+      stream.push_back(corner(x, y));
+      stream.push_back(corner(x + 1, y + 1));
+      stream.push_back(corner(x, y + 1));
+    }
+  }
+
+  return stream;
+}
+
+// what loadModel used to do (minus the double push_back), kept as the baseline
+size_t dedup_unordered_map(const vec<Vertex> &stream) {
+  std::unordered_map<Vertex, u32> unique;
+  vec<Vertex> vertices;
+  vec<u32> indices;
+
+  for (const auto &v: stream) {
+    auto [it, inserted] = unique.try_emplace(v, static_cast<u32>(vertices.size()));
+    if (inserted) {
+      vertices.push_back(v);
+    }
+    indices.push_back(it->second);
+  }
+
+  return vertices.size();
+}
+
+size_t dedup_open_addressing(const vec<Vertex> &stream) {
+  vk::VertexDedup dedup;
+  dedup.reserve(stream.size());
+  for (const auto &v: stream) {
+    dedup.insert(v);
+  }
+
+  return dedup.num_vertices();
+}
+
+template<typename F>
+void run(const char *name, const vec<Vertex> &stream, u32 repetitions, F &&f) {
+  double best = std::numeric_limits<double>::max();
+  size_t unique = 0;
+
+  for (u32 i = 0; i < repetitions; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    unique = f(stream);
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(end - start).count());
+  }
+
+  fmt::print(
+    "{:<16} {:>10} in -> {:>9} unique  best {:8.2f} ms  {:8.2f} M vertices/s\n",
+    name, stream.size(), unique, best * 1e3, stream.size() / best / 1e6
+  );
+}
+
+}
+
+int main(int argc, char **argv) {
+  u32 size = argc > 1 ? static_cast<u32>(std::atoi(argv[1])) : 1024;
+  u32 repetitions = argc > 2 ? static_cast<u32>(std::atoi(argv[2])) : 5;
+
+  auto stream = make_grid(size);
+
+  run("unordered_map", stream, repetitions, dedup_unordered_map);
+  run("open addressing", stream, repetitions, dedup_open_addressing);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,220 @@
+#ifndef VULKAN_TUT_BINDLESS_H
+#define VULKAN_TUT_BINDLESS_H
+
+#include <algorithm>
+#include <array>
+
+#include "common.h"
+
+namespace vk {
+
+// a single descriptor set that holds every texture and storage buffer, bound once per command
+// buffer. draws select what they use with indices in their push constants, so any number of
+// draws with different materials costs no descriptor set binds.
+//
+//   binding 0: sampler2D textures[]     (TEXTURE_CAPACITY, or less if the device can't)
+//   binding 1: buffer buffers[]         (BUFFER_CAPACITY)
+//
+// both bindings are update after bind and partially bound: only the elements that are written
+// have to be valid, and elements can be written while the set is bound. with update unused while
+// pending that includes command buffers that are still executing, as long as they don't use the
+// element. that is why a removed slot must not be reused before the frames that use it are done:
+// remove_*() is to be called like a destroy of the object in the slot.
+//
+// descriptor indexing is core in Vulkan 1.2, the features this needs are the ones supported()
+// checks for, they have to be enabled on the device
+class BindlessDescriptors {
+  VkDevice device_;
+  VkDescriptorSetLayout layout_;
+  VkDescriptorPool pool_;
+  VkDescriptorSet set_;
+
+  u32 texture_capacity_;
+  u32 buffer_capacity_;
+
+  // slots that have never been used start at the high-water marks
+  u32 next_texture_ = 0;
+  u32 next_buffer_ = 0;
+  vec<u32> free_textures_;
+  vec<u32> free_buffers_;
+
+  static u32 take(vec<u32> &free, u32 &next, u32 capacity, const char *what) {
+    if (!free.empty()) {
+      const u32 slot = free.back();
+      free.pop_back();
+      return slot;
+    }
+
+    if (next == capacity) {
+      throw std::runtime_error(fmt::format("out of bindless {} slots ({})", what, capacity));
+    }
+    return next++;
+  }
+
+public:
+  static constexpr u32 TEXTURE_BINDING = 0;
+  static constexpr u32 BUFFER_BINDING = 1;
+
+  static constexpr u32 TEXTURE_CAPACITY = 4096;
+  static constexpr u32 BUFFER_CAPACITY = 256;
+
+  // the descriptor indexing features of features12 and the dynamic indexing ones of features that
+  // the shaders need. everything else is left alone
+  static bool supported(const VkPhysicalDeviceFeatures &features, const VkPhysicalDeviceVulkan12Features &features12) {
+    return features.shaderSampledImageArrayDynamicIndexing == VK_TRUE &&
+           features.shaderStorageBufferArrayDynamicIndexing == VK_TRUE &&
+           features12.runtimeDescriptorArray == VK_TRUE &&
+           features12.descriptorBindingPartiallyBound == VK_TRUE &&
+           features12.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+           features12.descriptorBindingStorageBufferUpdateAfterBind == VK_TRUE &&
+           features12.descriptorBindingUpdateUnusedWhilePending == VK_TRUE;
+  }
+
+  static void enable(VkPhysicalDeviceFeatures &features, VkPhysicalDeviceVulkan12Features &features12) {
+    features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+    features.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+    features12.runtimeDescriptorArray = VK_TRUE;
+    features12.descriptorBindingPartiallyBound = VK_TRUE;
+    features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  }
+
+  BindlessDescriptors(VkDevice device, VkPhysicalDevice physical_device) : device_(device) {
+    VkPhysicalDeviceVulkan12Properties props12 {};
+    props12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 props {};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext = &props12;
+    vkGetPhysicalDeviceProperties2(physical_device, &props);
+
+    // combined image samplers count against both the sampler and the sampled image limits
+    texture_capacity_ = std::min({
+      TEXTURE_CAPACITY,
+      props12.maxPerStageDescriptorUpdateAfterBindSamplers,
+      props12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+      props12.maxDescriptorSetUpdateAfterBindSamplers,
+      props12.maxDescriptorSetUpdateAfterBindSampledImages,
+    });
+    buffer_capacity_ = std::min({
+      BUFFER_CAPACITY,
+      props12.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+      props12.maxDescriptorSetUpdateAfterBindStorageBuffers,
+    });
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings {};
+    bindings[0].binding = TEXTURE_BINDING;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = texture_capacity_;
+    bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].binding = BUFFER_BINDING;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = buffer_capacity_;
+    bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    const VkDescriptorBindingFlags flags =
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    std::array<VkDescriptorBindingFlags, 2> binding_flags = {flags, flags};
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info {};
+    flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flags_info.bindingCount = static_cast<u32>(binding_flags.size());
+    flags_info.pBindingFlags = binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo layout_info {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &flags_info;
+    layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = static_cast<u32>(bindings.size());
+    layout_info.pBindings = bindings.data();
+    VK_CHECK(vkCreateDescriptorSetLayout(device_, &layout_info, nullptr, &layout_));
+
+    std::array<VkDescriptorPoolSize, 2> pool_sizes {};
+    pool_sizes[0] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture_capacity_};
+    pool_sizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer_capacity_};
+
+    VkDescriptorPoolCreateInfo pool_info {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = static_cast<u32>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    VK_CHECK(vkCreateDescriptorPool(device_, &pool_info, nullptr, &pool_));
+
+    VkDescriptorSetAllocateInfo alloc_info {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = pool_;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout_;
+    VK_CHECK(vkAllocateDescriptorSets(device_, &alloc_info, &set_));
+
+    spdlog::info("bindless descriptors: {} textures, {} storage buffers", texture_capacity_, buffer_capacity_);
+  }
+
+  BindlessDescriptors(const BindlessDescriptors &) = delete;
+  BindlessDescriptors &operator=(const BindlessDescriptors &) = delete;
+
+  ~BindlessDescriptors() {
+    // the set goes with the pool
+    vkDestroyDescriptorPool(device_, pool_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, layout_, nullptr);
+  }
+
+  // the view has to be in SHADER_READ_ONLY_OPTIMAL whenever a draw that uses the slot executes
+  u32 add_texture(VkImageView view, VkSampler sampler) {
+    const u32 slot = take(free_textures_, next_texture_, texture_capacity_, "texture");
+
+    VkDescriptorImageInfo image_info {};
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    image_info.imageView = view;
+    image_info.sampler = sampler;
+
+    VkWriteDescriptorSet write {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set_;
+    write.dstBinding = TEXTURE_BINDING;
+    write.dstArrayElement = slot;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.descriptorCount = 1;
+    write.pImageInfo = &image_info;
+    vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+
+    return slot;
+  }
+
+  // the whole buffer unless a range is given
+  u32 add_buffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE) {
+    const u32 slot = take(free_buffers_, next_buffer_, buffer_capacity_, "buffer");
+
+    VkDescriptorBufferInfo buffer_info {};
+    buffer_info.buffer = buffer;
+    buffer_info.offset = offset;
+    buffer_info.range = range;
+
+    VkWriteDescriptorSet write {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set_;
+    write.dstBinding = BUFFER_BINDING;
+    write.dstArrayElement = slot;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.descriptorCount = 1;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+
+    return slot;
+  }
+
+  // only once no submitted work uses the slot anymore. the descriptor stays as it is, partially
+  // bound means nobody cares as long as it isn't used
+  void remove_texture(u32 slot) { free_textures_.push_back(slot); }
+  void remove_buffer(u32 slot) { free_buffers_.push_back(slot); }
+
+  VkDescriptorSetLayout layout() const { return layout_; }
+  VkDescriptorSet set() const { return set_; }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_BINDLESS_H
@@ -2,7 +2,15 @@
 #define VULKAN_TUT_COMMON_H
 
 #include <memory>
+#include <vector>
+#include <string>
+#include <limits>
+#include <stdexcept>
 #include <spdlog/spdlog.h>
+#include <fmt/core.h>
+
+#include <vulkan/vulkan.h>
+#include <vulkan/vk_enum_string_helper.h>
 
 
 template<typename T>
@@ -14,10 +22,22 @@ using ptr = std::unique_ptr<T>;
 template<typename T>
 using vec = std::vector<T>;
 
+using u8 = uint8_t;
+using u16 = uint16_t;
 using u32 = uint32_t;
+using u64 = uint64_t;
 
 using str = std::string;
 
 u32 u32_max = std::numeric_limits<u32>::max();
 
+#define VK_CHECK(x) \
+    do { \
+        VkResult err = x; \
+        if (err != VK_SUCCESS) { \
+            spdlog::error(#x " failed: {}", string_VkResult(err)); \
+            throw std::runtime_error(fmt::format(#x " failed: {}", string_VkResult(err))); \
+        } \
+    } while (0)
+
 #endif //VULKAN_TUT_COMMON_H
@@ -0,0 +1,637 @@
+#ifndef VULKAN_TUT_DEVICE_H
+#define VULKAN_TUT_DEVICE_H
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <utility>
+
+#include "common.h"
+
+// after vulkan.h, so that glfw declares glfwCreateWindowSurface
+#include <GLFW/glfw3.h>
+
+namespace vk {
+
+// owning wrappers of the objects everything else is created from: the instance, the surface,
+// the physical and the logical device and the swapchain. the wrappers that own a handle are
+// move-only, a moved from wrapper holds VK_NULL_HANDLE and destroys nothing
+
+struct Config {
+//  vec<const char*> enabled_layers = {
+//      "VK_LAYER_KHRONOS_validation"
+//  };
+};
+
+inline u32 ver() {
+  u32 ver;
+  VK_CHECK(vkEnumerateInstanceVersion(&ver));
+  return ver;
+}
+
+inline vec<VkLayerProperties> layers() {
+  u32 num_layers;
+  VK_CHECK(vkEnumerateInstanceLayerProperties(&num_layers, nullptr));
+
+  vec<VkLayerProperties> layers(num_layers);
+  VK_CHECK(vkEnumerateInstanceLayerProperties(&num_layers, layers.data()));
+
+  return layers;
+}
+
+inline vec<VkExtensionProperties> extensions() {
+  u32 num_extensions;
+  VK_CHECK(vkEnumerateInstanceExtensionProperties(nullptr, &num_extensions, nullptr));
+
+  vec<VkExtensionProperties> extensions(num_extensions);
+  VK_CHECK(vkEnumerateInstanceExtensionProperties(nullptr, &num_extensions, extensions.data()));
+
+  return extensions;
+}
+
+inline VKAPI_ATTR VkBool32 VKAPI_CALL debug_cb(
+  VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+  VkDebugUtilsMessageTypeFlagsEXT messageType,
+  const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+  void *pUserData
+) {
+  spdlog::get("vk_debug_messenger")->debug("validation layer: {}", pCallbackData->pMessage);
+  return VK_FALSE;
+}
+
+// the device level commands of the draw loop and the uploads. the ones vulkan.h declares go
+// through the loader, which forwards every call to the driver through the dispatch table of the
+// device. the pointers vkGetDeviceProcAddr returns are the driver's own (or the first layer's), so
+// calling them skips that trampoline. that's a few nanoseconds per call, but the draw loop makes a
+// lot of calls
+#define VK_DEVICE_FNS(X) \
+  X(vkBeginCommandBuffer) \
+  X(vkEndCommandBuffer) \
+  X(vkResetCommandPool) \
+  X(vkCmdBeginRenderPass) \
+  X(vkCmdEndRenderPass) \
+  X(vkCmdExecuteCommands) \
+  X(vkCmdSetViewport) \
+  X(vkCmdSetScissor) \
+  X(vkCmdBindPipeline) \
+  X(vkCmdBindDescriptorSets) \
+  X(vkCmdBindVertexBuffers) \
+  X(vkCmdBindIndexBuffer) \
+  X(vkCmdPushConstants) \
+  X(vkCmdDrawIndexed) \
+  X(vkCmdDrawIndexedIndirect) \
+  X(vkCmdDispatch) \
+  X(vkCmdUpdateBuffer) \
+  X(vkCmdFillBuffer) \
+  X(vkCmdCopyBuffer) \
+  X(vkCmdCopyBufferToImage) \
+  X(vkCmdCopyImage) \
+  X(vkCmdBlitImage) \
+  X(vkCmdResetQueryPool) \
+  X(vkCmdWriteTimestamp) \
+  X(vkCmdPipelineBarrier)
+
+// from an api version or device extension the device may not have, null then. whoever calls them
+// checks for the feature first anyway
+#define VK_OPTIONAL_DEVICE_FNS(X) \
+  X(vkCmdDrawIndexedIndirectCount) \
+  X(vkCmdBeginRendering) \
+  X(vkCmdEndRendering) \
+  X(vkCmdPipelineBarrier2) \
+  X(vkAcquireNextImageKHR) \
+  X(vkQueuePresentKHR)
+
+// named like the commands, so fns.vkCmdDraw(...) reads like the call it replaces
+struct DeviceFns {
+#define VK_DEVICE_FN_MEMBER(name) PFN_##name name = nullptr;
+  VK_DEVICE_FNS(VK_DEVICE_FN_MEMBER)
+  VK_OPTIONAL_DEVICE_FNS(VK_DEVICE_FN_MEMBER)
+#undef VK_DEVICE_FN_MEMBER
+
+  // only valid for the device they were loaded from
+  static DeviceFns load(VkDevice device) {
+    DeviceFns fns;
+
+#define VK_DEVICE_FN_LOAD(name) \
+    fns.name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name));
+    VK_DEVICE_FNS(VK_DEVICE_FN_LOAD)
+    VK_OPTIONAL_DEVICE_FNS(VK_DEVICE_FN_LOAD)
+#undef VK_DEVICE_FN_LOAD
+
+#define VK_DEVICE_FN_REQUIRE(name) \
+    if (fns.name == nullptr) { \
+      throw std::runtime_error(fmt::format("failed to load {}", #name)); \
+    }
+    VK_DEVICE_FNS(VK_DEVICE_FN_REQUIRE)
+#undef VK_DEVICE_FN_REQUIRE
+
+    return fns;
+  }
+};
+
+class DebugMessenger {
+  VkInstance instance_;
+  VkDebugUtilsMessengerEXT messenger_;
+
+public:
+  DebugMessenger(const VkDebugUtilsMessengerCreateInfoEXT& info, VkInstance instance): instance_(instance) {
+    spdlog::debug("getting ptr to vkCreateDebugUtilsMessengerEXT");
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(
+      instance,
+      "vkCreateDebugUtilsMessengerEXT"
+    );
+
+    if (func != nullptr) {
+      spdlog::debug("creating debug messenger");
+      VK_CHECK(func(instance, &info, nullptr, &messenger_));
+    } else {
+      throw std::runtime_error("failed to set up debug messenger!");
+    }
+  }
+
+  // owned by the Instance, which moves it by pointer
+  DebugMessenger(const DebugMessenger &) = delete;
+  DebugMessenger &operator=(const DebugMessenger &) = delete;
+
+  ~DebugMessenger() {
+    spdlog::debug("getting ptr to vkDestroyDebugUtilsMessengerEXT");
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(
+      instance_,
+      "vkDestroyDebugUtilsMessengerEXT"
+    );
+
+    if (func != nullptr) {
+      spdlog::debug("destroying debug messenger");
+      func(instance_, messenger_, nullptr);
+    }
+  }
+};
+
+class QFam {
+  VkQueueFamilyProperties props_;
+  u32 index_;
+
+public:
+  QFam(const VkQueueFamilyProperties& props, u32 index) : props_(props), index_(index) {}
+
+  u32 index() const { return index_; }
+  u32 qcount() const { return props_.queueCount; }
+  bool is_graphics() const { return props_.queueFlags & VK_QUEUE_GRAPHICS_BIT; }
+  bool is_compute() const { return props_.queueFlags & VK_QUEUE_COMPUTE_BIT; }
+  bool is_transfer() const { return props_.queueFlags & VK_QUEUE_TRANSFER_BIT; }
+
+  // transfer only family, usually the DMA engines of a discrete GPU
+  bool is_dedicated_transfer() const { return is_transfer() && !is_graphics() && !is_compute(); }
+  VkQueueFlags flags() const { return props_.queueFlags; }
+};
+
+// not an owning handle, physical devices belong to the instance. copies are fine
+class PDevice {
+  VkPhysicalDevice device_;
+  VkPhysicalDeviceProperties props_;
+
+public:
+  PDevice(VkPhysicalDevice device, VkPhysicalDeviceProperties props) : device_(device), props_(props) {}
+
+  explicit PDevice(VkPhysicalDevice device) : device_(device) {
+    vkGetPhysicalDeviceProperties(device_, &props_);
+  }
+
+  vec<QFam> qfams() const {
+    u32 num_families;
+    vkGetPhysicalDeviceQueueFamilyProperties(device_, &num_families, nullptr);
+
+    vec<VkQueueFamilyProperties> families(num_families);
+    vkGetPhysicalDeviceQueueFamilyProperties(device_, &num_families, families.data());
+
+    vec<QFam> res;
+    for (size_t i = 0; i < families.size(); ++i) {
+      res.push_back(QFam(families[i], i));
+    }
+
+    return res;
+  }
+
+  operator VkPhysicalDevice() const { return device_; }
+
+  const char* name() const { return props_.deviceName; }
+  const char* type() const { return string_VkPhysicalDeviceType(props_.deviceType); }
+  u32 api_ver() const { return props_.apiVersion; }
+  u32 driver_ver() const { return props_.driverVersion; }
+  const VkPhysicalDeviceProperties &props() const { return props_; }
+
+  // the video memory of the device, what the largest device local heap has. an integrated GPU
+  // reports (part of) system memory here
+  VkDeviceSize local_memory() const {
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vkGetPhysicalDeviceMemoryProperties(device_, &mem_props);
+
+    VkDeviceSize size = 0;
+    for (u32 i = 0; i < mem_props.memoryHeapCount; ++i) {
+      if (mem_props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+        size = std::max(size, mem_props.memoryHeaps[i].size);
+      }
+    }
+    return size;
+  }
+
+  // higher is better. the type decides: a discrete GPU beats an integrated one, which beats
+  // a virtual one and the CPU, whatever else they have. between two of the same type the newer
+  // api version and then the larger video memory wins
+  u64 score() const {
+    u64 type_score = 0;
+    switch (props_.deviceType) {
+      case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: type_score = 4; break;
+      case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: type_score = 3; break;
+      case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: type_score = 2; break;
+      case VK_PHYSICAL_DEVICE_TYPE_CPU: type_score = 1; break;
+      default: break;
+    }
+
+    // 2^40 MiB of video memory are still some way off
+    const u64 api = VK_API_VERSION_MAJOR(props_.apiVersion) * 16 + VK_API_VERSION_MINOR(props_.apiVersion);
+    const u64 memory_mib = std::min<u64>(local_memory() >> 20, (u64(1) << 40) - 1);
+    return type_score << 56 | (api & 0xff) << 40 | memory_mib;
+  }
+};
+
+// the highest scoring of the devices that are suitable, nullopt if none is. the first one wins a
+// tie, the order is the driver's
+inline std::optional<PDevice> pick_pdevice(const vec<PDevice> &pdevices, const std::function<bool(const PDevice &)> &suitable) {
+  std::optional<PDevice> best;
+  u64 best_score = 0;
+  for (const auto &pdevice: pdevices) {
+    const u64 score = pdevice.score();
+    const bool ok = suitable(pdevice);
+    spdlog::debug("device {} ({}): score={:#x}{}", pdevice.name(), pdevice.type(), score, ok ? "" : ", not suitable");
+
+    if (ok && (!best.has_value() || score > best_score)) {
+      best = pdevice;
+      best_score = score;
+    }
+  }
+
+  if (best.has_value()) {
+    spdlog::info("picked device {} ({}) of {}", best->name(), best->type(), pdevices.size());
+  }
+  return best;
+}
+
+class Instance {
+  VkInstance instance_ = VK_NULL_HANDLE;
+  ptr<DebugMessenger> debug_messenger_;
+
+public:
+  // a VkDebugUtilsMessengerCreateInfoEXT in the pNext chain also creates a debug messenger that
+  // lives as long as the instance
+  Instance(const VkInstanceCreateInfo &info) {
+    spdlog::debug("creating vulkan instance");
+    VK_CHECK(vkCreateInstance(&info, nullptr, &instance_));
+
+    for (auto *next = static_cast<const VkBaseInStructure *>(info.pNext); next != nullptr; next = next->pNext) {
+      if (next->sType == VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT) {
+        debug_messenger_ = std::make_unique<DebugMessenger>(
+          *reinterpret_cast<const VkDebugUtilsMessengerCreateInfoEXT *>(next),
+          instance_
+        );
+        break;
+      }
+    }
+
+    if (debug_messenger_ == nullptr) {
+      spdlog::debug("debug messenger not created");
+    }
+  }
+
+  Instance(const Instance &) = delete;
+  Instance &operator=(const Instance &) = delete;
+
+  Instance(Instance &&other) noexcept
+    : instance_(std::exchange(other.instance_, VK_NULL_HANDLE)), debug_messenger_(std::move(other.debug_messenger_)) {}
+
+  // the previous instance is destroyed by other
+  Instance &operator=(Instance &&other) noexcept {
+    std::swap(instance_, other.instance_);
+    std::swap(debug_messenger_, other.debug_messenger_);
+    return *this;
+  }
+
+  operator VkInstance() const { return instance_; }
+
+  vec<PDevice> pdevices() const {
+    u32 num_devices;
+    VK_CHECK(vkEnumeratePhysicalDevices(instance_, &num_devices, nullptr));
+
+    vec<VkPhysicalDevice> devices(num_devices);
+    VK_CHECK(vkEnumeratePhysicalDevices(instance_, &num_devices, devices.data()));
+
+    vec<PDevice> res;
+    for (u32 i = 0; i < num_devices; ++i) {
+      VkPhysicalDeviceProperties props {};
+      vkGetPhysicalDeviceProperties(devices[i], &props);
+      res.push_back(PDevice(devices[i], props));
+    }
+
+    return res;
+  }
+
+  ~Instance() {
+    // before the instance it belongs to
+    debug_messenger_.reset();
+
+    if (instance_ != VK_NULL_HANDLE) {
+      spdlog::debug("destroying vulkan instance");
+      vkDestroyInstance(instance_, nullptr);
+    }
+  }
+};
+
+class Surface {
+  VkInstance instance_;
+  VkSurfaceKHR surface_ = VK_NULL_HANDLE;
+
+public:
+  Surface(VkInstance instance, GLFWwindow *window) : instance_(instance) {
+    spdlog::debug("creating surface");
+    VK_CHECK(glfwCreateWindowSurface(instance, window, nullptr, &surface_));
+  }
+
+  Surface(const Surface &) = delete;
+  Surface &operator=(const Surface &) = delete;
+
+  Surface(Surface &&other) noexcept
+    : instance_(other.instance_), surface_(std::exchange(other.surface_, VK_NULL_HANDLE)) {}
+
+  Surface &operator=(Surface &&other) noexcept {
+    std::swap(instance_, other.instance_);
+    std::swap(surface_, other.surface_);
+    return *this;
+  }
+
+  operator VkSurfaceKHR() const { return surface_; }
+
+  VkSurfaceCapabilitiesKHR capabilities(const PDevice& pdevice) const {
+    VkSurfaceCapabilitiesKHR capabilities;
+    VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(pdevice, surface_, &capabilities));
+    return capabilities;
+  }
+
+  vec<VkSurfaceFormatKHR> formats(const PDevice& pdevice) const {
+    uint32_t num_formats;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(pdevice, surface_, &num_formats, nullptr);
+
+    vec<VkSurfaceFormatKHR> formats;
+    if (num_formats > 0) {
+      formats.resize(num_formats);
+      vkGetPhysicalDeviceSurfaceFormatsKHR(pdevice, surface_, &num_formats, formats.data());
+    }
+
+    return formats;
+  }
+
+  vec<VkPresentModeKHR> present_modes(const PDevice& pdevice) const {
+    uint32_t num_modes;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(pdevice, surface_, &num_modes, nullptr);
+
+    vec<VkPresentModeKHR> modes;
+    if (num_modes > 0) {
+      modes.resize(num_modes);
+      vkGetPhysicalDeviceSurfacePresentModesKHR(pdevice, surface_, &num_modes, modes.data());
+    }
+
+    return modes;
+  }
+
+  ~Surface() {
+    if (surface_ != VK_NULL_HANDLE) {
+      spdlog::debug("destroying surface");
+      vkDestroySurfaceKHR(instance_, surface_, nullptr);
+    }
+  }
+};
+
+class LDevice {
+  VkDevice device_ = VK_NULL_HANDLE;
+  vec<QFam> qfs_;
+  DeviceFns fns_;
+
+public:
+  LDevice(const PDevice& pdevice, const QFam& qf) : LDevice(pdevice, vec<QFam> {qf}) {}
+
+  // one queue for each of the families, the first one is what q() returns
+  LDevice(const PDevice& pdevice, const vec<QFam>& qfs) {
+    for (const auto& qf: qfs) {
+      bool seen = std::any_of(qfs_.begin(), qfs_.end(), [&](const QFam& o) { return o.index() == qf.index(); });
+      if (!seen) {
+        qfs_.push_back(qf);
+      }
+    }
+
+    VkDeviceCreateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+
+    VkPhysicalDeviceFeatures features {};
+    features.samplerAnisotropy = VK_TRUE;
+    features.sampleRateShading = VK_TRUE;
+    info.pEnabledFeatures = &features;
+
+    float qprio = 1.0f;
+    vec<VkDeviceQueueCreateInfo> qinfos;
+    for (const auto& qf: qfs_) {
+      spdlog::debug("creating logical device queue of family index={}", qf.index());
+      qinfos.push_back(VkDeviceQueueCreateInfo {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = qf.index(),
+        .queueCount = 1,
+        .pQueuePriorities = &qprio,
+      });
+    }
+    info.queueCreateInfoCount = (u32) qinfos.size();
+    info.pQueueCreateInfos = qinfos.data();
+
+    vec<const char *> extensions = {
+      VK_KHR_SWAPCHAIN_EXTENSION_NAME
+    };
+    info.enabledExtensionCount = (u32) extensions.size();
+    info.ppEnabledExtensionNames = extensions.data();
+
+    VK_CHECK(vkCreateDevice(pdevice, &info, nullptr, &device_));
+    fns_ = DeviceFns::load(device_);
+  }
+
+  // whatever features, extensions and queues the caller puts together. q() is the queue of the
+  // first family of info
+  LDevice(const PDevice& pdevice, const VkDeviceCreateInfo& info) {
+    const auto families = pdevice.qfams();
+    for (u32 i = 0; i < info.queueCreateInfoCount; ++i) {
+      qfs_.push_back(families.at(info.pQueueCreateInfos[i].queueFamilyIndex));
+    }
+
+    spdlog::debug("creating logical device with {} queue families", qfs_.size());
+    VK_CHECK(vkCreateDevice(pdevice, &info, nullptr, &device_));
+    fns_ = DeviceFns::load(device_);
+  }
+
+  LDevice(const LDevice &) = delete;
+  LDevice &operator=(const LDevice &) = delete;
+
+  LDevice(LDevice &&other) noexcept
+    : device_(std::exchange(other.device_, VK_NULL_HANDLE)), qfs_(std::move(other.qfs_)), fns_(other.fns_) {}
+
+  LDevice &operator=(LDevice &&other) noexcept {
+    std::swap(device_, other.device_);
+    std::swap(qfs_, other.qfs_);
+    std::swap(fns_, other.fns_);
+    return *this;
+  }
+
+  operator VkDevice() const { return device_; }
+
+  const DeviceFns &fns() const { return fns_; }
+
+  VkQueue q() const { return q(qfs_.front().index()); }
+
+  VkQueue q(u32 family) const {
+    VkQueue q;
+    vkGetDeviceQueue(device_, family, 0, &q);
+    return q;
+  }
+
+  ~LDevice() {
+    if (device_ != VK_NULL_HANDLE) {
+      spdlog::debug("destroying logical device");
+      vkDestroyDevice(device_, nullptr);
+    }
+  }
+};
+
+inline bool supports_khr(const PDevice& device, const Surface& surface, const QFam& qfam) {
+  VkBool32 res;
+  VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(device, qfam.index(), surface, &res));
+  return res;
+}
+
+
+inline const char* string_VkColorSpaceKHR(VkColorSpaceKHR colorSpace) {
+  switch (colorSpace) {
+    case VK_COLOR_SPACE_SRGB_NONLINEAR_KHR: return "VK_COLOR_SPACE_SRGB_NONLINEAR_KHR";
+    case VK_COLOR_SPACE_DISPLAY_P3_NONLINEAR_EXT: return "VK_COLOR_SPACE_DISPLAY_P3_NONLINEAR_EXT";
+    case VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT: return "VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT";
+    case VK_COLOR_SPACE_DISPLAY_P3_LINEAR_EXT: return "VK_COLOR_SPACE_DISPLAY_P3_LINEAR_EXT";
+    case VK_COLOR_SPACE_DCI_P3_NONLINEAR_EXT: return "VK_COLOR_SPACE_DCI_P3_NONLINEAR_EXT";
+    case VK_COLOR_SPACE_BT709_LINEAR_EXT: return "VK_COLOR_SPACE_BT709_LINEAR_EXT";
+    case VK_COLOR_SPACE_BT709_NONLINEAR_EXT: return "VK_COLOR_SPACE_BT709_NONLINEAR_EXT";
+    case VK_COLOR_SPACE_BT2020_LINEAR_EXT: return "VK_COLOR_SPACE_BT2020_LINEAR_EXT";
+    case VK_COLOR_SPACE_HDR10_ST2084_EXT: return "VK_COLOR_SPACE_HDR10_ST2084_EXT";
+    case VK_COLOR_SPACE_DOLBYVISION_EXT: return "VK_COLOR_SPACE_DOLBYVISION_EXT";
+    case VK_COLOR_SPACE_HDR10_HLG_EXT: return "VK_COLOR_SPACE_HDR10_HLG_EXT";
+    case VK_COLOR_SPACE_ADOBERGB_LINEAR_EXT: return "VK_COLOR_SPACE_ADOBERGB_LINEAR_EXT";
+    case VK_COLOR_SPACE_ADOBERGB_NONLINEAR_EXT: return "VK_COLOR_SPACE_ADOBERGB_NONLINEAR_EXT";
+    case VK_COLOR_SPACE_PASS_THROUGH_EXT: return "VK_COLOR_SPACE_PASS_THROUGH_EXT";
+    case VK_COLOR_SPACE_EXTENDED_SRGB_NONLINEAR_EXT: return "VK_COLOR_SPACE_EXTENDED_SRGB_NONLINEAR_EXT";
+    default: return "Unknown color space";
+  }
+}
+
+class ImageView {
+  VkDevice device_;
+  VkImageView view_ = VK_NULL_HANDLE;
+
+public:
+  ImageView(const VkImageViewCreateInfo& info, VkDevice device) : device_(device) {
+    spdlog::debug("creating image view");
+    VK_CHECK(vkCreateImageView(device_, &info, nullptr, &view_));
+  }
+
+  ImageView(const ImageView &) = delete;
+  ImageView &operator=(const ImageView &) = delete;
+
+  ImageView(ImageView &&other) noexcept
+    : device_(other.device_), view_(std::exchange(other.view_, VK_NULL_HANDLE)) {}
+
+  ImageView &operator=(ImageView &&other) noexcept {
+    std::swap(device_, other.device_);
+    std::swap(view_, other.view_);
+    return *this;
+  }
+
+  operator VkImageView() const { return view_; }
+
+  ~ImageView() {
+    if (view_ != VK_NULL_HANDLE) {
+      vkDestroyImageView(device_, view_, nullptr);
+    }
+  }
+};
+
+class Swapchain {
+  VkDevice device_;
+  VkSwapchainKHR swapChain_ = VK_NULL_HANDLE;
+  VkFormat format_;
+
+public:
+  Swapchain(const VkSwapchainCreateInfoKHR& info, VkDevice device) : device_(device), format_(info.imageFormat) {
+    spdlog::debug("creating swapchain");
+    VK_CHECK(vkCreateSwapchainKHR(device, &info, nullptr, &swapChain_));
+  }
+
+  Swapchain(const Swapchain &) = delete;
+  Swapchain &operator=(const Swapchain &) = delete;
+
+  Swapchain(Swapchain &&other) noexcept
+    : device_(other.device_), swapChain_(std::exchange(other.swapChain_, VK_NULL_HANDLE)), format_(other.format_) {}
+
+  Swapchain &operator=(Swapchain &&other) noexcept {
+    std::swap(device_, other.device_);
+    std::swap(swapChain_, other.swapChain_);
+    std::swap(format_, other.format_);
+    return *this;
+  }
+
+  operator VkSwapchainKHR() const { return swapChain_; }
+
+  vec<VkImage> images() const {
+    u32 num_images;
+    VK_CHECK(vkGetSwapchainImagesKHR(device_, swapChain_, &num_images, nullptr));
+
+    vec<VkImage> images(num_images);
+    VK_CHECK(vkGetSwapchainImagesKHR(device_, swapChain_, &num_images, images.data()));
+
+    return images;
+  }
+
+  // a color view of each of the images(), in the same order
+  vec<ImageView> image_views() const {
+    vec<ImageView> views;
+    for (auto image: images()) {
+      VkImageViewCreateInfo info {};
+      info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      info.image = image;
+      info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      info.format = format_;
+      info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+      info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+      info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+      info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+      info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      info.subresourceRange.baseMipLevel = 0;
+      info.subresourceRange.levelCount = 1;
+      info.subresourceRange.baseArrayLayer = 0;
+      info.subresourceRange.layerCount = 1;
+      views.emplace_back(info, device_);
+    }
+
+    return views;
+  }
+
+  ~Swapchain() {
+    if (swapChain_ != VK_NULL_HANDLE) {
+      spdlog::debug("destroying swapchain");
+      vkDestroySwapchainKHR(device_, swapChain_, nullptr);
+    }
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_DEVICE_H
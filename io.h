@@ -0,0 +1,123 @@
+#ifndef VULKAN_TUT_IO_H
+#define VULKAN_TUT_IO_H
+
+#include <cstddef>
+#include <fstream>
+#include <span>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "common.h"
+
+namespace vk {
+
+// a copy of the whole file on the heap. for files another process may rewrite while they are
+// read: a mapped file that is truncated underneath raises SIGBUS on the next touched page, a
+// read only comes up short
+inline vec<std::byte> read_file(const str &path) {
+  std::ifstream f(path, std::ios::ate | std::ios::binary);
+  if (!f.is_open()) {
+    throw std::runtime_error(fmt::format("failed to open file: {}", path));
+  }
+
+  vec<std::byte> res(static_cast<size_t>(f.tellg()));
+  f.seekg(0);
+  f.read(reinterpret_cast<char *>(res.data()), static_cast<std::streamsize>(res.size()));
+  if (!f) {
+    throw std::runtime_error(fmt::format("failed to read file: {}", path));
+  }
+  return res;
+}
+
+// read-only view of a whole file.
+//
+// on POSIX systems the file is mmap'ed: nothing is read until a page is touched and the pages
+// come straight from the page cache, so a file that was read recently costs no I/O at all and
+// there is no intermediate copy between the file and wherever the data ends up (e.g. a staging
+// buffer). elsewhere, or with copy, the file is simply read into memory: the view then stays
+// valid whatever happens to the file, see read_file.
+class MappedFile {
+  const std::byte *data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  vec<std::byte> buffer_;
+
+public:
+  explicit MappedFile(const str &path, bool copy = false) {
+#ifndef _WIN32
+    if (!copy) {
+      map(path);
+      return;
+    }
+#endif
+    buffer_ = read_file(path);
+    size_ = buffer_.size();
+    data_ = buffer_.data();
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+#ifndef _WIN32
+    if (mapped_) {
+      ::munmap(const_cast<std::byte *>(data_), size_);
+    }
+#endif
+  }
+
+  const std::byte *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // the start is aligned for any fundamental type (a mapping is page aligned), so e.g. SPIR-V
+  // words can be read in place
+  std::span<const std::byte> bytes() const { return {data_, size_}; }
+
+  // pointer to a T at the given byte offset, the caller checks bounds and alignment
+  template<typename T>
+  const T *at(size_t offset) const {
+    return reinterpret_cast<const T *>(data_ + offset);
+  }
+
+private:
+#ifndef _WIN32
+  void map(const str &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error(fmt::format("failed to open file: {}", path));
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error(fmt::format("failed to stat file: {}", path));
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+
+    // mapping 0 bytes is an error, an empty file is just an empty view
+    if (size_ > 0) {
+      void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error(fmt::format("failed to map file: {}", path));
+      }
+
+      data_ = static_cast<const std::byte *>(p);
+      mapped_ = true;
+    }
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+  }
+#endif
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_IO_H
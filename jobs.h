@@ -0,0 +1,119 @@
+#ifndef VULKAN_TUT_JOBS_H
+#define VULKAN_TUT_JOBS_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "common.h"
+
+namespace vk {
+
+// fixed number of worker threads pulling jobs from a single FIFO queue.
+//
+// meant for coarse CPU work (decoding an image, parsing a model) where a job takes milliseconds,
+// so a plain mutex + condition variable is plenty. submit() returns a std::future, exceptions
+// thrown by a job are rethrown by future::get() on the thread that consumes the result.
+//
+// jobs must not touch Vulkan objects that are externally synchronized (queues, command pools),
+// results are handed back to the main thread which records the uploads.
+class ThreadPool {
+  vec<std::thread> workers_;
+  std::deque<std::function<void()>> jobs_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+
+  static inline thread_local u32 current_worker_ = UINT32_MAX;  // NO_WORKER
+
+  void work(u32 index) {
+    current_worker_ = index;
+    for (;;) {
+      std::function<void()> job;
+      {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+
+        // drain the queue before exiting so no future is left without a value
+        if (jobs_.empty()) {
+          return;
+        }
+
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+
+      job();
+    }
+  }
+
+public:
+  static constexpr u32 NO_WORKER = UINT32_MAX;
+
+  // leave one core for the thread that is submitting the jobs
+  static u32 default_size() {
+    u32 n = std::thread::hardware_concurrency();
+    return n > 1 ? n - 1 : 1;
+  }
+
+  explicit ThreadPool(u32 num_threads = default_size()) {
+    workers_.reserve(num_threads);
+    for (u32 i = 0; i < num_threads; ++i) {
+      workers_.emplace_back([this, i] { work(i); });
+    }
+
+    spdlog::debug("thread pool with {} workers", num_threads);
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(mutex_);
+      stopping_ = true;
+    }
+
+    cv_.notify_all();
+    for (auto &w: workers_) {
+      w.join();
+    }
+  }
+
+  template<typename F>
+  auto submit(F &&f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+    using R = std::invoke_result_t<std::decay_t<F>>;
+
+    // std::function needs a copyable callable, packaged_task is move only
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto future = task->get_future();
+
+    {
+      std::lock_guard lock(mutex_);
+      jobs_.emplace_back([task] { (*task)(); });
+    }
+
+    cv_.notify_one();
+    return future;
+  }
+
+  u32 size() const { return (u32) workers_.size(); }
+
+  // which worker the calling thread is, in [0, size()), or NO_WORKER for any other thread.
+  // there is only one pool, so that's unique
+  static u32 worker_index() { return current_worker_; }
+};
+
+// non-blocking check whether a job has finished
+template<typename T>
+bool is_ready(const std::future<T> &f) {
+  return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+} // namespace vk
+
+#endif //VULKAN_TUT_JOBS_H
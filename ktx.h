@@ -0,0 +1,277 @@
+#ifndef VULKAN_TUT_KTX_H
+#define VULKAN_TUT_KTX_H
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+#include "common.h"
+#include "io.h"
+
+namespace vk {
+
+// textures with their whole mip chain precomputed, in the layout of a KTX 2.0 file:
+//
+//   identifier | Header | Index | Level[level count] | (dfd, key/values) | level data
+//
+// the level index starts with the largest level, the level data in the file is stored
+// smallest level first and every level is aligned to its texel block size. the files written
+// here leave out the data format descriptor (all the dfd/kvd/sgd fields are 0), which is
+// mandatory in KTX 2.0, so other tools may refuse them. in the other direction any KTX 2.0 file
+// works as long as it's a single layer 2D texture of a format below without supercompression.
+//
+// the level data is a view into the mapped file, so it can be copied straight into a staging
+// buffer
+namespace ktx {
+
+constexpr u8 IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct Header {
+  u32 vk_format;
+  u32 type_size;
+  u32 pixel_width;
+  u32 pixel_height;
+  u32 pixel_depth;
+  u32 layer_count;
+  u32 face_count;
+  u32 level_count;
+  u32 supercompression_scheme;
+};
+
+struct Index {
+  u32 dfd_byte_offset;
+  u32 dfd_byte_length;
+  u32 kvd_byte_offset;
+  u32 kvd_byte_length;
+  u64 sgd_byte_offset;
+  u64 sgd_byte_length;
+};
+
+struct LevelIndex {
+  u64 byte_offset;
+  u64 byte_length;
+  u64 uncompressed_byte_length;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(sizeof(IDENTIFIER) + sizeof(Header) + sizeof(Index) == 80, "level index has to start at byte 80");
+
+// the formats we know how to size, anything else is rejected when the file is opened
+struct FormatInfo {
+  u32 block_width;
+  u32 block_height;
+  u32 block_size;  // bytes
+};
+
+inline std::optional<FormatInfo> format_info(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+      return FormatInfo {1, 1, 4};
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+      return FormatInfo {4, 4, 16};
+    default:
+      return std::nullopt;
+  }
+}
+
+inline VkDeviceSize level_size(const FormatInfo &info, u32 width, u32 height) {
+  const VkDeviceSize blocks_x = (width + info.block_width - 1) / info.block_width;
+  const VkDeviceSize blocks_y = (height + info.block_height - 1) / info.block_height;
+  return blocks_x * blocks_y * info.block_size;
+}
+
+inline u32 mip_extent(u32 extent, u32 level) {
+  return std::max(1u, extent >> level);
+}
+
+// where the converter writes the <name> version of source_path, e.g. textures/viking_room.png
+// -> textures/viking_room.bc7.ktx2
+inline str path_for(const str &source_path, const str &name) {
+  return std::filesystem::path(source_path).replace_extension(name + ".ktx2").string();
+}
+
+// the versions of a texture that are looked for, in the order of preference. what ends up being
+// used is the first one that exists and whose format the device supports
+inline vec<str> candidates(const str &source_path) {
+  return {path_for(source_path, "bc7"), path_for(source_path, "astc"), path_for(source_path, "rgba8")};
+}
+
+struct Level {
+  u32 width;
+  u32 height;
+  u64 offset;  // in the file
+  u64 size;
+};
+
+class Texture {
+  ptr<MappedFile> file_;
+  str path_;
+  VkFormat format_;
+  FormatInfo info_;
+  u32 width_;
+  u32 height_;
+  vec<Level> levels_;
+
+  Texture(ptr<MappedFile> file, str path, VkFormat format, FormatInfo info, u32 width, u32 height, vec<Level> levels)
+    : file_(std::move(file)), path_(std::move(path)), format_(format), info_(info),
+      width_(width), height_(height), levels_(std::move(levels)) {}
+
+public:
+  // nothing if the file doesn't exist or is not a texture we can use, the reason is logged.
+  // copy reads the file into memory instead of mapping it, for files that may be rewritten while
+  // the texture is in use (hot reload): the streamer stages from data() for as long as it lives
+  static ptr<Texture> open(const str &path, bool copy = false) {
+    if (!std::filesystem::exists(path)) {
+      return nullptr;
+    }
+
+    auto file = std::make_unique<MappedFile>(path, copy);
+    const size_t header_end = sizeof(IDENTIFIER) + sizeof(Header) + sizeof(Index);
+    if (file->size() < header_end || memcmp(file->data(), IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+      spdlog::warn("{} is not a KTX2 file, ignoring it", path);
+      return nullptr;
+    }
+
+    Header h;
+    memcpy(&h, file->data() + sizeof(IDENTIFIER), sizeof(h));
+
+    const auto format = static_cast<VkFormat>(h.vk_format);
+    const auto info = format_info(format);
+    if (!info) {
+      spdlog::warn("{} has unsupported format {}, ignoring it", path, h.vk_format);
+      return nullptr;
+    }
+
+    if (h.supercompression_scheme != 0 ||
+        h.pixel_width == 0 || h.pixel_height == 0 || h.pixel_depth > 1 ||
+        h.layer_count > 1 || h.face_count != 1 || h.level_count == 0) {
+      spdlog::warn("{} is not a supercompression free, single layer 2D texture with precomputed mips, ignoring it", path);
+      return nullptr;
+    }
+
+    const u32 max_levels = std::bit_width(std::max(h.pixel_width, h.pixel_height));
+    if (h.level_count > max_levels || header_end + u64(h.level_count) * sizeof(LevelIndex) > file->size()) {
+      spdlog::warn("{} is corrupt, ignoring it", path);
+      return nullptr;
+    }
+
+    vec<Level> levels(h.level_count);
+    for (u32 i = 0; i < h.level_count; ++i) {
+      LevelIndex index;
+      memcpy(&index, file->data() + header_end + i * sizeof(LevelIndex), sizeof(index));
+
+      Level &level = levels[i];
+      level.width = mip_extent(h.pixel_width, i);
+      level.height = mip_extent(h.pixel_height, i);
+      level.offset = index.byte_offset;
+      level.size = level_size(*info, level.width, level.height);
+
+      // the copy into the image needs the offsets aligned to the block size
+      if (index.byte_length < level.size ||
+          index.byte_offset % info->block_size != 0 ||
+          index.byte_offset > file->size() ||
+          level.size > file->size() - index.byte_offset) {
+        spdlog::warn("{} is corrupt (level {}), ignoring it", path, i);
+        return nullptr;
+      }
+    }
+
+    return ptr<Texture>(new Texture(std::move(file), path, format, *info, h.pixel_width, h.pixel_height, std::move(levels)));
+  }
+
+  Texture(const Texture &) = delete;
+  Texture &operator=(const Texture &) = delete;
+
+  const str &path() const { return path_; }
+  VkFormat format() const { return format_; }
+  const FormatInfo &info() const { return info_; }
+  u32 width() const { return width_; }
+  u32 height() const { return height_; }
+  const vec<Level> &levels() const { return levels_; }
+
+  // the whole file, Level::offset is relative to this
+  const std::byte *data() const { return file_->data(); }
+};
+
+// levels[0] is the largest level, every level has exactly level_size() bytes
+inline bool write(const str &path, VkFormat format, u32 width, u32 height, const vec<vec<u8>> &levels) {
+  const auto info = format_info(format);
+  if (!info || levels.empty()) {
+    spdlog::error("can't write {}: unsupported format or no levels", path);
+    return false;
+  }
+
+  Header h {};
+  h.vk_format = static_cast<u32>(format);
+  h.type_size = 1;
+  h.pixel_width = width;
+  h.pixel_height = height;
+  h.pixel_depth = 0;
+  h.layer_count = 0;
+  h.face_count = 1;
+  h.level_count = static_cast<u32>(levels.size());
+  h.supercompression_scheme = 0;
+
+  Index index {};
+
+  // smallest level first, each aligned to lcm(block size, 4) which is the block size for all
+  // of our formats
+  vec<LevelIndex> level_index(levels.size());
+  u64 offset = sizeof(IDENTIFIER) + sizeof(h) + sizeof(index) + level_index.size() * sizeof(LevelIndex);
+  for (size_t i = levels.size(); i-- > 0;) {
+    offset = (offset + info->block_size - 1) / info->block_size * info->block_size;
+    level_index[i] = {offset, levels[i].size(), levels[i].size()};
+    offset += levels[i].size();
+  }
+
+  // write to a temporary file and rename it, a reader never sees a half written texture
+  const str tmp_path = path + ".tmp";
+  {
+    std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) {
+      spdlog::error("failed to create {}", tmp_path);
+      return false;
+    }
+
+    f.write(reinterpret_cast<const char *>(IDENTIFIER), sizeof(IDENTIFIER));
+    f.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    f.write(reinterpret_cast<const char *>(&index), sizeof(index));
+    f.write(reinterpret_cast<const char *>(level_index.data()), static_cast<std::streamsize>(level_index.size() * sizeof(LevelIndex)));
+
+    const char zeros[16] {};
+    for (size_t i = levels.size(); i-- > 0;) {
+      f.write(zeros, static_cast<std::streamsize>(level_index[i].byte_offset - static_cast<u64>(f.tellp())));
+      f.write(reinterpret_cast<const char *>(levels[i].data()), static_cast<std::streamsize>(levels[i].size()));
+    }
+
+    if (!f) {
+      spdlog::error("failed to write {}", tmp_path);
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    spdlog::error("failed to rename {}: {}", tmp_path, ec.message());
+    return false;
+  }
+
+  spdlog::info("wrote {} ({}x{}, {} levels, {} bytes)", path, width, height, levels.size(), offset);
+  return true;
+}
+
+} // namespace ktx
+
+} // namespace vk
+
+#endif //VULKAN_TUT_KTX_H
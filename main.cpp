@@ -7,13 +7,17 @@
 #include <vector>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
 #include <optional>
 #include <set>
 #include <limits>
-#include <fstream>
 #include <chrono>
 #include <array>
 #include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <filesystem>
 
 #include <fmt/core.h>
 
@@ -45,99 +49,288 @@
 #include <spdlog/sinks/stdout_color_sinks.h>
 
 #include "common.h"
+#include "arena.h"
+#include "device.h"
+#include "io.h"
+#include "memory.h"
+#include "timeline.h"
+#include "upload.h"
+#include "bindless.h"
+#include "mipgen.h"
+#include "streaming.h"
+#include "watch.h"
+#include "transient.h"
+#include "jobs.h"
+#include "vertex.h"
+#include "mesh.h"
+#include "scene.h"
+#include "ktx.h"
+#include "meshopt.h"
+#include "vertex_format.h"
+#include "transforms.h"
+#include "recorder.h"
+#include "profiler.h"
+#include "pipeline_cache.h"
+#include "pipelines.h"
 
 // being explicit about alignment requirements
-struct UniformBufferObject {
-  alignas(16) glm::mat4 model;
+//
+// both live in the transient buffer and are bound with dynamic offsets: FrameUniforms once per
+// frame, DrawUniforms for every draw (binding 0 and 2 of shader.ubo.vert)
+struct FrameUniforms {
   alignas(16) glm::mat4 view;
   alignas(16) glm::mat4 proj;
 };
 
-// hash function for Vertex (for unordered_map)
-// implemented by specifying template specialization for std::hash<T>
+struct DrawUniforms {
+  alignas(16) glm::mat4 model;
+};
+
+void checkSpirv(const std::string &path, std::span<const std::byte> code) {
+  uint32_t magic = 0;
+  if (code.size() >= 20 && code.size() % 4 == 0) {
+    std::memcpy(&magic, code.data(), sizeof(magic));
+  }
+  if (magic != 0x07230203) {
+    throw std::runtime_error(fmt::format("{} is not SPIR-V", path));
+  }
+}
+
+// SPIR-V is mapped and handed to vkCreateShaderModule as it is, there is no copy of it on the heap.
+// a file that is being written may be cut short, which the driver isn't required to notice
+std::unique_ptr<vk::MappedFile> readSpirv(const std::string &path) {
+  auto code = std::make_unique<vk::MappedFile>(path);
+  checkSpirv(path, code->bytes());
+  return code;
+}
 
+// for hot reloading: the shaders are rebuilt while the app runs, and glslc truncating a mapped
+// file would be a SIGBUS instead of an error
+std::vector<std::byte> readSpirvCopy(const std::string &path) {
+  std::vector<std::byte> code = vk::read_file(path);
+  checkSpirv(path, code);
+  return code;
+}
 
-struct Vertex {
-  glm::vec3 pos;
-  glm::vec3 color;
-  glm::vec2 texCoord;
+// everything loaded from disk that gets uploaded to the GPU later on. produced by the asset
+// jobs on worker threads and consumed by the main thread, which owns the upload queue
 
-  // needed for unordered_map
-  bool operator==(const Vertex &other) const {
-    return pos == other.pos &&
-           color == other.color &&
-           texCoord == other.texCoord;
+struct TextureData {
+  std::string path;
 
-  }
+  // every precompressed version of the texture that exists next to it, see vk::ktx. which one
+  // is used depends on the formats the device supports, and that's only known on the main thread
+  std::vector<std::unique_ptr<vk::ktx::Texture>> compressed;
 
-  // why the following static methods are needed:
-  // we need to tell vulkan how to pass vertex data format to the vertex shader
-  // once it's been uploaded into GPU memory. both structures are needed to convey
-  // this information
+  // the decoded source image, only if there is no precompressed version
+  int width = 0;
+  int height = 0;
+  std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> pixels {nullptr, stbi_image_free};
 
-  static VkVertexInputBindingDescription getBindingDescription() {
-    VkVertexInputBindingDescription bindingDescription {};
-    bindingDescription.binding = 0;
-    bindingDescription.stride = sizeof(Vertex);
-    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-    return bindingDescription;
-  }
+  VkDeviceSize size() const { return static_cast<VkDeviceSize>(width) * height * 4; }
+};
 
-  // TODO(cpp): do I get a compile error if i use array<..., > and do arr[x] / arr[x+1]?
-  static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
-    std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions {};
+TextureData decodeTexture(const std::string &path) {
+  TextureData texture;
+  texture.path = path;
+  int texChannels;
+
+  // uc == unsigned char
+  // TODO(cpp): char == byte ALWAYS? why isn't there a "byte" type?
+  // answer: since C++17 there exists a std::byte
+  // like unsigned char it can be used to access raw memory occupied by other objects but unlike
+  // unsigned char it is not a character type and is not an arithmetic type
+  // std::byte models a mere collection of bits, supporting only bitwise and comparison operations
+  // https://en.cppreference.com/w/cpp/types/byte
+  //
+  // the encoded image is decoded from the mapped file instead of stdio's buffered reads. the
+  // decoded pixels need a home on the heap until the main thread stages them
+  const vk::MappedFile file(path);
+  if (file.size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    throw std::runtime_error(fmt::format("failed to load texture image {}: file too large", path));
+  }
 
-    attributeDescriptions[0].binding = 0;
-    attributeDescriptions[0].location = 0;
-    attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[0].offset = offsetof(Vertex, pos);
+  texture.pixels.reset(stbi_load_from_memory(
+    reinterpret_cast<const stbi_uc *>(file.data()),
+    static_cast<int>(file.size()),
+    &texture.width,
+    &texture.height,
+    &texChannels,
+    STBI_rgb_alpha
+  ));
+
+  if (!texture.pixels) {
+    throw std::runtime_error(fmt::format("failed to load texture image {}: {}", path, stbi_failure_reason()));
+  }
 
-    attributeDescriptions[1].binding = 0;
-    attributeDescriptions[1].location = 1;
-    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[1].offset = offsetof(Vertex, color);
+  return texture;
+}
 
-    attributeDescriptions[2].binding = 0;
-    attributeDescriptions[2].location = 2;
-    attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-    attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+// mapping the precompressed files and reading their headers is cheap, decoding the source
+// image isn't, so it's only done if there's nothing else. with hot reload the files are read
+// instead: they can be overwritten while they are streamed, and a truncated mapping is a SIGBUS
+TextureData loadTexture(const std::string &path, bool hotReload) {
+  TextureData texture;
+  texture.path = path;
 
-    return attributeDescriptions;
+  for (const auto &candidate: vk::ktx::candidates(path)) {
+    if (auto file = vk::ktx::Texture::open(candidate, hotReload)) {
+      texture.compressed.push_back(std::move(file));
+    }
   }
-};
 
-namespace std {
-template<>
-struct hash<Vertex> {
-  size_t operator()(Vertex const &vertex) const {
-    return ((hash<glm::vec3>()(vertex.pos) ^
-             (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-           (hash<glm::vec2>()(vertex.texCoord) << 1);
+  if (texture.compressed.empty()) {
+    return decodeTexture(path);
   }
-};
+  return texture;
 }
 
-std::vector<char> readf(const std::string &filename) {
-  std::ifstream f(
-    filename,
-    // start reading at the end of the file
-    // we do this because we can determine the size of the file and allocate a buffer for it
-    std::ios::ate |
-    std::ios::binary
+// the faces are grouped by their material, every group becomes a submesh. material textures
+// are relative to the obj, they're made relative to the working directory here
+vk::MeshData parseObj(const std::string &path) {
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string warn, err;
+
+  const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+  const std::string mtlDirectory = directory.empty() ? "" : directory.string() + "/";
+
+  // object file consists of positions, normals, texture coords, and faces
+  // faces consist of arbitrary amount of vertices, where each vertex refers to a position
+  // normal and/or texture coordinate by index
+  //
+  // attrib holds all of the positions normals and texture coords in
+  // attrib.vertices
+  // attrib.texcoords
+  // attrib.normals
+  //
+  // shapes contains all separate objects and their faces
+  // each face is an array of vertices
+  // each vertex contaions indices of the position, normal, and texture coord attributes
+  // each face also has a material (shape.mesh.material_ids), -1 if it has none
+  bool ok = tinyobj::LoadObj(
+    &attrib,
+    &shapes,
+    &materials,
+    &warn,
+    &err,
+    path.c_str(),
+    mtlDirectory.empty() ? nullptr : mtlDirectory.c_str()
   );
 
-  if (!f.is_open()) {
-    throw std::runtime_error(fmt::format("failed to open file: {}", filename));
+  if (!ok) {
+    throw std::runtime_error(warn + err);
+  }
+
+  // a missing mtl file is only a warning, the faces then have no material
+  if (!warn.empty()) {
+    spdlog::warn("{}: {}", path, warn);
+  }
+
+  // the faces of every material, the ones without one go last. LoadObj triangulates, so every
+  // face is 3 indices
+  std::vector<std::vector<const tinyobj::index_t *>> faces(materials.size() + 1);
+  size_t numIndices = 0;
+  for (const auto &shape: shapes) {
+    for (size_t face = 0; face < shape.mesh.material_ids.size(); ++face) {
+      const int id = shape.mesh.material_ids[face];
+      const size_t group = id >= 0 && static_cast<size_t>(id) < materials.size() ? id : materials.size();
+      faces[group].push_back(&shape.mesh.indices[3 * face]);
+    }
+    numIndices += shape.mesh.indices.size();
+  }
+
+  // reduces indices from 1,500,00 to 265,645 which saves a lot of GPU memory
+  vk::VertexDedup uniqueVertices;
+  uniqueVertices.reserve(numIndices);
+
+  std::vector<vk::Submesh> submeshes;
+  std::vector<vk::MeshMaterial> meshMaterials;
+  uint32_t indexCount = 0;
+
+  // the dedup appends indices in the order the vertices are inserted, so inserting one material
+  // after the other keeps every material's indices contiguous
+  for (size_t group = 0; group < faces.size(); ++group) {
+    if (faces[group].empty()) {
+      continue;
+    }
+
+    for (const tinyobj::index_t *face: faces[group]) {
+      for (int corner = 0; corner < 3; ++corner) {
+        const tinyobj::index_t &index = face[corner];
+        Vertex vertex {};
+
+        // attrib.vertices is an array of float values instead of something like vec3, thus
+        // we need to multiply by 3
+        vertex.pos = {
+          attrib.vertices[3 * index.vertex_index + 0],
+          attrib.vertices[3 * index.vertex_index + 1],
+          attrib.vertices[3 * index.vertex_index + 2]
+        };
+
+        if (index.texcoord_index >= 0) {
+          vertex.texCoord = {
+            attrib.texcoords[2 * index.texcoord_index + 0],
+
+            // obj format assumes vertical coord of 0 means bottom of the image
+            // while we use top to bottom orientation where 0 means top of image
+            // so we need to flip it
+            1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+          };
+        }
+
+        vertex.color = {1.0f, 1.0f, 1.0f};
+
+        uniqueVertices.insert(vertex);
+      }
+    }
+
+    vk::MeshMaterial material;
+    if (group < materials.size()) {
+      const tinyobj::material_t &source = materials[group];
+      if (!source.diffuse_texname.empty()) {
+        material.texture = (directory / source.diffuse_texname).generic_string();
+      }
+      // anything with a cutout or transparency gets the alpha tested pipeline, there is no blending
+      material.alpha_test = source.dissolve < 1.0f || !source.alpha_texname.empty();
+    }
+
+    const uint32_t count = static_cast<uint32_t>(3 * faces[group].size());
+    submeshes.push_back({indexCount, count, static_cast<uint32_t>(meshMaterials.size())});
+    meshMaterials.push_back(std::move(material));
+    indexCount += count;
   }
 
-  size_t fsize = static_cast<size_t>(f.tellg());
-  std::vector<char> buffer(fsize);
+  std::vector<Vertex> vertices = uniqueVertices.take_vertices();
+  std::vector<uint32_t> indices = uniqueVertices.take_indices();
 
-  f.seekg(0);
-  f.read(buffer.data(), fsize);
-  f.close();
+  // the obj order has poor post-transform cache reuse. this is slow-ish, but only runs when the
+  // mesh cache is (re)built. every submesh is optimized on its own so they stay contiguous
+  std::vector<vk::IndexRange> ranges;
+  for (const auto &submesh: submeshes) {
+    ranges.push_back({submesh.first_index, submesh.index_count});
+  }
+  vk::optimize_mesh(vertices, indices, ranges);
+
+  return vk::MeshData(std::move(vertices), std::move(indices), std::move(submeshes), std::move(meshMaterials));
+}
+
+// parsing the text obj and deduplicating its vertices is by far the slowest part of startup,
+// so the result is cached in a binary file next to the obj. later runs map that file and
+// the vertices/indices get copied from the page cache straight into the staging ring
+vk::MeshData loadMesh(const std::string &path) {
+  if (auto cached = vk::mesh_cache::read(path)) {
+    spdlog::debug(
+      "loaded {} from mesh cache: {} vertices, {} indices",
+      path, cached->vertices().size(), cached->indices().size()
+    );
+    return std::move(*cached);
+  }
 
-  return buffer;  // TODO(cpp): how bad is this in terms of redundant copies?
+  vk::MeshData mesh = parseObj(path);
+  vk::mesh_cache::write(path, mesh);
+  return mesh;
 }
 
 // in vulkan anything from drawing to uploading textures, requires COMMANDS to be submitted to a QUEUE
@@ -153,6 +346,10 @@ struct QueueFamilyIndices {
   //               graphics == compute, present == purely about presenting on the Surface object?
   std::optional<uint32_t> presentFamily;
 
+  // a family that supports transfers but neither graphics nor compute. usually maps to the copy
+  // engines (DMA) of a discrete GPU which can run uploads in parallel to rendering
+  std::optional<uint32_t> transferFamily;
+
   bool isComplete() {
     return graphicsFamily.has_value() && presentFamily.has_value();
   }
@@ -172,44 +369,6 @@ struct SwapChainSupportDetails {
 };
 
 
-// The
-// VkDebugUtilsMessengerCreateInfoEXT struct should be passed to the
-// vkCreateDebugUtilsMessengerEXT function
-// but because this function is an extension function it is not automatically loaded
-// ==> we have to look up its address ourselves using vkGetInstanceProcAddr
-VkResult CreateDebugUtilsMessengerEXT(
-  VkInstance instance,
-  const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
-  const VkAllocationCallbacks *pAllocator,
-  VkDebugUtilsMessengerEXT *pDebugMessenger
-) {
-  auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(
-    instance,
-    "vkCreateDebugUtilsMessengerEXT"
-  );
-
-  if (func != nullptr) {
-    return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
-  } else {
-    return VK_ERROR_EXTENSION_NOT_PRESENT;
-  }
-}
-
-void DestroyDebugUtilsMessengerEXT(
-  VkInstance instance,
-  VkDebugUtilsMessengerEXT debugMessenger,
-  const VkAllocationCallbacks *pAllocator
-) {
-  auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(
-    instance,
-    "vkDestroyDebugUtilsMessengerEXT"
-  );
-
-  if (func != nullptr) {
-    func(instance, debugMessenger, pAllocator);
-  }
-}
-
 namespace glfw {
 
 vec<const char *> required_extensions() {
@@ -265,22 +424,211 @@ public:
 
 }
 
+// trade between input latency and throughput. framesInFlight, swapchainImages and presentMode
+// of AppConfig override the single choices of the mode
+enum class FramePacing {
+  // mailbox if available, 2 frames in flight, one swap chain image more than the minimum
+  Balanced,
+
+  // fifo with the minimum number of swap chain images, 2 frames in flight. a frame doesn't start
+  // (and sample its input) before the previous one was presented (VK_KHR_present_wait) or, if the
+  // device doesn't support that, before the GPU is done with it. the CPU never runs ahead
+  LowLatency,
+
+  // immediate if available (tears), then mailbox. 3 frames in flight, two extra images
+  MaxThroughput,
+};
+
+// a model file and the texture of its faces whose material has none (or that have no material)
+struct ModelAsset {
+  std::string mesh;
+  std::string texture;
+};
+
+// settings that are chosen when the application is started instead of being compiled in
+struct AppConfig {
+  // everything that is loaded into the scene, the models share the vertex and index buffers
+  std::vector<ModelAsset> models = {{"models/viking_room.obj", "textures/viking_room.png"}};
+
+  // number of copies of the scene that are drawn with a single instanced draw call.
+  // they are laid out on a square grid around the origin
+  uint32_t instanceCount = 1;
+
+  // cull the instances against the view frustum in a compute shader and draw the survivors
+  // with an indirect draw, the CPU cost of a frame then doesn't depend on the instance count
+  bool gpuCulling = true;
+
+  // without gpuCulling: cull the instances on the CPU while their transforms are written, only
+  // the visible ones end up in the instance buffer and are drawn
+  bool cpuCulling = true;
+
+  // radians per second every instance turns around its own z axis, neighbours in opposite
+  // directions. 0 leaves them as they are
+  float instanceSpin = 0.0f;
+
+  // CPU times of the steps of drawFrame and GPU times of its passes, logged as rolling
+  // min/avg/p99 every profileLogInterval frames. with a profileTrace path every sample is also
+  // written to that CSV file
+  bool profiling = true;
+  uint32_t profileLogInterval = 600;
+  std::string profileTrace;
+
+  // render into offscreen images instead of the swap chain of a window, nothing is presented.
+  // this is what the benchmark runs with, it needs no window system at all
+  bool headless = false;
+
+  // size of the window, or of the offscreen images
+  uint32_t width = 800;
+  uint32_t height = 600;
+
+  // 0: the highest sample count the device supports, otherwise the highest supported one that
+  // is not above this
+  uint32_t msaaSamples = 0;
+
+  // > 0: the animation advances by this many seconds every frame instead of following the
+  // clock, so every run renders the same frames
+  double fixedTimeStep = 0.0;
+
+  // fragment shader output for debugging, 0: texture, 1: vertex color, 2: texture coordinates.
+  // cycled with the V key
+  uint32_t debugOutput = 0;
+
+  // discard fragments whose texture alpha is below 0.5
+  bool alphaTest = false;
+
+  // render with vkCmdBeginRendering instead of a VkRenderPass and framebuffers if the device
+  // supports Vulkan 1.3, the render pass path stays as the fallback
+  bool dynamicRendering = true;
+
+  FramePacing pacing = FramePacing::Balanced;
+
+  // 0: what the pacing mode uses
+  uint32_t framesInFlight = 0;
+  uint32_t swapchainImages = 0;
+
+  // used instead of the pacing mode's choice if the surface supports it
+  std::optional<VkPresentModeKHR> presentMode;
+
+  // precompressed textures start out with only their small mip levels, the larger ones are
+  // streamed in when the model is large enough on screen to need them, see vk::TextureStreamer.
+  // textureBudgetMB 0: only what VK_EXT_memory_budget says is left (half the device local heap
+  // without it)
+  bool textureStreaming = true;
+  uint32_t textureBudgetMB = 0;
+
+  // one descriptor set with every texture and storage buffer, bound once per command buffer,
+  // draws find their uniforms and texture through push constants (see vk::BindlessDescriptors).
+  // needs the descriptor indexing features of Vulkan 1.2, the per draw descriptor set with
+  // dynamic uniform buffers stays as the fallback
+  bool bindless = true;
+
+  // watch the shaders, textures and models that were loaded and reload what changes while the
+  // application runs, see createFileWatcher. these are the files in the working directory, when
+  // running from the build directory that's the copies CMake made there
+  bool hotReload = true;
+};
+
+// frame times of HelloTriangleApplication::runBenchmark
+struct BenchmarkResult {
+  VkSampleCountFlagBits msaaSamples;
+  std::vector<double> frameMs;
+};
+
+// push constants of shaders/cull.comp
+struct CullPushConstants {
+  glm::vec4 planes[6];
+  glm::vec4 sphere;
+  uint32_t instanceCount;
+  uint32_t drawCount;
+};
+
+// push constants of the bindless shaders (shader.ubo.vert and shader.frag with BINDLESS).
+// the offsets are in vec4s into the storage buffer in slot buffer
+struct DrawPushConstants {
+  uint32_t frameUniforms;
+  uint32_t drawUniforms;
+  uint32_t buffer;
+  uint32_t texture;
+};
+
+// the variants of the graphics pipeline by vk::SceneDraw::pipeline: 0 opaque, 1 alpha tested
+using DrawPipelines = std::array<VkPipeline, 2>;
+
+// the start of the buffer written by shaders/cull.comp: the draw count that is read by
+// vkCmdDrawIndexedIndirectCount, followed by an indirect draw command per draw of the scene
+struct IndirectDrawBuffer {
+  uint32_t drawCount;
+  uint32_t pad[3];
+};
+
+VkDeviceSize indirectCommandOffset(uint32_t draw) {
+  return sizeof(IndirectDrawBuffer) + draw * sizeof(VkDrawIndexedIndirectCommand);
+}
+
+// the six planes of the frustum of a view projection matrix (Gribb/Hartmann), normals point
+// inside. uses the [0, 1] depth range of vulkan for the near plane
+std::array<glm::vec4, 6> frustumPlanes(const glm::mat4 &viewProj) {
+  auto row = [&](int i) {
+    return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+  };
+
+  std::array<glm::vec4, 6> planes = {
+    row(3) + row(0),  // left
+    row(3) - row(0),  // right
+    row(3) + row(1),  // bottom (top, with the flipped y of the projection)
+    row(3) - row(1),  // top
+    row(2),           // near
+    row(3) - row(2),  // far
+  };
+
+  for (auto &p: planes) {
+    p /= glm::length(glm::vec3(p));
+  }
+
+  return planes;
+}
+
 class HelloTriangleApplication {
 public:
-  const uint32_t WIDTH = 800;
-  const uint32_t HEIGHT = 600;
+  explicit HelloTriangleApplication(AppConfig config = {}) : config(config) {
+    this->config.instanceCount = std::max(this->config.instanceCount, 1u);
+
+    if (this->config.framesInFlight > 0) {
+      framesInFlight = std::min(this->config.framesInFlight, MAX_FRAMES_IN_FLIGHT);
+    } else {
+      framesInFlight = this->config.pacing == FramePacing::MaxThroughput ? 3 : 2;
+    }
 
-  const std::string MODEL_PATH = "models/viking_room.obj";
-  const std::string TEXTURE_PATH = "textures/viking_room.png";
+    // without a surface there is nothing to present to
+    if (this->config.headless) {
+      deviceExtensions.clear();
+    }
+  }
+
+  const std::string CULL_SHADER_PATH = "shaders/cull.spv";
+
+  // compiled pipelines of the last run, only used on the same device and driver
+  const std::string PIPELINE_CACHE_PATH = "pipeline.cache";
 
-  // each frame should have its own command buffer, set of semaphores and fence.
-  const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+  // layout of the vertices in the vertex buffer, Vertex is only the CPU side representation
+  const vk::VertexFormat VERTEX_FORMAT = vk::VertexFormat::compact();
+
+  // use VK_INDEX_TYPE_UINT16 when the model has few enough vertices
+  const bool ALLOW_16BIT_INDICES = true;
+
+  // room in the descriptor pool for textures that reloaded models bring along
+  const uint32_t HOT_RELOAD_TEXTURES = 16;
+
+  // each frame should have its own command buffer, set of semaphores and timeline value.
+  // set from the config in the constructor, see FramePacing
+  const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+  uint32_t framesInFlight = 2;
 
   const std::vector<const char *> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
   };
 
-  const std::vector<const char *> deviceExtensions = {
+  std::vector<const char *> deviceExtensions = {
     // vulkan has no defauilt framebuffer
     // it requires an infrastructure that iwll own the buffers we will render to before we visualize them on the screen
     // this infrastructure is the swap chain
@@ -297,6 +645,8 @@ public:
   // default: one sample per pixel, which is equivalent to no multisampling
   VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 
+  AppConfig config;
+
 public:
   void run() {
     initWindow();
@@ -305,6 +655,37 @@ public:
     cleanup();
   }
 
+  // renders warmupFrames + frames frames into the offscreen target and returns the time
+  // between the starts of consecutive frames for the last frames of them. the profiler's
+  // CPU and GPU section times are logged at the end
+  BenchmarkResult runBenchmark(uint32_t frames, uint32_t warmupFrames) {
+    config.headless = true;
+    deviceExtensions.clear();
+
+    initVulkan();
+
+    BenchmarkResult result {};
+    result.msaaSamples = msaaSamples;
+    result.frameMs.reserve(frames);
+
+    auto last = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < warmupFrames + frames; ++i) {
+      drawFrame();
+
+      auto now = std::chrono::steady_clock::now();
+      if (i >= warmupFrames) {
+        result.frameMs.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+      }
+      last = now;
+    }
+
+    vkDeviceWaitIdle(device);
+    profiler->log_stats();
+
+    cleanup();
+    return result;
+  }
+
 
 private:
   void initWindow() {
@@ -314,41 +695,206 @@ private:
 
     // last parameter relevant only for OpenGL
     // monitor param controls which monitor the window will be created on
-    window = glfwCreateWindow((int) WIDTH, (int) HEIGHT, "Vulkan", nullptr, nullptr);
+    window = glfwCreateWindow((int) config.width, (int) config.height, "Vulkan", nullptr, nullptr);
     glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    glfwSetKeyCallback(window, keyCallback);
   }
 
   void initVulkan() {
+    const auto initStart = std::chrono::steady_clock::now();
+
+    // decoding and parsing the assets is pure CPU work, it overlaps with creating the device
+    // and pipelines below
+    startAssetJobs();
+
     createInstance();
-    setupDebugMessenger();
-    createSurface();
+    if (!config.headless) {
+      createSurface();
+    }
     pickPhysicalDevice();
     createLogicalDevice();
-    createSwapChain();
+    createTimelines();
+    createMemoryAllocator();
+    createProfiler();
+    createPipelineCache();
+    if (config.headless) {
+      createOffscreenTarget();
+    } else {
+      createSwapChain();
+    }
     createImageViews();
     createRenderPass();
     createDescriptorSetLayout();
     createGraphicsPipeline();
     createCommandPool();
+    createFrameArenas();
+    createRecorder();
+    createUploadQueue();
+    createMipGenerator();
+    createTextureStreamer();
     createColorResources();
     createDepthResources();
     createFramebuffers(); // must be after createDepthResources
-    createTextureImage();
-    createTextureImageView();
+    uploadAssets();
+    createTextureImageViews();
     createTextureSampler();
-    loadModel();
-    createVertexBuffer();
-    createIndexBuffer();
-    createUniformBuffers();
+
+    // all asset copies above were only recorded, submit them as one batch.
+    // there's no need to wait: the batch ends with a barrier that orders it before the
+    // first frame that is submitted to the same queue
+    uploads->flush();
+
+    createTransientBuffer();
+    createInstanceBuffers();
+    createInstanceTransforms();
+    if (config.gpuCulling) {
+      createCullResources();
+    }
     createDescriptorPool();
     createDescriptorSets();
+    createFileWatcher();
     createCommandBuffers();
     createSyncObjects();
+
+    startTime = std::chrono::high_resolution_clock::now();
+
+    spdlog::info(
+      "startup took {:.1f} ms, {:.1f} ms of that creating pipelines ({} pipeline cache)",
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initStart).count(),
+      pipelineCreationMs,
+      pipelineCache->warm() ? "warm" : "cold"
+    );
+  }
+
+  void createProfiler() {
+    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    profiler = std::make_unique<vk::Profiler>(
+      device, fns, physicalDevice, queueFamilyIndices.graphicsFamily.value(), framesInFlight,
+      config.profiling, config.profileLogInterval
+    );
+    if (!config.profileTrace.empty()) {
+      profiler->enable_trace(config.profileTrace);
+    }
+  }
+
+  // shared by every pipeline that is created
+  void createPipelineCache() {
+    pipelineCache = std::make_unique<vk::PipelineCache>(device, physicalDevice, PIPELINE_CACHE_PATH);
+  }
+
+  // the default textures of the models are needed before their materials are known, so they
+  // are started together with the models. everything else starts once the model is parsed
+  void startAssetJobs() {
+    jobs = std::make_unique<vk::ThreadPool>();
+    for (const auto &asset: config.models) {
+      modelJobs.push_back(jobs->submit([path = asset.mesh] { return loadMesh(path); }));
+    }
+    for (const auto &asset: config.models) {
+      requestTexture(asset.texture);
+    }
+  }
+
+  // the index of the texture in textures, its job is started the first time it's asked for
+  uint32_t requestTexture(const std::string &path) {
+    auto [it, inserted] = textureIndices.try_emplace(path, static_cast<uint32_t>(textures.size()));
+    if (inserted) {
+      textures.emplace_back().path = path;
+      textureJobs.push_back(jobs->submit([path, hotReload = config.hotReload] { return loadTexture(path, hotReload); }));
+    }
+    return it->second;
+  }
+
+  // records the uploads of the textures in whatever order their jobs finish. the geometry goes
+  // into buffers that are shared by all models, so it's uploaded once every model is there
+  // a failed job rethrows its exception from get()
+  void uploadAssets() {
+    std::vector<std::optional<vk::MeshData>> meshes(modelJobs.size());
+    std::vector<std::vector<uint32_t>> materialTextures(modelJobs.size());
+    std::vector<bool> texturesDone(textureJobs.size(), false);
+
+    auto pendingModel = [&] {
+      return static_cast<size_t>(std::find_if(meshes.begin(), meshes.end(), [](const auto &m) { return !m; }) - meshes.begin());
+    };
+    auto pendingTexture = [&] {
+      return static_cast<size_t>(std::find(texturesDone.begin(), texturesDone.end(), false) - texturesDone.begin());
+    };
+
+    while (pendingModel() < meshes.size() || pendingTexture() < texturesDone.size()) {
+      bool progress = false;
+
+      for (size_t i = 0; i < modelJobs.size(); ++i) {
+        if (meshes[i] || !vk::is_ready(modelJobs[i])) {
+          continue;
+        }
+        meshes[i] = modelJobs[i].get();
+        for (const auto &material: meshes[i]->materials()) {
+          materialTextures[i].push_back(requestTexture(material.texture.empty() ? config.models[i].texture : material.texture));
+        }
+        progress = true;
+      }
+
+      // the materials of the models may have added textures
+      texturesDone.resize(textureJobs.size(), false);
+      for (size_t i = 0; i < textureJobs.size(); ++i) {
+        if (texturesDone[i] || !vk::is_ready(textureJobs[i])) {
+          continue;
+        }
+        createTextureImage(textures[i], textureJobs[i].get());
+        texturesDone[i] = true;
+        progress = true;
+      }
+
+      if (!progress) {
+        // nothing ready yet, block briefly on one of the outstanding jobs. the timeout keeps
+        // us from missing another one finishing first
+        if (const size_t i = pendingModel(); i < meshes.size()) {
+          modelJobs[i].wait_for(std::chrono::milliseconds(1));
+        } else {
+          textureJobs[pendingTexture()].wait_for(std::chrono::milliseconds(1));
+        }
+      }
+    }
+
+    // in config order, so the scene doesn't depend on which job finished first
+    for (auto &mesh: meshes) {
+      sceneMeshes.push_back(std::move(*mesh));
+    }
+    sceneMaterialTextures = std::move(materialTextures);
+    createScene();
+  }
+
+  // the scene of sceneMeshes and the buffers with its geometry, the staging copies are recorded
+  // into the current upload batch
+  void createScene() {
+    scene = vk::Scene();
+    for (size_t i = 0; i < sceneMeshes.size(); ++i) {
+      scene.add_model(sceneMeshes[i], sceneMaterialTextures[i]);
+    }
+
+    // variant 1 is the alpha tested one, see recordCommandBuffer
+    scene.build_draws([](const vk::SceneMaterial &material) { return material.alpha_test ? 1u : 0u; });
+
+    spdlog::info(
+      "scene: {} models, {} meshes, {} materials, {} textures, {} vertices, {} indices",
+      scene.models().size(), scene.meshes().size(), scene.materials().size(), textures.size(),
+      scene.vertex_count(), scene.index_count()
+    );
+
+    createVertexBuffer();
+    createIndexBuffer();
   }
 
   void mainLoop() {
     while (!glfwWindowShouldClose(window)) {
+      // minimized: there is no swap chain to render to, sleep until something happens
+      int width = 0, height = 0;
+      glfwGetFramebufferSize(window, &width, &height);
+      if (width == 0 || height == 0) {
+        glfwWaitEvents();
+        continue;
+      }
+
       glfwPollEvents();
       drawFrame();
     }
@@ -362,22 +908,38 @@ private:
   }
 
   void cleanup() {
+    // the device is idle, nothing that was retired is in use anymore
+    flushDeletionQueue();
     cleanupSwapchain();
 
     vkDestroySampler(device, textureSampler, nullptr);
 
-    vkDestroyImageView(device, textureImageView, nullptr);
+    // a streamed texture's images belong to the streamer
+    for (auto &texture: textures) {
+      if (texture.streamed) {
+        continue;
+      }
+      vkDestroyImageView(device, texture.view, nullptr);
+
+      vkDestroyImage(device, texture.image, nullptr);
+      allocator->free(texture.memory);
+    }
+    textureStreamer.reset();
+
+    transient.reset();
 
-    vkDestroyImage(device, textureImage, nullptr);
-    vkFreeMemory(device, textureImageMemory, nullptr);
+    for (size_t i = 0; i < framesInFlight; ++i) {
+      vkDestroyBuffer(device, instanceBuffers[i], nullptr);
+      allocator->free(instanceBuffersMemory[i]);
+    }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-      vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-      vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+    if (config.gpuCulling) {
+      destroyCullResources();
     }
 
     // descriptor sets are automatically freed when descriptor pool is destroyed
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    bindless.reset();
 
     // descriptor layout should stick around while we may create new graphics pipelines
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
@@ -385,35 +947,54 @@ private:
     // should be available for use in rendering commands until the end of the program and it does
     // not depend on the swap chain
     vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
+    allocator->free(vertexBufferMemory);
 
     vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
+    allocator->free(indexBufferMemory);
 
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    // waits for variants that are still compiling
+    pipelines.reset();
+    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(device, vertShaderModule, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyRenderPass(device, renderPass, nullptr);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    for (size_t i = 0; i < framesInFlight; ++i) {
       vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
       vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-      vkDestroyFence(device, inFlightFences[i], nullptr);
     }
 
     vkDestroyCommandPool(device, commandPool, nullptr);
+    for (auto pool: frameCommandPools) {
+      vkDestroyCommandPool(device, pool, nullptr);
+    }
+    recorder.reset();
+    profiler.reset();
 
-    // queues are automatically cleaned up when their logical device is destroyed
-    vkDestroyDevice(device, nullptr);
+    // everything compiled during this run, for the next one
+    pipelineCache->save();
+    pipelineCache.reset();
 
-    if (enableValidationLayers) {
-      DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
-    }
+    // waits for any batch that's still in flight and releases the staging ring
+    mipGenerator.reset();
+    uploads.reset();
+    transferTimeline.reset();
+    graphicsTimeline.reset();
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
-    vkDestroyInstance(instance, nullptr);
+    // all sub-allocations have been returned by now, this frees the underlying blocks
+    allocator.reset();
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    // queues are automatically cleaned up when their logical device is destroyed
+    vkDevice.reset();
+    vkSurface.reset();
+
+    // and the debug messenger with the instance
+    vkInstance.reset();
+
+    if (window != nullptr) {
+      glfwDestroyWindow(window);
+      glfwTerminate();
+    }
   }
 
 private:
@@ -432,7 +1013,9 @@ private:
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // 1.2 for vkCmdDrawIndexedIndirectCount and VkPhysicalDeviceVulkan12Features,
+    // 1.3 for dynamic rendering and synchronization2 (only used if the device has 1.3 as well)
+    appInfo.apiVersion = VK_API_VERSION_1_3;
 
     // tells the Vulkan driver which *global availableVkExtensions* and *validation layers* we want to use
     // global == they apply to the entire program and not a specific device
@@ -456,10 +1039,7 @@ private:
     }
 
     // retrieve a list of supported availableVkExtensions before creating an instance
-    uint32_t extensionCount = 0;
-    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
-    std::vector<VkExtensionProperties> availableVkExtensions(extensionCount);
-    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableVkExtensions.data());
+    std::vector<VkExtensionProperties> availableVkExtensions = vk::extensions();
 
     std::cout << "available extensions:\n";
     for (const auto &extension: availableVkExtensions) {
@@ -467,12 +1047,12 @@ private:
     }
 
     // Vulkan is platform-agnostic, which means that you need an extension to interface with the window system
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    // the extensions specified by GLFW are always required
-    std::vector<const char *> enabledExtensionNames(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    // (not needed when rendering headless, GLFW isn't even initialized then)
+    std::vector<const char *> enabledExtensionNames;
+    if (!config.headless) {
+      // the extensions specified by GLFW are always required
+      enabledExtensionNames = glfw::required_extensions();
+    }
 
     // the debug messenger extension is conditionally added
     if (enableValidationLayers) {
@@ -511,20 +1091,15 @@ private:
     // - pointer to struct w/ creation info
     // - pointer to custom allocator callbacks
     // - pointer to variable that will store the newly created object
-    VkResult result = vkCreateInstance(&createInfo, nullptr, &instance);
-    if (result != VK_SUCCESS) {
-      throw std::runtime_error(fmt::format(
-        "[err={}] failed to create instance!",
-        static_cast<int>(result)));
-    }
+    //
+    // with validation layers the debug messenger info is in the pNext chain, the instance then
+    // also creates the messenger that reports everything after this call
+    vkInstance = std::make_unique<vk::Instance>(createInfo);
+    instance = *vkInstance;
   }
 
   bool checkValidationLayerSupport() {
-    uint32_t layerCount;
-    vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
-
-    std::vector<VkLayerProperties> availableLayers(layerCount);
-    vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+    std::vector<VkLayerProperties> availableLayers = vk::layers();
 
     for (const char *layerName: validationLayers) {
       std::cout << fmt::format("checking support for validation layer: {}\n", layerName);
@@ -546,6 +1121,16 @@ private:
     return true;
   }
 
+  // switching the debug output picks another pipeline variant, the first time it's compiled
+  // in the background while the current one keeps being drawn
+  static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    auto app = reinterpret_cast<HelloTriangleApplication *>(glfwGetWindowUserPointer(window));
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+      app->config.debugOutput = (app->config.debugOutput + 1) % 3;
+      spdlog::info("debug output {}", app->config.debugOutput);
+    }
+  }
+
   static void framebufferResizeCallback(GLFWwindow *window, int width, int height) {
     auto app = reinterpret_cast<HelloTriangleApplication *>(glfwGetWindowUserPointer(window));
     app->framebufferResized = true;
@@ -561,11 +1146,9 @@ private:
     return VK_FALSE;
   }
 
-  // we have two places where we need to set the fields of this "create info" type:
-  // once in the setupdebugmessenger function which is called from initvulkan
-  // then in createinstance
-  // the reason for creating this in createinstance is if we want the debug messenger layer thing to
-  // output information during the create instance phase
+  // in the pNext chain of the instance's create info, so the debug messenger layer thing also
+  // outputs information during the create instance phase. vk::Instance creates the messenger
+  // for after that from the same info
   void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
     createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
 
@@ -587,23 +1170,6 @@ private:
     createInfo.pUserData = nullptr;
   }
 
-  void setupDebugMessenger() {
-    if (!enableValidationLayers) {
-      return;
-    }
-
-    VkDebugUtilsMessengerCreateInfoEXT createInfo = {};
-    populateDebugMessengerCreateInfo(createInfo);
-    if (CreateDebugUtilsMessengerEXT(
-      instance,
-      &createInfo,
-      nullptr,
-      &debugMessenger
-    ) != VK_SUCCESS) {
-      throw std::runtime_error("failed to set up debug messenger!");
-    }
-  }
-
   // need to check which queue families are supported by the device
   // and which of these families supports the commands that we want to use
   QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
@@ -615,20 +1181,30 @@ private:
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
 
+    // no early exit: the dedicated transfer/compute families usually come after the graphics one
     int i = 0;
     for (const auto &queueFamily: queueFamilies) {
-      if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+      const VkQueueFlags flags = queueFamily.queueFlags;
+
+      if ((flags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value()) {
         indices.graphicsFamily = i;
       }
 
+      // headless: nothing is presented, the graphics queue stands in for the present queue
       VkBool32 presentSupport = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-      if (presentSupport) {
+      if (surface != VK_NULL_HANDLE) {
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+      } else {
+        presentSupport = (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
+      }
+      if (presentSupport && !indices.presentFamily.has_value()) {
         indices.presentFamily = i;
       }
 
-      if (indices.isComplete()) {
-        break;
+      if ((flags & VK_QUEUE_TRANSFER_BIT) &&
+          !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+          !indices.transferFamily.has_value()) {
+        indices.transferFamily = i;
       }
 
       ++i;
@@ -637,44 +1213,56 @@ private:
     return indices;
   }
 
-  // look for and select a graphics card in the systme that supports the features we need
-  // we can select any number of graphics cards and use them simultaneously
-  void pickPhysicalDevice() {
-    uint32_t deviceCount = 0;
-    vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-    if (deviceCount == 0) {
-      throw std::runtime_error("failed to find GPUs with Vulkan support!");
+  bool isDeviceSuitable(VkPhysicalDevice device) {
+    VkPhysicalDeviceFeatures deviceFeatures;
+    vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+
+    // all synchronization goes through timeline semaphores, which createLogicalDevice requires
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    bool timelineSemaphores = false;
+    if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+      VkPhysicalDeviceVulkan12Features features12 {};
+      features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+      VkPhysicalDeviceFeatures2 features2 {};
+      features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features2.pNext = &features12;
+      vkGetPhysicalDeviceFeatures2(device, &features2);
+      timelineSemaphores = features12.timelineSemaphore == VK_TRUE;
     }
 
-    std::vector<VkPhysicalDevice> devices(deviceCount);
-    vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+    QueueFamilyIndices indices = findQueueFamilies(device);
+    bool swapChainAdequate = true;
+    if (!config.headless) {
+      SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
+      swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+    }
 
-    for (const auto &device: devices) {
-      VkPhysicalDeviceProperties deviceProperties;
-      vkGetPhysicalDeviceProperties(device, &deviceProperties);
-      VkPhysicalDeviceFeatures deviceFeatures;
-      vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+    return deviceFeatures.geometryShader &&
+           deviceFeatures.samplerAnisotropy &&
+           timelineSemaphores &&
+           indices.isComplete() &&
+           checkDeviceExtensionSupport(device) &&
+           swapChainAdequate;
+  }
 
-      QueueFamilyIndices indices = findQueueFamilies(device);
-      SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-      bool swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
-
-      // isDeviceSuitable
-      if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-          deviceFeatures.geometryShader &&
-          deviceFeatures.samplerAnisotropy &&
-          indices.isComplete() &&
-          checkDeviceExtensionSupport(device) &&
-          swapChainAdequate) {
-        physicalDevice = device;
-        msaaSamples = getMaxUsableSampleCount();
-        break;
-      }
+  // look for and select a graphics card in the systme that supports the features we need
+  // we can select any number of graphics cards and use them simultaneously.
+  // of the suitable ones the best is taken (see vk::PDevice::score), not the first the driver
+  // lists: that's often the integrated one of a laptop that has a discrete GPU as well
+  void pickPhysicalDevice() {
+    auto pdevices = vkInstance->pdevices();
+    if (pdevices.empty()) {
+      throw std::runtime_error("failed to find GPUs with Vulkan support!");
     }
 
-    if (physicalDevice == VK_NULL_HANDLE) {
+    auto pdevice = vk::pick_pdevice(pdevices, [this](const vk::PDevice &d) { return isDeviceSuitable(d); });
+    if (!pdevice.has_value()) {
       throw std::runtime_error("failed to find a suitable GPU!");
     }
+
+    physicalDevice = *pdevice;
+    msaaSamples = chooseSampleCount();
   }
 
   void createLogicalDevice() {
@@ -685,6 +1273,9 @@ private:
       indices.graphicsFamily.value(),
       indices.presentFamily.value()
     };
+    if (indices.transferFamily.has_value()) {
+      uniqueQueueFamilies.insert(indices.transferFamily.value());
+    }
     float queuePriority = 1.0f;
 
     for (uint32_t queueFamily: uniqueQueueFamilies) {
@@ -703,43 +1294,221 @@ private:
     VkPhysicalDeviceFeatures deviceFeatures {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;  // enable anisotropy, physical device must support this
     deviceFeatures.sampleRateShading = VK_TRUE; // enable sample shading feature
+
+    // block compressed textures, whatever the device has. which format a texture is actually
+    // loaded in is decided per texture by textureFormatSupported
+    VkPhysicalDeviceFeatures supportedFeatures {};
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    deviceFeatures.textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR;
+    textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+    textureCompressionASTC = supportedFeatures.textureCompressionASTC_LDR == VK_TRUE;
+
+    // the compute mip generator indexes an array of storage images, see createMipGenerator
+    deviceFeatures.shaderStorageImageArrayDynamicIndexing = supportedFeatures.shaderStorageImageArrayDynamicIndexing;
+    storageImageArrayDynamicIndexing = supportedFeatures.shaderStorageImageArrayDynamicIndexing == VK_TRUE;
+
+    // several indirect draws with one command, see recordIndirectDraws
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-    createInfo.pQueueCreateInfos = queueCreateInfos.data();
+    // the gpu culling path takes the number of draws from a buffer if the device can do that,
+    // otherwise it always issues one draw whose instance count may be 0
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+    VkPhysicalDeviceVulkan12Features supported12 {};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceVulkan12Features features12 {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    // dynamic rendering and synchronization2 replace the render pass path and the old barriers
+    // where they are available
+    VkPhysicalDeviceVulkan13Features supported13 {};
+    supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    VkPhysicalDeviceVulkan13Features features13 {};
+    features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+    if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+      if (deviceProperties.apiVersion >= VK_API_VERSION_1_3) {
+        supported12.pNext = &supported13;
+      }
 
-    // similar to VkInstanceCreateInfo, but these are now device specific
-    // e.g. VKK_KHR_swapchain is device specific extension that allows you to present rendered images
-    // from that device to windows
+      VkPhysicalDeviceFeatures2 features2 {};
+      features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features2.pNext = &supported12;
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
 
-    // vulkan _no longer_ makes a distinction between instance and device specific validation layers
-    // ==> enabledLayerCount and ppEnabledLayerNames are ignored
-    //    createInfo.enabledLayerCount
-    //    createInfo.ppEnabledLayerNames
+      features12.drawIndirectCount = supported12.drawIndirectCount;
+      features12.timelineSemaphore = supported12.timelineSemaphore;
+      createInfo.pNext = &features12;
 
-    createInfo.enabledExtensionCount = deviceExtensions.size();
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+      if (deviceProperties.apiVersion >= VK_API_VERSION_1_3) {
+        features13.dynamicRendering = supported13.dynamicRendering;
+        features13.synchronization2 = supported13.synchronization2;
+        features12.pNext = &features13;
+      }
+    }
 
-    VkResult res = vkCreateDevice(physicalDevice, &createInfo, nullptr, &device);
-    if (res != VK_SUCCESS) {
-      throw std::runtime_error(fmt::format(
-        "[err={}] failed to create logical device!",
-        static_cast<int>(res)
-      ));
+    // all synchronization with the GPU goes through timelines, see createTimelines
+    if (features12.timelineSemaphore != VK_TRUE) {
+      throw std::runtime_error("timeline semaphores are not supported!");
+    }
+
+    // descriptor indexing for the bindless descriptor set, see createDescriptorSetLayout
+    bindlessSupported = vk::BindlessDescriptors::supported(supportedFeatures, supported12);
+    if (config.bindless && bindlessSupported) {
+      vk::BindlessDescriptors::enable(deviceFeatures, features12);
+    }
+
+    drawIndirectCountSupported = features12.drawIndirectCount == VK_TRUE;
+    dynamicRenderingSupported = features13.dynamicRendering == VK_TRUE;
+    synchronization2Supported = features13.synchronization2 == VK_TRUE;
+
+    // only the low latency mode waits for presents
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures {};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures {};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+    if (!config.headless && config.pacing == FramePacing::LowLatency && presentWaitAvailable()) {
+      deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+      deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+
+      presentIdFeatures.presentId = VK_TRUE;
+      presentWaitFeatures.presentWait = VK_TRUE;
+      presentIdFeatures.pNext = const_cast<void *>(createInfo.pNext);
+      presentWaitFeatures.pNext = &presentIdFeatures;
+      createInfo.pNext = &presentWaitFeatures;
+      presentWaitEnabled = true;
+    }
+
+    // lets texture streaming keep below what the device has left instead of guessing
+    if (deviceExtensionAvailable(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+      deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+      memoryBudgetEnabled = true;
+    }
+
+    spdlog::info(
+      "dynamic rendering: {}, synchronization2: {}, bindless: {}, BC textures: {}, ASTC textures: {}",
+      useDynamicRendering() ? "on" : (dynamicRenderingSupported ? "off" : "not supported"),
+      synchronization2Supported ? "on" : "not supported",
+      useBindless() ? "on" : (bindlessSupported ? "off" : "not supported"),
+      textureCompressionBC ? "on" : "not supported",
+      textureCompressionASTC ? "on" : "not supported"
+    );
+
+    createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+    createInfo.pQueueCreateInfos = queueCreateInfos.data();
+
+    // similar to VkInstanceCreateInfo, but these are now device specific
+    // e.g. VKK_KHR_swapchain is device specific extension that allows you to present rendered images
+    // from that device to windows
+
+    // vulkan _no longer_ makes a distinction between instance and device specific validation layers
+    // ==> enabledLayerCount and ppEnabledLayerNames are ignored
+    //    createInfo.enabledLayerCount
+    //    createInfo.ppEnabledLayerNames
+
+    createInfo.enabledExtensionCount = deviceExtensions.size();
+    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+    vkDevice = std::make_unique<vk::LDevice>(vk::PDevice(physicalDevice), createInfo);
+    device = *vkDevice;
+    fns = vkDevice->fns();
+
+    graphicsQueue = vkDevice->q(indices.graphicsFamily.value());
+    presentQueue = vkDevice->q(indices.presentFamily.value());
+
+    if (presentWaitEnabled) {
+      waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"));
+    }
+    if (config.pacing == FramePacing::LowLatency && !config.headless) {
+      spdlog::info("low latency pacing: {}", waitForPresent != nullptr ? "waiting for presents" : "waiting for the previous frame");
+    }
+
+    // without a dedicated family the uploads run on the graphics queue
+    transferQueue = graphicsQueue;
+    if (indices.transferFamily.has_value()) {
+      transferQueue = vkDevice->q(indices.transferFamily.value());
+    }
+
+    spdlog::info(
+      "queue families: graphics={} present={} transfer={}",
+      indices.graphicsFamily.value(),
+      indices.presentFamily.value(),
+      indices.transferFamily.has_value() ? std::to_string(indices.transferFamily.value()) : "-"
+    );
+  }
+
+  // one counter per queue that is submitted to. waiting for the frames in flight, the upload
+  // batches and the deletion queue all compare their values. compute work runs on the graphics
+  // queue, so there's no compute timeline
+  void createTimelines() {
+    graphicsTimeline = std::make_unique<vk::Timeline>(device, "graphics");
+
+    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    if (indices.transferFamily.has_value()) {
+      transferTimeline = std::make_unique<vk::Timeline>(device, "transfer");
     }
+  }
 
-    vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-    vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+  // every buffer and image gets its memory from here instead of calling vkAllocateMemory itself
+  void createMemoryAllocator() {
+    allocator = std::make_unique<vk::MemoryAllocator>(physicalDevice, device);
   }
 
   void createSurface() {
-    VkResult res = glfwCreateWindowSurface(instance, window, nullptr, &surface);
-    if (res != VK_SUCCESS) {
-      throw std::runtime_error(fmt::format(
-        "[err={}] failed to create window surface!",
-        static_cast<int>(res)
-      ));
+    vkSurface = std::make_unique<vk::Surface>(instance, window);
+    surface = *vkSurface;
+  }
+
+  bool deviceExtensionAvailable(const char *name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableVkExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableVkExtensions.data());
+
+    for (const auto &e: availableVkExtensions) {
+      if (strcmp(e.extensionName, name) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // VK_KHR_present_id and VK_KHR_present_wait, both extensions and features
+  bool presentWaitAvailable() {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableVkExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableVkExtensions.data());
+
+    auto has = [&](const char *name) {
+      for (const auto &e: availableVkExtensions) {
+        if (strcmp(e.extensionName, name) == 0) {
+          return true;
+        }
+      }
+      return false;
+    };
+    if (!has(VK_KHR_PRESENT_ID_EXTENSION_NAME) || !has(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+      return false;
     }
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentId {};
+    presentId.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWait {};
+    presentWait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWait.pNext = &presentId;
+
+    VkPhysicalDeviceFeatures2 features2 {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &presentWait;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+    return presentId.presentId == VK_TRUE && presentWait.presentWait == VK_TRUE;
   }
 
   bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -812,13 +1581,39 @@ private:
 
 
   VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes) {
-    for (const auto &presentMode: availablePresentModes) {
-      // helps avoid tearing (which happens if we choose VK_PRESENT_MODE_IMMEDIATE_KHR)
-      // but avoids the latency issues of VK_PRESENT_MODE_FIFO_KHR
-      // on mobile pdevices, VK_PRESENT_MODE_FIFO_KHR is better because it consumes less power
-      if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-        return presentMode;
+    auto available = [&](VkPresentModeKHR mode) {
+      return std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end();
+    };
+
+    if (config.presentMode.has_value()) {
+      if (available(*config.presentMode)) {
+        return *config.presentMode;
       }
+      spdlog::warn("present mode {} is not supported, using the one of the pacing mode", string_VkPresentModeKHR(*config.presentMode));
+    }
+
+    switch (config.pacing) {
+      case FramePacing::Balanced:
+        // helps avoid tearing (which happens if we choose VK_PRESENT_MODE_IMMEDIATE_KHR)
+        // but avoids the latency issues of VK_PRESENT_MODE_FIFO_KHR
+        // on mobile pdevices, VK_PRESENT_MODE_FIFO_KHR is better because it consumes less power
+        if (available(VK_PRESENT_MODE_MAILBOX_KHR)) {
+          return VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+        break;
+
+      case FramePacing::LowLatency:
+        // with present wait, fifo never has more than one frame queued
+        break;
+
+      case FramePacing::MaxThroughput:
+        if (available(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+          return VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+        if (available(VK_PRESENT_MODE_MAILBOX_KHR)) {
+          return VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+        break;
     }
 
     // the only mode that is guaranteed to be available
@@ -855,7 +1650,9 @@ private:
     return actualExtent;
   }
 
-  void createSwapChain() {
+  // oldSwapChain: the swap chain this one replaces, which is retired by this call but has to be
+  // destroyed by the caller
+  void createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE) {
     SwapChainSupportDetails details = querySwapChainSupport(physicalDevice);
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(details.formats);
@@ -864,8 +1661,16 @@ private:
 
     // decide how many images we would like to have in the swap chain
     // if we stick to the minimum we may sometimes have to wait on the driver to complete
-    // internal operation before we can acquire another image to render to
-    uint32_t imageCount = details.capabilities.minImageCount + 1;
+    // internal operation before we can acquire another image to render to. every extra image is
+    // also a frame more that can be queued for presentation, so that's latency
+    uint32_t imageCount = details.capabilities.minImageCount;
+    if (config.swapchainImages > 0) {
+      imageCount = std::max(config.swapchainImages, imageCount);
+    } else if (config.pacing == FramePacing::Balanced) {
+      imageCount += 1;
+    } else if (config.pacing == FramePacing::MaxThroughput) {
+      imageCount += 2;
+    }
     if (details.capabilities.maxImageCount > 0 && imageCount > details.capabilities.maxImageCount) {
       imageCount = details.capabilities.maxImageCount;
     }
@@ -923,8 +1728,9 @@ private:
     createInfo.clipped = VK_TRUE;
 
     // this might be used when a window resizes for example and we need to create a new swap chain while
-    // still keeping the old one alive until we can move on to the new one
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // still keeping the old one alive until we can move on to the new one. lets the driver reuse
+    // its resources, and images already acquired from the old one can still be presented
+    createInfo.oldSwapchain = oldSwapChain;
 
     VkResult res = vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain);
     if (res != VK_SUCCESS) {
@@ -940,6 +1746,30 @@ private:
 
     swapChainImageFormat = surfaceFormat.format;
     swapChainExtent = extent;
+
+    spdlog::info(
+      "swap chain: {} images, {}, {} frames in flight",
+      imageCount, string_VkPresentModeKHR(presentMode), framesInFlight
+    );
+  }
+
+  // headless replacement of createSwapChain: plain images in the format the swap chain would
+  // most likely have, with the size from the config. the frames in flight take turns
+  void createOffscreenTarget() {
+    swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    swapChainExtent = {config.width, config.height};
+
+    swapChainImages.resize(framesInFlight);
+    offscreenImagesMemory.resize(framesInFlight);
+    for (size_t i = 0; i < framesInFlight; ++i) {
+      createImage(
+        swapChainExtent.width, swapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, swapChainImageFormat,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        swapChainImages[i], offscreenImagesMemory[i]
+      );
+    }
   }
 
   void createImageViews() {
@@ -977,20 +1807,82 @@ private:
     // main function that is invoked for every object
     //
     // we need a "vertex shader" and a "fragment shader" to get a triangle on the screen
-    auto vertShaderCode = readf("shaders/vert.spv");
-    auto fragShaderCode = readf("shaders/frag.spv");
+    // the vertex shader variant has to match the attributes of VERTEX_FORMAT
+    auto vertShaderCode = readSpirv(vertexShaderPath());
+    auto fragShaderCode = readSpirv(fragmentShaderPath());
 
     // compilation of the SPIR-V bytecode to machine code for execution by the GPU doesn't happen
     // until the graphcis pipeline is created
-    // ==> we can destroy shader modules as soon as pipeline creation is finished
-    // ==> we use locals
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+    // ==> we could destroy shader modules as soon as pipeline creation is finished
+    // ==> but variants can be created at any time, so they stay around as long as the registry
+    vertShaderModule = createShaderModule(vertShaderCode->bytes());
+    fragShaderModule = createShaderModule(fragShaderCode->bytes());
+
+    // bindless: the draw's part goes into push constants instead of dynamic offsets
+    VkPushConstantRange drawPushConstants {};
+    drawPushConstants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    drawPushConstants.offset = 0;
+    drawPushConstants.size = sizeof(DrawPushConstants);
+
+    VkDescriptorSetLayout setLayout = useBindless() ? bindless->layout() : descriptorSetLayout;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = useBindless() ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = useBindless() ? &drawPushConstants : nullptr;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    pipelines = std::make_unique<vk::PipelineRegistry>(device, *jobs, [this](const vk::PipelineKey &key) {
+      return buildGraphicsPipeline(key, vertShaderModule, fragShaderModule);
+    });
+
+    // the fallback has to exist before the first frame
+    const auto pipelineStart = std::chrono::steady_clock::now();
+    pipelines->get(fallbackPipelineKey());
+    pipelineCreationMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineStart).count();
+
+    // the variant the config asks for (if that's a different one) compiles in the background
+    pipelines->find(pipelineKey());
+  }
+
+  std::string vertexShaderPath() const {
+    return VERTEX_FORMAT.vertex_shader(useBindless());
+  }
+
+  std::string fragmentShaderPath() const {
+    return useBindless() ? "shaders/frag.bindless.spv" : "shaders/frag.spv";
+  }
+
+  // the variant of the graphics pipeline that's drawn with, selected by the config and the
+  // material (see DrawPipelines)
+  vk::PipelineKey pipelineKey(bool alphaTest = false) const {
+    vk::PipelineKey key;
+    key.samples = msaaSamples;
+    key.debug_output = config.debugOutput;
+    key.alpha_test = config.alphaTest || alphaTest;
+    return key;
+  }
+
+  // used while the variant of pipelineKey() is still compiling
+  vk::PipelineKey fallbackPipelineKey() const {
+    vk::PipelineKey key;
+    key.samples = msaaSamples;
+    return key;
+  }
+
+  // creates one variant of the graphics pipeline, called by the registry (on a worker thread
+  // unless it's needed right away) with the current modules
+  VkPipeline buildGraphicsPipeline(const vk::PipelineKey &key, VkShaderModule vert, VkShaderModule frag) {
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.module = vert;
 
     // it's possible to combine multiple fragment shaders into a single shader module
     // and use different entry points to differentiate between their behaviors
@@ -1006,9 +1898,20 @@ private:
     VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
     fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
+    fragShaderStageInfo.module = frag;
     fragShaderStageInfo.pName = "main";
 
+    // the fragment shader's part of the variant
+    const vk::FragmentSpecialization fragConstants(key);
+    const auto fragMapEntries = vk::FragmentSpecialization::map_entries();
+
+    VkSpecializationInfo fragSpecialization {};
+    fragSpecialization.mapEntryCount = static_cast<uint32_t>(fragMapEntries.size());
+    fragSpecialization.pMapEntries = fragMapEntries.data();
+    fragSpecialization.dataSize = sizeof(fragConstants);
+    fragSpecialization.pData = &fragConstants;
+    fragShaderStageInfo.pSpecializationInfo = &fragSpecialization;
+
     VkPipelineShaderStageCreateInfo shaderStages[] = {
       vertShaderStageInfo,
       fragShaderStageInfo
@@ -1017,16 +1920,24 @@ private:
     // ********************************************************************************
     //
     // ********************************************************************************
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    // binding 0: per vertex, binding 1: per instance
+    std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = {
+      VERTEX_FORMAT.binding_description(),
+      InstanceData::getBindingDescription()
+    };
+
+    auto attributeDescriptions = VERTEX_FORMAT.attribute_descriptions();
+    for (const auto &attribute: InstanceData::getAttributeDescriptions()) {
+      attributeDescriptions.push_back(attribute);
+    }
 
     // describes format of the vertex data that will be passed to the vertex shader
     // we're hard coding vertex data directly to vertex shader, we fill this to specify
     // that there is no vertex data to load for now
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.vertexBindingDescriptionCount = (uint32_t) bindingDescriptions.size();
+    vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
     vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t) attributeDescriptions.size();
     vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
@@ -1140,7 +2051,7 @@ private:
     VkPipelineMultisampleStateCreateInfo multisampling {};
     multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
     multisampling.sampleShadingEnable = VK_TRUE; // enable sample shading
-    multisampling.rasterizationSamples = msaaSamples;
+    multisampling.rasterizationSamples = key.samples;
     multisampling.minSampleShading = 0.2f; // min fraction for sample shading: closer to 1 == smoother
     multisampling.pSampleMask = nullptr; // Optional
     multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
@@ -1195,16 +2106,6 @@ finalColor = finalColor & colorWriteMask;
     //
     // ********************************************************************************
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-    pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create pipeline layout!");
-    }
 
     // ********************************************************************************
     //
@@ -1238,14 +2139,33 @@ finalColor = finalColor & colorWriteMask;
     pipelineInfo.renderPass = renderPass;
     pipelineInfo.subpass = 0;
 
+    // with dynamic rendering there is no render pass, the pipeline only has to know the
+    // attachment formats
+    const VkFormat depthAttachmentFormat = findDepthFormat();
+    VkPipelineRenderingCreateInfo renderingInfo {};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+    renderingInfo.depthAttachmentFormat = depthAttachmentFormat;
+    if (hasStencilComponent(depthAttachmentFormat)) {
+      renderingInfo.stencilAttachmentFormat = depthAttachmentFormat;
+    }
+
+    if (useDynamicRendering()) {
+      pipelineInfo.renderPass = VK_NULL_HANDLE;
+      pipelineInfo.pNext = &renderingInfo;
+    }
+
     // it is less expensive to set up pipelines when they have much functionality in common with an existing
     // pipeline and switchin between pielines from the same parent can also be done quicker
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
+    // this is where the driver compiles the SPIR-V, unless the pipeline cache already has the result
+    VkPipeline graphicsPipeline;
     if (vkCreateGraphicsPipelines(
       device,
-      VK_NULL_HANDLE,
+      pipelineCache->handle(),
       1,
       &pipelineInfo,
       nullptr,
@@ -1253,11 +2173,15 @@ finalColor = finalColor & colorWriteMask;
       throw std::runtime_error("failed to create graphics pipeline!");
     }
 
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    return graphicsPipeline;
   }
 
   void createRenderPass() {
+    // the attachments are given to vkCmdBeginRendering directly
+    if (useDynamicRendering()) {
+      return;
+    }
+
     // frame buffer attachments that will be used while rendering
     // need to specify how manmy color and epth buffers there will be, how many
     // samples to use for each of them and how their contents should be handled throughout the
@@ -1294,8 +2218,15 @@ finalColor = finalColor & colorWriteMask;
     // finalLayout specifies the layout to automatically transition to when the render pass finishes
     // UNDEFINED means we don't care
     // as for final, we want the image to be ready for presentation using the swap chain after rendering
+    //
+    // the layout the swap chain image ends up in. offscreen images aren't presented, and without
+    // VK_KHR_swapchain there is no present layout either
+    const VkImageLayout targetLayout = config.headless
+                                       ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                       : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = usesResolveAttachment() ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : targetLayout;
 
     VkAttachmentReference colorAttachmentRef {};
     // we have a single attachment, described above
@@ -1324,7 +2255,7 @@ finalColor = finalColor & colorWriteMask;
     colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachmentResolve.finalLayout = targetLayout;
 
     VkAttachmentReference colorAttachmentResolveRef {};
     colorAttachmentResolveRef.attachment = 2;
@@ -1341,7 +2272,8 @@ finalColor = finalColor & colorWriteMask;
     // line
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pResolveAttachments = &colorAttachmentResolveRef;
+    // with a single sample there is nothing to resolve, the swap chain image is the color attachment
+    subpass.pResolveAttachments = usesResolveAttachment() ? &colorAttachmentResolveRef : nullptr;
     subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
     std::array<VkAttachmentDescription, 3> attachments = {
@@ -1367,7 +2299,7 @@ finalColor = finalColor & colorWriteMask;
 
     VkRenderPassCreateInfo renderPassInfo {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = attachments.size();
+    renderPassInfo.attachmentCount = usesResolveAttachment() ? attachments.size() : 2;
     renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
@@ -1384,8 +2316,8 @@ finalColor = finalColor & colorWriteMask;
     }
   }
 
-  // a thin wrapper around the shader bytecode
-  VkShaderModule createShaderModule(const std::vector<char> &code) {
+  // a thin wrapper around the shader bytecode, which has to be aligned to 4 bytes
+  VkShaderModule createShaderModule(std::span<const std::byte> code) {
     VkShaderModuleCreateInfo ci = {};
     ci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     ci.codeSize = code.size();
@@ -1402,6 +2334,11 @@ finalColor = finalColor & colorWriteMask;
   }
 
   void createFramebuffers() {
+    // no framebuffers with dynamic rendering, so nothing to rebuild when the swap chain is recreated
+    if (useDynamicRendering()) {
+      return;
+    }
+
     swapChainFramebuffers.resize(swapChainImageViews.size());
 
     for (size_t i = 0; i < swapChainImageViews.size(); ++i) {
@@ -1410,6 +2347,9 @@ finalColor = finalColor & colorWriteMask;
         depthImageView,
         swapChainImageViews[i],
       };
+      if (!usesResolveAttachment()) {
+        attachments = {swapChainImageViews[i], depthImageView, VK_NULL_HANDLE};
+      }
 
       VkFramebufferCreateInfo framebufferInfo = {};
       framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -1418,7 +2358,7 @@ finalColor = finalColor & colorWriteMask;
       // you can only use a framebuffer with the render passes that it is compatible with
       // which roughly means that they use the same number and type of attachments
       framebufferInfo.renderPass = renderPass;
-      framebufferInfo.attachmentCount = attachments.size();
+      framebufferInfo.attachmentCount = usesResolveAttachment() ? attachments.size() : 2;
       framebufferInfo.pAttachments = attachments.data();
       framebufferInfo.width = swapChainExtent.width;
       framebufferInfo.height = swapChainExtent.height;
@@ -1446,247 +2386,1040 @@ finalColor = finalColor & colorWriteMask;
     if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
       throw std::runtime_error("failed to create command pool!");
     }
+
+    // the per-frame command buffers come from a pool per frame in flight instead, these are reset
+    // as a whole with vkResetCommandPool once the frame is done on the GPU
+    frameCommandPools.resize(framesInFlight);
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    for (auto &pool: frameCommandPools) {
+      if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create command pool!");
+      }
+    }
   }
 
-  void createCommandBuffers() {
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+  // what the CPU builds for a frame (the draw list, the culling reset, submit info arrays) comes
+  // from the frame's arenas instead of the heap, for the main thread and every worker
+  void createFrameArenas() {
+    frameArenas = std::make_unique<vk::FrameArenas>(framesInFlight, jobs->size());
+  }
 
-    VkCommandBufferAllocateInfo allocInfo {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    // TODO(cpp): what kind of cast is this? reasons to be strict? (TYPE) VAR
-    allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
+  // the draws of a frame are recorded into secondary command buffers by the worker threads,
+  // each of them has its own set of command pools
+  void createRecorder() {
+    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    recorder = std::make_unique<vk::SecondaryRecorder>(
+      device, fns, queueFamilyIndices.graphicsFamily.value(), framesInFlight, *jobs, *frameArenas
+    );
+  }
 
-    // can be submitted to a queue for execution, but cannot be called from other command buffers
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  // all asset transfers go through one persistently mapped staging ring and are recorded
+  // into batched command buffers instead of one single time command buffer per copy
+  // the copies run on the dedicated transfer queue if there is one
+  void createUploadQueue() {
+    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+    uint32_t transferFamily = queueFamilyIndices.transferFamily.value_or(graphicsFamily);
 
-    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate command buffers!");
-    }
+    uploads = std::make_unique<vk::UploadQueue>(
+      device,
+      fns,
+      vk::QueueSlot {transferQueue, transferFamily, transferTimeline ? transferTimeline.get() : graphicsTimeline.get()},
+      vk::QueueSlot {graphicsQueue, graphicsFamily, graphicsTimeline.get()},
+      *allocator,
+      *frameArenas
+    );
   }
 
-  void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-    VkCommandBufferBeginInfo beginInfo {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = 0; // Optional
-    beginInfo.pInheritanceInfo = nullptr; // Optional
+  // mip chains of all textures of an upload batch in one chain of compute dispatches at the
+  // end of the batch, instead of a blit and a barrier per level and texture
+  void createMipGenerator() {
+    if (!storageImageArrayDynamicIndexing) {
+      spdlog::info("compute mip generation not supported, mips are generated with blits");
+      return;
+    }
 
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-      throw std::runtime_error("failed to begin recording command buffer!");
+    mipGenerator = std::make_unique<vk::MipGenerator>(
+      device, fns, *allocator, *uploads, pipelineCache->handle(), readSpirv("shaders/mipgen.spv")->bytes()
+    );
+  }
+
+  void createTextureStreamer() {
+    if (!config.textureStreaming) {
+      return;
     }
 
-    VkRenderPassBeginInfo renderPassInfo {};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    vk::TextureStreamer::Config streamingConfig;
+    streamingConfig.budget = static_cast<VkDeviceSize>(config.textureBudgetMB) << 20;
+
+    // the old view goes away together with the old descriptor, see swapTextureView
+    textureStreamer = std::make_unique<vk::TextureStreamer>(
+      device, fns, physicalDevice, *allocator, *uploads, memoryBudgetEnabled, streamingConfig,
+      [this](uint32_t id, VkImageView view, std::function<void()> release) {
+        auto texture = std::find_if(textures.begin(), textures.end(), [id](const SceneTexture &t) {
+          return t.streamed == id;
+        });
+
+        // a change that was still uploading when the texture was reloaded without its
+        // precompressed version, nothing samples it anymore
+        if (texture == textures.end()) {
+          deferDestroy(std::move(release));
+          return;
+        }
 
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChainExtent;
+        swapTextureView(*texture, view, std::move(release));
+      }
+    );
+  }
 
-    std::array<VkClearValue, 2> clearValues {};
-    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-    clearValues[1].depthStencil = {1.0f, 0};
+  // a view can't be written into the descriptor the frames in flight use, so it goes into a new
+  // slot of the bindless set, or a new set. release is called together with freeing the old one
+  void swapTextureView(SceneTexture &texture, VkImageView view, std::function<void()> release) {
+    texture.view = view;
+
+    if (useBindless()) {
+      const uint32_t oldSlot = texture.slot;
+      texture.slot = bindless->add_texture(view, textureSampler);
+      deferDestroy([this, oldSlot, release = std::move(release)] {
+        bindless->remove_texture(oldSlot);
+        release();
+      });
+      return;
+    }
 
-//    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    renderPassInfo.clearValueCount = clearValues.size();
-    renderPassInfo.pClearValues = clearValues.data();
+    VkDescriptorSet oldSet = texture.descriptorSet;
+    texture.descriptorSet = createDescriptorSet(view);
+    deferDestroy([this, oldSet, release = std::move(release)] {
+      vkFreeDescriptorSets(device, descriptorPool, 1, &oldSet);
+      release();
+    });
+  }
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+  // the mip level each streamed texture needs: every texel of it covers about a pixel where the
+  // scene's bounding sphere is on screen, assuming the texture is spread over the whole scene once.
+  // the closest instance decides, which is the one at the origin
+  void updateTextureStreaming() {
+    if (!textureStreamer) {
+      return;
+    }
 
-    VkViewport viewport {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(swapChainExtent.width);
-    viewport.height = static_cast<float>(swapChainExtent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    const vk::MeshBounds &bounds = scene.bounds();
+    const glm::vec3 center = glm::vec3(modelRotation * glm::vec4(0.5f * (bounds.min + bounds.max), 1.0f));
+    const float radius = 0.5f * glm::length(bounds.max - bounds.min);
 
-    VkRect2D scissor {};
-    scissor.offset = {0, 0};
-    scissor.extent = swapChainExtent;
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    // the camera of updateUniformBuffer
+    const float sceneScale = std::max(1.0f, 0.5f * instanceGridExtent());
+    const float distance = std::max(glm::length(glm::vec3(2.0f) * sceneScale - center), radius);
+    const float pixels = radius * static_cast<float>(swapChainExtent.height) / (distance * std::tan(glm::radians(22.5f)));
 
-    VkBuffer vertexBuffers[] = {vertexBuffer};
-    VkDeviceSize offsets[] = {0};
+    for (const auto &texture: textures) {
+      if (!texture.streamed) {
+        continue;
+      }
 
-    // used to bind vertex buffers to bindings (in shader code(?))
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+      const vk::ktx::Texture &source = textureStreamer->source(*texture.streamed);
+      const float texels = static_cast<float>(std::max(source.width(), source.height()));
+      const float level = std::floor(std::log2(std::max(texels / std::max(pixels, 1.0f), 1.0f)));
+      textureStreamer->request(*texture.streamed, static_cast<uint32_t>(level));
+    }
 
-    // difference between binding index and vertex buffer: you can only have a single index buffer.
-    // its not possible to use different indices for each vertex attribute, so you have to completely duplicate
-    // vertex data even if just one attributes varies
-    //
-    // two types that are possible: UINT16, UINT32
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    textureStreamer->update();
+  }
 
-    // the old draw command that did not use index buffer
-    //vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
+  // ********************************************************************************
+  // hot reload
+  // ********************************************************************************
 
-    // bind the right descriptor set for each frame to the descriptors in the shader
-    //
-    // unlike vertex and index buffers, descriptor sets are not unique to graphics pipelines
-    // therefore we need to specify if we want to bind descriptor sets to the graphics or compute pipeline
-    vkCmdBindDescriptorSets(
-      commandBuffer,
-      VK_PIPELINE_BIND_POINT_GRAPHICS,
-      pipelineLayout,
-      0, 1,
-      &descriptorSets[currentFrame],
-      0, nullptr
-    );
+  // everything that was loaded from a file is watched. a changed shader replaces its pipelines
+  // right away, textures and models are loaded again by jobs and replace the old ones once
+  // they're there. what the frames in flight still use goes into the deletion queue
+  void createFileWatcher() {
+    if (!config.hotReload) {
+      return;
+    }
 
-    vkCmdDrawIndexed(
-      commandBuffer,
-      (uint32_t) indices.size(),
-      1, 0, 0, 0
-    );
+    fileWatcher = std::make_unique<vk::FileWatcher>();
+    fileWatcher->watch(vertexShaderPath(), [this](const std::string &) { reloadGraphicsShaders(); });
+    fileWatcher->watch(fragmentShaderPath(), [this](const std::string &) { reloadGraphicsShaders(); });
+    if (config.gpuCulling) {
+      fileWatcher->watch(CULL_SHADER_PATH, [this](const std::string &) { reloadCullShader(); });
+    }
 
-    vkCmdEndRenderPass(commandBuffer);
+    for (uint32_t i = 0; i < textures.size(); ++i) {
+      watchTexture(i);
+    }
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-      throw std::runtime_error("failed to record command buffer!");
+    for (uint32_t i = 0; i < config.models.size(); ++i) {
+      fileWatcher->watch(config.models[i].mesh, [this, i](const std::string &path) {
+        modelReloads.push_back({i, jobs->submit([path] { return loadMesh(path); })});
+      });
     }
+
+    spdlog::info("hot reload: watching {} files", fileWatcher->size());
   }
 
-  void createSyncObjects() {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+  // the source image and every precompressed version that might be loaded instead
+  void watchTexture(uint32_t texture) {
+    auto reload = [this, texture](const std::string &path) {
+      textureReloads.push_back({texture, jobs->submit([path = textures[texture].path] { return loadTexture(path, true); })});
+    };
 
-    VkSemaphoreCreateInfo semaphoreInfo {};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    fileWatcher->watch(textures[texture].path, reload);
+    for (const auto &candidate: vk::ktx::candidates(textures[texture].path)) {
+      fileWatcher->watch(candidate, reload);
+    }
+  }
 
-    VkFenceCreateInfo fenceInfo {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  // once per frame, before anything is recorded. a reload that fails keeps what was there
+  void updateHotReload() {
+    if (!fileWatcher) {
+      return;
+    }
 
-    // look at drawFrame: we want to fence to be created with signaled state s.t. on the first call to
-    // drawFrame the wait the is performed on this fence at the start of the function works as expected
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    fileWatcher->poll();
+    bool recorded = false;
 
-    // TODO(cpp): "canonical" way to iterate i 0 to 10?
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-      if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-          vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-          vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create semaphores!");
+    for (auto it = textureReloads.begin(); it != textureReloads.end();) {
+      if (!vk::is_ready(it->job)) {
+        ++it;
+        continue;
+      }
+
+      try {
+        reloadTexture(textures[it->texture], it->job.get());
+        recorded = true;
+      } catch (const std::exception &e) {
+        spdlog::error("failed to reload {}: {}", textures[it->texture].path, e.what());
       }
+      it = textureReloads.erase(it);
     }
-  }
 
-  void drawFrame() {
-    // a core design philosophy in vulkan is that sync of execution on the GPU is explicit
-    // the order of operations is up to us to define
-    // many vulkan API calls start executing work on the GPU are async
+    // textures that reloaded models asked for for the first time
+    for (uint32_t i = 0; i < textures.size(); ++i) {
+      if (!textureJobs[i].valid() || !vk::is_ready(textureJobs[i])) {
+        continue;
+      }
 
-    // we want to wait until the previous frame has finished, so that the command buffer and
-    // semaphores are available to use
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+      try {
+        createTextureImage(textures[i], textureJobs[i].get());
+        createTextureImageView(textures[i]);
+        createTextureDescriptor(textures[i]);
+        watchTexture(i);
+        recorded = true;
+      } catch (const std::exception &e) {
+        // e.g. the descriptor pool has no room left for it, see HOT_RELOAD_TEXTURES
+        spdlog::error("failed to load {}: {}", textures[i].path, e.what());
+        discardTexture(textures[i]);
+      }
+    }
 
-    // ****
-    // this block of code, until the call to vkResetFences, used to be after it
-    // this could cause a deadlock, see https://vulkan-tutorial.com/en/Drawing_a_triangle/Swap_chain_recreation
+    for (auto it = modelReloads.begin(); it != modelReloads.end();) {
+      if (!it->mesh) {
+        if (!vk::is_ready(it->job)) {
+          ++it;
+          continue;
+        }
 
-    // acquire an image from the swap chain
-    // swap chain is an extension feature
-    // imageIndex refers to position in swapChainImages
-    uint32_t imageIndex;
-    VkResult res = vkAcquireNextImageKHR(
-      device,
-      swapChain,
-      UINT64_MAX,
-      imageAvailableSemaphores[currentFrame],
-      VK_NULL_HANDLE,
-      &imageIndex
-    );
+        try {
+          it->mesh = it->job.get();
+        } catch (const std::exception &e) {
+          spdlog::error("failed to reload {}: {}", config.models[it->model].mesh, e.what());
+          it = modelReloads.erase(it);
+          continue;
+        }
 
-    // VK_ERROR_OUT_OF_DATE_KHR is triggered on window resize, but it is not guranteed to happen
+        for (const auto &material: it->mesh->materials()) {
+          it->textures.push_back(requestTexture(material.texture.empty() ? config.models[it->model].texture : material.texture));
+        }
+      }
 
-    // both VK_SUCCESS and VK_SUBOPTIMAL_KHR are considered "success" return codes
-    if (res == VK_ERROR_OUT_OF_DATE_KHR) {
-      recreateSwapchain();
+      // the textures it needs are loaded (or failed to), see above. loading has finished once
+      // the job's result was taken
+      const bool waiting = std::any_of(it->textures.begin(), it->textures.end(), [this](uint32_t t) {
+        return textureJobs[t].valid();
+      });
+      if (waiting) {
+        ++it;
+        continue;
+      }
+
+      const bool failed = std::any_of(it->textures.begin(), it->textures.end(), [this](uint32_t t) {
+        return !textureLoaded(textures[t]);
+      });
+      if (failed) {
+        spdlog::error("not reloading {}, a texture of it failed to load", config.models[it->model].mesh);
+      } else {
+        reloadModel(it->model, std::move(*it->mesh), std::move(it->textures));
+        recorded = true;
+      }
+      it = modelReloads.erase(it);
+    }
+
+    // the new resources can be used by anything submitted after this batch
+    if (recorded) {
+      uploads->flush();
+    }
+  }
+
+  // the pipeline registry builds every variant again from the new modules, the ones that exist
+  // are destroyed once the frames in flight are done with them.
+  //
+  // the fallback is built from the new modules before anything old goes away: valid SPIR-V can
+  // still fail to make a pipeline (e.g. an interface that doesn't match the other stage), and
+  // then the old shaders and pipelines stay. a variant other than the fallback that fails is
+  // drawn with the fallback, see PipelineRegistry::find_or
+  void reloadGraphicsShaders() {
+    VkShaderModule vert = VK_NULL_HANDLE;
+    VkShaderModule frag = VK_NULL_HANDLE;
+    VkPipeline fallback;
+    try {
+      vert = createShaderModule(readSpirvCopy(vertexShaderPath()));
+      frag = createShaderModule(readSpirvCopy(fragmentShaderPath()));
+      fallback = buildGraphicsPipeline(fallbackPipelineKey(), vert, frag);
+    } catch (const std::exception &e) {
+      vkDestroyShaderModule(device, frag, nullptr);
+      vkDestroyShaderModule(device, vert, nullptr);
+      spdlog::error("keeping the old shaders: {}", e.what());
       return;
-    } else if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR) {
-      throw std::runtime_error(fmt::format(
-        "[err={}] failed to acquire swap chain image!",
-        static_cast<int>(res)
-      ));
     }
 
-    // TODO: what happens if this is performed after the reset fences?
-    updateUniformBuffer(currentFrame);
+    // nothing compiles from the old modules anymore once replace returns
+    std::vector<VkPipeline> old = pipelines->replace(fallbackPipelineKey(), fallback);
+    deferDestroy([this, old] {
+      for (VkPipeline pipeline: old) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+      }
+    });
+    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    vertShaderModule = vert;
+    fragShaderModule = frag;
 
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
+    // the other variants compile in the background
+    pipelines->find(pipelineKey());
+  }
 
-    // now record the command buffer
-    vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-    recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+  void reloadCullShader() {
+    VkPipeline pipeline;
+    try {
+      pipeline = createCullPipeline(readSpirvCopy(CULL_SHADER_PATH));
+    } catch (const std::exception &e) {
+      spdlog::error("keeping the old culling shader: {}", e.what());
+      return;
+    }
 
-    VkSubmitInfo submitInfo {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    deferDestroy([this, old = cullPipeline] { vkDestroyPipeline(device, old, nullptr); });
+    cullPipeline = pipeline;
+  }
 
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+  // a streamed texture that's still streamed gets its new view through the streamer's swap
+  // callback. otherwise the new image gets a new view and descriptor, and the old image goes away
+  // with the old descriptor
+  //
+  // the new one is built next to the old one, which stays as it was if anything of it fails
+  void reloadTexture(SceneTexture &texture, TextureData data) {
+    SceneTexture loaded;
+    loaded.path = texture.path;
+    loaded.streamed = texture.streamed;
+    loaded.slot = texture.slot;
+    loaded.descriptorSet = texture.descriptorSet;
+    auto sameStream = [&] { return loaded.streamed && loaded.streamed == texture.streamed; };
+
+    try {
+      createTextureImage(loaded, std::move(data));
+      if (sameStream()) {
+        texture.format = loaded.format;
+        texture.mipLevels = loaded.mipLevels;
+        return;
+      }
 
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+      createTextureImageView(loaded);
+      swapTextureView(loaded, loaded.view, [this, old = texture] {
+        if (!old.streamed) {
+          vkDestroyImageView(device, old.view, nullptr);
+          vkDestroyImage(device, old.image, nullptr);
+          allocator->free(old.memory);
+        }
+      });
+    } catch (...) {
+      if (!sameStream()) {
+        discardTexture(loaded);
+      }
+      throw;
+    }
+
+    // streamed before, but not anymore: the streamer keeps it, with only its smallest levels
+    if (texture.streamed) {
+      textureStreamer->request(*texture.streamed, std::numeric_limits<uint32_t>::max());
+    }
+    texture = std::move(loaded);
+  }
+
+  // whether draws can use the texture, it has a view and a descriptor for it
+  bool textureLoaded(const SceneTexture &texture) const {
+    if (texture.view == VK_NULL_HANDLE) {
+      return false;
+    }
+    return useBindless() ? texture.slot != SceneTexture::NO_SLOT : texture.descriptorSet != VK_NULL_HANDLE;
+  }
+
+  // what a texture that failed part of the way through being created has so far. the upload
+  // batch that's being recorded may already use it. afterwards it's as if it was never loaded,
+  // descriptors are left alone: they are the last thing that's created
+  void discardTexture(SceneTexture &texture) {
+    if (texture.streamed) {
+      // the streamer keeps it, with only its smallest levels
+      textureStreamer->request(*texture.streamed, std::numeric_limits<uint32_t>::max());
+    } else if (texture.image != VK_NULL_HANDLE) {
+      uploads->release_after_batch([this, view = texture.view, image = texture.image, memory = texture.memory] {
+        vkDestroyImageView(device, view, nullptr);
+        vkDestroyImage(device, image, nullptr);
+        allocator->free(memory);
+      });
+    }
+
+    SceneTexture empty;
+    empty.path = texture.path;
+    texture = std::move(empty);
+  }
+
+  // the geometry of all models shares the buffers, so they're built again with the new mesh in
+  // place of the old one. the models that didn't change are just copied again
+  void reloadModel(uint32_t model, vk::MeshData mesh, std::vector<uint32_t> materialTextures) {
+    deferDestroy([
+      this, vb = vertexBuffer, vbm = vertexBufferMemory, ib = indexBuffer, ibm = indexBufferMemory
+    ] {
+      vkDestroyBuffer(device, vb, nullptr);
+      allocator->free(vbm);
+      vkDestroyBuffer(device, ib, nullptr);
+      allocator->free(ibm);
+    });
+
+    sceneMeshes[model] = std::move(mesh);
+    sceneMaterialTextures[model] = std::move(materialTextures);
+    createScene();
+
+    // the grid is spaced by the size of the scene
+    createInstanceTransforms();
+
+    if (config.gpuCulling && scene.draws().size() > indirectDrawCapacity) {
+      recreateCullBuffers();
+    }
+  }
+
+  void createCommandBuffers() {
+    commandBuffers.resize(framesInFlight);
+
+    // one primary command buffer per frame in flight, each from the pool of its frame
+    for (size_t i = 0; i < framesInFlight; ++i) {
+      VkCommandBufferAllocateInfo allocInfo {};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.commandPool = frameCommandPools[i];
+      allocInfo.commandBufferCount = 1;
+
+      // can be submitted to a queue for execution, but cannot be called from other command buffers
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+      if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffers[i]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+      }
+    }
+  }
+
+  // records the items [begin, end) of the draw list into a secondary command buffer that
+  // continues the render pass. runs on the worker threads of the recorder, so it must only read
+  // state that doesn't change while a frame is recorded
+  //
+  // an item is an instance of the whole scene (or with gpu culling, all of them at once). the
+  // draws of the scene are sorted by pipeline and material, state is only bound when it changes
+  // from one draw to the next. pipelines has the pipeline of every variant index of the draws
+  //
+  // nothing is inherited from the primary command buffer, every secondary binds its own state
+  void recordDraws(VkCommandBuffer cmd, uint32_t frame, const DrawPipelines &pipelines, uint32_t begin, uint32_t end) {
+    VkViewport viewport {};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(swapChainExtent.width);
+    viewport.height = static_cast<float>(swapChainExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    fns.vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+    VkRect2D scissor {};
+    scissor.offset = {0, 0};
+    scissor.extent = swapChainExtent;
+    fns.vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    // the instance buffer of this frame goes to binding 1, with gpu culling that's the buffer the
+    // compute shader compacted the visible instances into
+    VkBuffer instanceBuffer = config.gpuCulling ? visibleInstanceBuffers[frame] : instanceBuffers[frame];
+    VkBuffer vertexBuffers[] = {vertexBuffer, instanceBuffer};
+    VkDeviceSize offsets[] = {0, 0};
+
+    // used to bind vertex buffers to bindings (in shader code(?))
+    fns.vkCmdBindVertexBuffers(cmd, 0, 2, vertexBuffers, offsets);
+
+    // difference between binding index and vertex buffer: you can only have a single index buffer.
+    // its not possible to use different indices for each vertex attribute, so you have to completely duplicate
+    // vertex data even if just one attributes varies
+    //
+    // two types that are possible: UINT16, UINT32
+    // the meshes of all models share it, each draw selects its range with firstIndex and the
+    // first vertex of its model with vertexOffset
+    fns.vkCmdBindIndexBuffer(cmd, indexBuffer, 0, indexType);
+
+    // the old draw command that did not use index buffer
+    //vkCmdDraw(cmd, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
+
+    if (useBindless()) {
+      // the set is the same for the whole command buffer, whatever the draws use. a draw of
+      // another material only pushes other indices
+      VkDescriptorSet set = bindless->set();
+      fns.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &set, 0, nullptr);
+    }
+
+    const auto &draws = scene.draws();
+    std::optional<uint32_t> boundPipeline;
+    std::optional<std::pair<uint32_t, uint32_t>> boundMaterial;  // texture, model
+
+    // runs of draws that need the same state, with gpu culling they're one multi draw
+    for (size_t first = 0; first < draws.size();) {
+      const vk::SceneMesh &mesh = scene.meshes()[draws[first].mesh];
+      const uint32_t texture = scene.materials()[draws[first].material].texture;
+
+      size_t last = first + 1;
+      while (last < draws.size() &&
+             draws[last].pipeline == draws[first].pipeline &&
+             scene.materials()[draws[last].material].texture == texture &&
+             scene.meshes()[draws[last].mesh].model == mesh.model) {
+        ++last;
+      }
+
+      if (boundPipeline != draws[first].pipeline) {
+        fns.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[draws[first].pipeline]);
+        boundPipeline = draws[first].pipeline;
+      }
+
+      if (boundMaterial != std::make_pair(texture, mesh.model)) {
+        bindMaterial(cmd, textures[texture], drawUniformsOffsets[mesh.model]);
+        boundMaterial = std::make_pair(texture, mesh.model);
+      }
+
+      if (config.gpuCulling) {
+        recordIndirectDraws(cmd, frame, static_cast<uint32_t>(first), static_cast<uint32_t>(last - first));
+      } else {
+        // instances [begin, end) in one draw per mesh, the per-instance binding supplies their
+        // model matrices
+        for (size_t i = first; i < last; ++i) {
+          const vk::SceneMesh &m = scene.meshes()[draws[i].mesh];
+          fns.vkCmdDrawIndexed(cmd, m.index_count, end - begin, m.first_index, m.vertex_offset, begin);
+        }
+      }
+
+      first = last;
+    }
+  }
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to submit draw command buffer!");
+  // what the draws of one texture and model read: the texture, the frame uniforms and the model's
+  // draw uniforms
+  void bindMaterial(VkCommandBuffer cmd, const SceneTexture &texture, uint32_t drawUniformsOffset) {
+    if (useBindless()) {
+      // the transient buffer's allocations are aligned to at least 16 bytes
+      DrawPushConstants constants {};
+      constants.frameUniforms = frameUniformsOffset / 16;
+      constants.drawUniforms = drawUniformsOffset / 16;
+      constants.buffer = transientBufferSlot;
+      constants.texture = texture.slot;
+      fns.vkCmdPushConstants(
+        cmd, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0, sizeof(constants), &constants
+      );
+      return;
+    }
+
+    // the texture's descriptor set is bound for every frame and every model, only the dynamic
+    // offsets (in binding order: frame uniforms, draw uniforms) change
+    const uint32_t dynamicOffsets[] = {frameUniformsOffset, drawUniformsOffset};
+
+    // unlike vertex and index buffers, descriptor sets are not unique to graphics pipelines
+    // therefore we need to specify if we want to bind descriptor sets to the graphics or compute pipeline
+    fns.vkCmdBindDescriptorSets(
+      cmd,
+      VK_PIPELINE_BIND_POINT_GRAPHICS,
+      pipelineLayout,
+      0, 1,
+      &texture.descriptorSet,
+      2, dynamicOffsets
+    );
+  }
+
+  // the commands [first, first + count) of the buffer written by the culling shader. with
+  // drawIndirectCount nothing is drawn at all if no instance is visible, otherwise the commands
+  // just have no instances. without multiDrawIndirect every command is a draw of its own
+  void recordIndirectDraws(VkCommandBuffer cmd, uint32_t frame, uint32_t first, uint32_t count) {
+    const uint32_t perDraw = multiDrawIndirectSupported ? count : 1;
+
+    for (uint32_t i = 0; i < count; i += perDraw) {
+      if (drawIndirectCountSupported) {
+        fns.vkCmdDrawIndexedIndirectCount(
+          cmd,
+          indirectBuffers[frame], indirectCommandOffset(first + i),
+          indirectBuffers[frame], offsetof(IndirectDrawBuffer, drawCount),
+          perDraw,
+          sizeof(VkDrawIndexedIndirectCommand)
+        );
+      } else {
+        fns.vkCmdDrawIndexedIndirect(
+          cmd,
+          indirectBuffers[frame], indirectCommandOffset(first + i),
+          perDraw,
+          sizeof(VkDrawIndexedIndirectCommand)
+        );
+      }
+    }
+  }
+
+  bool useBindless() const {
+    return bindlessSupported && config.bindless;
+  }
+
+  bool useDynamicRendering() const {
+    return dynamicRenderingSupported && config.dynamicRendering;
+  }
+
+  // the equivalent of the render pass of createRenderPass: the layout transitions that the
+  // render pass did implicitly are explicit barriers, the attachments are set every frame
+  void beginDynamicRendering(
+    VkCommandBuffer commandBuffer,
+    uint32_t imageIndex,
+    const std::array<VkClearValue, 2> &clearValues
+  ) {
+    VkImageSubresourceRange colorRange {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    VkImageSubresourceRange depthRange {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+    if (hasStencilComponent(depthFormat)) {
+      depthRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    // the previous contents of all attachments are discarded (UNDEFINED). the wait for the
+    // swap chain image happens at COLOR_ATTACHMENT_OUTPUT (see drawFrame), so that's where the
+    // transition of the swap chain image has to start
+    VkImageMemoryBarrier2 barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;  // the msaa image is shared by all frames
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = swapChainImages[imageIndex];
+    barrier.subresourceRange = colorRange;
+    cmdImageBarrier(commandBuffer, barrier);
+
+    if (usesResolveAttachment()) {
+      barrier.image = colorImage;
+      cmdImageBarrier(commandBuffer, barrier);
+    }
+
+    // the depth image is shared by all frames, the previous frame's depth writes have to be done
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barrier.image = depthImage;
+    barrier.subresourceRange = depthRange;
+    cmdImageBarrier(commandBuffer, barrier);
+
+    // with msaa the multisampled image is rendered to and resolved into the swap chain image,
+    // it isn't needed afterwards
+    VkRenderingAttachmentInfo colorAttachment {};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.clearValue = clearValues[0];
+    if (usesResolveAttachment()) {
+      colorAttachment.imageView = colorImageView;
+      colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+      colorAttachment.resolveImageView = swapChainImageViews[imageIndex];
+      colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    } else {
+      colorAttachment.imageView = swapChainImageViews[imageIndex];
+      colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    }
+
+    VkRenderingAttachmentInfo depthAttachment {};
+    depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthAttachment.imageView = depthImageView;
+    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.clearValue = clearValues[1];
+
+    VkRenderingInfo renderingInfo {};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    renderingInfo.renderArea = {{0, 0}, swapChainExtent};
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachment;
+    renderingInfo.pDepthAttachment = &depthAttachment;
+    if (hasStencilComponent(depthFormat)) {
+      renderingInfo.pStencilAttachment = &depthAttachment;
+    }
+
+    fns.vkCmdBeginRendering(commandBuffer, &renderingInfo);
+  }
+
+  void endDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    fns.vkCmdEndRendering(commandBuffer);
+
+    // what the final layout of the render pass did. presenting is ordered by the semaphore, it
+    // needs no access mask
+    VkImageMemoryBarrier2 barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barrier.newLayout = config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = swapChainImages[imageIndex];
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    cmdImageBarrier(commandBuffer, barrier);
+  }
+
+  void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    VkCommandBufferBeginInfo beginInfo {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = 0; // Optional
+    beginInfo.pInheritanceInfo = nullptr; // Optional
+
+    if (fns.vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    // picks up the timestamps of the last time this frame was recorded, has to be outside of the render pass
+    profiler->begin_gpu_frame(commandBuffer, currentFrame);
+
+    VkRenderPassBeginInfo renderPassInfo {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = useDynamicRendering() ? VK_NULL_HANDLE : swapChainFramebuffers[imageIndex];
+
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = swapChainExtent;
+
+    std::array<VkClearValue, 2> clearValues {};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+//    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+    renderPassInfo.clearValueCount = clearValues.size();
+    renderPassInfo.pClearValues = clearValues.data();
+
+    // compute work can't be recorded inside a render pass
+    if (config.gpuCulling) {
+      auto scope = profiler->gpu_scope(commandBuffer, currentFrame, "cull", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+      recordCulling(commandBuffer);
     }
 
-    // last step of drawing a frame is submitting the result back to the swap chain to have it eventually show
-    // up on the screen
+    // timestamps can't be written inside of this render pass, the scope encloses all of it
+    {
+      auto scope = profiler->gpu_scope(commandBuffer, currentFrame, "render pass");
 
-    VkPresentInfoKHR presentInfo {};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+      // the draws themselves are recorded into secondary command buffers, possibly on several
+      // worker threads, so the render pass contents come from those
+      if (useDynamicRendering()) {
+        beginDynamicRendering(commandBuffer, imageIndex, clearValues);
+      } else {
+        fns.vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+      }
+
+      VkCommandBufferInheritanceInfo inheritanceInfo {};
+      inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      inheritanceInfo.renderPass = renderPass;
+      inheritanceInfo.subpass = 0;
+      inheritanceInfo.framebuffer = useDynamicRendering() ? VK_NULL_HANDLE : swapChainFramebuffers[imageIndex];
+
+      // without a render pass the secondaries get the attachment formats instead
+      VkCommandBufferInheritanceRenderingInfo renderingInheritance {};
+      renderingInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+      renderingInheritance.colorAttachmentCount = 1;
+      renderingInheritance.pColorAttachmentFormats = &swapChainImageFormat;
+      renderingInheritance.depthAttachmentFormat = depthFormat;
+      renderingInheritance.stencilAttachmentFormat = hasStencilComponent(depthFormat) ? depthFormat : VK_FORMAT_UNDEFINED;
+      renderingInheritance.rasterizationSamples = msaaSamples;
+      if (useDynamicRendering()) {
+        inheritanceInfo.pNext = &renderingInheritance;
+      }
+
+      // the draw list: the indirect draws of the whole scene with gpu culling, otherwise the
+      // instances (the visible ones, with cpu culling), which can be split into several draws of
+      // consecutive instances per mesh
+      const uint32_t drawCount = config.gpuCulling ? 1 : visibleInstanceCount;
+      const uint32_t frame = currentFrame;
+
+      // a variant that isn't compiled yet doesn't hold up the frame, the fallback is drawn instead.
+      // alpha tested materials are drawn opaque until theirs is there
+      DrawPipelines drawPipelines;
+      for (uint32_t i = 0; i < drawPipelines.size(); ++i) {
+        drawPipelines[i] = pipelines->find_or(pipelineKey(i == 1), fallbackPipelineKey());
+      }
 
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+      auto secondaries = recorder->record(frame, inheritanceInfo, drawCount, [this, frame, drawPipelines](VkCommandBuffer cmd, uint32_t begin, uint32_t end) {
+        recordDraws(cmd, frame, drawPipelines, begin, end);
+      });
 
-    VkSwapchainKHR swapChains[] = {swapChain};
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
+      fns.vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
 
-    res = vkQueuePresentKHR(presentQueue, &presentInfo);
-    if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || framebufferResized) {
-      framebufferResized = false;
+      if (useDynamicRendering()) {
+        endDynamicRendering(commandBuffer, imageIndex);
+      } else {
+        fns.vkCmdEndRenderPass(commandBuffer);
+      }
+    }
+
+    if (fns.vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record command buffer!");
+    }
+  }
+
+  void createSyncObjects() {
+    frameInputTimes.resize(framesInFlight);
+    imageAvailableSemaphores.resize(framesInFlight);
+    renderFinishedSemaphores.resize(framesInFlight);
+
+    // look at drawFrame: instead of a fence per frame, every frame remembers the value its submit
+    // signals on the graphics timeline. 0 is complete from the start, so on the first call to
+    // drawFrame the wait that is performed at the start of the function works as expected
+    frameTimelineValues.assign(framesInFlight, 0);
+
+    // the swap chain can only use binary semaphores
+    VkSemaphoreCreateInfo semaphoreInfo {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    // TODO(cpp): "canonical" way to iterate i 0 to 10?
+    for (size_t i = 0; i < framesInFlight; ++i) {
+      if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+          vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create semaphores!");
+      }
+    }
+  }
+
+  void drawFrame() {
+    // a core design philosophy in vulkan is that sync of execution on the GPU is explicit
+    // the order of operations is up to us to define
+    // many vulkan API calls start executing work on the GPU are async
+
+    // we want to wait until the previous frame has finished, so that the command buffer and
+    // semaphores are available to use
+    {
+      auto scope = profiler->cpu_scope("frame wait");
+      graphicsTimeline->wait(frameTimelineValues[currentFrame]);
+    }
+
+    // nothing that was allocated for the frame's last use is needed anymore, CPU or GPU side
+    frameArenas->begin_frame(currentFrame);
+
+    // an upper bound: the GPU may have been done with the frame a while before it was waited on
+    if (frameNumber >= framesInFlight) {
+      profiler->add_latency("input to gpu done", msSince(frameInputTimes[currentFrame]));
+    }
+
+    if (config.pacing == FramePacing::LowLatency && !config.headless) {
+      auto scope = profiler->cpu_scope("pacing wait");
+      waitForPreviousFrame();
+    }
+
+    // recycle staging space of uploads the GPU is done with
+    uploads->collect();
+
+    // and destroy what was retired when the swap chain was recreated or a texture was streamed
+    collectDeletionQueue();
+
+    updateTextureStreaming();
+    updateHotReload();
+
+    // ****
+    // this block of code used to be after resetting the frame's fence (before the timelines)
+    // this could cause a deadlock, see https://vulkan-tutorial.com/en/Drawing_a_triangle/Swap_chain_recreation
+
+    // acquire an image from the swap chain
+    // swap chain is an extension feature
+    // imageIndex refers to position in swapChainImages
+    //
+    // headless: every frame in flight has its own offscreen image, there is nothing to acquire
+    uint32_t imageIndex = currentFrame;
+    VkResult res = VK_SUCCESS;
+    if (!config.headless) {
+      auto scope = profiler->cpu_scope("acquire");
+      res = fns.vkAcquireNextImageKHR(
+        device,
+        swapChain,
+        UINT64_MAX,
+        imageAvailableSemaphores[currentFrame],
+        VK_NULL_HANDLE,
+        &imageIndex
+      );
+    }
+
+    // VK_ERROR_OUT_OF_DATE_KHR is triggered on window resize, but it is not guranteed to happen
+
+    // both VK_SUCCESS and VK_SUBOPTIMAL_KHR are considered "success" return codes
+    if (res == VK_ERROR_OUT_OF_DATE_KHR) {
       recreateSwapchain();
-    } else if (res != VK_SUCCESS) {
+      return;
+    } else if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR) {
       throw std::runtime_error(fmt::format(
-        "[err={}] failed to present swap chain image!",
+        "[err={}] failed to acquire swap chain image!",
         static_cast<int>(res)
       ));
     }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    {
+      auto scope = profiler->cpu_scope("update buffers");
+
+      // the animation time is the input of a frame, latencies are measured from here
+      frameInputTimes[currentFrame] = std::chrono::steady_clock::now();
+      transient->begin_frame(currentFrame);
+      updateUniformBuffer();
+      updateInstanceBuffer(currentFrame);
+    }
+
+    // now record the command buffer. the frame's timeline value is complete, so nothing that was
+    // allocated from the frame's pools is in use anymore and they can be reset as a whole
+    {
+      auto scope = profiler->cpu_scope("record");
+      if (fns.vkResetCommandPool(device, frameCommandPools[currentFrame], 0) != VK_SUCCESS) {
+        throw std::runtime_error("failed to reset command pool!");
+      }
+      recorder->begin_frame(currentFrame);
+      recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    }
+
+    vk::SubmitBatch submit(&frameArenas->local());
+    submit.command_buffer(commandBuffers[currentFrame]);
+
+    // headless: no acquire to wait for and no present that waits for us
+    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
+    if (!config.headless) {
+      submit.wait_binary(imageAvailableSemaphores[currentFrame], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+      submit.signal_binary(renderFinishedSemaphores[currentFrame]);
+    }
+    frameTimelineValues[currentFrame] = submit.signal(*graphicsTimeline);
+
+    {
+      auto scope = profiler->cpu_scope("submit");
+      submit.submit(graphicsQueue);
+    }
+
+    if (!config.headless) {
+      // last step of drawing a frame is submitting the result back to the swap chain to have it eventually show
+      // up on the screen
+
+      VkPresentInfoKHR presentInfo {};
+      presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+      presentInfo.waitSemaphoreCount = 1;
+      presentInfo.pWaitSemaphores = signalSemaphores;
+
+      VkSwapchainKHR swapChains[] = {swapChain};
+      presentInfo.swapchainCount = 1;
+      presentInfo.pSwapchains = swapChains;
+      presentInfo.pImageIndices = &imageIndex;
+
+      // the id waitForPreviousFrame waits for in the next frame
+      const uint64_t presentId = frameNumber + 1;
+      VkPresentIdKHR presentIdInfo {};
+      presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+      presentIdInfo.swapchainCount = 1;
+      presentIdInfo.pPresentIds = &presentId;
+      if (waitForPresent != nullptr) {
+        presentInfo.pNext = &presentIdInfo;
+        lastPresentSwapChain = swapChain;
+        lastPresentInputTime = frameInputTimes[currentFrame];
+      }
+
+      {
+        auto scope = profiler->cpu_scope("present");
+        res = fns.vkQueuePresentKHR(presentQueue, &presentInfo);
+      }
+      if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || framebufferResized) {
+        framebufferResized = false;
+        recreateSwapchain();
+      } else if (res != VK_SUCCESS) {
+        throw std::runtime_error(fmt::format(
+          "[err={}] failed to present swap chain image!",
+          static_cast<int>(res)
+        ));
+      }
+    }
+
+    profiler->end_frame();
+    ++frameNumber;
+    currentFrame = (currentFrame + 1) % framesInFlight;
   }
 
-  void updateUniformBuffer(uint32_t currentImage) {
-    // TODO(cpp): static local variable: when does this run?
-    static auto startTime = std::chrono::high_resolution_clock::now();
+  static double msSince(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+  }
+
+  // low latency pacing, before the current frame acquires an image or samples its input
+  void waitForPreviousFrame() {
+    if (frameNumber == 0) {
+      return;
+    }
 
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    if (waitForPresent != nullptr) {
+      // the present ids are frameNumber + 1 of the frame, so this is the previous frame's. a
+      // present that never makes it to the screen (the swap chain was replaced) would block
+      // forever, so give up after a while
+      const uint64_t timeoutNs = 100'000'000;
+      VkResult res = waitForPresent(device, lastPresentSwapChain, frameNumber, timeoutNs);
+      if (res == VK_SUCCESS) {
+        profiler->add_latency("input to present", msSince(lastPresentInputTime));
+      } else if (res != VK_TIMEOUT && res != VK_ERROR_OUT_OF_DATE_KHR && res != VK_SUBOPTIMAL_KHR) {
+        VK_CHECK(res);
+      }
+      return;
+    }
+
+    // no present wait: at least the GPU has to be done with the previous frame
+    const uint32_t previous = (currentFrame + framesInFlight - 1) % framesInFlight;
+    graphicsTimeline->wait(frameTimelineValues[previous]);
+  }
+
+  void updateUniformBuffer() {
+    // startTime is set at the end of initVulkan, the benchmark uses a fixed time step instead so
+    // the result doesn't depend on how fast the frames are
+    float time;
+    if (config.fixedTimeStep > 0.0) {
+      time = static_cast<float>(static_cast<double>(frameNumber) * config.fixedTimeStep);
+    } else {
+      auto currentTime = std::chrono::high_resolution_clock::now();
+      time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    }
 
-    UniformBufferObject ubo {};
+    FrameUniforms ubo {};
+    animationTime = time;
 
-    ubo.model = glm::rotate(
+    modelRotation = glm::rotate(
       glm::mat4(1.0f),
       time * glm::radians(90.0f),  // rotation angle
       glm::vec3(0.0f, 0.0f, 1.0f)  // rotation axis
     );
 
+    // move the camera back far enough to see the whole instance grid
+    const float sceneScale = std::max(1.0f, 0.5f * instanceGridExtent());
+
     ubo.view = glm::lookAt(
-      glm::vec3(2.0f, 2.0f, 2.0f), // eye position
+      glm::vec3(2.0f, 2.0f, 2.0f) * sceneScale, // eye position
       glm::vec3(0.0f, 0.0f, 0.0f), // center (origin?) position
       glm::vec3(0.0f, 0.0f, 1.0f)  // up axis
     );
@@ -1698,7 +3431,7 @@ finalColor = finalColor & colorWriteMask;
       glm::radians(45.0f), // vertical field of view
       (float) swapChainExtent.width / (float) swapChainExtent.height, // aspect ratio
       0.1f,
-      10.0f
+      10.0f * sceneScale
     );
 
     // GLM was designed for OpenGL where the Y coordinate of the clip coordinates is inverted
@@ -1706,24 +3439,54 @@ finalColor = finalColor & colorWriteMask;
     // if you don't do this the rendered image will be upside down
     ubo.proj[1][1] *= -1;
 
-    memcpy(uniformBuffersMappped[currentImage], &ubo, sizeof(ubo));
+    cullViewProj = ubo.proj * ubo.view;
+
+    // transient->begin_frame was called for this frame, this is just a bump of its head
+    frameUniformsOffset = transient->push(ubo);
+
+    // the model matrices go to the DrawUniforms of the models' draws, see recordDraws. the culling
+    // shader needs it without the dequantization, the bounds are in model space.
+    // quantized positions are stored relative to the bounds of each model
+    drawUniformsOffsets.resize(vertexDequantize.size());
+    for (size_t i = 0; i < vertexDequantize.size(); ++i) {
+      drawUniformsOffsets[i] = transient->push(DrawUniforms {modelRotation * vertexDequantize[i]});
+    }
   }
 
+  // doesn't wait for the device to go idle: the new swap chain is created from the old one, and
+  // the old one with its image views and framebuffers goes into the deletion queue until the
+  // frames that were recorded for it are done. depth and msaa color targets are only replaced if
+  // the new swap chain is larger than they are, see createDepthResources
   void recreateSwapchain() {
     int width = 0, height = 0;
     glfwGetFramebufferSize(window, &width, &height);
 
-    while (width == 0 || height == 0) {
-      glfwGetFramebufferSize(window, &width, &height);
-      glfwWaitEvents();
+    // minimized. keep the old swap chain, mainLoop waits until the window has a size again and
+    // the next frame asks for a new swap chain
+    if (width == 0 || height == 0) {
+      framebufferResized = true;
+      return;
     }
 
-    std::cout << fmt::format("recreating swap chain w={}, h={}\n", width, height);
-    vkDeviceWaitIdle(device);
+    const auto start = std::chrono::steady_clock::now();
 
-    cleanupSwapchain();
+    VkSwapchainKHR oldSwapChain = swapChain;
+    std::vector<VkImageView> oldImageViews = std::move(swapChainImageViews);
+    std::vector<VkFramebuffer> oldFramebuffers = std::move(swapChainFramebuffers);
+    swapChainImageViews.clear();
+    swapChainFramebuffers.clear();
 
-    createSwapChain();
+    createSwapChain(oldSwapChain);
+
+    deferDestroy([this, oldSwapChain, oldImageViews, oldFramebuffers] {
+      for (auto framebuffer: oldFramebuffers) {
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+      }
+      for (auto imageView: oldImageViews) {
+        vkDestroyImageView(device, imageView, nullptr);
+      }
+      vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+    });
 
     // image views based directly on the swap chain imagesjA
     createImageViews();
@@ -1739,16 +3502,51 @@ finalColor = finalColor & colorWriteMask;
     // it is possible for the swap chain image format to change during an applications lifetime
     // for example when moving a window from a standard range to a high dynamic range monitor
     // this would require the application to recreate the renderpass
+    spdlog::info(
+      "recreated swap chain w={}, h={} in {:.2f} ms",
+      swapChainExtent.width, swapChainExtent.height,
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+    );
+  }
+
+  // destroy runs once everything that was submitted to the graphics queue before this call has
+  // finished on the GPU
+  void deferDestroy(std::function<void()> destroy) {
+    deletionQueue.push_back({graphicsTimeline->submitted(), std::move(destroy)});
+  }
+
+  // doesn't wait, only destroys what's already safe to destroy
+  void collectDeletionQueue() {
+    while (!deletionQueue.empty() && graphicsTimeline->is_complete(deletionQueue.front().timelineValue)) {
+      deletionQueue.front().destroy();
+      deletionQueue.pop_front();
+    }
+  }
+
+  // only if the device is idle
+  void flushDeletionQueue() {
+    for (auto &entry: deletionQueue) {
+      entry.destroy();
+    }
+    deletionQueue.clear();
+  }
+
+  // the size an attachment needs for the current swap chain. attachments only grow, a smaller
+  // swap chain renders to a part of them (the framebuffer and render area are the swap chain's)
+  VkExtent2D attachmentExtent(VkExtent2D current) const {
+    return {std::max(current.width, swapChainExtent.width), std::max(current.height, swapChainExtent.height)};
   }
 
   void cleanupSwapchain() {
-    vkDestroyImageView(device, colorImageView, nullptr);
-    vkDestroyImage(device, colorImage, nullptr);
-    vkFreeMemory(device, colorImageMemory, nullptr);
+    if (usesResolveAttachment()) {
+      vkDestroyImageView(device, colorImageView, nullptr);
+      vkDestroyImage(device, colorImage, nullptr);
+      allocator->free(colorImageMemory);
+    }
 
     vkDestroyImageView(device, depthImageView, nullptr);
     vkDestroyImage(device, depthImage, nullptr);
-    vkFreeMemory(device, depthImageMemory, nullptr);
+    allocator->free(depthImageMemory);
 
     for (auto framebuffer: swapChainFramebuffers) {
       vkDestroyFramebuffer(device, framebuffer, nullptr);
@@ -1758,27 +3556,27 @@ finalColor = finalColor & colorWriteMask;
       vkDestroyImageView(device, imageView, nullptr);
     }
 
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
+    if (config.headless) {
+      for (size_t i = 0; i < swapChainImages.size(); ++i) {
+        vkDestroyImage(device, swapChainImages[i], nullptr);
+        allocator->free(offscreenImagesMemory[i]);
+      }
+    } else {
+      vkDestroySwapchainKHR(device, swapChain, nullptr);
+    }
   }
 
+  // the vertices of every model in one buffer, model i starts at vertex scene.models()[i].first_vertex.
+  // each model is quantized relative to its own bounds, so there's a dequantize matrix per model
   void createVertexBuffer() {
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+    const VkDeviceSize stride = VERTEX_FORMAT.stride();
+    VkDeviceSize bufferSize = stride * scene.vertex_count();
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,   // <---
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      stagingBuffer,
-      stagingBufferMemory
+    spdlog::debug(
+      "vertex buffer: {} vertices, {} bytes per vertex ({} bytes uncompressed)",
+      scene.vertex_count(), VERTEX_FORMAT.stride(), sizeof(Vertex)
     );
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), (size_t) bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
     createBuffer(
       bufferSize,
       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, // <---
@@ -1787,32 +3585,37 @@ finalColor = finalColor & colorWriteMask;
       vertexBufferMemory
     );
 
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    vertexDequantize.clear();
+    for (size_t i = 0; i < sceneMeshes.size(); ++i) {
+      const vk::MeshData &mesh = sceneMeshes[i];
+      vertexDequantize.push_back(vk::vertex_dequantize(VERTEX_FORMAT, mesh.bounds()));
+
+      // encoded straight into the staging ring, chunk by chunk, from the vertices that are
+      // usually still mapped from the mesh cache. a plain copy for VertexFormat::full(). the
+      // copies are recorded into the current upload batch
+      size_t clamped = 0;
+      uploads->upload_buffer_with(
+        vertexBuffer, stride * scene.models()[i].first_vertex, stride * mesh.vertices().size(), stride,
+        [&](std::byte *dst, VkDeviceSize offset, VkDeviceSize size) {
+          clamped += vk::encode_vertices(mesh.vertices().subspan(offset / stride, size / stride), VERTEX_FORMAT, mesh.bounds(), dst);
+        }
+      );
+      vk::warn_clamped(clamped);
+    }
   }
 
   // almost identical to createVertexBuffer
   // two notable differences:
   // bufferSize is now equal to number of indices * size of index type
   // indexBuffer should be USAGE_INDEX_BUFFER_BIT
+  //
+  // the indices stay relative to their model, the draws add the model's first vertex with
+  // vertexOffset. that's what lets 16 bit indices address a scene of more than 65535 vertices
   void createIndexBuffer() {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      stagingBuffer, stagingBufferMemory
-    );
-
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t) bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    // halves the size of the index buffer and the index fetch bandwidth
+    indexType = ALLOW_16BIT_INDICES && scene.fits_index16() ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    const VkDeviceSize indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    VkDeviceSize bufferSize = indexSize * scene.index_count();
 
     createBuffer(
       bufferSize,
@@ -1822,148 +3625,552 @@ finalColor = finalColor & colorWriteMask;
       indexBufferMemory
     );
 
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    for (size_t i = 0; i < sceneMeshes.size(); ++i) {
+      auto indices = sceneMeshes[i].indices();
+      const VkDeviceSize offset = indexSize * scene.models()[i].first_index;
+
+      if (indexType == VK_INDEX_TYPE_UINT16) {
+        // narrowed while they're written into the staging ring
+        uploads->upload_buffer_with(
+          indexBuffer, offset, indexSize * indices.size(), indexSize,
+          [&](std::byte *dst, VkDeviceSize first, VkDeviceSize size) {
+            vk::narrow_indices(indices.subspan(first / indexSize, size / indexSize), reinterpret_cast<uint16_t *>(dst));
+          }
+        );
+      } else {
+        uploads->upload_buffer(indexBuffer, offset, indices.data(), sizeof(indices[0]) * indices.size());
+      }
+    }
+  }
+
+  void createDescriptorPool() {
+    // the bindless set comes with its own pool
+    if (useBindless()) {
+      return;
+    }
+
+    // a set per texture: the frames in flight and the models differ only in the dynamic offsets.
+    // a streamed or reloaded texture replaces its set whenever its view changes, the replaced ones
+    // are freed once the frames using them are done. that is at most one per texture and frame in
+    // flight. reloaded models can bring textures that weren't there before
+    const bool replaced = textureStreamer || config.hotReload;
+    const uint32_t textureCount = static_cast<uint32_t>(textures.size()) + (config.hotReload ? HOT_RELOAD_TEXTURES : 0);
+    const uint32_t sets = textureCount * (replaced ? framesInFlight + 1 : 1);
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 2 * sets;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = sets;
+
+    VkDescriptorPoolCreateInfo poolInfo {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = replaced ? VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT : 0;
+    poolInfo.poolSizeCount = poolSizes.size();
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = sets;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create descriptor pool!");
+    }
+  }
+
+  // TODO: base layout, then you have sets of such layouts, what
+  //
+  // written once: the uniform buffers are ranges of the transient buffer that are selected with
+  // dynamic offsets when the set is bound
+  void createDescriptorSets() {
+    if (useBindless()) {
+      transientBufferSlot = bindless->add_buffer(transient->buffer());
+    }
+
+    for (auto &texture: textures) {
+      createTextureDescriptor(texture);
+    }
+  }
+
+  // where the draws find the texture's view, see SceneTexture
+  void createTextureDescriptor(SceneTexture &texture) {
+    if (useBindless()) {
+      texture.slot = bindless->add_texture(texture.view, textureSampler);
+    } else {
+      texture.descriptorSet = createDescriptorSet(texture.view);
+    }
+  }
+
+  VkDescriptorSet createDescriptorSet(VkImageView textureView) {
+    VkDescriptorSetAllocateInfo allocInfo {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+
+    VkDescriptorSet set;
+    if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    // the range is what the shader sees, the dynamic offset moves it through the buffer
+    VkDescriptorBufferInfo frameBufferInfo {};
+    frameBufferInfo.buffer = transient->buffer();
+    frameBufferInfo.offset = 0;
+    frameBufferInfo.range = sizeof(FrameUniforms);
+
+    VkDescriptorBufferInfo drawBufferInfo {};
+    drawBufferInfo.buffer = transient->buffer();
+    drawBufferInfo.offset = 0;
+    drawBufferInfo.range = sizeof(DrawUniforms);
+
+    VkDescriptorImageInfo imageInfo {};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = textureView;
+    imageInfo.sampler = textureSampler;
+
+    std::array<VkWriteDescriptorSet, 3> descriptorWrites {};
+
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = set;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &frameBufferInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = set;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &imageInfo; // used instead of pBufferInfo
+
+    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[2].dstSet = set;
+    descriptorWrites[2].dstBinding = 2;
+    descriptorWrites[2].dstArrayElement = 0;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[2].descriptorCount = 1;
+    descriptorWrites[2].pBufferInfo = &drawBufferInfo;
+
+    vkUpdateDescriptorSets(
+      device,
+      descriptorWrites.size(),
+      descriptorWrites.data(),
+      0,
+      nullptr
+    );
+
+    return set;
+  }
+
+  // we're going to copy new data to the uniforms every frame, so it doesn't make sense to have
+  // a staging buffer: it would add extra overhead in this case and likely degrade performance.
+  // one region per frame in flight, because we dont want to update the data in preparation of
+  // the next frame while a previous one is still reading from it
+  void createTransientBuffer() {
+    transient = std::make_unique<vk::TransientBuffer>(device, physicalDevice, *allocator, framesInFlight);
+  }
+
+  // one buffer per frame in flight, so the CPU can write the transforms of the next frame while
+  // the GPU still reads the previous ones. persistently mapped like the uniform buffers
+  void createInstanceBuffers() {
+    VkDeviceSize bufferSize = sizeof(InstanceData) * config.instanceCount;
+
+    instanceBuffers.resize(framesInFlight);
+    instanceBuffersMemory.resize(framesInFlight);
+
+    for (size_t i = 0; i < framesInFlight; ++i) {
+      createBuffer(
+        bufferSize,
+        // storage: input of the culling shader
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        instanceBuffers[i],
+        instanceBuffersMemory[i]
+      );
+    }
+  }
+
+  // culling: the compute pipeline, and per frame in flight a buffer for the visible instances
+  // and one for the indirect draw
+  void createCullResources() {
+    // ********************************************************************************
+    // descriptors: instances (in), visible instances (out), indirect draw
+    // ********************************************************************************
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings {};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+      bindings[i].binding = i;
+      bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindings.size();
+    layoutInfo.pBindings = bindings.data();
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullDescriptorSetLayout));
+
+    VkPushConstantRange pushConstantRange {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout));
+
+    const auto pipelineStart = std::chrono::steady_clock::now();
+    cullPipeline = createCullPipeline(readSpirv(CULL_SHADER_PATH)->bytes());
+    pipelineCreationMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineStart).count();
+
+    createCullBuffers();
+
+    spdlog::info(
+      "gpu culling of {} instances, {} indirect draws each, drawIndirectCount {}, multiDrawIndirect {}",
+      config.instanceCount, scene.draws().size(),
+      drawIndirectCountSupported ? "supported" : "not supported",
+      multiDrawIndirectSupported ? "supported" : "not supported"
+    );
+  }
+
+  VkPipeline createCullPipeline(std::span<const std::byte> cullShaderCode) {
+    VkShaderModule cullShaderModule = createShaderModule(cullShaderCode);
+
+    VkComputePipelineCreateInfo pipelineInfo {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = cullShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = cullPipelineLayout;
+    VkPipeline pipeline;
+    VkResult result = vkCreateComputePipelines(device, pipelineCache->handle(), 1, &pipelineInfo, nullptr, &pipeline);
+
+    vkDestroyShaderModule(device, cullShaderModule, nullptr);
+    VK_CHECK(result);
+    return pipeline;
   }
 
-  void createDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> poolSizes {};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+  // per frame in flight the visible instances, the indirect draws (as many as the scene has) and
+  // the descriptor set with them
+  void createCullBuffers() {
+    // ********************************************************************************
+    // buffers, only ever touched by the GPU
+    // ********************************************************************************
+    indirectDrawCapacity = static_cast<uint32_t>(scene.draws().size());
+    visibleInstanceBuffers.resize(framesInFlight);
+    visibleInstanceBuffersMemory.resize(framesInFlight);
+    indirectBuffers.resize(framesInFlight);
+    indirectBuffersMemory.resize(framesInFlight);
 
-    VkDescriptorPoolCreateInfo poolInfo {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = poolSizes.size();
-    poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    for (size_t i = 0; i < framesInFlight; ++i) {
+      createBuffer(
+        sizeof(InstanceData) * config.instanceCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        visibleInstanceBuffers[i],
+        visibleInstanceBuffersMemory[i]
+      );
 
-    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create descriptor pool!");
+      createBuffer(
+        indirectCommandOffset(indirectDrawCapacity),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        indirectBuffers[i],
+        indirectBuffersMemory[i]
+      );
     }
-  }
 
-  // TODO: base layout, then you have sets of such layouts, what
-  void createDescriptorSets() {
-    // specify descriptor layout to base these on
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+    // ********************************************************************************
+    // descriptor sets, one per frame in flight
+    // ********************************************************************************
+    const uint32_t bindingCount = 3;
+    VkDescriptorPoolSize poolSize {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = static_cast<uint32_t>(bindingCount * framesInFlight);
+
+    VkDescriptorPoolCreateInfo poolInfo {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = static_cast<uint32_t>(framesInFlight);
+    VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &cullDescriptorPool));
 
+    std::vector<VkDescriptorSetLayout> layouts(framesInFlight, cullDescriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo {};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.descriptorPool = cullDescriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(framesInFlight);
     allocInfo.pSetLayouts = layouts.data();
 
-    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    cullDescriptorSets.resize(framesInFlight);
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, cullDescriptorSets.data()));
+
+    for (size_t i = 0; i < framesInFlight; ++i) {
+      std::array<VkDescriptorBufferInfo, 3> bufferInfos {};
+      bufferInfos[0] = {instanceBuffers[i], 0, VK_WHOLE_SIZE};
+      bufferInfos[1] = {visibleInstanceBuffers[i], 0, VK_WHOLE_SIZE};
+      bufferInfos[2] = {indirectBuffers[i], 0, VK_WHOLE_SIZE};
+
+      std::array<VkWriteDescriptorSet, 3> writes {};
+      for (uint32_t b = 0; b < writes.size(); ++b) {
+        writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[b].dstSet = cullDescriptorSets[i];
+        writes[b].dstBinding = b;
+        writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[b].descriptorCount = 1;
+        writes[b].pBufferInfo = &bufferInfos[b];
+      }
 
-    // will allocate descriptor sets, each with one uniform buffer descriptor
-    if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate descriptor sets!");
+      vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
     }
+  }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-      VkDescriptorBufferInfo bufferInfo {};
-      bufferInfo.buffer = uniformBuffers[i];
-      bufferInfo.offset = 0;
-      bufferInfo.range = sizeof(UniformBufferObject);
-
-      VkDescriptorImageInfo imageInfo {};
-      imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-      imageInfo.imageView = textureImageView;
-      imageInfo.sampler = textureSampler;
-
-      std::array<VkWriteDescriptorSet, 2> descriptorWrites {};
-
-      descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      descriptorWrites[0].dstSet = descriptorSets[i];
-      descriptorWrites[0].dstBinding = 0;
-      descriptorWrites[0].dstArrayElement = 0;
-      descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      descriptorWrites[0].descriptorCount = 1;
-      descriptorWrites[0].pBufferInfo = &bufferInfo;
-      descriptorWrites[0].pImageInfo = nullptr;
-      descriptorWrites[0].pTexelBufferView = nullptr;
-
-      descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      descriptorWrites[1].dstSet = descriptorSets[i];
-      descriptorWrites[1].dstBinding = 1;
-      descriptorWrites[1].dstArrayElement = 0;
-      descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-      descriptorWrites[1].descriptorCount = 1;
-      descriptorWrites[1].pImageInfo = &imageInfo; // used instead of pBufferInfo
-
-      vkUpdateDescriptorSets(
-        device,
-        descriptorWrites.size(),
-        descriptorWrites.data(),
-        0,
-        nullptr
-      );
+  // the descriptor sets are bound by the frames in flight, so they're replaced together with the
+  // buffers, and all of it goes away once those frames are done
+  void recreateCullBuffers() {
+    deferDestroy([
+      this,
+      visible = std::move(visibleInstanceBuffers), visibleMemory = std::move(visibleInstanceBuffersMemory),
+      indirect = std::move(indirectBuffers), indirectMemory = std::move(indirectBuffersMemory),
+      pool = cullDescriptorPool
+    ] {
+      for (size_t i = 0; i < visible.size(); ++i) {
+        vkDestroyBuffer(device, visible[i], nullptr);
+        allocator->free(visibleMemory[i]);
+        vkDestroyBuffer(device, indirect[i], nullptr);
+        allocator->free(indirectMemory[i]);
+      }
+      vkDestroyDescriptorPool(device, pool, nullptr);
+    });
+
+    visibleInstanceBuffers.clear();
+    visibleInstanceBuffersMemory.clear();
+    indirectBuffers.clear();
+    indirectBuffersMemory.clear();
+    cullDescriptorSets.clear();
+    createCullBuffers();
+  }
+
+  void destroyCullResources() {
+    for (size_t i = 0; i < framesInFlight; ++i) {
+      vkDestroyBuffer(device, visibleInstanceBuffers[i], nullptr);
+      allocator->free(visibleInstanceBuffersMemory[i]);
+
+      vkDestroyBuffer(device, indirectBuffers[i], nullptr);
+      allocator->free(indirectBuffersMemory[i]);
     }
+
+    vkDestroyDescriptorPool(device, cullDescriptorPool, nullptr);
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, cullDescriptorSetLayout, nullptr);
   }
 
-  void createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+  // resets the indirect commands, culls all instances of this frame and makes the results
+  // visible to the indirect draws and the vertex input of the render pass that follows
+  void recordCulling(VkCommandBuffer commandBuffer) {
+    // a command per draw of the scene in draw list order, all without instances. it's copied
+    // into the command buffer, the frame's arena is only needed while recording
+    std::pmr::vector<std::byte> reset(indirectCommandOffset(static_cast<uint32_t>(scene.draws().size())), &frameArenas->local());
+    auto *commands = reinterpret_cast<VkDrawIndexedIndirectCommand *>(reset.data() + sizeof(IndirectDrawBuffer));
+    for (size_t i = 0; i < scene.draws().size(); ++i) {
+      const vk::SceneMesh &mesh = scene.meshes()[scene.draws()[i].mesh];
+      commands[i].indexCount = mesh.index_count;
+      commands[i].instanceCount = 0;
+      commands[i].firstIndex = mesh.first_index;
+      commands[i].vertexOffset = mesh.vertex_offset;
+      commands[i].firstInstance = 0;
+    }
 
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMappped.resize(MAX_FRAMES_IN_FLIGHT);
+    // vkCmdUpdateBuffer takes at most 64 KiB at once
+    const VkDeviceSize maxUpdate = 65536;
+    for (VkDeviceSize offset = 0; offset < reset.size(); offset += maxUpdate) {
+      const VkDeviceSize size = std::min<VkDeviceSize>(reset.size() - offset, maxUpdate);
+      fns.vkCmdUpdateBuffer(commandBuffer, indirectBuffers[currentFrame], offset, size, reset.data() + offset);
+    }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-      createBuffer(
-        bufferSize,
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        uniformBuffers[i],
-        uniformBuffersMemory[i]
+    VkMemoryBarrier resetBarrier {};
+    resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    fns.vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      1, &resetBarrier,
+      0, nullptr,
+      0, nullptr
+    );
+
+    CullPushConstants constants {};
+    auto planes = frustumPlanes(cullViewProj);
+    for (size_t i = 0; i < planes.size(); ++i) {
+      constants.planes[i] = planes[i];
+    }
+    constants.sphere = instanceSphere();
+    constants.instanceCount = config.instanceCount;
+    constants.drawCount = static_cast<uint32_t>(scene.draws().size());
+
+    fns.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    fns.vkCmdBindDescriptorSets(
+      commandBuffer,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      cullPipelineLayout,
+      0, 1, &cullDescriptorSets[currentFrame],
+      0, nullptr
+    );
+    fns.vkCmdPushConstants(
+      commandBuffer,
+      cullPipelineLayout,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0, sizeof(constants), &constants
+    );
+    fns.vkCmdDispatch(commandBuffer, (config.instanceCount + 63) / 64, 1, 1);
+
+    VkMemoryBarrier cullBarrier {};
+    cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    VkPipelineStageFlags cullSrcStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    // the shader only counts into the first command, every other draws as many instances. one
+    // copy region per command, instead of an atomic per visible instance and draw
+    const uint32_t drawCount = static_cast<uint32_t>(scene.draws().size());
+    if (drawCount > 1) {
+      VkMemoryBarrier countBarrier {};
+      countBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      countBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      countBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+      fns.vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &countBarrier,
+        0, nullptr,
+        0, nullptr
       );
 
-      // we map the buffer right after creation to get pointer to which we can write teh data later on.
-      // the buffer stays mapped to this pointer for the applications whole lifetime.
-      // technique is called perssistent mapping and works on all Vulkan implementations
-      // not having to map the buffer every time we need to update it increases performance as mapping is not free
-      vkMapMemory(
-        device,
-        uniformBuffersMemory[i],
-        0, bufferSize, 0,
-        &uniformBuffersMappped[i]
+      const VkDeviceSize countOffset = offsetof(VkDrawIndexedIndirectCommand, instanceCount);
+      std::pmr::vector<VkBufferCopy> regions(&frameArenas->local());
+      regions.reserve(drawCount - 1);
+      for (uint32_t d = 1; d < drawCount; ++d) {
+        regions.push_back({indirectCommandOffset(0) + countOffset, indirectCommandOffset(d) + countOffset, sizeof(uint32_t)});
+      }
+      fns.vkCmdCopyBuffer(
+        commandBuffer, indirectBuffers[currentFrame], indirectBuffers[currentFrame],
+        static_cast<uint32_t>(regions.size()), regions.data()
       );
-    }
-  }
 
-  void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+      cullBarrier.srcAccessMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
+      cullSrcStage |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
 
-    VkBufferCopy copyRegion {};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(
+    fns.vkCmdPipelineBarrier(
       commandBuffer,
-      src,
-      dst,
-      1,
-      &copyRegion
+      cullSrcStage,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+      0,
+      1, &cullBarrier,
+      0, nullptr,
+      0, nullptr
     );
+  }
 
-    endSingleTimeCommands(commandBuffer);
+  uint32_t instanceGridSide() const {
+    return static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(config.instanceCount))));
   }
 
-  uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    // has two arrays memoryTypes and memoryHeaps
-    // heaps are distinct memory resources like dedicated VRAM and swap space in RAM (for when VRAM runs out)
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+  // distance between neighbouring instances, a bit more than the scene itself
+  float instanceSpacing() const {
+    glm::vec3 extent = scene.bounds().max - scene.bounds().min;
+    return 1.25f * std::max({extent.x, extent.y, 1e-3f});
+  }
 
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i) {
-      if ((typeFilter & (1 << i)) &&
-          (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-        return i;
-      }
+  float instanceGridExtent() const {
+    return config.instanceCount > 1 ? instanceGridSide() * instanceSpacing() : 0.0f;
+  }
+
+  // the bounding sphere of the scene in the space the instance transforms apply to
+  glm::vec4 instanceSphere() const {
+    const vk::MeshBounds &bounds = scene.bounds();
+    const glm::vec3 center = 0.5f * (bounds.min + bounds.max);
+    const float radius = 0.5f * glm::length(bounds.max - bounds.min);
+    return glm::vec4(glm::vec3(modelRotation * glm::vec4(center, 1.0f)), radius);
+  }
+
+  // the instances on a square grid around the origin
+  void createInstanceTransforms() {
+    const uint32_t side = instanceGridSide();
+    const float spacing = instanceSpacing();
+    const float offset = 0.5f * (side - 1) * spacing;
+
+    instanceTransforms.resize(config.instanceCount);
+    for (uint32_t i = 0; i < config.instanceCount; ++i) {
+      const uint32_t column = i % side;
+      const uint32_t row = i / side;
+      glm::vec3 position {
+        column * spacing - offset,
+        row * spacing - offset,
+        0.0f
+      };
+      const float spin = (column + row) % 2 == 0 ? config.instanceSpin : -config.instanceSpin;
+      instanceTransforms.set(i, position, 0.0f, spin, 1.0f);
+    }
+  }
+
+  // fewer instances than this aren't worth a job of their own
+  static constexpr uint32_t MIN_INSTANCES_PER_JOB = 4096;
+
+  // the model matrices are composed (and culled) four at a time from the structure of arrays in
+  // instanceTransforms and written directly into the mapped memory, no staging or descriptor
+  // updates involved. many instances are split among the workers, the calling thread takes the
+  // first range
+  void updateInstanceBuffer(uint32_t currentImage) {
+    auto *instances = static_cast<InstanceData *>(instanceBuffersMemory[currentImage].mapped);
+    const uint32_t count = instanceTransforms.size();
+
+    // the same test as the culling shader
+    std::optional<vk::InstanceTransforms::Frustum> frustum;
+    if (!config.gpuCulling && config.cpuCulling) {
+      frustum = vk::InstanceTransforms::Frustum {frustumPlanes(cullViewProj), instanceSphere()};
+    }
+
+    const uint32_t group = vk::InstanceTransforms::GROUP;
+    const uint32_t ranges = std::clamp((count + MIN_INSTANCES_PER_JOB - 1) / MIN_INSTANCES_PER_JOB, 1u, jobs->size() + 1);
+    const uint32_t perRange = std::max(((count + ranges - 1) / ranges + group - 1) / group * group, group);
+
+    std::atomic<uint32_t> visible {0};
+    auto write = [&](uint32_t begin) {
+      instanceTransforms.write(begin, std::min(count, begin + perRange), animationTime, frustum ? &*frustum : nullptr, instances, visible);
+    };
+
+    std::pmr::vector<std::future<void>> pending(&frameArenas->local());
+    for (uint32_t begin = perRange; begin < count; begin += perRange) {
+      pending.push_back(jobs->submit([&write, begin] { write(begin); }));
+    }
+    write(0);
+
+    // get() rethrows, but only once none of them uses this stack frame anymore
+    for (auto &f: pending) {
+      f.wait();
+    }
+    for (auto &f: pending) {
+      f.get();
     }
 
-    throw std::runtime_error("failed to find suitable memory type!");
+    visibleInstanceCount = frustum ? visible.load() : count;
+  }
+
+  // memory properties are queried once by the allocator instead of on every call
+  uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+    return allocator->find_memory_type(typeFilter, properties);
   }
 
   void createBuffer(
@@ -1971,7 +4178,7 @@ finalColor = finalColor & colorWriteMask;
     VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties,
     VkBuffer &buffer,
-    VkDeviceMemory &bufferMemory
+    vk::Allocation &bufferMemory
   ) {
     VkBufferCreateInfo bufferInfo {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1986,32 +4193,29 @@ finalColor = finalColor & colorWriteMask;
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
     // you're not supposed to actually call vkAllocateMemory for every individual buffer
     // the maximum number of simultaneous memory allocations is limited by the
     // maxMemoryAllocationCount physical device limit which may be as low as 4096 even
     // on high end hardware like GTX 1080.
-    // the right way to allocate memory for large number of objects at the same time is to create
-    // a custom allocator that spliuts up a single allocation among many different objects using
+    // the allocator splits up a few large allocations among many different objects using
     // the offset parameters that we've seen in many functions
-    //
-    // you can use the VulkanMemoryAllocator library provided by the GPUOpen initiative
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate buffer memory!");
-    }
+    bufferMemory = allocator->allocate(memRequirements, properties, true);
 
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
   }
 
   void createDescriptorSetLayout() {
+    // one set for everything, its layout doesn't depend on what the shaders use
+    if (useBindless()) {
+      bindless = std::make_unique<vk::BindlessDescriptors>(device, physicalDevice);
+      return;
+    }
+
     VkDescriptorSetLayoutBinding uboLayoutBinding {};
     // the binding used in the shader
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    // dynamic: the offset into the buffer is given when the set is bound, not when it's written
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
     // possible for shader variable to represent an array of uniform buiffer objects
     // this could be used to specify a transformation for each of the bones in a skeleton
@@ -2034,9 +4238,17 @@ finalColor = finalColor & colorWriteMask;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     // ********************************************************************************
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {
+    // per draw uniforms, changes with every draw while binding 0 stays the same for the frame
+    VkDescriptorSetLayoutBinding drawLayoutBinding {};
+    drawLayoutBinding.binding = 2;
+    drawLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    drawLayoutBinding.descriptorCount = 1;
+    drawLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {
       uboLayoutBinding,
-      samplerLayoutBinding
+      samplerLayoutBinding,
+      drawLayoutBinding
     };
 
     VkDescriptorSetLayoutCreateInfo layoutInfo {};
@@ -2064,10 +4276,12 @@ finalColor = finalColor & colorWriteMask;
     VkImageUsageFlags usage,
     VkMemoryPropertyFlags properties,
     VkImage &out_image,
-    VkDeviceMemory &out_imageMemory
+    vk::Allocation &out_imageMemory,
+    VkImageCreateFlags flags = 0
   ) {
     VkImageCreateInfo imageInfo {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = flags;
 
     // 1D used to store an array of data or gradient
     // 2D store textures
@@ -2096,102 +4310,192 @@ finalColor = finalColor & colorWriteMask;
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(device, out_image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    // linearly tiled images are treated like buffers w.r.t. bufferImageGranularity
+    out_imageMemory = allocator->allocate(memRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
+
+    vkBindImageMemory(device, out_image, out_imageMemory.memory, out_imageMemory.offset);
+  }
+
+  // sampling a texture of the format (with linear filtering, for the mip chain) and copying into it
+  bool textureFormatSupported(VkFormat format) {
+    const bool bc = format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+    const bool astc = format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+    if ((bc && !textureCompressionBC) || (astc && !textureCompressionASTC)) {
+      return false;
+    }
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+
+    const VkFormatFeatureFlags required =
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT |
+      VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    return (formatProperties.optimalTilingFeatures & required) == required;
+  }
+
+  // the first precompressed version of the texture the device can sample, or the source image
+  // with its mips generated at runtime. precompressed ones are streamed if that's on, the file
+  // then stays open for the streamer (see loadTexture). a texture that is already streamed keeps its id, the
+  // streamer hands out the new view through the swap callback
+  void createTextureImage(SceneTexture &texture, TextureData data) {
+    for (auto &file: data.compressed) {
+      if (textureFormatSupported(file->format())) {
+        if (textureStreamer) {
+          texture.format = file->format();
+          texture.mipLevels = static_cast<uint32_t>(file->levels().size());
+          if (texture.streamed) {
+            textureStreamer->replace(*texture.streamed, std::move(file));
+          } else {
+            texture.streamed = textureStreamer->add(std::move(file));
+          }
+        } else {
+          createTextureImage(texture, *file);
+        }
+        return;
+      }
+      spdlog::info("{} has format {}, which this device can't sample", file->path(), string_VkFormat(file->format()));
+    }
 
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &out_imageMemory) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate out_image memory!");
+    if (!data.pixels) {
+      // only precompressed versions that don't work here, the source has to be decoded after all
+      spdlog::warn("no usable precompressed version of {}, decoding it", data.path);
+      createTextureImage(texture, decodeTexture(data.path));
+      return;
     }
 
-    vkBindImageMemory(device, out_image, out_imageMemory, 0);
+    createTextureImageFromPixels(texture, data);
   }
 
-  void createTextureImage() {
-    int texWidth, texHeight, texChannels;
+  // precompressed, all the mip levels are copied from the file as they are
+  void createTextureImage(SceneTexture &texture, const vk::ktx::Texture &file) {
+    texture.streamed.reset();
+    texture.format = file.format();
+    texture.mipLevels = static_cast<uint32_t>(file.levels().size());
+
+    createImage(
+      static_cast<int>(file.width()),
+      static_cast<int>(file.height()),
+      texture.mipLevels,
+      VK_SAMPLE_COUNT_1_BIT,
+      texture.format,
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      texture.image,
+      texture.memory
+    );
 
-    // uc == unsigned char
-    // TODO(cpp): char == byte ALWAYS? why isn't there a "byte" type?
-    // answer: since C++17 there exists a std::byte
-    // like unsigned char it can be used to access raw memory occupied by other objects but unlike
-    // unsigned char it is not a character type and is not an arithmetic type
-    // std::byte models a mere collection of bits, supporting only bitwise and comparison operations
-    // https://en.cppreference.com/w/cpp/types/byte
-    stbi_uc *pixels = stbi_load(
-      TEXTURE_PATH.c_str(),
-      &texWidth,
-      &texHeight,
-      &texChannels,
-      STBI_rgb_alpha
+    transitionImageLayout(
+      uploads->cmd(),
+      texture.image,
+      texture.format,
+      VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      texture.mipLevels
     );
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
 
-    if (!pixels) {
-      throw std::runtime_error(fmt::format("failed to load texture image: {}", stbi_failure_reason()));
+    // staged level by level, a large level in bands, so no texture needs the whole ring
+    std::vector<vk::UploadQueue::ImageLevel> levels;
+    uint64_t dataSize = 0;
+    for (const vk::ktx::Level &level: file.levels()) {
+      levels.push_back({file.data() + level.offset, level.width, level.height});
+      dataSize += level.size;
+    }
+    const vk::ktx::FormatInfo &info = file.info();
+    uploads->upload_image(texture.image, levels, info.block_width, info.block_height, info.block_size);
+
+    // the upload may have flushed batches in between
+    VkCommandBuffer commandBuffer = uploads->cmd();
+    VkCommandBuffer graphicsCommandBuffer = uploads->graphics_cmd();
+    if (uploads->dedicated_transfer()) {
+      transferImageOwnership(
+        commandBuffer,
+        graphicsCommandBuffer,
+        texture.image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        texture.mipLevels,
+        uploads->transfer_family(),
+        uploads->graphics_family()
+      );
     }
 
-    // max selects largest dimension
-    // log2 to see how many times that dimension can be divided by 2
-    // and then floor
-    mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+    // no mipmap blits, so this is the only thing left for the graphics queue
+    transitionImageLayout(
+      graphicsCommandBuffer,
+      texture.image,
+      texture.format,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      texture.mipLevels
+    );
 
-    // create buffer in host visible memory so we can use vkMapMemory and copy
-    // pixels to it
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(
-      imageSize,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      stagingBuffer,
-      stagingBufferMemory
+    spdlog::info(
+      "loaded texture {} ({}x{}, {}, {} precomputed mip levels, {} KiB)",
+      file.path(), file.width(), file.height(), string_VkFormat(texture.format), texture.mipLevels, dataSize / 1024
     );
+  }
+
+  void createTextureImageFromPixels(SceneTexture &texture, const TextureData &data) {
+    texture.streamed.reset();
+    texture.format = VK_FORMAT_R8G8B8A8_SRGB;
+
+    int texWidth = data.width;
+    int texHeight = data.height;
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(device, stagingBufferMemory);
+    // max selects largest dimension
+    // log2 to see how many times that dimension can be divided by 2
+    // and then floor
+    texture.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
-    stbi_image_free(pixels);
+    // the compute mip generator doesn't need linear filtering, so it's used whenever it can
+    // write the format. blits are the fallback
+    const bool computeMips =
+      mipGenerator != nullptr && texture.mipLevels > 1 && vk::MipGenerator::supports(physicalDevice, texture.format);
 
     // ********************************************************************************
 
     createImage(
       texWidth,
       texHeight,
-      mipLevels,
+      texture.mipLevels,
       VK_SAMPLE_COUNT_1_BIT,
-      VK_FORMAT_R8G8B8A8_SRGB,
+      texture.format,
       VK_IMAGE_TILING_OPTIMAL,
 
       // vkCmdBlitImage (for mipmapping) is considered a transfer operation
       VK_IMAGE_USAGE_TRANSFER_DST_BIT |
       VK_IMAGE_USAGE_SAMPLED_BIT |
-      VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+      (computeMips ? vk::MipGenerator::storage_usage() : 0),
 
       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-      textureImage,
-      textureImageMemory
+      texture.image,
+      texture.memory,
+      computeMips ? vk::MipGenerator::storage_flags() : 0
     );
 
+    // transitions, copy and mipmap blits are all recorded into the upload batches
+    // the copy goes into the transfer queue's command buffer, the blits need a graphics queue
+
     // image was create with VK_IMAGE_LAYOUT_UNDEFINED
     transitionImageLayout(
-      textureImage,
-      VK_FORMAT_R8G8B8A8_SRGB,
+      uploads->cmd(),
+      texture.image,
+      texture.format,
       VK_IMAGE_LAYOUT_UNDEFINED,
       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      mipLevels
+      texture.mipLevels
     );
 
     // fyi the order of calling copy and then another transition is CORRECT
     // tried to reverse it and it explicitly told me the expected layout was incorrect
-    copyBufferToImage(
-      stagingBuffer,
-      textureImage,
-      static_cast<uint32_t>(texWidth),
-      static_cast<uint32_t>(texHeight)
-    );
+    //
+    // the pixels are staged in bands of rows, a large image doesn't fit into the ring at once.
+    // the upload may flush in between, so the command buffers are only fetched afterwards
+    const vk::UploadQueue::ImageLevel level {data.pixels.get(), static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight)};
+    uploads->upload_image(texture.image, std::span(&level, 1), 1, 1, 4);
+    VkCommandBuffer commandBuffer = uploads->cmd();
 
     // to be able to start sampling from the texture image in the shader we need one last transition to
     // prepare it for shader access:
@@ -2204,15 +4508,34 @@ finalColor = finalColor & colorWriteMask;
 //        mipLevels
 //    );
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    // hand the image over from the transfer to the graphics queue family
+    // (a no-op without a dedicated transfer queue)
+    VkCommandBuffer graphicsCommandBuffer = uploads->graphics_cmd();
+    if (uploads->dedicated_transfer()) {
+      transferImageOwnership(
+        commandBuffer,
+        graphicsCommandBuffer,
+        texture.image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        texture.mipLevels,
+        uploads->transfer_family(),
+        uploads->graphics_family()
+      );
+    }
+
+    if (computeMips) {
+      // recorded together with the mips of every other texture of the batch when it's flushed
+      mipGenerator->add(texture.image, texture.format, texWidth, texHeight, texture.mipLevels);
+      return;
+    }
 
     generateMipmaps(
-      textureImage,
-      VK_FORMAT_R8G8B8A8_SRGB,
+      graphicsCommandBuffer,
+      texture.image,
+      texture.format,
       texWidth,
       texHeight,
-      mipLevels
+      texture.mipLevels
     );
   }
 
@@ -2263,13 +4586,27 @@ finalColor = finalColor & colorWriteMask;
     //   endSingleTimeCommands(bla);
     // }
     VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    transitionImageLayout(commandBuffer, image, format, oldLayout, newLayout, mipLevels);
+    endSingleTimeCommands(commandBuffer);
+  }
 
+  // records the transition into an existing command buffer (e.g. the current upload batch)
+  void transitionImageLayout(
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkFormat format,
+    VkImageLayout oldLayout,
+    VkImageLayout newLayout,
+    uint32_t mipLevels
+  ) {
     // barriers used to synchronize access to resources like ensuireing that a write
     // to a buffer completes before reading from it
     // also can be used to transition image layouts
     // and transfer queue family ownership
-    VkImageMemoryBarrier barrier {};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    //
+    // synchronization2 barriers carry their stages in the barrier itself, see cmdImageBarrier
+    VkImageMemoryBarrier2 barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
 
     // VK_IMAGE_LAYOUT_UNDEFINED if we don't care about existing contents of the image
     barrier.oldLayout = oldLayout;
@@ -2309,79 +4646,128 @@ finalColor = finalColor & colorWriteMask;
 
     // see https://registry.khronos.org/vulkan/specs/1.3-extensions/html/chap7.html#synchronization-access-types-supported
     // for list of valujes
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-
     if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
         newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
       barrier.srcAccessMask = 0;
-      barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-      sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-      destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+      barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+      barrier.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
+      barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
     } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
                newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-      sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-      destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+      barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+      barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+      barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
     } else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
                newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
       barrier.srcAccessMask = 0;
-      barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-      sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-      destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+      barrier.dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                              VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      barrier.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
+      barrier.dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT;
     } else {
       throw std::invalid_argument("unsupported layout transition!");
     }
 
-    // all pipeline barriers are submitted using the same function
-    vkCmdPipelineBarrier(
+    cmdImageBarrier(commandBuffer, barrier);
+  }
+
+  // vkCmdPipelineBarrier2 if the device has synchronization2, otherwise the same barrier as a
+  // vkCmdPipelineBarrier. the stage and access bits below 32 have the same values in both, so
+  // the fallback only works for barriers that don't use any of the flags new in synchronization2
+  void cmdImageBarrier(VkCommandBuffer commandBuffer, const VkImageMemoryBarrier2 &barrier) {
+    if (synchronization2Supported) {
+      VkDependencyInfo dependency {};
+      dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+      dependency.imageMemoryBarrierCount = 1;
+      dependency.pImageMemoryBarriers = &barrier;
+      fns.vkCmdPipelineBarrier2(commandBuffer, &dependency);
+      return;
+    }
+
+    // SHADER_SAMPLED_READ is a synchronization2 split of SHADER_READ
+    VkAccessFlags2 srcAccess = barrier.srcAccessMask;
+    VkAccessFlags2 dstAccess = barrier.dstAccessMask;
+    if (dstAccess & VK_ACCESS_2_SHADER_SAMPLED_READ_BIT) {
+      dstAccess = (dstAccess & ~VK_ACCESS_2_SHADER_SAMPLED_READ_BIT) | VK_ACCESS_2_SHADER_READ_BIT;
+    }
+
+    VkImageMemoryBarrier legacy {};
+    legacy.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    legacy.srcAccessMask = static_cast<VkAccessFlags>(srcAccess);
+    legacy.dstAccessMask = static_cast<VkAccessFlags>(dstAccess);
+    legacy.oldLayout = barrier.oldLayout;
+    legacy.newLayout = barrier.newLayout;
+    legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+    legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+    legacy.image = barrier.image;
+    legacy.subresourceRange = barrier.subresourceRange;
+
+    // 0 stages are allowed in synchronization2 only
+    auto stages = [](VkPipelineStageFlags2 s, VkPipelineStageFlags none) {
+      return s == 0 ? none : static_cast<VkPipelineStageFlags>(s);
+    };
+
+    fns.vkCmdPipelineBarrier(
       commandBuffer,
-      sourceStage, destinationStage,
+      stages(barrier.srcStageMask, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+      stages(barrier.dstStageMask, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
       0,
       0, nullptr,
       0, nullptr,
-      1, &barrier
+      1, &legacy
     );
-
-    endSingleTimeCommands(commandBuffer);
   }
 
-  void copyBufferToImage(
-    VkBuffer buffer,
+  // moves an image from one queue family to another without changing its layout
+  // the same barrier has to be recorded twice: the release half in a command buffer executed on the
+  // src family and the acquire half in one on the dst family. the acquire must not execute before
+  // the release, the caller takes care of that with a semaphore between the two submits
+  void transferImageOwnership(
+    VkCommandBuffer releaseCommandBuffer,
+    VkCommandBuffer acquireCommandBuffer,
     VkImage image,
-    uint32_t width,
-    uint32_t height
+    VkImageLayout layout,
+    uint32_t mipLevels,
+    uint32_t srcFamily,
+    uint32_t dstFamily
   ) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-    VkBufferImageCopy region {};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {
-      width,
-      height,
-      1
-    };
+    VkImageMemoryBarrier barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = layout;
+    barrier.newLayout = layout;
+    barrier.srcQueueFamilyIndex = srcFamily;
+    barrier.dstQueueFamilyIndex = dstFamily;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
 
-    vkCmdCopyBufferToImage(
-      commandBuffer,
-      buffer,
-      image,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      1,
-      &region
+    // release: dstAccessMask is ignored
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    fns.vkCmdPipelineBarrier(
+      releaseCommandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      0,
+      0, nullptr,
+      0, nullptr,
+      1, &barrier
     );
 
-    endSingleTimeCommands(commandBuffer);
+    // acquire: srcAccessMask is ignored
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    fns.vkCmdPipelineBarrier(
+      acquireCommandBuffer,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0,
+      0, nullptr,
+      0, nullptr,
+      1, &barrier
+    );
   }
 
   VkImageView createImageView(
@@ -2425,12 +4811,24 @@ finalColor = finalColor & colorWriteMask;
   }
 
   // basically the same as create image view, which was the reason for createImageView
-  void createTextureImageView() {
-    textureImageView = createImageView(
-      textureImage,
-      VK_FORMAT_R8G8B8A8_SRGB,
+  void createTextureImageViews() {
+    for (auto &texture: textures) {
+      createTextureImageView(texture);
+    }
+  }
+
+  void createTextureImageView(SceneTexture &texture) {
+    // owned by the streamer, and replaced as levels come and go
+    if (texture.streamed) {
+      texture.view = textureStreamer->view(*texture.streamed);
+      return;
+    }
+
+    texture.view = createImageView(
+      texture.image,
+      texture.format,
       VK_IMAGE_ASPECT_COLOR_BIT,
-      mipLevels
+      texture.mipLevels
     );
   }
 
@@ -2495,7 +4893,8 @@ finalColor = finalColor & colorWriteMask;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
 //    samplerInfo.minLod = (float) mipLevels / 2;  // simulate what it will look like from far away
-    samplerInfo.maxLod = (float) mipLevels;
+    // shared by all textures, whatever their number of levels
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
     if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
       throw std::runtime_error("failed to create texture sampler!");
@@ -2539,112 +4938,53 @@ finalColor = finalColor & colorWriteMask;
   bool hasStencilComponent(VkFormat format) {
     return format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
            format == VK_FORMAT_D24_UNORM_S8_UINT;
-  }
-
-  void createDepthResources() {
-    VkFormat depthFormat = findDepthFormat();
-
-    createImage(
-      swapChainExtent.width,
-      swapChainExtent.height,
-      1,
-      msaaSamples,
-      depthFormat,
-      VK_IMAGE_TILING_OPTIMAL,
-      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-      depthImage,
-      depthImageMemory
-    );
-
-    depthImageView = createImageView(
-      depthImage,
-      depthFormat,
-      VK_IMAGE_ASPECT_DEPTH_BIT,
-      1
-    );
-
-    transitionImageLayout(
-      depthImage,
-      depthFormat,
-      VK_IMAGE_LAYOUT_UNDEFINED,
-      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-      1
-    );
-
-  }
-
-  void loadModel() {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
-
-    // object file consists of positions, normals, texture coords, and faces
-    // faces consist of arbitrary amount of vertices, where each vertex refers to a position
-    // normal and/or texture coordinate by index
-    //
-    // attrib holds all of the positions normals and texture coords in
-    // attrib.vertices
-    // attrib.texcoords
-    // attrib.normals
-    //
-    // shapes contains all separate objects and their faces
-    // each face is an array of vertices
-    // each vertex contaions indices of the position, normal, and texture coord attributes
-    // (obj can also define a material and texture per face but we ignore this)
-    bool ok = tinyobj::LoadObj(
-      &attrib,
-      &shapes,
-      &materials,
-      &warn,
-      &err,
-      MODEL_PATH.c_str()
-    );
-
-    if (!ok) {
-      throw std::runtime_error(warn + err);
-    }
-
-    std::unordered_map<Vertex, uint32_t> uniqueVertices {};
-
-    // combine alll faces into a single model
-    for (const auto &shape: shapes) {
-      for (const auto &index: shape.mesh.indices) {
-        Vertex vertex {};
-
-        // attrib.vertices is an array of float values instead of something like vec3, thus
-        // we need to multiply by 3
-        vertex.pos = {
-          attrib.vertices[3 * index.vertex_index + 0],
-          attrib.vertices[3 * index.vertex_index + 1],
-          attrib.vertices[3 * index.vertex_index + 2]
-        };
+  }
 
-        vertex.texCoord = {
-          attrib.texcoords[2 * index.texcoord_index + 0],
+  void createDepthResources() {
+    depthFormat = findDepthFormat();
 
-          // obj format assumes vertical coord of 0 means bottom of the image
-          // while we use top to bottom orientation where 0 means top of image
-          // so we need to flip it
-          1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-        };
+    const VkExtent2D extent = attachmentExtent(depthImageExtent);
+    if (depthImage != VK_NULL_HANDLE) {
+      if (extent.width == depthImageExtent.width && extent.height == depthImageExtent.height) {
+        return;
+      }
 
-        vertex.color = {1.0f, 1.0f, 1.0f};
+      // frames that are still in flight render to the old one
+      deferDestroy([this, image = depthImage, view = depthImageView, memory = depthImageMemory] {
+        vkDestroyImageView(device, view, nullptr);
+        vkDestroyImage(device, image, nullptr);
+        allocator->free(memory);
+      });
+    }
+    depthImageExtent = extent;
 
-        // reduces indices from 1,500,00 to 265,645 which saves a lot of GPU memory
-        if (uniqueVertices.count(vertex) == 0) {
-          uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-          vertices.push_back(vertex);
-        }
+    createImage(
+      extent.width,
+      extent.height,
+      1,
+      msaaSamples,
+      depthFormat,
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      depthImage,
+      depthImageMemory
+    );
 
-        vertices.push_back(vertex);
-        indices.push_back(uniqueVertices[vertex]);  // assume every vertex is unique
-      }
-    }
+    depthImageView = createImageView(
+      depthImage,
+      depthFormat,
+      VK_IMAGE_ASPECT_DEPTH_BIT,
+      1
+    );
+
+    // no explicit transition: the render pass and the dynamic rendering path both start from
+    // VK_IMAGE_LAYOUT_UNDEFINED every frame, and a transition here would wait for the queue
+    // to go idle
   }
 
   void generateMipmaps(
+    VkCommandBuffer commandBuffer,
     VkImage image,
     VkFormat imageFormat,
     int32_t texWidth,
@@ -2667,8 +5007,6 @@ finalColor = finalColor & colorWriteMask;
       throw std::runtime_error("texture image format does not support linear blitting!");
     }
 
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
     // we'll make several transitions, and we'll re-use this barrier
     // subresourceRange.mipLevel
     // oldLayout,
@@ -2696,7 +5034,7 @@ finalColor = finalColor & colorWriteMask;
       barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
       barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
-      vkCmdPipelineBarrier(
+      fns.vkCmdPipelineBarrier(
         commandBuffer,
         VK_PIPELINE_STAGE_TRANSFER_BIT,
         VK_PIPELINE_STAGE_TRANSFER_BIT,
@@ -2724,7 +5062,7 @@ finalColor = finalColor & colorWriteMask;
       // be supported on all platforms
       // it requires texture image format we use to support linear filtering
       // which can be checked with vkGetPhysicalDeviceFormatProperties
-      vkCmdBlitImage(
+      fns.vkCmdBlitImage(
         commandBuffer,
         image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
         image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -2737,7 +5075,7 @@ finalColor = finalColor & colorWriteMask;
       barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
       barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-      vkCmdPipelineBarrier(commandBuffer,
+      fns.vkCmdPipelineBarrier(commandBuffer,
                            VK_PIPELINE_STAGE_TRANSFER_BIT,
                            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
                            0, nullptr,
@@ -2756,13 +5094,11 @@ finalColor = finalColor & colorWriteMask;
 
     // transitions last mip level from VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL to
     // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-    vkCmdPipelineBarrier(commandBuffer,
+    fns.vkCmdPipelineBarrier(commandBuffer,
                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
                          0, nullptr,
                          0, nullptr,
                          1, &barrier);
-
-    endSingleTimeCommands(commandBuffer);
   }
 
   VkSampleCountFlagBits getMaxUsableSampleCount() {
@@ -2782,22 +5118,65 @@ finalColor = finalColor & colorWriteMask;
     return VK_SAMPLE_COUNT_1_BIT;
   }
 
+  // the sample count requested by AppConfig::msaaSamples, or the closest one below it
+  VkSampleCountFlagBits chooseSampleCount() {
+    VkSampleCountFlagBits maxSamples = getMaxUsableSampleCount();
+    if (config.msaaSamples == 0) {
+      return maxSamples;
+    }
+
+    uint32_t samples = std::min<uint32_t>(config.msaaSamples, maxSamples);
+    while (samples > 1 && (samples & (samples - 1)) != 0) {
+      samples &= samples - 1;
+    }
+    return static_cast<VkSampleCountFlagBits>(std::max(samples, 1u));
+  }
+
+  bool usesResolveAttachment() const {
+    return msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+  }
+
   void createColorResources() {
+    if (!usesResolveAttachment()) {
+      return;
+    }
+
     VkFormat colorFormat = swapChainImageFormat;
 
-    createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL,
+    // grows like the depth image, see createDepthResources. a different surface format needs a
+    // new image as well
+    const VkExtent2D extent = attachmentExtent(colorImageExtent);
+    if (colorImage != VK_NULL_HANDLE) {
+      if (extent.width == colorImageExtent.width && extent.height == colorImageExtent.height &&
+          colorFormat == colorImageFormat) {
+        return;
+      }
+
+      deferDestroy([this, image = colorImage, view = colorImageView, memory = colorImageMemory] {
+        vkDestroyImageView(device, view, nullptr);
+        vkDestroyImage(device, image, nullptr);
+        allocator->free(memory);
+      });
+    }
+    colorImageExtent = extent;
+    colorImageFormat = colorFormat;
+
+    createImage(extent.width, extent.height, 1, msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL,
                 VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageMemory);
     colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
   }
 
 private: // members
-  GLFWwindow *window;
+  GLFWwindow *window = nullptr;
   VkInstance instance;
 
-  // even the debug callback in vulkan ins managed with a handle that is created/destroyed.
-  // you can have as many of these as you want.
-  VkDebugUtilsMessengerEXT debugMessenger;
+  // owns the instance, the debug messenger (the debug callback in vulkan is managed with a handle
+  // that is created/destroyed as well), the surface and the logical device. the handles above and
+  // below are what everything else uses
+  ptr<vk::Instance> vkInstance;
+  ptr<vk::Surface> vkSurface;
+  ptr<vk::LDevice> vkDevice;
 
   // graphics card
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
@@ -2806,8 +5185,25 @@ private: // members
   // interfaces with the physical device
   VkDevice device;
 
+  // the device's own entry points of what the draw loop calls, see vk::DeviceFns
+  vk::DeviceFns fns;
+
+  // sub-allocates device memory for all buffers and images
+  ptr<vk::MemoryAllocator> allocator;
+
   VkQueue graphicsQueue;
 
+  // == graphicsQueue if the device has no dedicated transfer family
+  VkQueue transferQueue;
+
+  // batches all staging copies through one persistently mapped ring
+  ptr<vk::UploadQueue> uploads;
+  ptr<vk::MipGenerator> mipGenerator;
+
+  // see createTimelines. transferTimeline only exists with a dedicated transfer family
+  ptr<vk::Timeline> graphicsTimeline;
+  ptr<vk::Timeline> transferTimeline;
+
   // to establish connection between vulkan and the window system to present results to the screen we need to use
   // the WSI (window system integration) extensions
   // VK_KHR_surface is one
@@ -2816,11 +5212,14 @@ private: // members
   // instance level extension
   // returned by the glfwGetRequiredInstanceExtensions
   // the surface needs to be created right after the instance creation because it can influence the physical device selection
-  VkSurfaceKHR surface;
+  VkSurfaceKHR surface = VK_NULL_HANDLE;
 
   VkQueue presentQueue;
-  VkSwapchainKHR swapChain;
+  VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+
+  // headless: offscreen images that take the place of the swap chain images, one per frame in flight
   std::vector<VkImage> swapChainImages;
+  std::vector<vk::Allocation> offscreenImagesMemory;
   VkFormat swapChainImageFormat;
   VkExtent2D swapChainExtent;
 
@@ -2828,43 +5227,131 @@ private: // members
   // to be used as a render target
   std::vector<VkImageView> swapChainImageViews;
 
-  VkRenderPass renderPass;
-  VkDescriptorSetLayout descriptorSetLayout;
+  // VK_NULL_HANDLE with dynamic rendering, see useDynamicRendering()
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
   VkPipelineLayout pipelineLayout;
-  VkPipeline graphicsPipeline;
+
+  // the variants of the graphics pipeline, see pipelineKey()
+  ptr<vk::PipelineRegistry> pipelines;
+  VkShaderModule vertShaderModule;
+  VkShaderModule fragShaderModule;
 
   std::vector<VkFramebuffer> swapChainFramebuffers;
 
+  // commandPool is for single time commands, the frame's command buffers come from frameCommandPools
   VkCommandPool commandPool;
+  std::vector<VkCommandPool> frameCommandPools;
   std::vector<VkCommandBuffer> commandBuffers;
-
-  std::vector<Vertex> vertices;
-  std::vector<uint32_t> indices;
+  ptr<vk::SecondaryRecorder> recorder;
+  ptr<vk::Profiler> profiler;
+
+  ptr<vk::PipelineCache> pipelineCache;
+  double pipelineCreationMs = 0.0;
+
+  // asset decoding runs on these while the main thread sets up vulkan, later they record the draws
+  ptr<vk::ThreadPool> jobs;
+  ptr<vk::FrameArenas> frameArenas;
+  // one per AppConfig::models
+  std::vector<std::future<vk::MeshData>> modelJobs;
+  // one per textures, started as soon as something needs the texture, see requestTexture
+  std::vector<std::future<TextureData>> textureJobs;
+  std::unordered_map<std::string, uint32_t> textureIndices;
+
+  // the meshes of all models, their materials and the sorted draw list, see uploadAssets
+  vk::Scene scene;
+
+  // what the scene was built from, per model. kept so that a reloaded model can be merged with
+  // the others again
+  std::vector<vk::MeshData> sceneMeshes;
+  std::vector<std::vector<uint32_t>> sceneMaterialTextures;
+
+  // the scene's vertices and indices, every model in its own range
   VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
+  vk::Allocation vertexBufferMemory;
 
-  VkBuffer indexBuffer;
-  VkDeviceMemory indexBufferMemory;
-
-  VkDescriptorPool descriptorPool;
-  std::vector<VkDescriptorSet> descriptorSets;
+  // per model, see vk::vertex_dequantize
+  std::vector<glm::mat4> vertexDequantize;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
 
-  // we're going to copyh new data to the uniform buffer every frame, so it doesn't make sense
-  // to have a staging buffer: it would add extra overhead in this case and likely degrade performance
-  //
-  // we should have multiple buffers, because multiple frames may be in flight at the same time and we dont
-  // want to update the buffer in preparation of the next frame while a previous one is still reading from it
-  std::vector<VkBuffer> uniformBuffers;
-  std::vector<VkDeviceMemory> uniformBuffersMemory;
-  std::vector<void *> uniformBuffersMappped;
+  VkBuffer indexBuffer;
+  vk::Allocation indexBufferMemory;
+
+  // without bindless descriptors, the sets are per texture
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+
+  // with them, see createDescriptorSetLayout and DrawPushConstants
+  ptr<vk::BindlessDescriptors> bindless;
+  uint32_t transientBufferSlot = 0;
+
+  // per frame and per draw uniforms, see createTransientBuffer. the draw uniforms are per model
+  ptr<vk::TransientBuffer> transient;
+  uint32_t frameUniformsOffset = 0;
+  std::vector<uint32_t> drawUniformsOffsets;
+
+  // per frame in flight, see createInstanceBuffers
+  std::vector<VkBuffer> instanceBuffers;
+  std::vector<vk::Allocation> instanceBuffersMemory;
+
+  // gpu culling, see createCullResources
+  VkDescriptorSetLayout cullDescriptorSetLayout;
+  VkPipelineLayout cullPipelineLayout;
+  VkPipeline cullPipeline;
+  VkDescriptorPool cullDescriptorPool;
+  std::vector<VkDescriptorSet> cullDescriptorSets;
+  std::vector<VkBuffer> visibleInstanceBuffers;
+  std::vector<vk::Allocation> visibleInstanceBuffersMemory;
+  std::vector<VkBuffer> indirectBuffers;
+  std::vector<vk::Allocation> indirectBuffersMemory;
+  uint32_t indirectDrawCapacity = 0;
+
+  // inputs of the culling pass, written by updateUniformBuffer
+  glm::mat4 cullViewProj {1.0f};
+  glm::mat4 modelRotation {1.0f};
+  float animationTime = 0.0f;
+
+  // what updateInstanceBuffer writes the instance buffers from, and how many of the instances
+  // it wrote this frame (all of them unless they're culled on the CPU)
+  vk::InstanceTransforms instanceTransforms;
+  uint32_t visibleInstanceCount = 0;
+  bool drawIndirectCountSupported = false;
+  bool multiDrawIndirectSupported = false;
+  bool dynamicRenderingSupported = false;
+  bool synchronization2Supported = false;
+  bool textureCompressionBC = false;
+  bool textureCompressionASTC = false;
+  bool storageImageArrayDynamicIndexing = false;
+  bool memoryBudgetEnabled = false;
+  bool bindlessSupported = false;
+
+  // FramePacing::LowLatency
+  bool presentWaitEnabled = false;
+  PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+  VkSwapchainKHR lastPresentSwapChain = VK_NULL_HANDLE;
+  std::chrono::steady_clock::time_point lastPresentInputTime;
+
+  // when the frame of a slot sampled its input, see drawFrame
+  std::vector<std::chrono::steady_clock::time_point> frameInputTimes;
 
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
+  // what the submit of the frame in each slot signals on graphicsTimeline
+  std::vector<uint64_t> frameTimelineValues;
 
   uint32_t currentFrame = 0;
   bool framebufferResized = false;
 
+  // what was replaced while frames that use it may still be in flight, see deferDestroy
+  struct DeferredDestroy {
+    uint64_t timelineValue;  // on the graphics timeline, safe to destroy once that's complete
+    std::function<void()> destroy;
+  };
+  std::deque<DeferredDestroy> deletionQueue;
+
+  // input of the animation, see AppConfig::fixedTimeStep
+  std::chrono::high_resolution_clock::time_point startTime;
+  uint64_t frameNumber = 0;
+
   // shader can use raw pixel buffer, but it's better to use image objects
   // they make it easier and faster to retrieve colors by using 2D coordinated for example
   // (terminology) pixels within an image object == TEXTURE
@@ -2872,24 +5359,65 @@ private: // members
   // mip level 0 == original image
   // higher the level, less detail / smaller the image
   // (also, somehow helps avoid artfiacts such as Moire patterns (?))
-  uint32_t mipLevels;
-  VkImage textureImage;
-  VkDeviceMemory textureImageMemory;
+  struct SceneTexture {
+    std::string path;
+    uint32_t mipLevels = 1;
+    VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+    VkImage image = VK_NULL_HANDLE;
+    vk::Allocation memory;
+    VkImageView view = VK_NULL_HANDLE;
+
+    // the streamer's id of the texture when it's streamed, image and view belong to the
+    // streamer then. see createTextureStreamer
+    std::optional<uint32_t> streamed;
+
+    // where the draws find it: the slot of the bindless set, or its own descriptor set
+    static constexpr uint32_t NO_SLOT = std::numeric_limits<uint32_t>::max();
+    uint32_t slot = NO_SLOT;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  };
 
-  VkImageView textureImageView;
+  // indexed by vk::SceneMaterial::texture
+  std::vector<SceneTexture> textures;
   VkSampler textureSampler;
 
+  ptr<vk::TextureStreamer> textureStreamer;
+
+  // hot reload, see createFileWatcher
+  ptr<vk::FileWatcher> fileWatcher;
+
+  struct TextureReload {
+    uint32_t texture;
+    std::future<TextureData> job;
+  };
+  std::vector<TextureReload> textureReloads;
+
+  struct ModelReload {
+    uint32_t model;
+    std::future<vk::MeshData> job;
+
+    // once the job is done, and the textures of its materials
+    std::optional<vk::MeshData> mesh;
+    std::vector<uint32_t> textures;
+  };
+  std::vector<ModelReload> modelReloads;
+
   // depth attachment
   // dpeth image requires the trifecta:L image, memory and image view
-  VkImage depthImage;
-  VkDeviceMemory depthImageMemory;
+  VkImage depthImage = VK_NULL_HANDLE;
+  vk::Allocation depthImageMemory;
   VkImageView depthImageView;
+  VkFormat depthFormat;
+  VkExtent2D depthImageExtent {0, 0};  // at least swapChainExtent, see attachmentExtent
 
   // msaa
   // image will store the desired number of samples per pixel
-  VkImage colorImage;
-  VkDeviceMemory colorImageMemory;
-  VkImageView colorImageView;
+  // not used with a single sample, the swap chain image is the color attachment then
+  VkImage colorImage = VK_NULL_HANDLE;
+  vk::Allocation colorImageMemory;
+  VkImageView colorImageView = VK_NULL_HANDLE;
+  VkExtent2D colorImageExtent {0, 0};
+  VkFormat colorImageFormat = VK_FORMAT_UNDEFINED;
 };
 
 void init_spdlog() {
@@ -2940,629 +5468,174 @@ std::string hexdump(void *ptr, int buflen) {
   return dump;
 }
 
-#define VK_CHECK(x) \
-    do { \
-        VkResult err = x; \
-        if (err != VK_SUCCESS) { \
-            spdlog::error(#x " failed: {}", string_VkResult(err)); \
-            throw std::runtime_error(fmt::format(#x " failed: {}", string_VkResult(err))); \
-        } \
-    } while (0)
-
-namespace vk {
-
-struct Config {
-//  vec<const char*> enabled_layers = {
-//      "VK_LAYER_KHRONOS_validation"
-//  };
-};
-
-u32 ver() {
-  u32 ver;
-  VK_CHECK(vkEnumerateInstanceVersion(&ver));
-  return ver;
-}
-
-vec<VkLayerProperties> layers() {
-  u32 num_layers;
-  VK_CHECK(vkEnumerateInstanceLayerProperties(&num_layers, nullptr));
-
-  vec<VkLayerProperties> layers(num_layers);
-  VK_CHECK(vkEnumerateInstanceLayerProperties(&num_layers, layers.data()));
-
-  return layers;
-}
-
-vec<VkExtensionProperties> extensions() {
-  u32 num_extensions;
-  VK_CHECK(vkEnumerateInstanceExtensionProperties(nullptr, &num_extensions, nullptr));
-
-  vec<VkExtensionProperties> extensions(num_extensions);
-  VK_CHECK(vkEnumerateInstanceExtensionProperties(nullptr, &num_extensions, extensions.data()));
-
-  return extensions;
-}
-
-static VKAPI_ATTR VkBool32 VKAPI_CALL debug_cb(
-  VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-  VkDebugUtilsMessageTypeFlagsEXT messageType,
-  const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-  void *pUserData
-) {
-  spdlog::get("vk_debug_messenger")->debug("validation layer: {}", pCallbackData->pMessage);
-  return VK_FALSE;
-}
-
-
-class DebugMessenger {
-  VkInstance instance_;
-  VkDebugUtilsMessengerEXT messenger_;
-
-public:
-  DebugMessenger(const VkDebugUtilsMessengerCreateInfoEXT& info, VkInstance instance): instance_(instance) {
-    spdlog::debug("getting ptr to vkCreateDebugUtilsMessengerEXT");
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(
-      instance,
-      "vkCreateDebugUtilsMessengerEXT"
-    );
-
-    if (func != nullptr) {
-      spdlog::debug("creating debug messenger");
-      VK_CHECK(func(instance, &info, nullptr, &messenger_));
-    } else {
-      throw std::runtime_error("failed to set up debug messenger!");
-    }
-  }
-
-  ~DebugMessenger() {
-    spdlog::debug("getting ptr to vkDestroyDebugUtilsMessengerEXT");
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(
-      instance_,
-      "vkDestroyDebugUtilsMessengerEXT"
-    );
-
-    if (func != nullptr) {
-      spdlog::debug("destroying debug messenger");
-      func(instance_, messenger_, nullptr);
-    }
-  }
-};
-
-class QFam {
-  VkQueueFamilyProperties props_;
-  u32 index_;
-
-public:
-  QFam(const VkQueueFamilyProperties& props, u32 index) : props_(props), index_(index) {}
-
-  u32 index() const { return index_; }
-  u32 qcount() const { return props_.queueCount; }
-  bool is_graphics() const { return props_.queueFlags & VK_QUEUE_GRAPHICS_BIT; }
-  VkQueueFlags flags() const { return props_.queueFlags; }
-};
-
-class PDevice {
-  VkPhysicalDevice device_;
-  VkPhysicalDeviceProperties props_;
-
-public:
-  PDevice(VkPhysicalDevice device, VkPhysicalDeviceProperties props) : device_(device), props_(props) {}
-
-  vec<QFam> qfams() {
-    u32 num_families;
-    vkGetPhysicalDeviceQueueFamilyProperties(device_, &num_families, nullptr);
-
-    vec<VkQueueFamilyProperties> families(num_families);
-    vkGetPhysicalDeviceQueueFamilyProperties(device_, &num_families, families.data());
-
-    vec<QFam> res;
-    for (size_t i = 0; i < families.size(); ++i) {
-      res.push_back(QFam(families[i], i));
-    }
-
-    return res;
-  }
-
-  operator VkPhysicalDevice() { return device_; }
-
-  const char* name() const { return props_.deviceName; }
-  const char* type() const { return string_VkPhysicalDeviceType(props_.deviceType); }
-  u32 api_ver() const { return props_.apiVersion; }
-  u32 driver_ver() const { return props_.driverVersion; }
-};
-
-class Instance {
-  VkInstance instance_;
-  DebugMessenger* debug_messenger_;
-
-public:
-  Instance(const VkInstanceCreateInfo &info) : debug_messenger_(nullptr) {
-    spdlog::debug("creating vulkan instance");
-    VK_CHECK(vkCreateInstance(&info, nullptr, &instance_));
-
-    auto pNext = info.pNext;
-    while (pNext != nullptr) {
-      auto debug_info_maybe = (VkDebugUtilsMessengerCreateInfoEXT *)(info.pNext);
-      if (debug_info_maybe->sType == VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT) {
-        debug_messenger_ = new DebugMessenger(*debug_info_maybe, instance_);
-      }
-
-      pNext = debug_info_maybe->pNext;
-    }
-
-    if (debug_messenger_ == nullptr) {
-      spdlog::warn("debug messenger not created");
-    }
-  }
-
-  operator VkInstance() { return instance_; }
-
-  vec<PDevice> pdevices() {
-    u32 num_devices;
-    VK_CHECK(vkEnumeratePhysicalDevices(instance_, &num_devices, nullptr));
-
-    vec<VkPhysicalDevice> devices(num_devices);
-    VK_CHECK(vkEnumeratePhysicalDevices(instance_, &num_devices, devices.data()));
-
-    vec<PDevice> res;
-    for (u32 i = 0; i < num_devices; ++i) {
-      VkPhysicalDeviceProperties props {};
-      vkGetPhysicalDeviceProperties(devices[i], &props);
-      res.push_back(PDevice(devices[i], props));
-    }
-
-    return res;
-  }
-
-  ~Instance() {
-    delete debug_messenger_;
-
-    spdlog::debug("destroying vulkan instance");
-    vkDestroyInstance(instance_, nullptr);
-  }
-};
-
-class Surface {
-  VkInstance instance_;
-  VkSurfaceKHR surface_;
-
-public:
-  Surface(VkInstance instance, GLFWwindow *window) : instance_(instance) {
-    spdlog::debug("creating surface");
-    VK_CHECK(glfwCreateWindowSurface(instance, window, nullptr, &surface_));
-  }
-
-  operator VkSurfaceKHR() { return surface_; }
-
-  VkSurfaceCapabilitiesKHR capabilities(PDevice& pdevice) {
-    VkSurfaceCapabilitiesKHR capabilities;
-    VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(pdevice, surface_, &capabilities));
-    return capabilities;
-  }
-
-  vec<VkSurfaceFormatKHR> formats(PDevice& pdevice) {
-    uint32_t num_formats;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(pdevice, surface_, &num_formats, nullptr);
-
-    vec<VkSurfaceFormatKHR> formats;
-    if (num_formats > 0) {
-      formats.resize(num_formats);
-      vkGetPhysicalDeviceSurfaceFormatsKHR(pdevice, surface_, &num_formats, formats.data());
-    }
-
-    return formats;
-  }
-
-  vec<VkPresentModeKHR> present_modes(PDevice& pdevice) {
-    uint32_t num_modes;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(pdevice, surface_, &num_modes, nullptr);
 
-    vec<VkPresentModeKHR> modes;
-    if (num_modes > 0) {
-      modes.resize(num_modes);
-      vkGetPhysicalDeviceSurfacePresentModesKHR(pdevice, surface_, &num_modes, modes.data());
+#ifdef VULKAN_TUT_BENCHMARK
+// headless benchmark, built as the vulkan_tut_bench target: renders a fixed number of frames
+// offscreen for every combination of scene size (instance count) and sample count and prints
+// percentiles of the frame times. the profiler logs the CPU and GPU section times of every run
+//
+// vulkan_tut_bench [--frames N] [--warmup N] [--size WxH] [--instances 1,256,4096] [--msaa 1,4,8] [--no-gpu-culling]
+//                  [--no-cpu-culling] [--instance-spin RAD_PER_S] [--frames-in-flight N]
+
+// "1,4,8" -> {1, 4, 8}
+static std::vector<uint32_t> parseList(const std::string &arg) {
+  std::vector<uint32_t> res;
+  size_t begin = 0;
+  while (begin <= arg.size()) {
+    size_t end = arg.find(',', begin);
+    if (end == std::string::npos) {
+      end = arg.size();
     }
-
-    return modes;
-  }
-
-  ~Surface() {
-    spdlog::debug("destroying surface");
-    vkDestroySurfaceKHR(instance_, surface_, nullptr);
-  }
-};
-
-class LDevice {
-  VkDevice device_;
-  QFam qf_;
-
-public:
-  LDevice(PDevice& pdevice, const QFam& qf) : qf_(qf) {
-    spdlog::debug("creating logical device with single queue of family index={}", qf.index());
-    VkDeviceCreateInfo info {};
-    info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-
-    VkPhysicalDeviceFeatures features {};
-    features.samplerAnisotropy = VK_TRUE;
-    features.sampleRateShading = VK_TRUE;
-    info.pEnabledFeatures = &features;
-
-    float qprio = 1.0f;
-    auto qinfo = VkDeviceQueueCreateInfo {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-      .queueFamilyIndex = qf.index(),
-      .queueCount = 1,
-      .pQueuePriorities = &qprio,
-    };
-    info.queueCreateInfoCount = 1;
-    info.pQueueCreateInfos = &qinfo;
-
-    vec<const char *> extensions = {
-      VK_KHR_SWAPCHAIN_EXTENSION_NAME
-    };
-    info.enabledExtensionCount = (u32) extensions.size();
-    info.ppEnabledExtensionNames = extensions.data();
-
-    VK_CHECK(vkCreateDevice(pdevice, &info, nullptr, &device_));
-  }
-
-  operator VkDevice() { return device_; }
-
-  VkQueue q() {
-    VkQueue q;
-    vkGetDeviceQueue(device_, qf_.index(), 0, &q);
-    return q;
-  }
-
-  ~LDevice() {
-    spdlog::debug("destroying logical device");
-    vkDestroyDevice(device_, nullptr);
+    res.push_back(static_cast<uint32_t>(std::stoul(arg.substr(begin, end - begin))));
+    begin = end + 1;
   }
-};
-
-bool supports_khr(PDevice& device, Surface& surface, QFam& qfam) {
-  VkBool32 res;
-  VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(device, qfam.index(), surface, &res));
   return res;
 }
 
-
-const char* string_VkColorSpaceKHR(VkColorSpaceKHR colorSpace) {
-  switch (colorSpace) {
-    case VK_COLOR_SPACE_SRGB_NONLINEAR_KHR: return "VK_COLOR_SPACE_SRGB_NONLINEAR_KHR";
-    case VK_COLOR_SPACE_DISPLAY_P3_NONLINEAR_EXT: return "VK_COLOR_SPACE_DISPLAY_P3_NONLINEAR_EXT";
-    case VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT: return "VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT";
-    case VK_COLOR_SPACE_DISPLAY_P3_LINEAR_EXT: return "VK_COLOR_SPACE_DISPLAY_P3_LINEAR_EXT";
-    case VK_COLOR_SPACE_DCI_P3_NONLINEAR_EXT: return "VK_COLOR_SPACE_DCI_P3_NONLINEAR_EXT";
-    case VK_COLOR_SPACE_BT709_LINEAR_EXT: return "VK_COLOR_SPACE_BT709_LINEAR_EXT";
-    case VK_COLOR_SPACE_BT709_NONLINEAR_EXT: return "VK_COLOR_SPACE_BT709_NONLINEAR_EXT";
-    case VK_COLOR_SPACE_BT2020_LINEAR_EXT: return "VK_COLOR_SPACE_BT2020_LINEAR_EXT";
-    case VK_COLOR_SPACE_HDR10_ST2084_EXT: return "VK_COLOR_SPACE_HDR10_ST2084_EXT";
-    case VK_COLOR_SPACE_DOLBYVISION_EXT: return "VK_COLOR_SPACE_DOLBYVISION_EXT";
-    case VK_COLOR_SPACE_HDR10_HLG_EXT: return "VK_COLOR_SPACE_HDR10_HLG_EXT";
-    case VK_COLOR_SPACE_ADOBERGB_LINEAR_EXT: return "VK_COLOR_SPACE_ADOBERGB_LINEAR_EXT";
-    case VK_COLOR_SPACE_ADOBERGB_NONLINEAR_EXT: return "VK_COLOR_SPACE_ADOBERGB_NONLINEAR_EXT";
-    case VK_COLOR_SPACE_PASS_THROUGH_EXT: return "VK_COLOR_SPACE_PASS_THROUGH_EXT";
-    case VK_COLOR_SPACE_EXTENDED_SRGB_NONLINEAR_EXT: return "VK_COLOR_SPACE_EXTENDED_SRGB_NONLINEAR_EXT";
-    default: return "Unknown color space";
+// nearest rank, sorted has to be sorted
+static double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
   }
+  size_t i = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+  return sorted[std::clamp<size_t>(i, 1, sorted.size()) - 1];
 }
 
-class ImageView {
-  VkDevice device_;
-  VkImageView view_;
-
-public:
-  ImageView(const VkImageViewCreateInfo& info, LDevice& device) : device_(device) {
-    spdlog::debug("creating image view");
-    VK_CHECK(vkCreateImageView(device_, &info, nullptr, &view_));
-  }
-
-  ~ImageView() {
-    vkDestroyImageView(device_, view_, nullptr);
-  }
-};
-
-class Swapchain {
-  VkDevice device_;
-  VkSwapchainKHR swapChain_;
-
-public:
-  Swapchain(const VkSwapchainCreateInfoKHR& info, LDevice& device) : device_(device) {
-    spdlog::debug("creating swapchain");
-    VK_CHECK(vkCreateSwapchainKHR(device, &info, nullptr, &swapChain_));
-  }
-
-  vec<VkImage> images() {
-    u32 num_images;
-    VK_CHECK(vkGetSwapchainImagesKHR(device_, swapChain_, &num_images, nullptr));
-
-    vec<VkImage> images(num_images);
-    VK_CHECK(vkGetSwapchainImagesKHR(device_, swapChain_, &num_images, images.data()));
-
-    return images;
-  }
-
-  // vec<ptr<ImageView>> image_views() {
-  //   auto images = this->images();
-  //   vec<ptr<ImageView>> views;
-
-  //   for (auto image: images) {
-  //     ptr(new ImageView(VkImageViewCreateInfo {
-  //       .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-  //       .image = image,
-  //       .viewType = VK_IMAGE_VIEW_TYPE_2D,
-  //       .format = VK_FORMAT_B8G8R8A8_SRGB,
-  //       .components.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-  //       .components.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-  //       .components.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-  //       .components.a = VK_COMPONENT_SWIZZLE_IDENTITY,
-  //       .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-  //       .subresourceRange.baseMipLevel = 0,
-  //       .subresourceRange.levelCount = 1,
-  //       .subresourceRange.baseArrayLayer = 0,
-  //       .subresourceRange.layerCount = 1
-  //     }, device_));
-  //     VkImageViewCreateInfo info {};
-  //     info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-  //     info.image = image;
-  //     info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-  //     info.format = VK_FORMAT_B8G8R8A8_SRGB;
-  //     info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-  //     info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-  //     info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-  //     info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-  //     info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  //     info.subresourceRange.baseMipLevel = 0;
-  //     info.subresourceRange.levelCount = 1;
-  //     info.subresourceRange.baseArrayLayer = 0;
-  //     info.subresourceRange.layerCount = 1;
-
-  //     VkImageView image_view;
-  //     VK_CHECK(vkCreateImageView(device_, &info, nullptr, &image_view));
-  //     image_views.push_back(image_view);
-  //   }
-
-  //   return image_views;
-  // }
-
-  ~Swapchain() {
-    spdlog::debug("destroying swapchain");
-    vkDestroySwapchainKHR(device_, swapChain_, nullptr);
-  }
-
-};
-
-} // namespace vk
-
-
-int main() {
+int main(int argc, char **argv) {
   init_spdlog();
+  spdlog::set_level(spdlog::level::info);
+
+  uint32_t frames = 1000;
+  uint32_t warmupFrames = 100;
+  uint32_t width = 1920;
+  uint32_t height = 1080;
+  bool gpuCulling = true;
+  bool cpuCulling = true;
+  float instanceSpin = 0.0f;
+  uint32_t framesInFlight = 0;
+  std::vector<uint32_t> instanceCounts = {1, 256, 4096};
+  std::vector<uint32_t> sampleCounts = {1, 4, 8};
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      const std::string arg = argv[i];
+      auto value = [&]() -> std::string {
+        if (i + 1 >= argc) {
+          throw std::runtime_error(fmt::format("missing value for {}", arg));
+        }
+        return argv[++i];
+      };
 
-  auto window = glfw::Window(800, 600, "Vulkan");
-
-  spdlog::info("Vulkan version: {}", vk::ver());
-
-  auto layers = vk::layers();
-  for (const auto &l: layers) {
-    spdlog::debug("found layer {} ({})", l.layerName, l.description);
-  }
-
-  auto enabled_layers = vec<const char *> {
-    "VK_LAYER_KHRONOS_validation"
-  };
-
-  for (const auto &el: enabled_layers) {
-    spdlog::debug("checking if layer {} is available ...", el);
-    bool found = false;
-    for (const auto &l: layers) {
-      if (strcmp(l.layerName, el) == 0) {
-        found = true;
-        break;
+      if (arg == "--frames") {
+        frames = static_cast<uint32_t>(std::stoul(value()));
+      } else if (arg == "--warmup") {
+        warmupFrames = static_cast<uint32_t>(std::stoul(value()));
+      } else if (arg == "--size") {
+        const std::string size = value();
+        const size_t x = size.find('x');
+        if (x == std::string::npos) {
+          throw std::runtime_error(fmt::format("invalid size {}, expected WxH", size));
+        }
+        width = static_cast<uint32_t>(std::stoul(size.substr(0, x)));
+        height = static_cast<uint32_t>(std::stoul(size.substr(x + 1)));
+      } else if (arg == "--instances") {
+        instanceCounts = parseList(value());
+      } else if (arg == "--msaa") {
+        sampleCounts = parseList(value());
+      } else if (arg == "--no-gpu-culling") {
+        gpuCulling = false;
+      } else if (arg == "--no-cpu-culling") {
+        cpuCulling = false;
+      } else if (arg == "--instance-spin") {
+        instanceSpin = std::stof(value());
+      } else if (arg == "--frames-in-flight") {
+        framesInFlight = static_cast<uint32_t>(std::stoul(value()));
+      } else {
+        throw std::runtime_error(fmt::format("unknown argument {}", arg));
       }
     }
-    if (!found) {
-      spdlog::error("required layer {} not found", el);
-      return EXIT_FAILURE;
-    }
-  }
-
-  auto extensions = vk::extensions();
-  for (const auto &e: extensions) {
-    spdlog::debug("found extension {}", e.extensionName);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
   }
 
-  auto enabled_extensions = glfw::required_extensions();
-  enabled_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+  struct Row {
+    uint32_t instances;
+    uint32_t samples;
+    double avg, p50, p90, p99, max;
+  };
+  std::vector<Row> rows;
+
+  try {
+    for (uint32_t instances: instanceCounts) {
+      for (uint32_t samples: sampleCounts) {
+        AppConfig config;
+        config.headless = true;
+        config.instanceCount = instances;
+        config.gpuCulling = gpuCulling;
+        config.cpuCulling = cpuCulling;
+        config.instanceSpin = instanceSpin;
+        config.msaaSamples = samples;
+        config.width = width;
+        config.height = height;
+        config.fixedTimeStep = 1.0 / 60.0;
+        config.hotReload = false;
+        config.framesInFlight = framesInFlight;
+
+        // one summary at the end of the run instead
+        config.profileLogInterval = 0;
+
+        spdlog::info("benchmark: {} instances, {}x msaa, {}x{}, {} frames", instances, samples, width, height, frames);
+
+        HelloTriangleApplication app(config);
+        BenchmarkResult result = app.runBenchmark(frames, warmupFrames);
+
+        std::vector<double> sorted = result.frameMs;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (double ms: sorted) {
+          sum += ms;
+        }
 
-  for (const auto &ee: enabled_extensions) {
-    spdlog::debug("checking if extension {} is available ...", ee);
-    bool found = false;
-    for (const auto &e: extensions) {
-      if (strcmp(e.extensionName, ee) == 0) {
-        found = true;
-        break;
+        rows.push_back({
+          instances,
+          static_cast<uint32_t>(result.msaaSamples),
+          sorted.empty() ? 0.0 : sum / static_cast<double>(sorted.size()),
+          percentile(sorted, 50.0),
+          percentile(sorted, 90.0),
+          percentile(sorted, 99.0),
+          sorted.empty() ? 0.0 : sorted.back()
+        });
       }
     }
-    if (!found) {
-      spdlog::error("required extension {} not found", ee);
-      return EXIT_FAILURE;
-    }
-  }
-
-  auto app_info = VkApplicationInfo {
-    .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-    .pNext = nullptr,
-    .pApplicationName = "test_app",
-    .applicationVersion = VK_MAKE_VERSION(0, 0, 1),
-    .pEngineName = "test_engine",
-    .engineVersion = VK_MAKE_VERSION(0, 0, 1),
-    .apiVersion = VK_API_VERSION_1_3
-  };
-
-  auto debug_messenger_info = VkDebugUtilsMessengerCreateInfoEXT {
-    .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-    .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                       VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                       VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
-
-    .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                   VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                   VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-
-    .pfnUserCallback = vk::debug_cb,
-    .pUserData = nullptr
-  };
-
-  auto instance = vk::Instance(VkInstanceCreateInfo {
-    .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-    .pNext = &debug_messenger_info,
-    .flags = 0,
-    .pApplicationInfo = &app_info,
-    .enabledLayerCount = (u32) enabled_layers.size(),
-    .ppEnabledLayerNames = enabled_layers.data(),
-    .enabledExtensionCount = (u32) enabled_extensions.size(),
-    .ppEnabledExtensionNames = enabled_extensions.data()
-  });
-
-  auto surface = vk::Surface(instance, window);
-
-  auto pdevices = instance.pdevices();
-  for (const auto& d: pdevices) {
-    spdlog::debug(
-      "found device name={}, type={}, api_ver={}, driver_ver={}",
-      d.name(),
-      d.type(),
-      d.api_ver(),
-      d.driver_ver()
-    );
-  }
-
-  if (pdevices.size() == 0) {
-    spdlog::error("no pdevices found");
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
   }
 
-  if (pdevices.size() > 1) {
-    spdlog::warn("found {} device, will pick the first one", pdevices.size());
-  }
-
-  auto phys_device = pdevices.back();
-
-  auto qfams = phys_device.qfams();
-  vec<vk::QFam> suitable_qfams;
-  for (size_t i = 0; i < qfams.size(); ++i) {
-    auto& qf = qfams[i];
-    spdlog::debug(
-      "found queue family: count={}, flags={}",
-      qf.qcount(),
-      string_VkQueueFlags(qf.flags())
+  // the sample count is the one actually used, it can be lower than requested
+  fmt::print("{:>10} {:>5} {:>9} {:>9} {:>9} {:>9} {:>9}\n", "instances", "msaa", "avg ms", "p50 ms", "p90 ms", "p99 ms", "max ms");
+  for (const auto &r: rows) {
+    fmt::print(
+      "{:>10} {:>5} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f}\n",
+      r.instances, r.samples, r.avg, r.p50, r.p90, r.p99, r.max
     );
-
-    if (qf.is_graphics() && vk::supports_khr(phys_device, surface, qf)) {
-      suitable_qfams.push_back(qf);
-    }
   }
 
-  for (const auto& sqf: suitable_qfams) {
-    spdlog::debug("suitable queue family: index={}, count={}, flags={}", sqf.index(), sqf.qcount(), string_VkQueueFlags(sqf.flags()));
-  }
+  return EXIT_SUCCESS;
+}
+#else
+int main() {
+  init_spdlog();
 
-  if (suitable_qfams.empty()) {
-    spdlog::error("no suitable queue family found");
+  HelloTriangleApplication app;
+  try {
+    app.run();
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
-  } else if (suitable_qfams.size() > 1) {
-    spdlog::warn("found {} suitable queue families, will pick the first one", suitable_qfams.size());
-  }
-
-  auto qfam = suitable_qfams.back();
-
-  auto ldevice = vk::LDevice(phys_device, qfam);
-
-  auto khr_capabilities = surface.capabilities(phys_device);
-  spdlog::debug("surface khr min_image count = {}", khr_capabilities.minImageCount);
-
-  u32 desired_image_count = khr_capabilities.minImageCount + 1;
-  if (khr_capabilities.maxImageCount > 0 && desired_image_count > khr_capabilities.maxImageCount) {
-    desired_image_count = khr_capabilities.maxImageCount;
-  }
-
-  auto khr_formats = surface.formats(phys_device);
-  VkSurfaceFormatKHR desired_format = khr_formats.back();
-  for (const auto & fmt : khr_formats) {
-    spdlog::debug("format={} color_space={}", string_VkFormat(fmt.format), vk::string_VkColorSpaceKHR(fmt.colorSpace));
-    if (fmt.format == VK_FORMAT_B8G8R8A8_SRGB && fmt.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-      desired_format = fmt;
-    }
-  }
-
-  auto khr_present_modes = surface.present_modes(phys_device);
-  VkPresentModeKHR desired_present_mode = VK_PRESENT_MODE_FIFO_KHR;
-  for (const auto& pm: khr_present_modes) {
-    spdlog::debug("present mode={}", string_VkPresentModeKHR(pm));
-    if (pm == VK_PRESENT_MODE_MAILBOX_KHR) {
-      desired_present_mode = pm;
-    }
-  }
-
-  if (khr_capabilities.currentExtent.width != u32_max) {
-    // if the width isn't the maximum value of uint32_t it means the window manager (GLFW) does not
-    // allow us to differ from the window size, and so we just use that.
-    spdlog::debug("surface khr current extent = {}x{}", khr_capabilities.currentExtent.width, khr_capabilities.currentExtent.height);
   }
 
-  auto [w, h] = window.dims();
-
-  auto extent = VkExtent2D {
-    .width = std::clamp(w, khr_capabilities.minImageExtent.width, khr_capabilities.maxImageExtent.width),
-    .height = std::clamp(h, khr_capabilities.minImageExtent.height, khr_capabilities.maxImageExtent.height)
-  };
-
-  spdlog::debug("swap extent = {}x{}", extent.width, extent.height);
-
-  auto swapchain = vk::Swapchain(
-      VkSwapchainCreateInfoKHR{
-          .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-          .pNext = nullptr,
-          .flags = 0,
-          .surface = surface,
-          .minImageCount = desired_image_count,
-          .imageFormat = desired_format.format,
-          .imageColorSpace = desired_format.colorSpace,
-          .imageExtent = extent,
-          .imageArrayLayers = 1,
-          .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-
-          .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
-          .queueFamilyIndexCount = 0,
-          .pQueueFamilyIndices = nullptr,
-
-          .preTransform = khr_capabilities.currentTransform,
-          .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-          .presentMode = desired_present_mode,
-          .clipped = VK_TRUE,
-          .oldSwapchain = VK_NULL_HANDLE
-      },
-      ldevice
-  );
-
-  auto swapchain_images = swapchain.images();
-
-//    VkInstanceCreateInfo createInfo{};
-//    vkCreateInstance(&createInfo, nullptr, nullptr);
-
-
-
-
-//    VkResult result = vkCreateInstance(&createInfo, nullptr, &instance);
-
-
-//  try {
-//    app.run();
-//  } catch (const std::exception &e) {
-//    std::cerr << e.what() << std::endl;
-//    return EXIT_FAILURE;
-//  }
-
   return EXIT_SUCCESS;
 }
+#endif
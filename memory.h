@@ -0,0 +1,363 @@
+#ifndef VULKAN_TUT_MEMORY_H
+#define VULKAN_TUT_MEMORY_H
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#include "common.h"
+
+namespace vk {
+
+// a sub-range of a larger VkDeviceMemory block handed out by MemoryAllocator
+// resources are bound at (memory, offset) instead of at offset 0 of their own allocation
+struct Allocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+
+  // non-null if the memory type is host visible: blocks are persistently mapped when they are
+  // created, so there is never a need to call vkMapMemory on a sub-allocation (mapping the same
+  // VkDeviceMemory twice is not allowed anyway)
+  void *mapped = nullptr;
+
+  // bookkeeping used by MemoryAllocator::free
+  u32 pool = 0;
+  u32 block = 0;
+
+  explicit operator bool() const { return memory != VK_NULL_HANDLE; }
+};
+
+// splits a small number of large vkAllocateMemory calls among many buffers and images.
+//
+// the maximum number of simultaneous memory allocations is limited by maxMemoryAllocationCount
+// (may be as low as 4096) and every allocation is a round-trip to the kernel driver.
+//
+// - one pool of blocks per (memory type, linear/optimal) pair. buffers and optimally tiled images
+//   never share a block, which is the simplest way to respect bufferImageGranularity: a linear
+//   and a non-linear resource can then never end up on the same "page"
+// - inside a block, free ranges are kept in an offset ordered map. allocation is best-fit
+//   honouring the alignment from VkMemoryRequirements, freeing coalesces with neighbours
+// - requests larger than half a block get their own dedicated VkDeviceMemory
+// - memory properties are queried once instead of on every findMemoryType call
+class MemoryAllocator {
+  struct Block {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    VkDeviceSize used = 0;
+    void *mapped = nullptr;
+    bool dedicated = false;
+
+    // offset -> size of every free range in the block
+    std::map<VkDeviceSize, VkDeviceSize> free;
+  };
+
+  struct Pool {
+    u32 memory_type = 0;
+    bool linear = true;
+    vec<ptr<Block>> blocks;  // nullptr slots are reused
+  };
+
+  VkDevice device_;
+  VkPhysicalDeviceMemoryProperties props_ {};
+  VkDeviceSize granularity_;
+  VkDeviceSize block_size_;
+  u32 max_allocations_;
+  u32 num_allocations_ = 0;
+
+  // pools_[2 * memory_type + (linear ? 0 : 1)]
+  vec<Pool> pools_;
+
+  std::mutex mutex_;
+
+  static VkDeviceSize align_up(VkDeviceSize v, VkDeviceSize alignment) {
+    return (v + alignment - 1) & ~(alignment - 1);
+  }
+
+  bool host_visible(u32 memory_type) const {
+    return props_.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  }
+
+  VkDeviceSize block_size_for(u32 memory_type) const {
+    // don't grab a big chunk of a small heap (e.g. the 256MB host visible + device local heap)
+    VkDeviceSize heap_size = props_.memoryHeaps[props_.memoryTypes[memory_type].heapIndex].size;
+    return std::min(block_size_, align_up(heap_size / 8, 1024 * 1024));
+  }
+
+  ptr<Block> allocate_block(u32 memory_type, VkDeviceSize size, bool dedicated) {
+    if (num_allocations_ >= max_allocations_) {
+      throw std::runtime_error(fmt::format(
+        "maxMemoryAllocationCount ({}) reached!", max_allocations_));
+    }
+
+    VkMemoryAllocateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    info.allocationSize = size;
+    info.memoryTypeIndex = memory_type;
+
+    auto block = std::make_unique<Block>();
+    block->size = size;
+    block->dedicated = dedicated;
+    VK_CHECK(vkAllocateMemory(device_, &info, nullptr, &block->memory));
+    ++num_allocations_;
+
+    if (host_visible(memory_type)) {
+      VK_CHECK(vkMapMemory(device_, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped));
+    }
+
+    block->free[0] = size;
+
+    spdlog::debug(
+      "allocated {}memory block of {} KiB, type={}, total allocations={}",
+      dedicated ? "dedicated " : "", size / 1024, memory_type, num_allocations_
+    );
+
+    return block;
+  }
+
+  // puts the block into the first empty slot of the pool, returns the slot index
+  static u32 store(Pool &pool, ptr<Block> block) {
+    u32 i = 0;
+    while (i < pool.blocks.size() && pool.blocks[i] != nullptr) {
+      ++i;
+    }
+
+    if (i == pool.blocks.size()) {
+      pool.blocks.push_back(nullptr);
+    }
+
+    pool.blocks[i] = std::move(block);
+    return i;
+  }
+
+  // best-fit search over the free ranges of a block; returns false if nothing fits
+  static bool sub_allocate(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &out_offset) {
+    auto best = block.free.end();
+    VkDeviceSize best_offset = 0;
+
+    for (auto it = block.free.begin(); it != block.free.end(); ++it) {
+      auto [offset, range] = *it;
+      VkDeviceSize aligned = align_up(offset, alignment);
+      if (aligned + size > offset + range) {
+        continue;
+      }
+
+      if (best == block.free.end() || range < best->second) {
+        best = it;
+        best_offset = aligned;
+      }
+    }
+
+    if (best == block.free.end()) {
+      return false;
+    }
+
+    auto [offset, range] = *best;
+    block.free.erase(best);
+
+    // the padding introduced by the alignment stays free and can be used by
+    // allocations with looser alignment requirements
+    if (best_offset > offset) {
+      block.free[offset] = best_offset - offset;
+    }
+
+    VkDeviceSize end = best_offset + size;
+    if (end < offset + range) {
+      block.free[end] = offset + range - end;
+    }
+
+    block.used += size;
+    out_offset = best_offset;
+    return true;
+  }
+
+  static void release(Block &block, VkDeviceSize offset, VkDeviceSize size) {
+    block.used -= size;
+
+    auto it = block.free.emplace(offset, size).first;
+
+    // merge with the following range
+    auto next = std::next(it);
+    if (next != block.free.end() && it->first + it->second == next->first) {
+      it->second += next->second;
+      block.free.erase(next);
+    }
+
+    // merge with the preceding range
+    if (it != block.free.begin()) {
+      auto prev = std::prev(it);
+      if (prev->first + prev->second == it->first) {
+        prev->second += it->second;
+        block.free.erase(it);
+      }
+    }
+  }
+
+  void destroy_block(Block &block) {
+    if (block.mapped != nullptr) {
+      vkUnmapMemory(device_, block.memory);
+    }
+
+    vkFreeMemory(device_, block.memory, nullptr);
+    --num_allocations_;
+  }
+
+public:
+  static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+  MemoryAllocator(VkPhysicalDevice pdevice, VkDevice device, VkDeviceSize block_size = DEFAULT_BLOCK_SIZE)
+    : device_(device), block_size_(block_size) {
+    // has two arrays memoryTypes and memoryHeaps
+    // heaps are distinct memory resources like dedicated VRAM and swap space in RAM (for when VRAM runs out)
+    vkGetPhysicalDeviceMemoryProperties(pdevice, &props_);
+
+    VkPhysicalDeviceProperties props {};
+    vkGetPhysicalDeviceProperties(pdevice, &props);
+    granularity_ = props.limits.bufferImageGranularity;
+    max_allocations_ = props.limits.maxMemoryAllocationCount;
+
+    pools_.resize(2 * props_.memoryTypeCount);
+    for (u32 i = 0; i < props_.memoryTypeCount; ++i) {
+      pools_[2 * i].memory_type = i;
+      pools_[2 * i].linear = true;
+      pools_[2 * i + 1].memory_type = i;
+      pools_[2 * i + 1].linear = false;
+    }
+
+    spdlog::debug(
+      "memory allocator: {} memory types, {} heaps, bufferImageGranularity={}, maxMemoryAllocationCount={}",
+      props_.memoryTypeCount, props_.memoryHeapCount, granularity_, max_allocations_
+    );
+  }
+
+  MemoryAllocator(const MemoryAllocator &) = delete;
+  MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+
+  ~MemoryAllocator() {
+    for (auto &pool: pools_) {
+      for (auto &block: pool.blocks) {
+        if (block == nullptr) {
+          continue;
+        }
+
+        if (block->used != 0) {
+          spdlog::warn(
+            "memory block of type {} still has {} bytes in use on destruction",
+            pool.memory_type, block->used
+          );
+        }
+
+        destroy_block(*block);
+      }
+    }
+  }
+
+  const VkPhysicalDeviceMemoryProperties &properties() const { return props_; }
+
+  u32 find_memory_type(u32 type_filter, VkMemoryPropertyFlags properties) const {
+    for (u32 i = 0; i < props_.memoryTypeCount; ++i) {
+      if ((type_filter & (1 << i)) &&
+          (props_.memoryTypes[i].propertyFlags & properties) == properties) {
+        return i;
+      }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+  }
+
+  // linear == buffers and linearly tiled images, !linear == optimally tiled images
+  Allocation allocate(const VkMemoryRequirements &reqs, VkMemoryPropertyFlags properties, bool linear) {
+    std::lock_guard lock(mutex_);
+
+    u32 memory_type = find_memory_type(reqs.memoryTypeBits, properties);
+    u32 pool_index = 2 * memory_type + (linear ? 0 : 1);
+    auto &pool = pools_[pool_index];
+
+    Allocation alloc {};
+    alloc.pool = pool_index;
+    alloc.size = reqs.size;
+
+    VkDeviceSize block_size = block_size_for(memory_type);
+
+    if (reqs.size > block_size / 2) {
+      auto block = allocate_block(memory_type, reqs.size, true);
+      block->free.clear();
+      block->used = reqs.size;
+
+      alloc.memory = block->memory;
+      alloc.offset = 0;
+      alloc.mapped = block->mapped;
+      alloc.block = store(pool, std::move(block));
+      return alloc;
+    }
+
+    for (u32 i = 0; i < pool.blocks.size(); ++i) {
+      auto &block = pool.blocks[i];
+      if (block == nullptr || block->dedicated) {
+        continue;
+      }
+
+      if (sub_allocate(*block, reqs.size, reqs.alignment, alloc.offset)) {
+        alloc.memory = block->memory;
+        alloc.block = i;
+        alloc.mapped = block->mapped ? static_cast<char *>(block->mapped) + alloc.offset : nullptr;
+        return alloc;
+      }
+    }
+
+    // no room in any of the existing blocks
+    auto block = allocate_block(memory_type, block_size, false);
+    sub_allocate(*block, reqs.size, reqs.alignment, alloc.offset);
+
+    alloc.memory = block->memory;
+    alloc.mapped = block->mapped ? static_cast<char *>(block->mapped) + alloc.offset : nullptr;
+    alloc.block = store(pool, std::move(block));
+    return alloc;
+  }
+
+  void free(Allocation &alloc) {
+    if (!alloc) {
+      return;
+    }
+
+    std::lock_guard lock(mutex_);
+
+    auto &pool = pools_[alloc.pool];
+    auto &block = pool.blocks[alloc.block];
+
+    if (block->dedicated) {
+      destroy_block(*block);
+      block.reset();
+    } else {
+      release(*block, alloc.offset, alloc.size);
+
+      // keep the last empty block of a pool around so a free/allocate pattern doesn't thrash
+      // vkAllocateMemory
+      if (block->used == 0) {
+        u32 num_live = 0;
+        for (auto &b: pool.blocks) {
+          num_live += (b != nullptr && !b->dedicated) ? 1 : 0;
+        }
+
+        if (num_live > 1) {
+          destroy_block(*block);
+          block.reset();
+        }
+      }
+    }
+
+    alloc = Allocation {};
+  }
+
+  // for a copy that outlives where it came from, e.g. captured by a deferred destruction
+  void free(const Allocation &alloc) {
+    Allocation copy = alloc;
+    free(copy);
+  }
+
+  u32 num_allocations() const { return num_allocations_; }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_MEMORY_H
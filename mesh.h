@@ -0,0 +1,322 @@
+#ifndef VULKAN_TUT_MESH_H
+#define VULKAN_TUT_MESH_H
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+#include "common.h"
+#include "io.h"
+#include "vertex.h"
+
+namespace vk {
+
+struct MeshBounds {
+  glm::vec3 min {std::numeric_limits<float>::max()};
+  glm::vec3 max {std::numeric_limits<float>::lowest()};
+};
+
+// what the model file says about a material, texture is relative to the working directory.
+// empty: the model's default texture
+struct MeshMaterial {
+  str texture;
+  bool alpha_test = false;
+};
+
+// the indices [first_index, first_index + index_count) that are drawn with one material
+struct Submesh {
+  u32 first_index;
+  u32 index_count;
+  u32 material;  // into MeshData::materials()
+};
+
+// deduplicated vertices + indices of a model, either owned or a view into a mapped cache file.
+// in both cases vertices() and indices() can be copied straight into a staging buffer.
+//
+// the indices are grouped by material, one submesh per group. a model without materials has a
+// single submesh and a single material with the default texture
+class MeshData {
+  vec<Vertex> owned_vertices_;
+  vec<u32> owned_indices_;
+  ptr<MappedFile> file_;
+
+  std::span<const Vertex> vertices_;
+  std::span<const u32> indices_;
+  MeshBounds bounds_;
+
+  vec<Submesh> submeshes_;
+  vec<MeshMaterial> materials_;
+
+public:
+  MeshData() = default;
+
+  // without submeshes, all indices are one submesh
+  MeshData(vec<Vertex> vertices, vec<u32> indices, vec<Submesh> submeshes = {}, vec<MeshMaterial> materials = {})
+    : owned_vertices_(std::move(vertices)), owned_indices_(std::move(indices)),
+      submeshes_(std::move(submeshes)), materials_(std::move(materials)) {
+    vertices_ = owned_vertices_;
+    indices_ = owned_indices_;
+
+    for (const auto &v: vertices_) {
+      bounds_.min = glm::min(bounds_.min, v.pos);
+      bounds_.max = glm::max(bounds_.max, v.pos);
+    }
+
+    if (submeshes_.empty()) {
+      submeshes_.push_back({0, static_cast<u32>(indices_.size()), 0});
+    }
+    if (materials_.empty()) {
+      materials_.emplace_back();
+    }
+  }
+
+  MeshData(
+    ptr<MappedFile> file,
+    std::span<const Vertex> vertices,
+    std::span<const u32> indices,
+    MeshBounds bounds,
+    vec<Submesh> submeshes,
+    vec<MeshMaterial> materials
+  ) : file_(std::move(file)), vertices_(vertices), indices_(indices), bounds_(bounds),
+      submeshes_(std::move(submeshes)), materials_(std::move(materials)) {}
+
+  // moving a vector or a unique_ptr keeps the address of the data, the spans stay valid
+  MeshData(MeshData &&) = default;
+  MeshData &operator=(MeshData &&) = default;
+
+  std::span<const Vertex> vertices() const { return vertices_; }
+  std::span<const u32> indices() const { return indices_; }
+  const MeshBounds &bounds() const { return bounds_; }
+  const vec<Submesh> &submeshes() const { return submeshes_; }
+  const vec<MeshMaterial> &materials() const { return materials_; }
+
+  bool is_mapped() const { return file_ != nullptr; }
+};
+
+// binary cache of a parsed model, written next to the source file (<source>.meshcache).
+//
+// layout: Header | vertices | indices | submeshes | materials, native endianness. a material is
+// a u32 flags (bit 0: alpha test), the u32 length of its texture path and the path
+// the cache is only used if it was built by the same format version from a source file with
+// the same size and modification time, otherwise it is rebuilt.
+namespace mesh_cache {
+
+// bump whenever the layout of the file or of Vertex, or the way the data is produced, changes
+constexpr u32 VERSION = 4;
+
+struct Header {
+  char magic[4];
+  u32 version;
+  u32 vertex_size;
+  u32 index_size;
+  u64 source_hash;
+  u64 vertex_count;
+  u64 index_count;
+  u64 vertex_offset;
+  u64 index_offset;
+  float bounds_min[3];
+  float bounds_max[3];
+  u64 submesh_count;
+  u64 submesh_offset;
+  u64 material_count;
+  u64 material_offset;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(std::is_trivially_copyable_v<Vertex>);
+static_assert(std::is_trivially_copyable_v<Submesh>);
+
+constexpr char MAGIC[4] = {'V', 'T', 'M', 'C'};
+
+inline str path_for(const str &source_path) {
+  return source_path + ".meshcache";
+}
+
+inline u64 fnv1a(u64 h, const void *data, size_t size) {
+  auto p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ull;
+  }
+
+  return h;
+}
+
+// identifies the source file and everything that determines the cache contents. cheap: no need
+// to read the source file, which is the whole point of the cache
+inline u64 source_hash(const str &source_path) {
+  u64 size = std::filesystem::file_size(source_path);
+  auto mtime = std::filesystem::last_write_time(source_path).time_since_epoch().count();
+  u32 vertex_size = sizeof(Vertex);
+
+  u64 h = 0xcbf29ce484222325ull;
+  h = fnv1a(h, &size, sizeof(size));
+  h = fnv1a(h, &mtime, sizeof(mtime));
+  h = fnv1a(h, &VERSION, sizeof(VERSION));
+  h = fnv1a(h, &vertex_size, sizeof(vertex_size));
+  return h;
+}
+
+inline u64 align_up(u64 v, u64 alignment) {
+  return (v + alignment - 1) & ~(alignment - 1);
+}
+
+// returns nothing if there is no cache or it's stale/corrupt
+inline std::optional<MeshData> read(const str &source_path) {
+  const str path = path_for(source_path);
+  if (!std::filesystem::exists(path)) {
+    return std::nullopt;
+  }
+
+  auto file = std::make_unique<MappedFile>(path);
+  if (file->size() < sizeof(Header)) {
+    spdlog::warn("mesh cache {} is truncated, rebuilding", path);
+    return std::nullopt;
+  }
+
+  Header h;
+  memcpy(&h, file->data(), sizeof(h));
+
+  if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      h.version != VERSION ||
+      h.vertex_size != sizeof(Vertex) ||
+      h.index_size != sizeof(u32)) {
+    spdlog::info("mesh cache {} has a different format, rebuilding", path);
+    return std::nullopt;
+  }
+
+  if (h.source_hash != source_hash(source_path)) {
+    spdlog::info("mesh cache {} is out of date, rebuilding", path);
+    return std::nullopt;
+  }
+
+  // offsets first and then the sizes against what's left after them, a sum of the two could wrap
+  const u64 vertex_bytes = h.vertex_count * sizeof(Vertex);
+  const u64 index_bytes = h.index_count * sizeof(u32);
+  if (h.vertex_count > file->size() || h.index_count > file->size() ||
+      h.vertex_offset % alignof(Vertex) != 0 ||
+      h.index_offset % alignof(u32) != 0 ||
+      h.vertex_offset > file->size() || vertex_bytes > file->size() - h.vertex_offset ||
+      h.index_offset > file->size() || index_bytes > file->size() - h.index_offset) {
+    spdlog::warn("mesh cache {} is corrupt, rebuilding", path);
+    return std::nullopt;
+  }
+
+  if (h.submesh_count == 0 || h.submesh_count > file->size() ||
+      h.submesh_offset > file->size() || h.submesh_count * sizeof(Submesh) > file->size() - h.submesh_offset ||
+      h.material_count == 0 || h.material_offset > file->size()) {
+    spdlog::warn("mesh cache {} is corrupt, rebuilding", path);
+    return std::nullopt;
+  }
+
+  vec<Submesh> submeshes(h.submesh_count);
+  memcpy(submeshes.data(), file->data() + h.submesh_offset, h.submesh_count * sizeof(Submesh));
+  for (const auto &submesh: submeshes) {
+    if (submesh.material >= h.material_count || u64(submesh.first_index) + submesh.index_count > h.index_count) {
+      spdlog::warn("mesh cache {} is corrupt, rebuilding", path);
+      return std::nullopt;
+    }
+  }
+
+  vec<MeshMaterial> materials(h.material_count);
+  u64 pos = h.material_offset;
+  for (auto &material: materials) {
+    u32 fields[2];
+    if (pos + sizeof(fields) > file->size()) {
+      spdlog::warn("mesh cache {} is corrupt, rebuilding", path);
+      return std::nullopt;
+    }
+    memcpy(fields, file->data() + pos, sizeof(fields));
+    pos += sizeof(fields);
+
+    if (fields[1] > file->size() - pos) {
+      spdlog::warn("mesh cache {} is corrupt, rebuilding", path);
+      return std::nullopt;
+    }
+    material.alpha_test = (fields[0] & 1) != 0;
+    material.texture.assign(reinterpret_cast<const char *>(file->data() + pos), fields[1]);
+    pos += fields[1];
+  }
+
+  MeshBounds bounds;
+  bounds.min = {h.bounds_min[0], h.bounds_min[1], h.bounds_min[2]};
+  bounds.max = {h.bounds_max[0], h.bounds_max[1], h.bounds_max[2]};
+
+  std::span<const Vertex> vertices(file->at<Vertex>(h.vertex_offset), h.vertex_count);
+  std::span<const u32> indices(file->at<u32>(h.index_offset), h.index_count);
+
+  return MeshData(std::move(file), vertices, indices, bounds, std::move(submeshes), std::move(materials));
+}
+
+// failing to write the cache is not an error, the model is simply parsed again next time
+inline void write(const str &source_path, const MeshData &mesh) {
+  const str path = path_for(source_path);
+
+  Header h {};
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.vertex_size = sizeof(Vertex);
+  h.index_size = sizeof(u32);
+  h.source_hash = source_hash(source_path);
+  h.vertex_count = mesh.vertices().size();
+  h.index_count = mesh.indices().size();
+  h.vertex_offset = align_up(sizeof(Header), 16);
+  h.index_offset = align_up(h.vertex_offset + h.vertex_count * sizeof(Vertex), 16);
+  h.submesh_count = mesh.submeshes().size();
+  h.submesh_offset = h.index_offset + h.index_count * sizeof(u32);
+  h.material_count = mesh.materials().size();
+  h.material_offset = h.submesh_offset + h.submesh_count * sizeof(Submesh);
+  for (int i = 0; i < 3; ++i) {
+    h.bounds_min[i] = mesh.bounds().min[i];
+    h.bounds_max[i] = mesh.bounds().max[i];
+  }
+
+  // write to a temporary file and rename it, a reader never sees a half written cache
+  const str tmp_path = path + ".tmp";
+  {
+    std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) {
+      spdlog::warn("failed to create mesh cache {}", tmp_path);
+      return;
+    }
+
+    const char zeros[16] {};
+    f.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    f.write(zeros, static_cast<std::streamsize>(h.vertex_offset - sizeof(h)));
+    f.write(reinterpret_cast<const char *>(mesh.vertices().data()), h.vertex_count * sizeof(Vertex));
+    f.write(zeros, static_cast<std::streamsize>(h.index_offset - h.vertex_offset - h.vertex_count * sizeof(Vertex)));
+    f.write(reinterpret_cast<const char *>(mesh.indices().data()), h.index_count * sizeof(u32));
+    f.write(reinterpret_cast<const char *>(mesh.submeshes().data()), h.submesh_count * sizeof(Submesh));
+    for (const auto &material: mesh.materials()) {
+      const u32 fields[2] = {material.alpha_test ? 1u : 0u, static_cast<u32>(material.texture.size())};
+      f.write(reinterpret_cast<const char *>(fields), sizeof(fields));
+      f.write(material.texture.data(), static_cast<std::streamsize>(material.texture.size()));
+    }
+
+    if (!f) {
+      spdlog::warn("failed to write mesh cache {}", tmp_path);
+      return;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    spdlog::warn("failed to rename mesh cache {}: {}", tmp_path, ec.message());
+    return;
+  }
+
+  spdlog::info(
+    "wrote mesh cache {} ({} vertices, {} indices, {} submeshes)",
+    path, h.vertex_count, h.index_count, h.submesh_count
+  );
+}
+
+} // namespace mesh_cache
+
+} // namespace vk
+
+#endif //VULKAN_TUT_MESH_H
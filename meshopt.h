@@ -0,0 +1,373 @@
+#ifndef VULKAN_TUT_MESHOPT_H
+#define VULKAN_TUT_MESHOPT_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <span>
+
+#include "common.h"
+#include "vertex.h"
+
+// index buffer reordering passes, run once when a model is parsed (the result ends up in the
+// mesh cache). the order matters:
+// 1. optimize_vertex_cache: triangle order with good post-transform cache reuse
+// 2. optimize_overdraw: reorders clusters of that order front to back-ish, keeping most of the reuse
+// 3. optimize_vertex_fetch: renumbers the vertices in the order they are first used
+namespace vk {
+
+// average cache miss ratio: transformed vertices per triangle for a FIFO cache of the given size.
+// 3.0 is the worst case, ~0.5-0.7 is typical for a well optimized mesh, 0.5 is the limit for
+// large regular grids
+inline float acmr(std::span<const u32> indices, size_t num_vertices, u32 cache_size = 16) {
+  // no triangles, nothing to divide by
+  const size_t triangles = indices.size() / 3;
+  if (triangles == 0) {
+    return 0.0f;
+  }
+
+  // timestamp of the vertex when it entered the cache, a vertex is in the cache if it entered
+  // less than cache_size misses ago
+  vec<u64> entered(num_vertices, 0);
+  u64 misses = 0;
+
+  for (u32 i: indices) {
+    if (entered[i] == 0 || misses - entered[i] + 1 > cache_size) {
+      ++misses;
+      entered[i] = misses;
+    }
+  }
+
+  return float(misses) / float(triangles);
+}
+
+// Tom Forsyth's "linear-speed vertex cache optimisation": greedy triangle ordering where every
+// vertex is scored by its position in a simulated LRU cache and by how many triangles still use
+// it (so lone vertices are finished off quickly instead of being left behind)
+inline vec<u32> optimize_vertex_cache(std::span<const u32> indices, size_t num_vertices) {
+  constexpr int CACHE_SIZE = 32;
+  constexpr float CACHE_DECAY_POWER = 1.5f;
+  constexpr float LAST_TRI_SCORE = 0.75f;
+  constexpr float VALENCE_BOOST_SCALE = 2.0f;
+  constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+  const size_t num_triangles = indices.size() / 3;
+
+  auto vertex_score = [&](int cache_pos, u32 remaining) {
+    if (remaining == 0) {
+      return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_pos >= 0) {
+      if (cache_pos < 3) {
+        // the vertices of the last triangle are fixed to a score that stops the algorithm from
+        // preferring them too much, it would otherwise build long thin strips
+        score = LAST_TRI_SCORE;
+      } else {
+        const float scaler = 1.0f / (CACHE_SIZE - 3);
+        score = std::pow(1.0f - (cache_pos - 3) * scaler, CACHE_DECAY_POWER);
+      }
+    }
+
+    return score + VALENCE_BOOST_SCALE * std::pow(float(remaining), -VALENCE_BOOST_POWER);
+  };
+
+  // vertex -> triangles using it, as offsets into one flat array
+  vec<u32> remaining(num_vertices, 0);
+  for (u32 i: indices) {
+    ++remaining[i];
+  }
+
+  vec<u32> adjacency_offset(num_vertices + 1, 0);
+  for (size_t v = 0; v < num_vertices; ++v) {
+    adjacency_offset[v + 1] = adjacency_offset[v] + remaining[v];
+  }
+
+  vec<u32> adjacency(indices.size());
+  {
+    vec<u32> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+    for (size_t t = 0; t < num_triangles; ++t) {
+      for (int k = 0; k < 3; ++k) {
+        adjacency[fill[indices[3 * t + k]]++] = static_cast<u32>(t);
+      }
+    }
+  }
+
+  vec<int> cache_pos(num_vertices, -1);
+  vec<float> score(num_vertices);
+  for (size_t v = 0; v < num_vertices; ++v) {
+    score[v] = vertex_score(-1, remaining[v]);
+  }
+
+  vec<bool> emitted(num_triangles, false);
+  vec<float> triangle_score(num_triangles);
+  for (size_t t = 0; t < num_triangles; ++t) {
+    triangle_score[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+  }
+
+  // the triangles of a vertex that still have to be emitted are kept at the front of its range
+  auto remove_triangle = [&](u32 v, u32 t) {
+    u32 begin = adjacency_offset[v];
+    u32 end = begin + remaining[v];
+    for (u32 i = begin; i < end; ++i) {
+      if (adjacency[i] == t) {
+        std::swap(adjacency[i], adjacency[end - 1]);
+        break;
+      }
+    }
+    --remaining[v];
+  };
+
+  vec<u32> result;
+  result.reserve(indices.size());
+
+  // + 3: the vertices of the new triangle are pushed to the front before the tail is dropped
+  std::array<u32, CACHE_SIZE + 3> cache {};
+  int cache_count = 0;
+
+  // used to find a new starting triangle when the cache has no candidates left, it only ever
+  // moves forward so the fallback scans are linear in total
+  size_t cursor = 0;
+
+  auto best_new_triangle = [&]() -> int64_t {
+    while (cursor < num_triangles && emitted[cursor]) {
+      ++cursor;
+    }
+    return cursor < num_triangles ? int64_t(cursor) : -1;
+  };
+
+  int64_t best = -1;
+  {
+    float best_score = -1.0f;
+    for (size_t t = 0; t < num_triangles; ++t) {
+      if (triangle_score[t] > best_score) {
+        best_score = triangle_score[t];
+        best = int64_t(t);
+      }
+    }
+  }
+
+  for (size_t n = 0; n < num_triangles; ++n) {
+    if (best < 0) {
+      best = best_new_triangle();
+    }
+
+    const u32 t = static_cast<u32>(best);
+    emitted[t] = true;
+
+    const u32 tri[3] = {indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]};
+    for (u32 v: tri) {
+      result.push_back(v);
+      remove_triangle(v, t);
+    }
+
+    // move the triangle's vertices to the front of the cache, everything else shifts back
+    std::array<u32, CACHE_SIZE + 3> next {};
+    int next_count = 0;
+    for (u32 v: tri) {
+      next[next_count++] = v;
+    }
+    for (int i = 0; i < cache_count; ++i) {
+      u32 v = cache[i];
+      if (v != tri[0] && v != tri[1] && v != tri[2]) {
+        next[next_count++] = v;
+      }
+    }
+
+    // anything that fell out of the cache has lost its position bonus
+    for (int i = CACHE_SIZE; i < next_count; ++i) {
+      cache_pos[next[i]] = -1;
+      score[next[i]] = vertex_score(-1, remaining[next[i]]);
+    }
+
+    cache_count = std::min(next_count, CACHE_SIZE);
+    cache = next;
+
+    for (int i = 0; i < cache_count; ++i) {
+      cache_pos[cache[i]] = i;
+      score[cache[i]] = vertex_score(i, remaining[cache[i]]);
+    }
+
+    // only the triangles of cached vertices changed their score, the best one among them is next
+    best = -1;
+    float best_score = -1.0f;
+    for (int i = 0; i < cache_count; ++i) {
+      u32 v = cache[i];
+      u32 begin = adjacency_offset[v];
+      for (u32 j = begin; j < begin + remaining[v]; ++j) {
+        u32 other = adjacency[j];
+        float s = score[indices[3 * other]] + score[indices[3 * other + 1]] + score[indices[3 * other + 2]];
+        triangle_score[other] = s;
+        if (s > best_score) {
+          best_score = s;
+          best = int64_t(other);
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+// Tipsify-style overdraw optimization (Sander, Nehab, Barczak 2007) on top of a cache optimized
+// order: the index buffer is split into clusters wherever the simulated cache starts from
+// scratch (all three vertices of a triangle miss), so reordering whole clusters barely changes
+// the cache hit rate. clusters are then sorted by how likely they are to occlude the rest of the
+// mesh: facing away from the mesh center and being far out means it's drawn first
+inline vec<u32> optimize_overdraw(std::span<const u32> indices, std::span<const Vertex> vertices, u32 cache_size = 16) {
+  const size_t num_triangles = indices.size() / 3;
+  if (num_triangles == 0) {
+    return vec<u32>(indices.begin(), indices.end());
+  }
+
+  // cluster boundaries
+  vec<u32> cluster_start;
+  {
+    vec<u64> entered(vertices.size(), 0);
+    u64 misses = 0;
+
+    for (size_t t = 0; t < num_triangles; ++t) {
+      int triangle_misses = 0;
+      for (int k = 0; k < 3; ++k) {
+        u32 i = indices[3 * t + k];
+        if (entered[i] == 0 || misses - entered[i] + 1 > cache_size) {
+          ++misses;
+          entered[i] = misses;
+          ++triangle_misses;
+        }
+      }
+
+      if (t == 0 || triangle_misses == 3) {
+        cluster_start.push_back(static_cast<u32>(t));
+      }
+    }
+  }
+
+  glm::vec3 mesh_center {0.0f};
+  float mesh_area = 0.0f;
+
+  struct Cluster {
+    u32 begin;
+    u32 end;
+    glm::vec3 center {0.0f};
+    glm::vec3 normal {0.0f};
+    float area = 0.0f;
+    float sort_key = 0.0f;
+  };
+
+  vec<Cluster> clusters;
+  clusters.reserve(cluster_start.size());
+  for (size_t c = 0; c < cluster_start.size(); ++c) {
+    Cluster cl {};
+    cl.begin = cluster_start[c];
+    cl.end = c + 1 < cluster_start.size() ? cluster_start[c + 1] : static_cast<u32>(num_triangles);
+
+    for (u32 t = cl.begin; t < cl.end; ++t) {
+      const glm::vec3 &a = vertices[indices[3 * t]].pos;
+      const glm::vec3 &b = vertices[indices[3 * t + 1]].pos;
+      const glm::vec3 &c2 = vertices[indices[3 * t + 2]].pos;
+
+      // length of the cross product == 2 * triangle area, so this is an area weighted normal
+      glm::vec3 n = glm::cross(b - a, c2 - a);
+      float area = glm::length(n);
+
+      cl.center += (a + b + c2) * (area / 3.0f);
+      cl.normal += n;
+      cl.area += area;
+    }
+
+    mesh_center += cl.center;
+    mesh_area += cl.area;
+
+    if (cl.area > 0.0f) {
+      cl.center /= cl.area;
+    }
+
+    float normal_length = glm::length(cl.normal);
+    if (normal_length > 0.0f) {
+      cl.normal /= normal_length;
+    }
+
+    clusters.push_back(cl);
+  }
+
+  if (mesh_area > 0.0f) {
+    mesh_center /= mesh_area;
+  }
+
+  for (auto &cl: clusters) {
+    cl.sort_key = glm::dot(cl.center - mesh_center, cl.normal);
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+    return a.sort_key > b.sort_key;
+  });
+
+  vec<u32> result;
+  result.reserve(indices.size());
+  for (const auto &cl: clusters) {
+    result.insert(result.end(), indices.begin() + 3 * cl.begin, indices.begin() + 3 * cl.end);
+  }
+
+  return result;
+}
+
+// renumbers the vertices in the order the index buffer first references them, so the vertex
+// fetches walk through memory mostly sequentially. unreferenced vertices are dropped
+inline void optimize_vertex_fetch(vec<Vertex> &vertices, vec<u32> &indices) {
+  constexpr u32 UNUSED = std::numeric_limits<u32>::max();
+
+  vec<u32> remap(vertices.size(), UNUSED);
+  vec<Vertex> reordered;
+  reordered.reserve(vertices.size());
+
+  for (u32 &i: indices) {
+    if (remap[i] == UNUSED) {
+      remap[i] = static_cast<u32>(reordered.size());
+      reordered.push_back(vertices[i]);
+    }
+    i = remap[i];
+  }
+
+  vertices = std::move(reordered);
+}
+
+// a part of the index buffer whose triangles have to stay together, e.g. everything of one
+// material, which is drawn on its own
+struct IndexRange {
+  u32 first;
+  u32 count;
+};
+
+// all of the above, logs the cache miss ratio before and after. the triangle order is optimized
+// within each of ranges (which have to cover the index buffer), the vertices for all of them
+inline void optimize_mesh(vec<Vertex> &vertices, vec<u32> &indices, std::span<const IndexRange> ranges) {
+  const float acmr_before = acmr(indices, vertices.size());
+
+  for (const auto &range: ranges) {
+    std::span<u32> part(indices.data() + range.first, range.count);
+    vec<u32> optimized = optimize_vertex_cache(part, vertices.size());
+    optimized = optimize_overdraw(optimized, vertices);
+    std::copy(optimized.begin(), optimized.end(), part.begin());
+  }
+  const float acmr_cache = acmr(indices, vertices.size());
+
+  optimize_vertex_fetch(vertices, indices);
+  const float acmr_after = acmr(indices, vertices.size());
+
+  spdlog::info(
+    "mesh optimization: {} triangles in {} ranges, ACMR {:.3f} -> {:.3f} (vertex cache + overdraw) -> {:.3f} (fetch)",
+    indices.size() / 3, ranges.size(), acmr_before, acmr_cache, acmr_after
+  );
+}
+
+inline void optimize_mesh(vec<Vertex> &vertices, vec<u32> &indices) {
+  const IndexRange all {0, static_cast<u32>(indices.size())};
+  optimize_mesh(vertices, indices, std::span(&all, 1));
+}
+
+} // namespace vk
+
+#endif //VULKAN_TUT_MESHOPT_H
@@ -0,0 +1,409 @@
+#ifndef VULKAN_TUT_MIPGEN_H
+#define VULKAN_TUT_MIPGEN_H
+
+#include <algorithm>
+#include <array>
+#include <span>
+
+#include "common.h"
+#include "device.h"
+#include "memory.h"
+#include "upload.h"
+
+namespace vk {
+
+// generates the mip chains of textures with shaders/mipgen.comp, in the graphics command
+// buffer of the upload batch that copied their first level.
+//
+// add() only queues the image. when the batch is flushed all queued images are transitioned
+// with one barrier, downsampled by dispatches that are recorded back to back (the images are
+// independent, so nothing has to wait in between) and transitioned for sampling with another
+// barrier. one dispatch writes up to 12 levels (see the shader), larger images take a chain of
+// dispatches with a barrier in between.
+//
+// the images are written through R8G8B8A8_UNORM storage views, so they have to be created with
+// storage_usage() and storage_flags(). the shader indexes an array of storage images, which
+// needs shaderStorageImageArrayDynamicIndexing
+class MipGenerator {
+public:
+  static constexpr u32 MAX_VIEWS = 13;
+  static constexpr u32 MAX_LEVELS_PER_DISPATCH = MAX_VIEWS - 1;
+  static constexpr u32 MAX_DISPATCHES = 256;
+
+  // matches the push constants of shaders/mipgen.comp
+  struct PushConstants {
+    u32 extent[2];
+    u32 levels;
+    u32 srgb;
+    u32 counter;
+  };
+
+private:
+  struct Pending {
+    VkImage image;
+    VkFormat format;
+    u32 width;
+    u32 height;
+    u32 levels;
+  };
+
+  struct Dispatch {
+    u32 pending;  // index into pending_
+    u32 base;
+    u32 levels;
+  };
+
+  VkDevice device_;
+  const DeviceFns &fns_;
+  MemoryAllocator &allocator_;
+  UploadQueue &uploads_;
+
+  VkDescriptorSetLayout set_layout_ = VK_NULL_HANDLE;
+  VkPipelineLayout layout_ = VK_NULL_HANDLE;
+  VkPipeline pipeline_ = VK_NULL_HANDLE;
+
+  // one atomic counter per dispatch of a flush, zeroed at the start of every flush
+  VkBuffer counters_ = VK_NULL_HANDLE;
+  Allocation counters_memory_;
+
+  vec<Pending> pending_;
+
+  static bool is_rgba8(VkFormat format) {
+    return format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+  }
+
+  VkImageView create_view(VkImage image, u32 level) {
+    VkImageViewCreateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    info.image = image;
+    info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    info.subresourceRange.baseMipLevel = level;
+    info.subresourceRange.levelCount = 1;
+    info.subresourceRange.baseArrayLayer = 0;
+    info.subresourceRange.layerCount = 1;
+
+    VkImageView view;
+    VK_CHECK(vkCreateImageView(device_, &info, nullptr, &view));
+    return view;
+  }
+
+  // the level of the dispatch after base has to be at most 64x64 if a second phase runs, so
+  // dispatches on anything larger than 4096 only do the first phase
+  static vec<Dispatch> split(u32 pending, const Pending &p) {
+    vec<Dispatch> dispatches;
+    for (u32 base = 0; base + 1 < p.levels;) {
+      const u32 extent = std::max(std::max(1u, p.width >> base), std::max(1u, p.height >> base));
+      const u32 max_levels = extent > 4096 ? 6 : MAX_LEVELS_PER_DISPATCH;
+      const u32 levels = std::min(max_levels, p.levels - 1 - base);
+      dispatches.push_back({pending, base, levels});
+      base += levels;
+    }
+    return dispatches;
+  }
+
+  void barrier(VkCommandBuffer cmd, const vec<VkImageMemoryBarrier> &images, VkPipelineStageFlags src, VkPipelineStageFlags dst) {
+    fns_.vkCmdPipelineBarrier(cmd, src, dst, 0, 0, nullptr, 0, nullptr, (u32) images.size(), images.data());
+  }
+
+  VkImageMemoryBarrier image_barrier(const Pending &p, VkImageLayout from, VkImageLayout to, VkAccessFlags src, VkAccessFlags dst) {
+    VkImageMemoryBarrier b {};
+    b.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    b.srcAccessMask = src;
+    b.dstAccessMask = dst;
+    b.oldLayout = from;
+    b.newLayout = to;
+    b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.image = p.image;
+    b.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, p.levels, 0, 1};
+    return b;
+  }
+
+  void reset_counters(VkCommandBuffer cmd) {
+    VkBufferMemoryBarrier b {};
+    b.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.buffer = counters_;
+    b.offset = 0;
+    b.size = VK_WHOLE_SIZE;
+
+    // after the dispatches of the previous flush, which may still run
+    b.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    b.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    fns_.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &b, 0, nullptr);
+
+    fns_.vkCmdFillBuffer(cmd, counters_, 0, VK_WHOLE_SIZE, 0);
+
+    b.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    b.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    fns_.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &b, 0, nullptr);
+  }
+
+  // records everything added since the last flush, called by the upload queue
+  void record(VkCommandBuffer cmd) {
+    if (pending_.empty()) {
+      return;
+    }
+
+    vec<Dispatch> dispatches;
+    for (u32 i = 0; i < pending_.size(); ++i) {
+      auto d = split(i, pending_[i]);
+      dispatches.insert(dispatches.end(), d.begin(), d.end());
+    }
+
+    if (dispatches.size() > MAX_DISPATCHES) {
+      throw std::runtime_error(fmt::format(
+        "{} mip dispatches in one upload batch, at most {} are supported", dispatches.size(), MAX_DISPATCHES));
+    }
+
+    // ********************************************************************************
+    // descriptors: one set per dispatch, the views of its levels
+    // ********************************************************************************
+    std::array<VkDescriptorPoolSize, 2> pool_sizes {{
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_VIEWS * (u32) dispatches.size()},
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, (u32) dispatches.size()},
+    }};
+
+    VkDescriptorPoolCreateInfo pool_info {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = (u32) dispatches.size();
+    pool_info.poolSizeCount = (u32) pool_sizes.size();
+    pool_info.pPoolSizes = pool_sizes.data();
+
+    VkDescriptorPool pool;
+    VK_CHECK(vkCreateDescriptorPool(device_, &pool_info, nullptr, &pool));
+
+    vec<VkDescriptorSetLayout> layouts(dispatches.size(), set_layout_);
+    vec<VkDescriptorSet> sets(dispatches.size());
+    VkDescriptorSetAllocateInfo alloc_info {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = pool;
+    alloc_info.descriptorSetCount = (u32) sets.size();
+    alloc_info.pSetLayouts = layouts.data();
+    VK_CHECK(vkAllocateDescriptorSets(device_, &alloc_info, sets.data()));
+
+    vec<VkImageView> views;
+    const VkDescriptorBufferInfo counters_info {counters_, 0, VK_WHOLE_SIZE};
+    for (u32 i = 0; i < dispatches.size(); ++i) {
+      const Dispatch &d = dispatches[i];
+
+      std::array<VkDescriptorImageInfo, MAX_VIEWS> image_infos {};
+      for (u32 level = 0; level <= d.levels; ++level) {
+        views.push_back(create_view(pending_[d.pending].image, d.base + level));
+        image_infos[level] = {VK_NULL_HANDLE, views.back(), VK_IMAGE_LAYOUT_GENERAL};
+      }
+      for (u32 level = d.levels + 1; level < MAX_VIEWS; ++level) {
+        image_infos[level] = image_infos[d.levels];
+      }
+
+      std::array<VkWriteDescriptorSet, 2> writes {};
+      writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[0].dstSet = sets[i];
+      writes[0].dstBinding = 0;
+      writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      writes[0].descriptorCount = MAX_VIEWS;
+      writes[0].pImageInfo = image_infos.data();
+
+      writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[1].dstSet = sets[i];
+      writes[1].dstBinding = 1;
+      writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[1].descriptorCount = 1;
+      writes[1].pBufferInfo = &counters_info;
+
+      vkUpdateDescriptorSets(device_, (u32) writes.size(), writes.data(), 0, nullptr);
+    }
+
+    // ********************************************************************************
+    // commands
+    // ********************************************************************************
+    reset_counters(cmd);
+
+    // the copy of level 0 is done, the other levels are only written by the shader
+    vec<VkImageMemoryBarrier> images;
+    for (const auto &p: pending_) {
+      images.push_back(image_barrier(
+        p, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+      ));
+    }
+    barrier(cmd, images, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    fns_.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+
+    // all images at the same position in their dispatch chain go in one round, the rounds are
+    // separated by a barrier: the next dispatch reads the last level of the one before
+    for (u32 round = 0, recorded = 0; recorded < dispatches.size(); ++round) {
+      if (round > 0) {
+        VkMemoryBarrier b {};
+        b.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        b.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        b.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        fns_.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &b, 0, nullptr, 0, nullptr);
+      }
+
+      u32 position = 0;
+      for (u32 i = 0; i < dispatches.size(); ++i) {
+        // position of the dispatch in the chain of its image
+        position = (i > 0 && dispatches[i].pending == dispatches[i - 1].pending) ? position + 1 : 0;
+        if (position != round) {
+          continue;
+        }
+
+        const Dispatch &d = dispatches[i];
+        const Pending &p = pending_[d.pending];
+
+        PushConstants constants {};
+        constants.extent[0] = std::max(1u, p.width >> d.base);
+        constants.extent[1] = std::max(1u, p.height >> d.base);
+        constants.levels = d.levels;
+        constants.srgb = p.format == VK_FORMAT_R8G8B8A8_SRGB ? 1 : 0;
+        constants.counter = i;
+
+        fns_.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout_, 0, 1, &sets[i], 0, nullptr);
+        fns_.vkCmdPushConstants(cmd, layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        fns_.vkCmdDispatch(cmd, (constants.extent[0] + 63) / 64, (constants.extent[1] + 63) / 64, 1);
+        ++recorded;
+      }
+    }
+
+    images.clear();
+    for (const auto &p: pending_) {
+      images.push_back(image_barrier(
+        p, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT
+      ));
+    }
+    barrier(cmd, images, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+    spdlog::debug("recorded mip generation of {} images in {} dispatches", pending_.size(), dispatches.size());
+    pending_.clear();
+
+    VkDevice device = device_;
+    uploads_.release_after_batch([device, pool, views = std::move(views)] {
+      for (auto view: views) {
+        vkDestroyImageView(device, view, nullptr);
+      }
+      vkDestroyDescriptorPool(device, pool, nullptr);
+    });
+  }
+
+public:
+  // the formats the shader can write, anything else needs blits
+  static bool supports(VkPhysicalDevice physical_device, VkFormat format) {
+    if (!is_rgba8(format)) {
+      return false;
+    }
+
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(physical_device, VK_FORMAT_R8G8B8A8_UNORM, &props);
+    return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+  }
+
+  // what the images need on top of their own usage and create flags. the views are UNORM, the
+  // image itself usually isn't, and an sRGB format can't be a storage image itself
+  static constexpr VkImageUsageFlags storage_usage() { return VK_IMAGE_USAGE_STORAGE_BIT; }
+  static constexpr VkImageCreateFlags storage_flags() {
+    return VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+  }
+
+  MipGenerator(
+    VkDevice device,
+    const DeviceFns &fns,
+    MemoryAllocator &allocator,
+    UploadQueue &uploads,
+    VkPipelineCache cache,
+    std::span<const std::byte> shader_code
+  ) : device_(device), fns_(fns), allocator_(allocator), uploads_(uploads) {
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[0].descriptorCount = MAX_VIEWS;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info {};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.bindingCount = (u32) bindings.size();
+    set_layout_info.pBindings = bindings.data();
+    VK_CHECK(vkCreateDescriptorSetLayout(device_, &set_layout_info, nullptr, &set_layout_));
+
+    VkPushConstantRange push_range {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants)};
+    VkPipelineLayoutCreateInfo layout_info {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout_;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_range;
+    VK_CHECK(vkCreatePipelineLayout(device_, &layout_info, nullptr, &layout_));
+
+    VkShaderModuleCreateInfo module_info {};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shader_code.size();
+    module_info.pCode = reinterpret_cast<const u32 *>(shader_code.data());
+    VkShaderModule module;
+    VK_CHECK(vkCreateShaderModule(device_, &module_info, nullptr, &module));
+
+    VkComputePipelineCreateInfo pipeline_info {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = layout_;
+    VkResult res = vkCreateComputePipelines(device_, cache, 1, &pipeline_info, nullptr, &pipeline_);
+    vkDestroyShaderModule(device_, module, nullptr);
+    VK_CHECK(res);
+
+    VkBufferCreateInfo buffer_info {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = MAX_DISPATCHES * sizeof(u32);
+    buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device_, &buffer_info, nullptr, &counters_));
+
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements(device_, counters_, &reqs);
+    counters_memory_ = allocator_.allocate(reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+    VK_CHECK(vkBindBufferMemory(device_, counters_, counters_memory_.memory, counters_memory_.offset));
+
+    uploads_.on_flush([this](VkCommandBuffer cmd) { record(cmd); });
+  }
+
+  MipGenerator(const MipGenerator &) = delete;
+  MipGenerator &operator=(const MipGenerator &) = delete;
+
+  ~MipGenerator() {
+    uploads_.on_flush(nullptr);
+
+    vkDestroyBuffer(device_, counters_, nullptr);
+    allocator_.free(counters_memory_);
+    vkDestroyPipeline(device_, pipeline_, nullptr);
+    vkDestroyPipelineLayout(device_, layout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, set_layout_, nullptr);
+  }
+
+  // all levels in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL and owned by the graphics family, at least
+  // level 0 written in the current upload batch. the image is in
+  // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL once the batch is done
+  void add(VkImage image, VkFormat format, u32 width, u32 height, u32 levels) {
+    if (!is_rgba8(format)) {
+      throw std::invalid_argument(fmt::format("can't generate mips of format {}", string_VkFormat(format)));
+    }
+    if (levels < 2) {
+      throw std::invalid_argument("an image with a single level has no mips to generate");
+    }
+
+    pending_.push_back({image, format, width, height, levels});
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_MIPGEN_H
@@ -0,0 +1,201 @@
+#ifndef VULKAN_TUT_PIPELINE_CACHE_H
+#define VULKAN_TUT_PIPELINE_CACHE_H
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <type_traits>
+
+#include "common.h"
+#include "io.h"
+
+namespace vk {
+
+// a VkPipelineCache that is loaded from a file when it's created and written back by save().
+//
+// file layout: Header | the data from vkGetPipelineCacheData.
+// the driver validates its own data too, but a cache from a different driver version is
+// accepted by some drivers and then silently ignored (or worse), so the file is only used if
+// vendor, device, driver version and pipeline cache UUID all match the device
+class PipelineCache {
+  struct Header {
+    char magic[4];
+    u32 version;
+    u32 vendor_id;
+    u32 device_id;
+    u32 driver_version;
+    u8 uuid[VK_UUID_SIZE];
+    u64 data_size;
+    u64 data_hash;
+  };
+
+  static_assert(std::is_trivially_copyable_v<Header>);
+
+  static constexpr char MAGIC[4] = {'V', 'T', 'P', 'C'};
+  static constexpr u32 VERSION = 1;
+
+  VkDevice device_;
+  VkPhysicalDeviceProperties props_;
+  str path_;
+  VkPipelineCache cache_ = VK_NULL_HANDLE;
+  size_t loaded_size_ = 0;
+
+  static u64 fnv1a(const void *data, size_t size) {
+    auto p = static_cast<const unsigned char *>(data);
+    u64 h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+      h ^= p[i];
+      h *= 0x100000001b3ull;
+    }
+    return h;
+  }
+
+  Header header_for(const vec<char> &data) const {
+    Header h {};
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.vendor_id = props_.vendorID;
+    h.device_id = props_.deviceID;
+    h.driver_version = props_.driverVersion;
+    memcpy(h.uuid, props_.pipelineCacheUUID, VK_UUID_SIZE);
+    h.data_size = data.size();
+    h.data_hash = fnv1a(data.data(), data.size());
+    return h;
+  }
+
+  // the cache data of the file, empty if there is none or it doesn't belong to this device. the
+  // data points into file, the driver copies what it needs when the cache is created
+  std::span<const std::byte> load(ptr<MappedFile> &file) const {
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path_, ec)) {
+      spdlog::info("no pipeline cache at {}, pipelines are compiled from scratch", path_);
+      return {};
+    }
+
+    try {
+      file = std::make_unique<MappedFile>(path_);
+    } catch (const std::exception &e) {
+      spdlog::warn("{}, pipelines are compiled from scratch", e.what());
+      return {};
+    }
+
+    const size_t file_size = file->size();
+    if (file_size < sizeof(Header)) {
+      spdlog::warn("pipeline cache {} is truncated, ignoring it", path_);
+      return {};
+    }
+
+    Header h;
+    memcpy(&h, file->data(), sizeof(h));
+
+    if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION) {
+      spdlog::warn("pipeline cache {} has a different format, ignoring it", path_);
+      return {};
+    }
+
+    if (h.vendor_id != props_.vendorID ||
+        h.device_id != props_.deviceID ||
+        h.driver_version != props_.driverVersion ||
+        memcmp(h.uuid, props_.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+      spdlog::info("pipeline cache {} was written by a different device or driver, ignoring it", path_);
+      return {};
+    }
+
+    if (h.data_size != file_size - sizeof(Header)) {
+      spdlog::warn("pipeline cache {} is corrupt, ignoring it", path_);
+      return {};
+    }
+
+    std::span<const std::byte> data = file->bytes().subspan(sizeof(Header));
+    if (fnv1a(data.data(), data.size()) != h.data_hash) {
+      spdlog::warn("pipeline cache {} is corrupt, ignoring it", path_);
+      return {};
+    }
+
+    return data;
+  }
+
+public:
+  PipelineCache(VkDevice device, VkPhysicalDevice physical_device, str path)
+    : device_(device), path_(std::move(path)) {
+    vkGetPhysicalDeviceProperties(physical_device, &props_);
+
+    ptr<MappedFile> file;
+    std::span<const std::byte> data = load(file);
+
+    VkPipelineCacheCreateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.initialDataSize = data.size();
+    info.pInitialData = data.empty() ? nullptr : data.data();
+
+    VkResult res = vkCreatePipelineCache(device_, &info, nullptr, &cache_);
+    if (res != VK_SUCCESS && !data.empty()) {
+      // the driver rejected the data after all, start over with an empty cache
+      spdlog::warn("failed to create pipeline cache from {} (err={}), starting with an empty one", path_, static_cast<int>(res));
+      info.initialDataSize = 0;
+      info.pInitialData = nullptr;
+      res = vkCreatePipelineCache(device_, &info, nullptr, &cache_);
+      data = {};
+    }
+    VK_CHECK(res);
+
+    loaded_size_ = data.size();
+    if (loaded_size_ > 0) {
+      spdlog::info("loaded pipeline cache {} ({} bytes)", path_, loaded_size_);
+    }
+  }
+
+  PipelineCache(const PipelineCache &) = delete;
+  PipelineCache &operator=(const PipelineCache &) = delete;
+
+  ~PipelineCache() {
+    vkDestroyPipelineCache(device_, cache_, nullptr);
+  }
+
+  VkPipelineCache handle() const { return cache_; }
+
+  // false: every pipeline is a cold compile
+  bool warm() const { return loaded_size_ > 0; }
+
+  // failing to write the cache is not an error, the pipelines are just compiled again next time
+  void save() const {
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(device_, cache_, &size, nullptr));
+    vec<char> data(size);
+    VK_CHECK(vkGetPipelineCacheData(device_, cache_, &size, data.data()));
+    data.resize(size);
+
+    const Header h = header_for(data);
+
+    // write to a temporary file and rename it, a half written cache is never loaded
+    const str tmp_path = path_ + ".tmp";
+    {
+      std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+      if (!f.is_open()) {
+        spdlog::warn("failed to create pipeline cache {}", tmp_path);
+        return;
+      }
+
+      f.write(reinterpret_cast<const char *>(&h), sizeof(h));
+      f.write(data.data(), static_cast<std::streamsize>(data.size()));
+      if (!f) {
+        spdlog::warn("failed to write pipeline cache {}", tmp_path);
+        return;
+      }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path_, ec);
+    if (ec) {
+      spdlog::warn("failed to rename pipeline cache {}: {}", tmp_path, ec.message());
+      return;
+    }
+
+    spdlog::info("wrote pipeline cache {} ({} bytes)", path_, data.size());
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_PIPELINE_CACHE_H
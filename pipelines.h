@@ -0,0 +1,243 @@
+#ifndef VULKAN_TUT_PIPELINES_H
+#define VULKAN_TUT_PIPELINES_H
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "common.h"
+#include "jobs.h"
+
+namespace vk {
+
+// what a graphics pipeline variant differs in, everything else is the same for all of them.
+// the fragment shader part ends up in specialization constants, see FragmentSpecialization
+struct PipelineKey {
+  // has to match the render pass the pipeline is used with
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+  // 0: texture, 1: vertex color, 2: texture coordinates
+  u32 debug_output = 0;
+
+  // discard fragments with a texture alpha below alpha_cutoff
+  bool alpha_test = false;
+  float alpha_cutoff = 0.5f;
+
+  bool operator==(const PipelineKey &) const = default;
+
+  u64 hash() const {
+    // fields one by one, the padding of the struct is indeterminate
+    u64 h = 0xcbf29ce484222325ull;
+    auto mix = [&h](u64 v) {
+      h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    };
+
+    mix(static_cast<u64>(samples));
+    mix(debug_output);
+    mix(alpha_test ? 1 : 0);
+    mix(std::bit_cast<u32>(alpha_cutoff));
+    return h;
+  }
+
+  str describe() const {
+    return fmt::format(
+      "{}x msaa, debug output {}, alpha test {}",
+      static_cast<u32>(samples), debug_output, alpha_test ? fmt::format("< {}", alpha_cutoff) : "off"
+    );
+  }
+};
+
+struct PipelineKeyHash {
+  size_t operator()(const PipelineKey &key) const { return static_cast<size_t>(key.hash()); }
+};
+
+// the constant_id's of shaders/shader.frag
+struct FragmentSpecialization {
+  u32 debug_output;
+  VkBool32 alpha_test;
+  float alpha_cutoff;
+
+  explicit FragmentSpecialization(const PipelineKey &key)
+    : debug_output(key.debug_output), alpha_test(key.alpha_test ? VK_TRUE : VK_FALSE), alpha_cutoff(key.alpha_cutoff) {}
+
+  static std::array<VkSpecializationMapEntry, 3> map_entries() {
+    return {{
+      {0, offsetof(FragmentSpecialization, debug_output), sizeof(u32)},
+      {1, offsetof(FragmentSpecialization, alpha_test), sizeof(VkBool32)},
+      {2, offsetof(FragmentSpecialization, alpha_cutoff), sizeof(float)},
+    }};
+  }
+};
+
+// every graphics pipeline variant, created exactly once and on demand.
+//
+// find() never blocks: a variant that doesn't exist yet is compiled by a job on the thread pool
+// and the caller draws with a fallback until it's there. get() is for the variants that have
+// to exist before the first frame, it blocks (and compiles on the calling thread if needed).
+//
+// the build function runs on worker threads, so it may only read state that doesn't change
+// while pipelines exist (render pass, layout, shader modules). vkCreateGraphicsPipelines itself
+// is fine to call concurrently, also with the same pipeline cache
+class PipelineRegistry {
+public:
+  using BuildFn = std::function<VkPipeline(const PipelineKey &key)>;
+
+private:
+  VkDevice device_;
+  ThreadPool &jobs_;
+  BuildFn build_;
+
+  std::mutex mutex_;
+  std::unordered_map<PipelineKey, std::shared_future<VkPipeline>, PipelineKeyHash> pipelines_;
+
+  // variants that failed to compile, find_or() draws them with the fallback
+  std::unordered_set<PipelineKey, PipelineKeyHash> failed_;
+
+  VkPipeline build_timed(const PipelineKey &key) {
+    const auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = build_(key);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("created pipeline variant ({}) in {:.1f} ms", key.describe(), ms);
+    return pipeline;
+  }
+
+public:
+  PipelineRegistry(VkDevice device, ThreadPool &jobs, BuildFn build)
+    : device_(device), jobs_(jobs), build_(std::move(build)) {}
+
+  PipelineRegistry(const PipelineRegistry &) = delete;
+  PipelineRegistry &operator=(const PipelineRegistry &) = delete;
+
+  // waits for the compiles that are still running
+  ~PipelineRegistry() {
+    for (auto &[key, pipeline]: pipelines_) {
+      pipeline.wait();
+
+      // a variant that failed to compile has nothing to destroy
+      try {
+        vkDestroyPipeline(device_, pipeline.get(), nullptr);
+      } catch (const std::exception &e) {
+        spdlog::warn("pipeline variant ({}) failed: {}", key.describe(), e.what());
+      }
+    }
+  }
+
+  // forgets every variant, for when what they're built from changed (e.g. a shader that was
+  // reloaded). waits for the ones that are still compiling, so the build function can use the
+  // new state once this returns. the pipelines may still be used by frames in flight, they are
+  // returned to be destroyed once those are done
+  vec<VkPipeline> release() {
+    decltype(pipelines_) released;
+    {
+      std::lock_guard lock(mutex_);
+      released.swap(pipelines_);
+      failed_.clear();
+    }
+
+    vec<VkPipeline> res;
+    for (auto &[key, pipeline]: released) {
+      pipeline.wait();
+      try {
+        res.push_back(pipeline.get());
+      } catch (const std::exception &e) {
+        spdlog::warn("pipeline variant ({}) failed: {}", key.describe(), e.what());
+      }
+    }
+    return res;
+  }
+
+  // the pipeline if it's ready, otherwise VK_NULL_HANDLE and the variant is compiled in the
+  // background. rethrows if compiling the variant failed
+  VkPipeline find(const PipelineKey &key) {
+    std::shared_future<VkPipeline> pipeline;
+    {
+      std::lock_guard lock(mutex_);
+      auto it = pipelines_.find(key);
+      if (it == pipelines_.end()) {
+        auto job = jobs_.submit([this, key] { return build_timed(key); });
+        pipelines_.emplace(key, job.share());
+        return VK_NULL_HANDLE;
+      }
+      pipeline = it->second;
+    }
+
+    if (pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      return VK_NULL_HANDLE;
+    }
+    return pipeline.get();
+  }
+
+  // release(), with a variant that was already built from the new state in place of the old
+  // one. building it first lets the caller keep everything as it was if that fails
+  vec<VkPipeline> replace(const PipelineKey &key, VkPipeline pipeline) {
+    vec<VkPipeline> res = release();
+
+    std::promise<VkPipeline> ready;
+    ready.set_value(pipeline);
+    std::lock_guard lock(mutex_);
+    pipelines_.emplace(key, ready.get_future().share());
+    return res;
+  }
+
+  // find() with fallback, which should be a variant that was created with get(). a variant that
+  // failed to compile is drawn with the fallback too, its error is only logged the first time
+  VkPipeline find_or(const PipelineKey &key, const PipelineKey &fallback) {
+    bool failed;
+    {
+      std::lock_guard lock(mutex_);
+      failed = failed_.contains(key);
+    }
+    if (failed) {
+      return get(fallback);
+    }
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try {
+      pipeline = find(key);
+    } catch (const std::exception &e) {
+      spdlog::error("pipeline variant ({}) failed, drawing the fallback instead: {}", key.describe(), e.what());
+      std::lock_guard lock(mutex_);
+      failed_.insert(key);
+    }
+    return pipeline != VK_NULL_HANDLE ? pipeline : get(fallback);
+  }
+
+  // blocks until the pipeline exists
+  VkPipeline get(const PipelineKey &key) {
+    std::shared_future<VkPipeline> pipeline;
+    std::promise<VkPipeline> promise;
+    bool build_here = false;
+    {
+      std::lock_guard lock(mutex_);
+      auto it = pipelines_.find(key);
+      if (it == pipelines_.end()) {
+        pipeline = promise.get_future().share();
+        pipelines_.emplace(key, pipeline);
+        build_here = true;
+      } else {
+        pipeline = it->second;
+      }
+    }
+
+    // outside of the lock, other threads may look up variants in the meantime
+    if (build_here) {
+      try {
+        promise.set_value(build_timed(key));
+      } catch (...) {
+        promise.set_exception(std::current_exception());
+      }
+    }
+
+    return pipeline.get();
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_PIPELINES_H
@@ -0,0 +1,359 @@
+#ifndef VULKAN_TUT_PROFILER_H
+#define VULKAN_TUT_PROFILER_H
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <optional>
+
+#include "common.h"
+#include "device.h"
+
+namespace vk {
+
+// rolling statistics over the last WINDOW samples of one named section
+class SectionStats {
+public:
+  static constexpr u32 WINDOW = 256;
+
+  void add(double ms) {
+    if (samples_.size() < WINDOW) {
+      samples_.push_back(ms);
+    } else {
+      samples_[next_] = ms;
+    }
+    next_ = (next_ + 1) % WINDOW;
+  }
+
+  bool empty() const { return samples_.empty(); }
+
+  double min() const { return *std::min_element(samples_.begin(), samples_.end()); }
+
+  double avg() const {
+    double sum = 0.0;
+    for (double s: samples_) {
+      sum += s;
+    }
+    return sum / double(samples_.size());
+  }
+
+  double p99() const {
+    vec<double> sorted(samples_);
+    const size_t i = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+    std::nth_element(sorted.begin(), sorted.begin() + i, sorted.end());
+    return sorted[i];
+  }
+
+private:
+  vec<double> samples_;
+  u32 next_ = 0;
+};
+
+// CPU and GPU timing of the sections of a frame.
+//
+// CPU sections are measured with a steady clock around a scope (cpu_scope). GPU sections are a
+// pair of vkCmdWriteTimestamp in the frame's command buffer (gpu_scope), written into a query
+// pool per frame in flight. the results of a frame are read back the next time the same frame
+// slot is recorded: the frame has been waited on by then, so reading them never stalls.
+//
+// latencies are samples that span frames (e.g. from when a frame sampled its input until it was
+// presented), the caller measures them and hands them in with add_latency.
+//
+// every log_interval frames the rolling min/avg/p99 of every section goes to spdlog. with a
+// trace path every single sample is also appended to a CSV file (frame,kind,section,ms).
+class Profiler {
+  struct Section {
+    str name;
+    SectionStats stats;
+  };
+
+  struct GpuScope {
+    u32 section;
+    u32 begin_query;
+  };
+
+  struct GpuFrame {
+    VkQueryPool pool = VK_NULL_HANDLE;
+    vec<GpuScope> scopes;
+    u32 queries = 0;  // written in the last recording of this frame
+    u64 frame_index = 0;
+  };
+
+  VkDevice device_;
+  const DeviceFns &fns_;
+  bool enabled_;
+  bool gpu_supported_ = false;
+  u32 max_queries_;
+  double ns_per_tick_ = 1.0;
+  u64 valid_mask_ = ~0ull;
+  u32 log_interval_;
+
+  vec<Section> cpu_sections_;
+  vec<Section> gpu_sections_;
+  vec<Section> latency_sections_;
+  vec<GpuFrame> gpu_frames_;
+
+  u64 frame_index_ = 0;
+  std::optional<std::ofstream> trace_;
+
+  static u32 find_or_add(vec<Section> &sections, const char *name) {
+    for (u32 i = 0; i < sections.size(); ++i) {
+      if (sections[i].name == name) {
+        return i;
+      }
+    }
+    sections.push_back({name, {}});
+    return static_cast<u32>(sections.size() - 1);
+  }
+
+  void trace(u64 frame, const char *kind, const str &name, double ms) {
+    if (trace_) {
+      *trace_ << frame << ',' << kind << ',' << name << ',' << ms << '\n';
+    }
+  }
+
+  void collect(u32 frame) {
+    GpuFrame &f = gpu_frames_[frame];
+    if (f.queries == 0) {
+      return;
+    }
+
+    // value + availability per query
+    vec<u64> results(size_t(f.queries) * 2);
+    VkResult res = vkGetQueryPoolResults(
+      device_, f.pool, 0, f.queries,
+      results.size() * sizeof(u64), results.data(), 2 * sizeof(u64),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+    );
+    if (res != VK_SUCCESS && res != VK_NOT_READY) {
+      VK_CHECK(res);
+    }
+
+    for (const auto &scope: f.scopes) {
+      const u64 *b = &results[size_t(scope.begin_query) * 2];
+      const u64 *e = &results[size_t(scope.begin_query + 1) * 2];
+      if (b[1] == 0 || e[1] == 0) {
+        continue;
+      }
+
+      const u64 ticks = ((e[0] & valid_mask_) - (b[0] & valid_mask_)) & valid_mask_;
+      const double ms = double(ticks) * ns_per_tick_ * 1e-6;
+      gpu_sections_[scope.section].stats.add(ms);
+      trace(f.frame_index, "gpu", gpu_sections_[scope.section].name, ms);
+    }
+
+    f.scopes.clear();
+    f.queries = 0;
+  }
+
+public:
+  class CpuScope {
+    Profiler *profiler_;
+    u32 section_;
+    std::chrono::steady_clock::time_point start_;
+
+  public:
+    CpuScope(Profiler *profiler, u32 section)
+      : profiler_(profiler), section_(section), start_(std::chrono::steady_clock::now()) {}
+
+    CpuScope(const CpuScope &) = delete;
+    CpuScope &operator=(const CpuScope &) = delete;
+
+    ~CpuScope() {
+      if (profiler_ != nullptr) {
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+        profiler_->add_cpu(section_, ms);
+      }
+    }
+  };
+
+  // ends the GPU section when it goes out of scope
+  class GpuScopeGuard {
+    Profiler *profiler_;
+    VkCommandBuffer cmd_;
+    u32 frame_;
+    u32 end_query_;
+    VkPipelineStageFlagBits stage_;
+
+  public:
+    GpuScopeGuard(Profiler *profiler, VkCommandBuffer cmd, u32 frame, u32 end_query, VkPipelineStageFlagBits stage)
+      : profiler_(profiler), cmd_(cmd), frame_(frame), end_query_(end_query), stage_(stage) {}
+
+    GpuScopeGuard(const GpuScopeGuard &) = delete;
+    GpuScopeGuard &operator=(const GpuScopeGuard &) = delete;
+
+    ~GpuScopeGuard() {
+      if (profiler_ != nullptr) {
+        profiler_->gpu_end(cmd_, frame_, end_query_, stage_);
+      }
+    }
+  };
+
+  // the timestamps are only valid on queues of the given family. 0 log_interval: never log
+  Profiler(
+    VkDevice device,
+    const DeviceFns &fns,
+    VkPhysicalDevice physical_device,
+    u32 queue_family,
+    u32 frames_in_flight,
+    bool enabled,
+    u32 log_interval = 600,
+    u32 max_gpu_scopes = 16
+  ) : device_(device), fns_(fns), enabled_(enabled), max_queries_(2 * max_gpu_scopes), log_interval_(log_interval) {
+    if (!enabled_) {
+      return;
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physical_device, &props);
+
+    u32 family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+    vec<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+
+    const u32 valid_bits = families[queue_family].timestampValidBits;
+    gpu_supported_ = props.limits.timestampPeriod > 0.0f && valid_bits > 0;
+    if (!gpu_supported_) {
+      spdlog::warn("timestamp queries are not supported on queue family {}, only CPU times are profiled", queue_family);
+      return;
+    }
+
+    ns_per_tick_ = props.limits.timestampPeriod;
+    valid_mask_ = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    gpu_frames_.resize(frames_in_flight);
+    for (auto &f: gpu_frames_) {
+      VkQueryPoolCreateInfo info {};
+      info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      info.queryCount = max_queries_;
+      VK_CHECK(vkCreateQueryPool(device_, &info, nullptr, &f.pool));
+    }
+  }
+
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+
+  ~Profiler() {
+    for (auto &f: gpu_frames_) {
+      vkDestroyQueryPool(device_, f.pool, nullptr);
+    }
+  }
+
+  bool enabled() const { return enabled_; }
+
+  // CSV trace of every sample, appended for the lifetime of the profiler
+  void enable_trace(const str &path) {
+    if (!enabled_) {
+      return;
+    }
+
+    trace_.emplace(path, std::ios::trunc);
+    if (!trace_->is_open()) {
+      spdlog::warn("failed to open profile trace {}", path);
+      trace_.reset();
+      return;
+    }
+
+    *trace_ << "frame,kind,section,ms\n";
+  }
+
+  [[nodiscard]] CpuScope cpu_scope(const char *name) {
+    if (!enabled_) {
+      return {nullptr, 0};
+    }
+    return {this, find_or_add(cpu_sections_, name)};
+  }
+
+  void add_cpu(u32 section, double ms) {
+    cpu_sections_[section].stats.add(ms);
+    trace(frame_index_, "cpu", cpu_sections_[section].name, ms);
+  }
+
+  void add_latency(const char *name, double ms) {
+    if (!enabled_) {
+      return;
+    }
+
+    Section &s = latency_sections_[find_or_add(latency_sections_, name)];
+    s.stats.add(ms);
+    trace(frame_index_, "latency", s.name, ms);
+  }
+
+  // call after the frame was waited on, with the frame's command buffer in the
+  // recording state and outside of a render pass: reads the previous results of this frame
+  // slot and resets its queries
+  void begin_gpu_frame(VkCommandBuffer cmd, u32 frame) {
+    if (!gpu_supported_) {
+      return;
+    }
+
+    collect(frame);
+    fns_.vkCmdResetQueryPool(cmd, gpu_frames_[frame].pool, 0, max_queries_);
+    gpu_frames_[frame].frame_index = frame_index_;
+  }
+
+  // the section covers everything recorded until the returned guard is destroyed, sections can
+  // be nested. timestamps can't be written inside a render pass that executes secondary command
+  // buffers, so a scope has to enclose such a render pass as a whole
+  [[nodiscard]] GpuScopeGuard gpu_scope(
+    VkCommandBuffer cmd, u32 frame, const char *name,
+    VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+  ) {
+    if (!gpu_supported_) {
+      return {nullptr, cmd, frame, 0, stage};
+    }
+
+    GpuFrame &f = gpu_frames_[frame];
+    if (f.queries + 2 > max_queries_) {
+      spdlog::warn("out of timestamp queries, section {} is not profiled", name);
+      return {nullptr, cmd, frame, 0, stage};
+    }
+
+    const u32 begin_query = f.queries;
+    f.scopes.push_back({find_or_add(gpu_sections_, name), f.queries});
+    fns_.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, f.pool, begin_query);
+    f.queries += 2;
+
+    return {this, cmd, frame, begin_query + 1, stage};
+  }
+
+  void gpu_end(VkCommandBuffer cmd, u32 frame, u32 end_query, VkPipelineStageFlagBits stage) {
+    fns_.vkCmdWriteTimestamp(cmd, stage, gpu_frames_[frame].pool, end_query);
+  }
+
+  // rolling statistics of every section so far, also done every log_interval frames
+  void log_stats() {
+    auto log = [](const char *kind, const vec<Section> &sections) {
+      for (const auto &s: sections) {
+        if (!s.stats.empty()) {
+          spdlog::info(
+            "{} {:<16} min {:7.3f} ms  avg {:7.3f} ms  p99 {:7.3f} ms",
+            kind, s.name, s.stats.min(), s.stats.avg(), s.stats.p99()
+          );
+        }
+      }
+    };
+
+    spdlog::info("profile after {} frames:", frame_index_);
+    log("cpu", cpu_sections_);
+    log("gpu", gpu_sections_);
+    log("lat", latency_sections_);
+  }
+
+  void end_frame() {
+    if (!enabled_) {
+      return;
+    }
+
+    ++frame_index_;
+    if (log_interval_ > 0 && frame_index_ % log_interval_ == 0) {
+      log_stats();
+    }
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_PROFILER_H
@@ -0,0 +1,160 @@
+#ifndef VULKAN_TUT_RECORDER_H
+#define VULKAN_TUT_RECORDER_H
+
+#include <algorithm>
+#include <functional>
+#include <future>
+
+#include "common.h"
+#include "arena.h"
+#include "device.h"
+#include "jobs.h"
+
+namespace vk {
+
+// records a list of draws into secondary command buffers on the worker threads of a ThreadPool.
+//
+// command pools are externally synchronized, so every slice of the draw list gets its own pool
+// (and there is a set of those per frame in flight, because the pools of a frame can only be reset
+// once the GPU is done with it). a slice is always recorded by exactly one job, so no two threads
+// ever touch the same pool.
+//
+// begin_frame() resets all pools of a frame with vkResetCommandPool, which is cheaper than
+// resetting the command buffers one by one and lets the driver recycle their memory in bulk.
+//
+// the per frame calls go through the device's DeviceFns, the record function should use them too
+class SecondaryRecorder {
+  struct Slice {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    vec<VkCommandBuffer> buffers;  // allocated on first use, reused after every reset
+    u32 used = 0;
+  };
+
+  VkDevice device_;
+  const DeviceFns &fns_;
+  ThreadPool &jobs_;
+  FrameArenas &arenas_;
+  u32 max_slices_;
+
+  // slices_[frame][slice]
+  vec<vec<Slice>> slices_;
+
+  VkCommandBuffer acquire(Slice &slice) {
+    if (slice.used == slice.buffers.size()) {
+      VkCommandBufferAllocateInfo alloc_info {};
+      alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      alloc_info.commandPool = slice.pool;
+      alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+      alloc_info.commandBufferCount = 1;
+
+      VkCommandBuffer cmd;
+      VK_CHECK(vkAllocateCommandBuffers(device_, &alloc_info, &cmd));
+      slice.buffers.push_back(cmd);
+    }
+
+    return slice.buffers[slice.used++];
+  }
+
+public:
+  // recording a slice on a worker only pays off if there is enough work in it
+  static constexpr u32 MIN_ITEMS_PER_SLICE = 64;
+
+  using RecordFn = std::function<void(VkCommandBuffer cmd, u32 begin, u32 end)>;
+
+  SecondaryRecorder(VkDevice device, const DeviceFns &fns, u32 queue_family, u32 frames_in_flight, ThreadPool &jobs, FrameArenas &arenas)
+    : device_(device), fns_(fns), jobs_(jobs), arenas_(arenas), max_slices_(jobs.size()) {
+    slices_.resize(frames_in_flight);
+    for (auto &frame: slices_) {
+      frame.resize(max_slices_);
+      for (auto &slice: frame) {
+        VkCommandPoolCreateInfo info {};
+        info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;  // no individual resets
+        info.queueFamilyIndex = queue_family;
+        VK_CHECK(vkCreateCommandPool(device_, &info, nullptr, &slice.pool));
+      }
+    }
+
+    spdlog::debug("secondary recorder: {} slices x {} frames in flight", max_slices_, frames_in_flight);
+  }
+
+  SecondaryRecorder(const SecondaryRecorder &) = delete;
+  SecondaryRecorder &operator=(const SecondaryRecorder &) = delete;
+
+  ~SecondaryRecorder() {
+    // command buffers are freed with their pool
+    for (auto &frame: slices_) {
+      for (auto &slice: frame) {
+        vkDestroyCommandPool(device_, slice.pool, nullptr);
+      }
+    }
+  }
+
+  // the GPU must be done with everything recorded for this frame the last time around
+  void begin_frame(u32 frame) {
+    for (auto &slice: slices_[frame]) {
+      VK_CHECK(fns_.vkResetCommandPool(device_, slice.pool, 0));
+      slice.used = 0;
+    }
+  }
+
+  // splits [0, count) into contiguous slices and calls record for each of them with a secondary
+  // command buffer that has already been begun with the given inheritance info. returns the
+  // secondaries in draw list order, ready for vkCmdExecuteCommands.
+  // a single slice is recorded on the calling thread. the list is allocated from the calling
+  // thread's frame arena, record can use the FrameArenas::local() of the thread it runs on
+  std::pmr::vector<VkCommandBuffer> record(u32 frame, const VkCommandBufferInheritanceInfo &inheritance, u32 count, const RecordFn &record) {
+    u32 num_slices = std::clamp((count + MIN_ITEMS_PER_SLICE - 1) / MIN_ITEMS_PER_SLICE, 1u, max_slices_);
+    const u32 per_slice = (count + num_slices - 1) / num_slices;
+    if (per_slice > 0) {
+      num_slices = (count + per_slice - 1) / per_slice;
+    }
+
+    std::pmr::vector<VkCommandBuffer> res(num_slices, &arenas_.local());
+
+    auto record_slice = [&, frame](u32 s) {
+      VkCommandBuffer cmd = res[s];
+
+      VkCommandBufferBeginInfo begin_info {};
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+      begin_info.pInheritanceInfo = &inheritance;
+      VK_CHECK(fns_.vkBeginCommandBuffer(cmd, &begin_info));
+
+      record(cmd, s * per_slice, std::min(count, (s + 1) * per_slice));
+
+      VK_CHECK(fns_.vkEndCommandBuffer(cmd));
+    };
+
+    // allocation touches the pools too, do it up front on this thread while no job is running
+    for (u32 s = 0; s < num_slices; ++s) {
+      res[s] = acquire(slices_[frame][s]);
+    }
+
+    if (num_slices == 1) {
+      record_slice(0);
+      return res;
+    }
+
+    std::pmr::vector<std::future<void>> pending(&arenas_.local());
+    pending.reserve(num_slices);
+    for (u32 s = 0; s < num_slices; ++s) {
+      pending.push_back(jobs_.submit([&record_slice, s] { record_slice(s); }));
+    }
+
+    // get() rethrows if a slice failed, wait for all of them first so none is still running
+    // when the stack frame goes away
+    for (auto &f: pending) {
+      f.wait();
+    }
+    for (auto &f: pending) {
+      f.get();
+    }
+
+    return res;
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_RECORDER_H
@@ -0,0 +1,140 @@
+#ifndef VULKAN_TUT_SCENE_H
+#define VULKAN_TUT_SCENE_H
+
+#include <algorithm>
+#include <span>
+#include <tuple>
+
+#include "common.h"
+#include "mesh.h"
+
+namespace vk {
+
+// where everything the scene draws lives and what it's drawn with. the geometry of all models
+// shares one vertex buffer and one index buffer: a model's vertices and indices are appended to
+// them, and every submesh of it becomes a SceneMesh that is drawn with its range of the index
+// buffer (firstIndex) and the model's first vertex (vertexOffset). the indices stay relative to
+// the model, so 16 bit indices work as long as every single model has few enough vertices.
+//
+// this only does the bookkeeping, the buffers and textures are up to the caller
+struct SceneMesh {
+  u32 first_index;
+  u32 index_count;
+  int32_t vertex_offset;
+  u32 model;
+  u32 material;
+};
+
+// what the fragment shader samples and the pipeline variant the material needs
+struct SceneMaterial {
+  u32 texture;
+  bool alpha_test;
+
+  bool operator==(const SceneMaterial &) const = default;
+};
+
+struct SceneModel {
+  u32 first_vertex;
+  u32 vertex_count;
+  u32 first_index;  // of its first mesh
+  u32 index_count;
+  MeshBounds bounds;
+};
+
+// one entry of the draw list, pipeline is an index into whatever the caller uses as variants
+struct SceneDraw {
+  u32 pipeline;
+  u32 material;
+  u32 mesh;
+};
+
+class Scene {
+  vec<SceneModel> models_;
+  vec<SceneMesh> meshes_;
+  vec<SceneMaterial> materials_;
+  vec<SceneDraw> draws_;
+  MeshBounds bounds_;
+
+  u32 vertex_count_ = 0;
+  u32 index_count_ = 0;
+  bool fits_index16_ = true;
+
+public:
+  // the scene's materials are shared by all models: two model materials with the same texture
+  // and state are the same scene material. textures[i] is what material i of the mesh samples
+  u32 add_model(const MeshData &mesh, std::span<const u32> textures) {
+    const u32 model = static_cast<u32>(models_.size());
+
+    SceneModel m {};
+    m.first_vertex = vertex_count_;
+    m.vertex_count = static_cast<u32>(mesh.vertices().size());
+    m.first_index = index_count_;
+    m.index_count = static_cast<u32>(mesh.indices().size());
+    m.bounds = mesh.bounds();
+    models_.push_back(m);
+
+    vec<u32> material_map;
+    for (size_t i = 0; i < mesh.materials().size(); ++i) {
+      const SceneMaterial material {textures[i], mesh.materials()[i].alpha_test};
+      auto it = std::find(materials_.begin(), materials_.end(), material);
+      if (it == materials_.end()) {
+        materials_.push_back(material);
+        it = materials_.end() - 1;
+      }
+      material_map.push_back(static_cast<u32>(it - materials_.begin()));
+    }
+
+    for (const auto &submesh: mesh.submeshes()) {
+      if (submesh.index_count == 0) {
+        continue;
+      }
+      meshes_.push_back({
+        index_count_ + submesh.first_index,
+        submesh.index_count,
+        static_cast<int32_t>(vertex_count_),
+        model,
+        material_map[submesh.material],
+      });
+    }
+
+    vertex_count_ += m.vertex_count;
+    index_count_ += m.index_count;
+    fits_index16_ = fits_index16_ && m.vertex_count < 0xffff;
+
+    bounds_.min = glm::min(bounds_.min, m.bounds.min);
+    bounds_.max = glm::max(bounds_.max, m.bounds.max);
+
+    return model;
+  }
+
+  // one draw per mesh, sorted so that consecutive draws share as much state as possible: the
+  // pipeline changes least often, then the material (the descriptors), then the geometry.
+  // pipeline_of maps a material to the caller's pipeline index
+  template<typename PipelineOf>
+  void build_draws(PipelineOf pipeline_of) {
+    draws_.clear();
+    for (u32 i = 0; i < meshes_.size(); ++i) {
+      draws_.push_back({pipeline_of(materials_[meshes_[i].material]), meshes_[i].material, i});
+    }
+
+    std::sort(draws_.begin(), draws_.end(), [](const SceneDraw &a, const SceneDraw &b) {
+      return std::tie(a.pipeline, a.material, a.mesh) < std::tie(b.pipeline, b.material, b.mesh);
+    });
+  }
+
+  const vec<SceneModel> &models() const { return models_; }
+  const vec<SceneMesh> &meshes() const { return meshes_; }
+  const vec<SceneMaterial> &materials() const { return materials_; }
+  const vec<SceneDraw> &draws() const { return draws_; }
+
+  // all models are in the same space
+  const MeshBounds &bounds() const { return bounds_; }
+
+  u32 vertex_count() const { return vertex_count_; }
+  u32 index_count() const { return index_count_; }
+  bool fits_index16() const { return fits_index16_; }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_SCENE_H
@@ -1,7 +1,24 @@
 #version 450
 
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+
+// every texture there is, the draw's is selected by the push constants. the index is the same
+// for the whole draw, so it needs no nonuniformEXT
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform Draw {
+    uint frame_uniforms;
+    uint draw_uniforms;
+    uint buffer_index;
+    uint texture_index;
+} pc;
+
+#define in_texSampler textures[pc.texture_index]
+#else
 // TODO(vulkan) location here is what? 0? 1?
 layout(binding = 1) uniform sampler2D in_texSampler;
+#endif
 
 // input passed on from vertex shader
 layout(location = 0) in vec3 in_fragColor;
@@ -9,6 +26,13 @@ layout(location = 1) in vec2 in_fragTexCoord;
 
 layout(location = 0) out vec4 out_color;
 
+// set per pipeline variant with VkSpecializationInfo (vk::FragmentSpecialization), the compiler
+// removes the branches that aren't taken
+// 0: texture, 1: vertex color, 2: texture coordinates
+layout(constant_id = 0) const int DEBUG_OUTPUT = 0;
+layout(constant_id = 1) const bool ALPHA_TEST = false;
+layout(constant_id = 2) const float ALPHA_CUTOFF = 0.5;
+
 
 // main is called for every fragment
 // colors are 4-channel RGBA in [0,1] range
@@ -20,13 +44,23 @@ void main() {
     // color with red all vertices
     // outColor = vec4(1.0, 0.0, 0.0, 1.0);
 
-//    out_color = vec4(in_fragColor, 1.0);
+    if (DEBUG_OUTPUT == 1) {
+        out_color = vec4(in_fragColor, 1.0);
+        return;
+    }
 
     // visualizing data using colors is the shader programming equivalent of priontf debugging, for lack
     // of a better option
-//    out_color = vec4(in_fragTexCoord, 0.0, 1.0);
+    if (DEBUG_OUTPUT == 2) {
+        out_color = vec4(in_fragTexCoord, 0.0, 1.0);
+        return;
+    }
 
     // texture is a built-in function
     // takes care of filtering and transformations in the background
     out_color = texture(in_texSampler, in_fragTexCoord * 1.0);
+
+    if (ALPHA_TEST && out_color.a < ALPHA_CUTOFF) {
+        discard;
+    }
 }
@@ -3,17 +3,55 @@
 // alignment requirements: https://www.khronos.org/registry/vulkan/specs/1.3-extensions/html/chap15.html#interfaces-resources-layout
 // nested structs may cause problems
 
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+
+// every storage buffer there is, see vk::BindlessDescriptors. the frame and draw uniforms are in
+// the one the push constants select, the offsets are in vec4s
+layout(std430, set = 0, binding = 1) readonly buffer Buffers {
+    vec4 data[];
+} buffers[];
+
+// matches DrawPushConstants, and the block in shader.frag
+layout(push_constant) uniform Draw {
+    uint frame_uniforms;
+    uint draw_uniforms;
+    uint buffer_index;
+    uint texture_index;
+} pc;
+
+mat4 load_mat4(uint offset) {
+    return mat4(
+        buffers[pc.buffer_index].data[offset],
+        buffers[pc.buffer_index].data[offset + 1],
+        buffers[pc.buffer_index].data[offset + 2],
+        buffers[pc.buffer_index].data[offset + 3]
+    );
+}
+#else
 // its possible to bind multiple descriptor sets simultaneously
-layout(set = 0, binding = 0) uniform UniformBufferObject {
-    mat4 model;
+// both blocks are dynamic uniform buffers: the same for the whole frame, and per draw
+layout(set = 0, binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 proj;
-} ubo;
+} frame;
+
+layout(set = 0, binding = 2) uniform DrawUniforms {
+    mat4 model;
+} draw;
+#endif
 
+// the attributes may be stored as UNORM16/SFLOAT16 (see vertex_format.h), the input assembler
+// converts them to float. compiled with and without VERTEX_COLOR, see Makefile
 layout(location = 0) in vec3 in_position;
+#ifdef VERTEX_COLOR
 layout(location = 1) in vec3 in_color;
+#endif
 layout(location = 2) in vec2 in_texCoord;
 
+// per instance (binding 1), occupies locations 3 to 6
+layout(location = 3) in mat4 in_instanceModel;
+
 // ****************************************
 
 layout(location = 0) out vec3 out_fragColor;
@@ -22,7 +60,19 @@ layout(location = 1) out vec2 out_fragTexCoord;
 // ****************************************
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(in_position, 1.0);
+#ifdef BINDLESS
+    // FrameUniforms {view, proj} and DrawUniforms {model}
+    mat4 view = load_mat4(pc.frame_uniforms);
+    mat4 proj = load_mat4(pc.frame_uniforms + 4);
+    mat4 model = load_mat4(pc.draw_uniforms);
+    gl_Position = proj * view * in_instanceModel * model * vec4(in_position, 1.0);
+#else
+    gl_Position = frame.proj * frame.view * in_instanceModel * draw.model * vec4(in_position, 1.0);
+#endif
+#ifdef VERTEX_COLOR
     out_fragColor = in_color;
+#else
+    out_fragColor = vec3(1.0);
+#endif
     out_fragTexCoord = in_texCoord;
 }
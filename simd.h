@@ -0,0 +1,172 @@
+#ifndef VULKAN_TUT_SIMD_H
+#define VULKAN_TUT_SIMD_H
+
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VK_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define VK_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "common.h"
+
+namespace vk::simd {
+
+// four floats at once, which is what SSE2 and NEON have. every x86-64 and arm64 cpu has one of
+// them without any compiler flags, wider vectors (AVX) would need a build per instruction set.
+// anything else gets a plain loop that does the same.
+//
+// only what the code using it needs: arithmetic, comparisons that give a mask4, selects and a
+// transpose to get from four lanes of structure of arrays data to four vectors of one element
+// each
+
+#if VK_SIMD_SSE2
+
+struct f32x4 { __m128 v; };
+struct mask4 { __m128 v; };
+
+inline f32x4 splat(float a) { return {_mm_set1_ps(a)}; }
+inline f32x4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+inline void store(float *p, f32x4 a) { _mm_storeu_ps(p, a.v); }
+
+inline f32x4 operator+(f32x4 a, f32x4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline f32x4 operator-(f32x4 a, f32x4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline f32x4 operator*(f32x4 a, f32x4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline f32x4 operator-(f32x4 a) { return {_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))}; }
+
+inline mask4 operator<(f32x4 a, f32x4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline mask4 operator>(f32x4 a, f32x4 b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline mask4 operator|(mask4 a, mask4 b) { return {_mm_or_ps(a.v, b.v)}; }
+
+// m ? a : b per lane
+inline f32x4 select(mask4 m, f32x4 a, f32x4 b) {
+  return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))};
+}
+
+// bit i is lane i
+inline u32 bits(mask4 m) { return static_cast<u32>(_mm_movemask_ps(m.v)); }
+
+inline void transpose(f32x4 &a, f32x4 &b, f32x4 &c, f32x4 &d) {
+  _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+}
+
+// to nearest. SSE2 has no rounding instruction: adding 1.5 * 2^23 pushes the fraction out of the
+// mantissa, for everything below 2^22
+inline f32x4 round(f32x4 a) {
+  const __m128 magic = _mm_set1_ps(12582912.0f);
+  return {_mm_sub_ps(_mm_add_ps(a.v, magic), magic)};
+}
+
+#elif VK_SIMD_NEON
+
+struct f32x4 { float32x4_t v; };
+struct mask4 { uint32x4_t v; };
+
+inline f32x4 splat(float a) { return {vdupq_n_f32(a)}; }
+inline f32x4 load(const float *p) { return {vld1q_f32(p)}; }
+inline void store(float *p, f32x4 a) { vst1q_f32(p, a.v); }
+
+inline f32x4 operator+(f32x4 a, f32x4 b) { return {vaddq_f32(a.v, b.v)}; }
+inline f32x4 operator-(f32x4 a, f32x4 b) { return {vsubq_f32(a.v, b.v)}; }
+inline f32x4 operator*(f32x4 a, f32x4 b) { return {vmulq_f32(a.v, b.v)}; }
+inline f32x4 operator-(f32x4 a) { return {vnegq_f32(a.v)}; }
+
+inline mask4 operator<(f32x4 a, f32x4 b) { return {vcltq_f32(a.v, b.v)}; }
+inline mask4 operator>(f32x4 a, f32x4 b) { return {vcgtq_f32(a.v, b.v)}; }
+inline mask4 operator|(mask4 a, mask4 b) { return {vorrq_u32(a.v, b.v)}; }
+
+inline f32x4 select(mask4 m, f32x4 a, f32x4 b) { return {vbslq_f32(m.v, a.v, b.v)}; }
+
+inline u32 bits(mask4 m) {
+  const uint32x4_t weights = {1, 2, 4, 8};
+  return vaddvq_u32(vandq_u32(m.v, weights));
+}
+
+inline void transpose(f32x4 &a, f32x4 &b, f32x4 &c, f32x4 &d) {
+  const float32x4x2_t ab = vtrnq_f32(a.v, b.v);
+  const float32x4x2_t cd = vtrnq_f32(c.v, d.v);
+  a.v = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+  b.v = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+  c.v = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+  d.v = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+
+inline f32x4 round(f32x4 a) { return {vrndnq_f32(a.v)}; }
+
+#else
+
+struct f32x4 { float v[4]; };
+struct mask4 { bool v[4]; };
+
+template<typename F>
+inline f32x4 lanes(F f) {
+  f32x4 r;
+  for (int i = 0; i < 4; ++i) {
+    r.v[i] = f(i);
+  }
+  return r;
+}
+
+inline f32x4 splat(float a) { return {{a, a, a, a}}; }
+inline f32x4 load(const float *p) { f32x4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+inline void store(float *p, f32x4 a) { memcpy(p, a.v, sizeof(a.v)); }
+
+inline f32x4 operator+(f32x4 a, f32x4 b) { return lanes([&](int i) { return a.v[i] + b.v[i]; }); }
+inline f32x4 operator-(f32x4 a, f32x4 b) { return lanes([&](int i) { return a.v[i] - b.v[i]; }); }
+inline f32x4 operator*(f32x4 a, f32x4 b) { return lanes([&](int i) { return a.v[i] * b.v[i]; }); }
+inline f32x4 operator-(f32x4 a) { return lanes([&](int i) { return -a.v[i]; }); }
+
+inline mask4 operator<(f32x4 a, f32x4 b) { return {{a.v[0] < b.v[0], a.v[1] < b.v[1], a.v[2] < b.v[2], a.v[3] < b.v[3]}}; }
+inline mask4 operator>(f32x4 a, f32x4 b) { return b < a; }
+inline mask4 operator|(mask4 a, mask4 b) { return {{a.v[0] || b.v[0], a.v[1] || b.v[1], a.v[2] || b.v[2], a.v[3] || b.v[3]}}; }
+
+inline f32x4 select(mask4 m, f32x4 a, f32x4 b) { return lanes([&](int i) { return m.v[i] ? a.v[i] : b.v[i]; }); }
+
+inline u32 bits(mask4 m) { return u32(m.v[0]) | u32(m.v[1]) << 1 | u32(m.v[2]) << 2 | u32(m.v[3]) << 3; }
+
+inline void transpose(f32x4 &a, f32x4 &b, f32x4 &c, f32x4 &d) {
+  f32x4 *rows[4] = {&a, &b, &c, &d};
+  for (int i = 0; i < 4; ++i) {
+    for (int j = i + 1; j < 4; ++j) {
+      std::swap(rows[i]->v[j], rows[j]->v[i]);
+    }
+  }
+}
+
+inline f32x4 round(f32x4 a) { return lanes([&](int i) { return std::nearbyint(a.v[i]); }); }
+
+#endif
+
+inline f32x4 madd(f32x4 a, f32x4 b, f32x4 c) { return a * b + c; }
+
+// sin and cos to within 4e-6 of angles of up to a few hundred radians. beyond that the float
+// angle itself is less precise than that, round() limits them to below 2^22 / (2 pi). the angle
+// is reduced to [-pi, pi] and folded into [-pi/2, pi/2] (sin(pi - x) = sin(x)), where a degree 9
+// polynomial is good enough. cos(x) is sin(x + pi/2)
+inline f32x4 sin(f32x4 x) {
+  const f32x4 pi = splat(3.14159265f);
+  const f32x4 half_pi = splat(1.57079633f);
+
+  x = x - splat(6.28318531f) * round(x * splat(0.159154943f));
+  x = select(x > half_pi, pi - x, x);
+  x = select(x < -half_pi, -pi - x, x);
+
+  const f32x4 x2 = x * x;
+  f32x4 p = splat(2.7557319e-6f);
+  p = madd(p, x2, splat(-1.98412698e-4f));
+  p = madd(p, x2, splat(8.33333333e-3f));
+  p = madd(p, x2, splat(-1.66666667e-1f));
+  p = madd(p, x2, splat(1.0f));
+  return p * x;
+}
+
+inline f32x4 cos(f32x4 x) { return sin(x + splat(1.57079633f)); }
+
+} // namespace vk::simd
+
+#endif //VULKAN_TUT_SIMD_H
@@ -0,0 +1,516 @@
+#ifndef VULKAN_TUT_STREAMING_H
+#define VULKAN_TUT_STREAMING_H
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+
+#include "common.h"
+#include "device.h"
+#include "ktx.h"
+#include "memory.h"
+#include "upload.h"
+
+namespace vk {
+
+// mip level residency of precompressed textures (ktx::Texture, the file is the source of every
+// level) under a VRAM budget.
+//
+// a texture's image only has the levels [base, level count) of the file, its level 0 is level
+// base of the file. add() loads the small levels at the end of the chain, after that the caller
+// says which level it would like to see with request() (from the screen space size of what the
+// texture is on) and update() moves the textures towards that, once per frame:
+// - upgrades and evictions both build a new image of the new range: the levels both have are
+//   copied from the old image on the GPU, the ones only the new one has are staged from the file.
+//   all of it is recorded into the upload queue, so it runs on the transfer queue where there is
+//   one, with the image to image copies on the graphics queue
+// - once the batch is complete the new view is handed to the swap callback. frames recorded
+//   before that keep sampling the old image, which is why its release is up to the caller
+// - over the budget, the texture whose largest resident level is the largest of all loses it
+//   first. nothing is evicted below the levels add() loaded
+//
+// the budget is the configured one, and with VK_EXT_memory_budget also never more than what the
+// device says is left of its device local heaps besides what we already use.
+//
+// not thread safe, everything runs on the thread that renders
+class TextureStreamer {
+public:
+  struct Config {
+    VkDeviceSize budget = 0;              // for all textures, 0: only what the device has left
+    u32 initial_extent = 128;             // add() loads the levels up to this size
+    VkDeviceSize max_upload = 8u << 20;   // staged by a single update()
+  };
+
+  // new view of texture for the descriptors from now on. release frees the old one, call it
+  // once none of the frames that may use it are in flight anymore
+  using SwapCallback = std::function<void(u32 texture, VkImageView view, std::function<void()> release)>;
+
+private:
+  struct Residency {
+    VkImage image = VK_NULL_HANDLE;
+    Allocation memory {};
+    VkImageView view = VK_NULL_HANDLE;
+    u32 base = 0;
+  };
+
+  struct Texture {
+    ptr<ktx::Texture> source;
+    Residency resident;
+    std::optional<Residency> pending;
+    u64 ticket = 0;    // of the batch that fills pending
+    u32 min_base = 0;  // what add() loaded, never evicted
+    u32 wanted = 0;
+  };
+
+  VkDevice device_;
+  const DeviceFns &fns_;
+  VkPhysicalDevice physical_device_;
+  MemoryAllocator &allocator_;
+  UploadQueue &uploads_;
+  Config config_;
+  SwapCallback swap_;
+  bool memory_budget_;
+
+  // without VK_EXT_memory_budget: half of the largest device local heap
+  VkDeviceSize fallback_budget_ = 0;
+
+  vec<Texture> textures_;
+
+  u32 levels(const Texture &t) const { return static_cast<u32>(t.source->levels().size()); }
+
+  // the first of the levels up to initial_extent, they are always resident
+  u32 initial_base(const Texture &t) const {
+    const auto &file_levels = t.source->levels();
+    u32 base = levels(t) - 1;
+    while (base > 0 && std::max(file_levels[base - 1].width, file_levels[base - 1].height) <= config_.initial_extent) {
+      --base;
+    }
+    return base;
+  }
+
+  VkDeviceSize bytes(const Texture &t, u32 base) const {
+    VkDeviceSize total = 0;
+    for (u32 level = base; level < levels(t); ++level) {
+      total += t.source->levels()[level].size;
+    }
+    return total;
+  }
+
+  // textures count with their pending range if they have one, its memory is already allocated
+  VkDeviceSize used() const {
+    VkDeviceSize total = 0;
+    for (const auto &t: textures_) {
+      total += bytes(t, t.pending ? std::min(t.pending->base, t.resident.base) : t.resident.base);
+    }
+    return total;
+  }
+
+  VkDeviceSize budget() const {
+    VkDeviceSize limit = config_.budget > 0 ? config_.budget : fallback_budget_;
+    if (!memory_budget_) {
+      return limit;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT heap_budget {};
+    heap_budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 props {};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    props.pNext = &heap_budget;
+    vkGetPhysicalDeviceMemoryProperties2(physical_device_, &props);
+
+    // a bit of headroom below the budget, other allocations (swap chain, attachments) come and go
+    VkDeviceSize available = 0;
+    VkDeviceSize usage = 0;
+    for (u32 i = 0; i < props.memoryProperties.memoryHeapCount; ++i) {
+      if (props.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+        available += heap_budget.heapBudget[i] / 10 * 9;
+        usage += heap_budget.heapUsage[i];
+      }
+    }
+
+    const VkDeviceSize ours = used();
+    const VkDeviceSize device_limit = available > usage ? ours + (available - usage) : ours - std::min(ours, usage - available);
+    return config_.budget > 0 ? std::min(limit, device_limit) : device_limit;
+  }
+
+  static void barrier(
+    VkCommandBuffer cmd,
+    VkImage image,
+    u32 level_count,
+    VkImageLayout old_layout,
+    VkImageLayout new_layout,
+    VkPipelineStageFlags src_stage,
+    VkAccessFlags src_access,
+    VkPipelineStageFlags dst_stage,
+    VkAccessFlags dst_access,
+    u32 src_family = VK_QUEUE_FAMILY_IGNORED,
+    u32 dst_family = VK_QUEUE_FAMILY_IGNORED
+  ) {
+    VkImageMemoryBarrier b {};
+    b.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    b.oldLayout = old_layout;
+    b.newLayout = new_layout;
+    b.srcQueueFamilyIndex = src_family;
+    b.dstQueueFamilyIndex = dst_family;
+    b.image = image;
+    b.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1};
+    b.srcAccessMask = src_access;
+    b.dstAccessMask = dst_access;
+    fns_.vkCmdPipelineBarrier(cmd, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &b);
+  }
+
+  Residency create(const Texture &t, u32 base) {
+    const ktx::Level &top = t.source->levels()[base];
+    const u32 level_count = levels(t) - base;
+
+    Residency r;
+    r.base = base;
+
+    VkImageCreateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    info.imageType = VK_IMAGE_TYPE_2D;
+    info.extent = {top.width, top.height, 1};
+    info.mipLevels = level_count;
+    info.arrayLayers = 1;
+    info.format = t.source->format();
+    info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // transfer src: the image is copied from when it's replaced
+    info.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    info.samples = VK_SAMPLE_COUNT_1_BIT;
+    VK_CHECK(vkCreateImage(device_, &info, nullptr, &r.image));
+
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(device_, r.image, &reqs);
+    r.memory = allocator_.allocate(reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+    VK_CHECK(vkBindImageMemory(device_, r.image, r.memory.memory, r.memory.offset));
+
+    VkImageViewCreateInfo view_info {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = r.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = info.format;
+    view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1};
+    VK_CHECK(vkCreateImageView(device_, &view_info, nullptr, &r.view));
+
+    return r;
+  }
+
+  void destroy(Residency &r) {
+    vkDestroyImageView(device_, r.view, nullptr);
+    vkDestroyImage(device_, r.image, nullptr);
+    allocator_.free(r.memory);
+    r = {};
+  }
+
+  // records filling next from the file and, if there is one, from the image it replaces
+  void record(const Texture &t, const Residency &next, const Residency *old) {
+    const u32 count = levels(t);
+    const u32 next_levels = count - next.base;
+    const u32 first_kept = old ? std::max(next.base, old->base) : count;
+    const ktx::Level *file_levels = t.source->levels().data();
+
+    // [next.base, first_kept) only the file has. the file stores the smallest level first, so
+    // they are contiguous and go into the ring with one copy
+    VkCommandBuffer graphics_cmd;
+    if (next.base < first_kept) {
+      u64 begin = UINT64_MAX;
+      u64 end = 0;
+      for (u32 level = next.base; level < first_kept; ++level) {
+        begin = std::min(begin, file_levels[level].offset);
+        end = std::max(end, file_levels[level].offset + file_levels[level].size);
+      }
+
+      const VkDeviceSize staged = uploads_.stage(t.source->data() + begin, end - begin, t.source->info().block_size);
+
+      VkCommandBuffer cmd = uploads_.cmd();
+      barrier(
+        cmd, next.image, next_levels,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT
+      );
+
+      vec<VkBufferImageCopy> regions;
+      for (u32 level = next.base; level < first_kept; ++level) {
+        VkBufferImageCopy region {};
+        region.bufferOffset = staged + (file_levels[level].offset - begin);
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - next.base, 0, 1};
+        region.imageExtent = {file_levels[level].width, file_levels[level].height, 1};
+        regions.push_back(region);
+      }
+      fns_.vkCmdCopyBufferToImage(
+        cmd, uploads_.buffer(), next.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<u32>(regions.size()), regions.data()
+      );
+
+      graphics_cmd = uploads_.graphics_cmd();
+      if (uploads_.dedicated_transfer()) {
+        // release and acquire, the rest happens on the graphics queue
+        barrier(
+          cmd, next.image, next_levels,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+          uploads_.transfer_family(), uploads_.graphics_family()
+        );
+        barrier(
+          graphics_cmd, next.image, next_levels,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+          uploads_.transfer_family(), uploads_.graphics_family()
+        );
+      }
+    } else {
+      graphics_cmd = uploads_.graphics_cmd();
+      barrier(
+        graphics_cmd, next.image, next_levels,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT
+      );
+    }
+
+    // the old image belongs to the graphics queue and is sampled by frames in flight, it goes
+    // back to being sampled right after the copy
+    if (old && first_kept < count) {
+      const u32 old_levels = count - old->base;
+      barrier(
+        graphics_cmd, old->image, old_levels,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT
+      );
+
+      vec<VkImageCopy> regions;
+      for (u32 level = first_kept; level < count; ++level) {
+        VkImageCopy region {};
+        region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - old->base, 0, 1};
+        region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - next.base, 0, 1};
+        region.extent = {file_levels[level].width, file_levels[level].height, 1};
+        regions.push_back(region);
+      }
+      fns_.vkCmdCopyImage(
+        graphics_cmd,
+        old->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        next.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<u32>(regions.size()), regions.data()
+      );
+
+      barrier(
+        graphics_cmd, old->image, old_levels,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT
+      );
+    }
+
+    barrier(
+      graphics_cmd, next.image, next_levels,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT
+    );
+  }
+
+  void begin_change(u32 id, u32 base) {
+    Texture &t = textures_[id];
+    t.pending = create(t, base);
+    record(t, *t.pending, &t.resident);
+    t.ticket = uploads_.flush();
+
+    spdlog::debug(
+      "{}: levels {}..{} -> {}..{}", t.source->path(),
+      t.resident.base, levels(t) - 1, base, levels(t) - 1
+    );
+  }
+
+  void finish_change(u32 id) {
+    Texture &t = textures_[id];
+    Residency old = t.resident;
+    t.resident = *t.pending;
+    t.pending.reset();
+
+    const ktx::Level &top = t.source->levels()[t.resident.base];
+    spdlog::debug(
+      "{}: {}x{} resident, {} KiB streamed textures of {} MiB budget",
+      t.source->path(), top.width, top.height, used() / 1024, budget() >> 20
+    );
+
+    swap_(id, t.resident.view, [this, old]() mutable { destroy(old); });
+  }
+
+public:
+  TextureStreamer(
+    VkDevice device,
+    const DeviceFns &fns,
+    VkPhysicalDevice physical_device,
+    MemoryAllocator &allocator,
+    UploadQueue &uploads,
+    bool memory_budget,
+    Config config,
+    SwapCallback swap
+  ) : device_(device), fns_(fns), physical_device_(physical_device), allocator_(allocator), uploads_(uploads),
+      config_(config), swap_(std::move(swap)), memory_budget_(memory_budget) {
+    VkPhysicalDeviceMemoryProperties props;
+    vkGetPhysicalDeviceMemoryProperties(physical_device_, &props);
+    for (u32 i = 0; i < props.memoryHeapCount; ++i) {
+      if (props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+        fallback_budget_ = std::max(fallback_budget_, props.memoryHeaps[i].size / 2);
+      }
+    }
+
+    spdlog::info(
+      "texture streaming: {} MiB budget{}", budget() >> 20,
+      memory_budget_ ? " (VK_EXT_memory_budget)" : ""
+    );
+  }
+
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+  // the swap callbacks that were handed out must have released their images before this
+  ~TextureStreamer() {
+    for (auto &t: textures_) {
+      if (t.pending) {
+        uploads_.wait(t.ticket);
+        destroy(*t.pending);
+      }
+      destroy(t.resident);
+    }
+  }
+
+  // records the upload of the smallest levels, the view can be used by anything submitted after
+  // the current upload batch
+  u32 add(ptr<ktx::Texture> source) {
+    Texture t;
+    t.source = std::move(source);
+
+    const auto &file_levels = t.source->levels();
+    t.min_base = initial_base(t);
+    t.wanted = t.min_base;
+
+    t.resident = create(t, t.min_base);
+    record(t, t.resident, nullptr);
+
+    spdlog::info(
+      "streaming texture {} ({}x{}, {}, {} levels), {}x{} loaded",
+      t.source->path(), t.source->width(), t.source->height(), string_VkFormat(t.source->format()),
+      levels(t), file_levels[t.min_base].width, file_levels[t.min_base].height
+    );
+
+    textures_.push_back(std::move(t));
+    return static_cast<u32>(textures_.size() - 1);
+  }
+
+  // a new version of the file of texture, e.g. because it changed on disk. starts over with the
+  // smallest levels of the new file like add(), the swap callback gets the new view right away.
+  // like with add() it can be used by anything submitted after the current upload batch. a
+  // change of the old file that's still uploading is waited for and dropped
+  void replace(u32 texture, ptr<ktx::Texture> source) {
+    Texture &t = textures_[texture];
+    if (t.pending) {
+      uploads_.wait(t.ticket);
+      destroy(*t.pending);
+      t.pending.reset();
+    }
+
+    Residency old = t.resident;
+    t.source = std::move(source);
+    t.min_base = initial_base(t);
+    t.wanted = t.min_base;
+
+    t.resident = create(t, t.min_base);
+    record(t, t.resident, nullptr);
+
+    spdlog::info("streaming texture {} replaced, {} levels", t.source->path(), levels(t));
+
+    swap_(texture, t.resident.view, [this, old]() mutable { destroy(old); });
+  }
+
+  // the finest level of the file texture should have, update() gets there as far as the budget
+  // allows
+  void request(u32 texture, u32 level) {
+    Texture &t = textures_[texture];
+    t.wanted = std::min(level, t.min_base);
+  }
+
+  // once per frame: swaps in what the GPU is done uploading, then starts at most one change
+  void update() {
+    for (u32 id = 0; id < textures_.size(); ++id) {
+      if (textures_[id].pending && uploads_.is_complete(textures_[id].ticket)) {
+        finish_change(id);
+      }
+    }
+
+    // where everything would like to be, then the largest levels give way until it fits
+    vec<u32> target(textures_.size());
+    VkDeviceSize total = 0;
+    for (u32 id = 0; id < textures_.size(); ++id) {
+      target[id] = textures_[id].wanted;
+      total += bytes(textures_[id], target[id]);
+    }
+
+    const VkDeviceSize limit = budget();
+    while (total > limit) {
+      std::optional<u32> largest;
+      for (u32 id = 0; id < textures_.size(); ++id) {
+        const Texture &t = textures_[id];
+        if (target[id] < t.min_base &&
+            (!largest || t.source->levels()[target[id]].size > textures_[*largest].source->levels()[target[*largest]].size)) {
+          largest = id;
+        }
+      }
+      if (!largest) {
+        break;
+      }
+
+      total -= textures_[*largest].source->levels()[target[*largest]].size;
+      ++target[*largest];
+    }
+
+    // evictions first, they free memory for the upgrades
+    for (u32 id = 0; id < textures_.size(); ++id) {
+      if (!textures_[id].pending && target[id] > textures_[id].resident.base) {
+        begin_change(id, target[id]);
+        return;
+      }
+    }
+
+    for (u32 id = 0; id < textures_.size(); ++id) {
+      Texture &t = textures_[id];
+      if (t.pending || target[id] >= t.resident.base) {
+        continue;
+      }
+
+      // at least one level, more as long as the staging stays below max_upload. the old image
+      // lives on until the frames using it are done, both have to fit for a moment
+      const VkDeviceSize in_use = used();
+      u32 base = t.resident.base - 1;
+      while (base > target[id] && bytes(t, base - 1) - bytes(t, t.resident.base) <= config_.max_upload &&
+             in_use + bytes(t, base - 1) <= limit) {
+        --base;
+      }
+
+      if (in_use + bytes(t, base) > limit) {
+        continue;
+      }
+
+      begin_change(id, base);
+      return;
+    }
+  }
+
+  VkImageView view(u32 texture) const { return textures_[texture].resident.view; }
+
+  // of the file, the image of view() starts there
+  u32 resident_level(u32 texture) const { return textures_[texture].resident.base; }
+  u32 level_count(u32 texture) const { return levels(textures_[texture]); }
+  const ktx::Texture &source(u32 texture) const { return *textures_[texture].source; }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_STREAMING_H
@@ -0,0 +1,177 @@
+#ifndef VULKAN_TUT_TIMELINE_H
+#define VULKAN_TUT_TIMELINE_H
+
+#include <algorithm>
+#include <memory_resource>
+
+#include "common.h"
+
+namespace vk {
+
+// a timeline semaphore that counts the submissions to one queue. every submit that signals it
+// gets the next value, so value v being complete means that everything submitted to the queue
+// up to and including v is complete.
+//
+// this is the one primitive for all of the synchronization with the GPU: the CPU waits for a
+// value (wait), other queues wait for it in their submits (SubmitBatch::wait), and deferred
+// destruction or ring recycling compare values (is_complete). binary semaphores are only left
+// for the swap chain, acquire and present can't use timelines
+class Timeline {
+  VkDevice device_;
+  VkSemaphore semaphore_ = VK_NULL_HANDLE;
+  str name_;
+
+  u64 submitted_ = 0;  // the highest value a submit signals
+  u64 completed_ = 0;  // cached, the GPU is at least this far
+
+public:
+  Timeline(VkDevice device, str name) : device_(device), name_(std::move(name)) {
+    VkSemaphoreTypeCreateInfo type_info {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    info.pNext = &type_info;
+    VK_CHECK(vkCreateSemaphore(device_, &info, nullptr, &semaphore_));
+
+    spdlog::debug("created {} timeline", name_);
+  }
+
+  Timeline(const Timeline &) = delete;
+  Timeline &operator=(const Timeline &) = delete;
+
+  ~Timeline() {
+    vkDestroySemaphore(device_, semaphore_, nullptr);
+  }
+
+  VkSemaphore handle() const { return semaphore_; }
+  const str &name() const { return name_; }
+
+  // the value for the next submit that signals this timeline. the submits have to happen in the
+  // order of their values, so only take a value right before submitting
+  u64 next() { return ++submitted_; }
+
+  // the value of the last submit, waiting for it waits for everything submitted so far
+  u64 submitted() const { return submitted_; }
+
+  u64 completed() {
+    if (completed_ < submitted_) {
+      u64 value = 0;
+      VK_CHECK(vkGetSemaphoreCounterValue(device_, semaphore_, &value));
+      completed_ = std::max(completed_, value);
+    }
+    return completed_;
+  }
+
+  bool is_complete(u64 value) {
+    return value <= completed_ || value <= completed();
+  }
+
+  // false if the timeout ran out first
+  bool wait(u64 value, u64 timeout_ns = UINT64_MAX) {
+    if (value <= completed_) {
+      return true;
+    }
+
+    VkSemaphoreWaitInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    info.semaphoreCount = 1;
+    info.pSemaphores = &semaphore_;
+    info.pValues = &value;
+
+    VkResult res = vkWaitSemaphores(device_, &info, timeout_ns);
+    if (res == VK_TIMEOUT) {
+      return false;
+    }
+    VK_CHECK(res);
+
+    completed_ = std::max(completed_, value);
+    return true;
+  }
+
+  void wait_idle() { wait(submitted_); }
+};
+
+// the command buffers and semaphores of one vkQueueSubmit. timeline and binary semaphores can
+// be mixed, the values of the binary ones are ignored.
+//
+// a batch is built and submitted every frame, its arrays can come from a frame's arena
+class SubmitBatch {
+  std::pmr::vector<VkCommandBuffer> cmds_;
+
+  std::pmr::vector<VkSemaphore> wait_semaphores_;
+  std::pmr::vector<u64> wait_values_;
+  std::pmr::vector<VkPipelineStageFlags> wait_stages_;
+
+  std::pmr::vector<VkSemaphore> signal_semaphores_;
+  std::pmr::vector<u64> signal_values_;
+
+public:
+  explicit SubmitBatch(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+    : cmds_(memory),
+      wait_semaphores_(memory), wait_values_(memory), wait_stages_(memory),
+      signal_semaphores_(memory), signal_values_(memory) {}
+
+  SubmitBatch &command_buffer(VkCommandBuffer cmd) {
+    cmds_.push_back(cmd);
+    return *this;
+  }
+
+  // the commands of this batch from stage on don't start before value is complete
+  SubmitBatch &wait(Timeline &timeline, u64 value, VkPipelineStageFlags stage) {
+    wait_semaphores_.push_back(timeline.handle());
+    wait_values_.push_back(value);
+    wait_stages_.push_back(stage);
+    return *this;
+  }
+
+  SubmitBatch &wait_binary(VkSemaphore semaphore, VkPipelineStageFlags stage) {
+    wait_semaphores_.push_back(semaphore);
+    wait_values_.push_back(0);
+    wait_stages_.push_back(stage);
+    return *this;
+  }
+
+  SubmitBatch &signal_binary(VkSemaphore semaphore) {
+    signal_semaphores_.push_back(semaphore);
+    signal_values_.push_back(0);
+    return *this;
+  }
+
+  // returns the value the batch signals. only the last submit to a queue should signal its
+  // timeline, and the batch has to be submitted before the timeline's next value is taken
+  u64 signal(Timeline &timeline) {
+    const u64 value = timeline.next();
+    signal_semaphores_.push_back(timeline.handle());
+    signal_values_.push_back(value);
+    return value;
+  }
+
+  void submit(VkQueue queue) const {
+    VkTimelineSemaphoreSubmitInfo timeline_info {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = static_cast<u32>(wait_values_.size());
+    timeline_info.pWaitSemaphoreValues = wait_values_.data();
+    timeline_info.signalSemaphoreValueCount = static_cast<u32>(signal_values_.size());
+    timeline_info.pSignalSemaphoreValues = signal_values_.data();
+
+    VkSubmitInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    info.pNext = &timeline_info;
+    info.waitSemaphoreCount = static_cast<u32>(wait_semaphores_.size());
+    info.pWaitSemaphores = wait_semaphores_.data();
+    info.pWaitDstStageMask = wait_stages_.data();
+    info.commandBufferCount = static_cast<u32>(cmds_.size());
+    info.pCommandBuffers = cmds_.data();
+    info.signalSemaphoreCount = static_cast<u32>(signal_semaphores_.size());
+    info.pSignalSemaphores = signal_semaphores_.data();
+
+    VK_CHECK(vkQueueSubmit(queue, 1, &info, VK_NULL_HANDLE));
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_TIMELINE_H
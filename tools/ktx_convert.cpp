@@ -0,0 +1,321 @@
+// converts an image into the precompressed textures that the application looks for next to it
+// (see ktx.h), with the whole mip chain computed offline
+//
+// usage: vulkan_tut_ktx_convert <image> [bc7|rgba8]...
+//
+// e.g. vulkan_tut_ktx_convert textures/viking_room.png bc7 writes textures/viking_room.bc7.ktx2.
+// without a format both are written. the mips are box filtered in linear space, the image is
+// treated as sRGB like the application does with the source image.
+//
+// bc7 blocks are encoded in mode 6 only (one subset, 7 bit RGBA endpoints + p-bit, 4 bit
+// indices): noticeably worse than a full encoder on blocks with several distinct colors, but
+// simple and fast. ASTC files are loaded by the application too, they have to come from an
+// external encoder for now
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "../common.h"
+#include "../ktx.h"
+
+namespace {
+
+struct Image {
+  u32 width;
+  u32 height;
+  vec<u8> rgba;
+};
+
+float srgb_to_linear(u8 v) {
+  const float c = float(v) / 255.0f;
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+u8 linear_to_srgb(float c) {
+  c = std::clamp(c, 0.0f, 1.0f);
+  const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+  return static_cast<u8>(std::lround(s * 255.0f));
+}
+
+// 2x2 box filter. the last row or column of an odd extent is dropped, like the rounded down
+// extent of the next level implies; the clamping only matters once a side is down to 1 texel
+Image downsample(const Image &src) {
+  Image dst {vk::ktx::mip_extent(src.width, 1), vk::ktx::mip_extent(src.height, 1), {}};
+  dst.rgba.resize(size_t(dst.width) * dst.height * 4);
+
+  std::array<float, 256> to_linear {};
+  for (u32 i = 0; i < 256; ++i) {
+    to_linear[i] = srgb_to_linear(static_cast<u8>(i));
+  }
+
+  for (u32 y = 0; y < dst.height; ++y) {
+    for (u32 x = 0; x < dst.width; ++x) {
+      const u32 x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+      const u32 y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+      const u8 *p[4] = {
+        &src.rgba[(size_t(y0) * src.width + x0) * 4], &src.rgba[(size_t(y0) * src.width + x1) * 4],
+        &src.rgba[(size_t(y1) * src.width + x0) * 4], &src.rgba[(size_t(y1) * src.width + x1) * 4],
+      };
+
+      u8 *out = &dst.rgba[(size_t(y) * dst.width + x) * 4];
+      for (int c = 0; c < 3; ++c) {
+        out[c] = linear_to_srgb(0.25f * (to_linear[p[0][c]] + to_linear[p[1][c]] + to_linear[p[2][c]] + to_linear[p[3][c]]));
+      }
+      out[3] = static_cast<u8>((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+    }
+  }
+
+  return dst;
+}
+
+class BitWriter {
+  u8 *out_;
+  u32 pos_ = 0;
+
+public:
+  explicit BitWriter(u8 *out) : out_(out) { memset(out_, 0, 16); }
+
+  // lsb first
+  void put(u32 value, u32 bits) {
+    for (u32 b = 0; b < bits; ++b, ++pos_) {
+      if ((value >> b) & 1) {
+        out_[pos_ / 8] |= static_cast<u8>(1 << (pos_ % 8));
+      }
+    }
+  }
+};
+
+constexpr u32 BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+u32 bc7_interpolate(u32 e0, u32 e1, u32 index) {
+  return ((64 - BC7_WEIGHTS4[index]) * e0 + BC7_WEIGHTS4[index] * e1 + 32) >> 6;
+}
+
+// 7 bit per channel + a p-bit shared by the channels, the p-bit that lands closer wins
+void bc7_quantize_endpoint(const float v[4], u32 q[4], u32 &pbit) {
+  float best_err = std::numeric_limits<float>::max();
+  for (u32 p = 0; p < 2; ++p) {
+    u32 cand[4];
+    float err = 0.0f;
+    for (int c = 0; c < 4; ++c) {
+      cand[c] = static_cast<u32>(std::clamp(std::lround((v[c] - float(p)) / 2.0f), 0l, 127l));
+      const float d = float((cand[c] << 1) | p) - v[c];
+      err += d * d;
+    }
+
+    if (err < best_err) {
+      best_err = err;
+      pbit = p;
+      memcpy(q, cand, sizeof(cand));
+    }
+  }
+}
+
+// px: 16 rgba texels in row order. the endpoints are the extent of the block along its
+// principal axis, every texel then takes the palette entry closest to it
+void bc7_encode_block_mode6(const u8 px[16][4], u8 out[16]) {
+  float mean[4] = {};
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < 4; ++c) {
+      mean[c] += px[i][c] / 16.0f;
+    }
+  }
+
+  float cov[4][4] = {};
+  for (int i = 0; i < 16; ++i) {
+    float d[4];
+    for (int c = 0; c < 4; ++c) {
+      d[c] = px[i][c] - mean[c];
+    }
+    for (int a = 0; a < 4; ++a) {
+      for (int b = 0; b < 4; ++b) {
+        cov[a][b] += d[a] * d[b];
+      }
+    }
+  }
+
+  // power iteration, a few steps are plenty for a 4x4 matrix
+  float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for (int it = 0; it < 8; ++it) {
+    float next[4] = {};
+    for (int a = 0; a < 4; ++a) {
+      for (int b = 0; b < 4; ++b) {
+        next[a] += cov[a][b] * axis[b];
+      }
+    }
+
+    const float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+    if (len < 1e-6f) {
+      break;  // (nearly) a single color, any axis works
+    }
+    for (int c = 0; c < 4; ++c) {
+      axis[c] = next[c] / len;
+    }
+  }
+
+  float tmin = std::numeric_limits<float>::max();
+  float tmax = std::numeric_limits<float>::lowest();
+  for (int i = 0; i < 16; ++i) {
+    float t = 0.0f;
+    for (int c = 0; c < 4; ++c) {
+      t += (px[i][c] - mean[c]) * axis[c];
+    }
+    tmin = std::min(tmin, t);
+    tmax = std::max(tmax, t);
+  }
+
+  float e[2][4];
+  for (int c = 0; c < 4; ++c) {
+    e[0][c] = std::clamp(mean[c] + axis[c] * tmin, 0.0f, 255.0f);
+    e[1][c] = std::clamp(mean[c] + axis[c] * tmax, 0.0f, 255.0f);
+  }
+
+  u32 q[2][4];
+  u32 p[2];
+  bc7_quantize_endpoint(e[0], q[0], p[0]);
+  bc7_quantize_endpoint(e[1], q[1], p[1]);
+
+  u32 full[2][4];
+  for (int k = 0; k < 2; ++k) {
+    for (int c = 0; c < 4; ++c) {
+      full[k][c] = (q[k][c] << 1) | p[k];
+    }
+  }
+
+  u32 indices[16];
+  for (int i = 0; i < 16; ++i) {
+    u32 best = 0;
+    u32 best_err = std::numeric_limits<u32>::max();
+    for (u32 index = 0; index < 16; ++index) {
+      u32 err = 0;
+      for (int c = 0; c < 4; ++c) {
+        const int d = int(bc7_interpolate(full[0][c], full[1][c], index)) - int(px[i][c]);
+        err += u32(d * d);
+      }
+      if (err < best_err) {
+        best_err = err;
+        best = index;
+      }
+    }
+    indices[i] = best;
+  }
+
+  // the msb of the first index is implicitly 0, swap the endpoints if it isn't
+  if (indices[0] & 8) {
+    std::swap(q[0], q[1]);
+    std::swap(p[0], p[1]);
+    for (u32 &index: indices) {
+      index = 15 - index;
+    }
+  }
+
+  BitWriter bits(out);
+  bits.put(1 << 6, 7);  // mode 6
+  for (int c = 0; c < 4; ++c) {
+    bits.put(q[0][c], 7);
+    bits.put(q[1][c], 7);
+  }
+  bits.put(p[0], 1);
+  bits.put(p[1], 1);
+  bits.put(indices[0], 3);
+  for (int i = 1; i < 16; ++i) {
+    bits.put(indices[i], 4);
+  }
+}
+
+vec<u8> encode_bc7(const Image &image) {
+  const u32 blocks_x = (image.width + 3) / 4;
+  const u32 blocks_y = (image.height + 3) / 4;
+  vec<u8> out(size_t(blocks_x) * blocks_y * 16);
+
+  for (u32 by = 0; by < blocks_y; ++by) {
+    for (u32 bx = 0; bx < blocks_x; ++bx) {
+      // texels outside of the image repeat the edge, they are never sampled
+      u8 px[16][4];
+      for (u32 y = 0; y < 4; ++y) {
+        for (u32 x = 0; x < 4; ++x) {
+          const u32 sx = std::min(bx * 4 + x, image.width - 1);
+          const u32 sy = std::min(by * 4 + y, image.height - 1);
+          memcpy(px[y * 4 + x], &image.rgba[(size_t(sy) * image.width + sx) * 4], 4);
+        }
+      }
+
+      bc7_encode_block_mode6(px, &out[(size_t(by) * blocks_x + bx) * 16]);
+    }
+  }
+
+  return out;
+}
+
+bool convert(const vec<Image> &mips, const str &source_path, const str &name) {
+  VkFormat format;
+  if (name == "bc7") {
+    format = VK_FORMAT_BC7_SRGB_BLOCK;
+  } else if (name == "rgba8") {
+    format = VK_FORMAT_R8G8B8A8_SRGB;
+  } else {
+    spdlog::error("unknown format {}, expected bc7 or rgba8", name);
+    return false;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  vec<vec<u8>> levels;
+  for (const auto &mip: mips) {
+    levels.push_back(format == VK_FORMAT_BC7_SRGB_BLOCK ? encode_bc7(mip) : mip.rgba);
+  }
+
+  spdlog::info(
+    "encoded {} levels as {} in {:.1f} ms", levels.size(), name,
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+  );
+
+  return vk::ktx::write(vk::ktx::path_for(source_path, name), format, mips[0].width, mips[0].height, levels);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fmt::print("usage: {} <image> [bc7|rgba8]...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const str source_path = argv[1];
+  vec<str> formats;
+  for (int i = 2; i < argc; ++i) {
+    formats.emplace_back(argv[i]);
+  }
+  if (formats.empty()) {
+    formats = {"bc7", "rgba8"};
+  }
+
+  int width, height, channels;
+  stbi_uc *pixels = stbi_load(source_path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if (pixels == nullptr) {
+    spdlog::error("failed to load {}: {}", source_path, stbi_failure_reason());
+    return EXIT_FAILURE;
+  }
+
+  vec<Image> mips;
+  mips.push_back({u32(width), u32(height), vec<u8>(pixels, pixels + size_t(width) * height * 4)});
+  stbi_image_free(pixels);
+
+  while (mips.back().width > 1 || mips.back().height > 1) {
+    mips.push_back(downsample(mips.back()));
+  }
+
+  bool ok = true;
+  for (const auto &name: formats) {
+    ok = convert(mips, source_path, name) && ok;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
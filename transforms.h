@@ -0,0 +1,155 @@
+#ifndef VULKAN_TUT_TRANSFORMS_H
+#define VULKAN_TUT_TRANSFORMS_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+
+#include "common.h"
+#include "simd.h"
+#include "vertex.h"
+
+namespace vk {
+
+// the transforms of the instances as structure of arrays, composed into model matrices and
+// culled four instances at a time (simd.h).
+//
+// an instance is placed at a position, turned around its z axis by yaw + spin * time and scaled
+// uniformly: its model matrix is translate(position) * rotate_z(yaw + spin * time) * scale.
+//
+// write() only reads the arrays, any number of threads can write disjoint ranges of instances at
+// once
+class InstanceTransforms {
+  // padded to whole groups of four, padding has scale 0
+  vec<float> x_, y_, z_, yaw_, spin_, scale_;
+  u32 count_ = 0;
+
+public:
+  // instances are written in groups of this many
+  static constexpr u32 GROUP = 4;
+
+  // culled instances are collected in batches of up to this many, one atomic per batch
+  static constexpr u32 BATCH = 64;
+
+  // the bounding sphere of what is instanced in the space the model matrices apply to, and the
+  // frustum planes of frustumPlanes() in main.cpp (normals point inside)
+  struct Frustum {
+    std::array<glm::vec4, 6> planes;
+    glm::vec4 sphere;
+  };
+
+  void resize(u32 count) {
+    count_ = count;
+    const size_t padded = (count + GROUP - 1) / GROUP * GROUP;
+    for (auto *a: {&x_, &y_, &z_, &yaw_, &spin_, &scale_}) {
+      a->assign(padded, 0.0f);
+    }
+  }
+
+  void set(u32 i, glm::vec3 position, float yaw, float spin, float scale) {
+    x_[i] = position.x;
+    y_[i] = position.y;
+    z_[i] = position.z;
+    yaw_[i] = yaw;
+    spin_[i] = spin;
+    scale_[i] = scale;
+  }
+
+  u32 size() const { return count_; }
+
+  // the model matrices of the instances [begin, end) at the given time, begin is a multiple of
+  // GROUP. without a frustum instance i goes to out[i]. with one only the instances whose
+  // bounding sphere is inside of it are written, one after another: they are collected in
+  // batches that take the next slots of out with visible.fetch_add, so threads culling different
+  // ranges compact into the same buffer.
+  //
+  // out is meant to be mapped memory (write combined, usually), it's only ever written and
+  // always with whole matrices
+  void write(u32 begin, u32 end, float time, const Frustum *frustum, InstanceData *out, std::atomic<u32> &visible) const {
+    using namespace simd;
+
+    const f32x4 t = splat(time);
+    const f32x4 zero = splat(0.0f);
+    const f32x4 one = splat(1.0f);
+
+    InstanceData batch[BATCH];
+    u32 batched = 0;
+    auto flush = [&] {
+      const u32 first = visible.fetch_add(batched, std::memory_order_relaxed);
+      memcpy(out + first, batch, sizeof(InstanceData) * batched);
+      batched = 0;
+    };
+
+    for (u32 i = begin; i < end; i += GROUP) {
+      const f32x4 angle = madd(load(&spin_[i]), t, load(&yaw_[i]));
+      const f32x4 s = load(&scale_[i]);
+      const f32x4 cos_s = cos(angle) * s;
+      const f32x4 sin_s = sin(angle) * s;
+      const f32x4 x = load(&x_[i]);
+      const f32x4 y = load(&y_[i]);
+      const f32x4 z = load(&z_[i]);
+
+      // lanes past the end are never written
+      u32 lanes = end - i < GROUP ? (1u << (end - i)) - 1 : (1u << GROUP) - 1;
+
+      if (frustum != nullptr) {
+        // the center of the sphere in world space, the radius only scales
+        const glm::vec4 &sphere = frustum->sphere;
+        const f32x4 cx = madd(cos_s, splat(sphere.x), madd(-sin_s, splat(sphere.y), x));
+        const f32x4 cy = madd(sin_s, splat(sphere.x), madd(cos_s, splat(sphere.y), y));
+        const f32x4 cz = madd(s, splat(sphere.z), z);
+        const f32x4 neg_radius = -(s * splat(sphere.w));
+
+        u32 outside = 0;
+        for (const glm::vec4 &p: frustum->planes) {
+          const f32x4 distance = madd(splat(p.x), cx, madd(splat(p.y), cy, madd(splat(p.z), cz, splat(p.w))));
+          outside |= bits(distance < neg_radius);
+        }
+        lanes &= ~outside;
+      }
+
+      if (lanes == 0) {
+        continue;
+      }
+
+      // the columns of the four matrices, each vector holds a column of all of them.
+      // transposed, each holds a column of one of them
+      f32x4 c0[4] = {cos_s, sin_s, zero, zero};
+      f32x4 c1[4] = {-sin_s, cos_s, zero, zero};
+      f32x4 c2[4] = {zero, zero, s, zero};
+      f32x4 c3[4] = {x, y, z, one};
+      for (f32x4 *c: {c0, c1, c2, c3}) {
+        transpose(c[0], c[1], c[2], c[3]);
+      }
+
+      InstanceData *dst = frustum != nullptr ? batch + batched : out + i;
+      for (u32 lane = 0; lane < GROUP; ++lane) {
+        if ((lanes & (1u << lane)) == 0) {
+          continue;
+        }
+        float *m = &dst->model[0][0];
+        store(m, c0[lane]);
+        store(m + 4, c1[lane]);
+        store(m + 8, c2[lane]);
+        store(m + 12, c3[lane]);
+        ++dst;
+      }
+
+      if (frustum != nullptr) {
+        batched += static_cast<u32>(std::popcount(lanes));
+        if (batched > BATCH - GROUP) {
+          flush();
+        }
+      }
+    }
+
+    if (batched > 0) {
+      flush();
+    }
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_TRANSFORMS_H
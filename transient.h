@@ -0,0 +1,122 @@
+#ifndef VULKAN_TUT_TRANSIENT_H
+#define VULKAN_TUT_TRANSIENT_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "common.h"
+#include "memory.h"
+
+namespace vk {
+
+// GPU data that only lives for one frame (per-frame and per-draw uniforms) in a single,
+// persistently mapped, host visible buffer that is split into one region per frame in flight.
+//
+// allocating is a bump of the frame's head, atomic so that the workers recording secondary
+// command buffers can push their per-draw data without locking. the whole region is recycled by
+// begin_frame(), which is only allowed once the GPU is done with the frame that used it last.
+//
+// the buffer is bound once with VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptors that start
+// at offset 0, and the offsets returned by push() are the dynamic offsets for
+// vkCmdBindDescriptorSets. so any number of draws with their own data costs no descriptor writes
+class TransientBuffer {
+  VkDevice device_;
+  MemoryAllocator &allocator_;
+
+  VkBuffer buffer_;
+  Allocation memory_;
+  VkDeviceSize frame_capacity_;
+  VkDeviceSize alignment_;
+
+  VkDeviceSize frame_begin_ = 0;
+  std::atomic<VkDeviceSize> head_ = 0;  // relative to frame_begin_
+
+  static VkDeviceSize align_up(VkDeviceSize v, VkDeviceSize alignment) {
+    return (v + alignment - 1) / alignment * alignment;
+  }
+
+public:
+  static constexpr VkDeviceSize DEFAULT_FRAME_CAPACITY = 4 * 1024 * 1024;
+
+  TransientBuffer(
+    VkDevice device,
+    VkPhysicalDevice physical_device,
+    MemoryAllocator &allocator,
+    u32 frames_in_flight,
+    VkDeviceSize frame_capacity = DEFAULT_FRAME_CAPACITY
+  ) : device_(device), allocator_(allocator) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physical_device, &props);
+
+    // every allocation is a possible dynamic offset
+    alignment_ = std::max<VkDeviceSize>(props.limits.minUniformBufferOffsetAlignment, 16);
+    frame_capacity_ = align_up(frame_capacity, alignment_);
+
+    VkBufferCreateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = frame_capacity_ * frames_in_flight;
+    // storage: the bindless shaders read it through BindlessDescriptors instead
+    info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device_, &info, nullptr, &buffer_));
+
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements(device_, buffer_, &reqs);
+    memory_ = allocator_.allocate(
+      reqs,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      true
+    );
+    VK_CHECK(vkBindBufferMemory(device_, buffer_, memory_.memory, memory_.offset));
+
+    spdlog::debug(
+      "created transient buffer of {} KiB x {} frames, {} byte alignment",
+      frame_capacity_ / 1024, frames_in_flight, alignment_
+    );
+  }
+
+  TransientBuffer(const TransientBuffer &) = delete;
+  TransientBuffer &operator=(const TransientBuffer &) = delete;
+
+  ~TransientBuffer() {
+    vkDestroyBuffer(device_, buffer_, nullptr);
+    allocator_.free(memory_);
+  }
+
+  // not thread safe, call before anything is pushed for the frame
+  void begin_frame(u32 frame) {
+    frame_begin_ = frame_capacity_ * frame;
+    head_.store(0, std::memory_order_relaxed);
+  }
+
+  // returns the offset of the allocation inside buffer(), data points to it
+  u32 allocate(VkDeviceSize size, void *&data) {
+    const VkDeviceSize aligned = align_up(size, alignment_);
+    const VkDeviceSize pos = head_.fetch_add(aligned, std::memory_order_relaxed);
+    if (pos + aligned > frame_capacity_) {
+      throw std::runtime_error(fmt::format(
+        "transient buffer exhausted: {} bytes per frame are not enough", frame_capacity_));
+    }
+
+    data = static_cast<char *>(memory_.mapped) + frame_begin_ + pos;
+    return static_cast<u32>(frame_begin_ + pos);
+  }
+
+  // copies value into this frame's region, returns the dynamic offset
+  template<typename T>
+  u32 push(const T &value) {
+    void *data;
+    const u32 offset = allocate(sizeof(T), data);
+    memcpy(data, &value, sizeof(T));
+    return offset;
+  }
+
+  VkDeviceSize used() const { return head_.load(std::memory_order_relaxed); }
+
+  VkBuffer buffer() const { return buffer_; }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_TRANSIENT_H
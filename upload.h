@@ -0,0 +1,567 @@
+#ifndef VULKAN_TUT_UPLOAD_H
+#define VULKAN_TUT_UPLOAD_H
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <span>
+
+#include "common.h"
+#include "arena.h"
+#include "device.h"
+#include "memory.h"
+#include "timeline.h"
+
+namespace vk {
+
+// a single, persistently mapped, host visible buffer that all staging data goes through.
+//
+// head_ and tail_ grow monotonically, their value modulo the capacity is the position inside
+// the buffer. [tail_, head_) is the part of the ring that may still be read by the GPU.
+// allocations never straddle the end of the buffer, if one doesn't fit we skip to the start.
+class StagingRing {
+  VkDevice device_;
+  MemoryAllocator &allocator_;
+
+  VkBuffer buffer_;
+  Allocation memory_;
+  VkDeviceSize capacity_;
+
+  VkDeviceSize head_ = 0;
+  VkDeviceSize tail_ = 0;
+
+public:
+  StagingRing(VkDevice device, MemoryAllocator &allocator, VkDeviceSize capacity)
+    : device_(device), allocator_(allocator), capacity_(capacity) {
+    VkBufferCreateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = capacity;
+    info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(device_, &info, nullptr, &buffer_));
+
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements(device_, buffer_, &reqs);
+    memory_ = allocator_.allocate(
+      reqs,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      true
+    );
+    VK_CHECK(vkBindBufferMemory(device_, buffer_, memory_.memory, memory_.offset));
+
+    spdlog::debug("created staging ring of {} KiB", capacity / 1024);
+  }
+
+  StagingRing(const StagingRing &) = delete;
+  StagingRing &operator=(const StagingRing &) = delete;
+
+  ~StagingRing() {
+    vkDestroyBuffer(device_, buffer_, nullptr);
+    allocator_.free(memory_);
+  }
+
+  // on success out_offset is the (monotonic) position of the allocation, use offset() to get the
+  // position inside the buffer. fails if the GPU hasn't consumed enough of the ring yet
+  bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &out_pos) {
+    if (size > capacity_) {
+      throw std::runtime_error(fmt::format(
+        "staging allocation of {} bytes exceeds ring capacity of {} bytes", size, capacity_));
+    }
+
+    VkDeviceSize pos = (head_ + alignment - 1) / alignment * alignment;
+    if (pos % capacity_ + size > capacity_) {
+      // wrap around to the start of the buffer
+      pos = (pos / capacity_ + 1) * capacity_;
+    }
+
+    if (pos + size - tail_ > capacity_) {
+      return false;
+    }
+
+    head_ = pos + size;
+    out_pos = pos;
+    return true;
+  }
+
+  // everything before pos has been consumed by the GPU
+  void retire(VkDeviceSize pos) { tail_ = std::max(tail_, pos); }
+
+  VkDeviceSize offset(VkDeviceSize pos) const { return pos % capacity_; }
+  char *data(VkDeviceSize pos) { return static_cast<char *>(memory_.mapped) + offset(pos); }
+
+  VkDeviceSize head() const { return head_; }
+  VkDeviceSize capacity() const { return capacity_; }
+  VkBuffer buffer() const { return buffer_; }
+};
+
+// a queue, its family index and the timeline that counts its submits
+struct QueueSlot {
+  VkQueue queue = VK_NULL_HANDLE;
+  u32 family = 0;
+  Timeline *timeline = nullptr;
+};
+
+// records any number of copies from the staging ring into one command buffer and submits them
+// together, signaling the timeline of the queue. nothing waits for the queue to go idle: callers
+// get a ticket back from flush() and only wait on it if they actually need the result on the CPU
+// side.
+//
+// ring space used by a batch is recycled by collect() once the batch's timeline value is
+// complete.
+//
+// if the device has a dedicated transfer queue family the copies run there, so they don't compete
+// with rendering on the graphics queue. each batch then consists of two command buffers:
+// - cmd(): recorded for the transfer queue; copies and the *release* half of the queue family
+//   ownership transfers
+// - graphics_cmd(): recorded for the graphics queue; the matching *acquire* barriers and anything
+//   that needs a graphics queue (e.g. mipmap blits). it waits for the transfer timeline value of
+//   cmd()
+// without a dedicated family both return the same command buffer on the graphics queue.
+//
+// gpu work submitted to the graphics queue after flush() is ordered after the uploads by a
+// barrier recorded at the end of graphics_cmd()
+//
+// work that is batched across the uploads of a batch (e.g. MipGenerator) records itself into
+// graphics_cmd() from the on_flush hook, and hands whatever its commands use to
+// release_after_batch
+class UploadQueue {
+  struct Batch {
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    VkCommandBuffer graphics_cmd = VK_NULL_HANDLE;  // == cmd without a dedicated transfer queue
+    u64 value = 0;  // on the graphics timeline, the batch always ends on the graphics queue
+    VkDeviceSize ring_end = 0;
+    u64 ticket = 0;
+    vec<std::function<void()>> releases;
+  };
+
+  VkDevice device_;
+  const DeviceFns &fns_;
+  QueueSlot transfer_;
+  QueueSlot graphics_;
+  FrameArenas &arenas_;  // for the submits, only the main thread uploads
+
+  VkCommandPool transfer_pool_;
+  VkCommandPool graphics_pool_;
+  StagingRing ring_;
+
+  std::deque<Batch> in_flight_;
+  vec<Batch> free_;
+
+  Batch current_ {};
+  bool recording_ = false;
+
+  // buffers written by the current batch that have to change owner at flush()
+  vec<VkBufferMemoryBarrier> buffer_releases_;
+
+  std::function<void(VkCommandBuffer)> flush_hook_;
+
+  u64 next_ticket_ = 1;
+  u64 completed_ = 0;
+
+  VkCommandPool create_pool(u32 family) {
+    VkCommandPoolCreateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    info.queueFamilyIndex = family;
+
+    VkCommandPool pool;
+    VK_CHECK(vkCreateCommandPool(device_, &info, nullptr, &pool));
+    return pool;
+  }
+
+  VkCommandBuffer allocate_cmd(VkCommandPool pool) {
+    VkCommandBufferAllocateInfo alloc_info {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandPool = pool;
+    alloc_info.commandBufferCount = 1;
+
+    VkCommandBuffer cmd;
+    VK_CHECK(vkAllocateCommandBuffers(device_, &alloc_info, &cmd));
+    return cmd;
+  }
+
+  static void begin(VkCommandBuffer cmd) {
+    VkCommandBufferBeginInfo begin_info {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+  }
+
+  Batch acquire_batch() {
+    if (!free_.empty()) {
+      Batch b = std::move(free_.back());
+      free_.pop_back();
+      VK_CHECK(vkResetCommandBuffer(b.cmd, 0));
+      if (b.graphics_cmd != b.cmd) {
+        VK_CHECK(vkResetCommandBuffer(b.graphics_cmd, 0));
+      }
+      return b;
+    }
+
+    Batch b {};
+    b.cmd = allocate_cmd(transfer_pool_);
+
+    if (dedicated_transfer()) {
+      b.graphics_cmd = allocate_cmd(graphics_pool_);
+    } else {
+      b.graphics_cmd = b.cmd;
+    }
+
+    return b;
+  }
+
+  void begin_batch() {
+    if (recording_) {
+      return;
+    }
+
+    current_ = acquire_batch();
+    begin(current_.cmd);
+    if (current_.graphics_cmd != current_.cmd) {
+      begin(current_.graphics_cmd);
+    }
+
+    recording_ = true;
+  }
+
+  // staging space is exhausted: make sure the pending copies are submitted and wait for the
+  // oldest batch to free up its part of the ring
+  void make_room() {
+    if (recording_) {
+      flush();
+    }
+
+    if (in_flight_.empty()) {
+      throw std::runtime_error("staging ring exhausted with no uploads in flight!");
+    }
+
+    wait(in_flight_.front().ticket);
+  }
+
+public:
+  static constexpr VkDeviceSize DEFAULT_RING_SIZE = 64 * 1024 * 1024;
+
+  // pass the graphics queue (and its timeline) as transfer queue if the device has no dedicated
+  // transfer family
+  UploadQueue(
+    VkDevice device,
+    const DeviceFns &fns,
+    QueueSlot transfer,
+    QueueSlot graphics,
+    MemoryAllocator &allocator,
+    FrameArenas &arenas,
+    VkDeviceSize ring_size = DEFAULT_RING_SIZE
+  ) : device_(device), fns_(fns), transfer_(transfer), graphics_(graphics), arenas_(arenas), ring_(device, allocator, ring_size) {
+    transfer_pool_ = create_pool(transfer_.family);
+    graphics_pool_ = dedicated_transfer() ? create_pool(graphics_.family) : transfer_pool_;
+
+    spdlog::debug(
+      "upload queue on family {}{}",
+      transfer_.family,
+      dedicated_transfer() ? " (dedicated transfer family)" : ""
+    );
+  }
+
+  UploadQueue(const UploadQueue &) = delete;
+  UploadQueue &operator=(const UploadQueue &) = delete;
+
+  ~UploadQueue() {
+    if (recording_) {
+      flush();
+    }
+
+    if (!in_flight_.empty()) {
+      graphics_.timeline->wait(in_flight_.back().value);
+    }
+    collect();
+
+    // command buffers are freed together with their pool
+    vkDestroyCommandPool(device_, transfer_pool_, nullptr);
+    if (graphics_pool_ != transfer_pool_) {
+      vkDestroyCommandPool(device_, graphics_pool_, nullptr);
+    }
+  }
+
+  bool dedicated_transfer() const { return transfer_.family != graphics_.family; }
+
+  u32 transfer_family() const { return transfer_.family; }
+  u32 graphics_family() const { return graphics_.family; }
+
+  // command buffer of the batch currently being recorded for the transfer queue.
+  // begins a new batch if needed
+  VkCommandBuffer cmd() {
+    begin_batch();
+    return current_.cmd;
+  }
+
+  // command buffer of the current batch that executes on the graphics queue after cmd()
+  VkCommandBuffer graphics_cmd() {
+    begin_batch();
+    return current_.graphics_cmd;
+  }
+
+  VkBuffer buffer() const { return ring_.buffer(); }
+
+  // copies data into the ring and returns its offset inside buffer()
+  // the returned range stays valid until the batch that is currently being recorded completes,
+  // so the copy reading from it has to be recorded into cmd() before the next flush().
+  // stage() may flush the current batch to make room, so call cmd() after it, not before
+  VkDeviceSize stage(const void *data, VkDeviceSize size, VkDeviceSize alignment = 16) {
+    return stage_with(size, alignment, [&](std::byte *dst) {
+      memcpy(dst, data, static_cast<size_t>(size));
+    });
+  }
+
+  // like stage(), but fill(std::byte *dst) writes the size bytes itself: data that is produced
+  // anyway (decoded, converted, ...) goes straight into the mapped ring without a copy in
+  // between. the ring is write combined memory on most devices, fill should write it
+  // sequentially and never read it
+  template<typename Fill>
+  VkDeviceSize stage_with(VkDeviceSize size, VkDeviceSize alignment, Fill &&fill) {
+    VkDeviceSize pos;
+    while (!ring_.allocate(size, alignment, pos)) {
+      make_room();
+    }
+
+    // make_room may have flushed, make sure the copy lands in a batch that is being recorded
+    begin_batch();
+
+    fill(reinterpret_cast<std::byte *>(ring_.data(pos)));
+    return ring_.offset(pos);
+  }
+
+  void upload_buffer(VkBuffer dst, VkDeviceSize dst_offset, const void *data, VkDeviceSize size) {
+    auto src = static_cast<const std::byte *>(data);
+    upload_buffer_with(dst, dst_offset, size, 1, [src](std::byte *out, VkDeviceSize offset, VkDeviceSize chunk) {
+      memcpy(out, src + offset, static_cast<size_t>(chunk));
+    });
+  }
+
+  // like upload_buffer(), with stage_with() for every chunk: fill(std::byte *dst, offset, size)
+  // writes bytes [offset, offset + size) of the buffer's data. chunks are a multiple of
+  // granularity (e.g. the size of an element) unless it's the last one
+  template<typename Fill>
+  void upload_buffer_with(VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize size, VkDeviceSize granularity, Fill &&fill) {
+    // large buffers are split so that a single upload never needs the whole ring
+    const VkDeviceSize max_chunk = std::max(ring_.capacity() / 4 / granularity, VkDeviceSize(1)) * granularity;
+
+    VkDeviceSize done = 0;
+    while (done < size) {
+      VkDeviceSize chunk = std::min(size - done, max_chunk);
+      VkDeviceSize offset = stage_with(chunk, 16, [&](std::byte *out) { fill(out, done, chunk); });
+
+      VkBufferCopy region {};
+      region.srcOffset = offset;
+      region.dstOffset = dst_offset + done;
+      region.size = chunk;
+      fns_.vkCmdCopyBuffer(cmd(), ring_.buffer(), dst, 1, &region);
+
+      if (dedicated_transfer()) {
+        VkBufferMemoryBarrier barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = transfer_.family;
+        barrier.dstQueueFamilyIndex = graphics_.family;
+        barrier.buffer = dst;
+        barrier.offset = dst_offset + done;
+        barrier.size = chunk;
+        buffer_releases_.push_back(barrier);
+      }
+
+      done += chunk;
+    }
+  }
+
+  // one mip level of an image, its texels (or blocks) tightly packed
+  struct ImageLevel {
+    const void *data;
+    u32 width;
+    u32 height;
+  };
+
+  // copies levels[i] into mip level i of dst, which has to be in TRANSFER_DST_OPTIMAL. like
+  // upload_buffer(), every level is staged on its own and one that's larger than a quarter of
+  // the ring is split into bands of (block) rows, one copy region each. the block_* describe the
+  // format: 1x1 and the size of a texel if it isn't block compressed.
+  // may flush, anything recorded for dst afterwards has to get cmd() / graphics_cmd() again
+  void upload_image(VkImage dst, std::span<const ImageLevel> levels, u32 block_width, u32 block_height, u32 block_size) {
+    const VkDeviceSize max_chunk = ring_.capacity() / 4;
+
+    // buffer offsets have to be a multiple of the block size and of 4
+    const VkDeviceSize alignment = std::max<VkDeviceSize>(block_size, 16);
+
+    for (u32 i = 0; i < levels.size(); ++i) {
+      const ImageLevel &level = levels[i];
+      const u32 rows = (level.height + block_height - 1) / block_height;
+      const VkDeviceSize row_size = VkDeviceSize((level.width + block_width - 1) / block_width) * block_size;
+      const u32 band = static_cast<u32>(std::clamp<VkDeviceSize>(max_chunk / row_size, 1, rows));
+
+      for (u32 row = 0; row < rows; row += band) {
+        const u32 count = std::min(band, rows - row);
+        const VkDeviceSize offset = stage(
+          static_cast<const std::byte *>(level.data) + row * row_size, count * row_size, alignment
+        );
+
+        VkBufferImageCopy region {};
+        region.bufferOffset = offset;
+        region.bufferRowLength = 0;  // tightly packed
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = i;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, static_cast<int32_t>(row * block_height), 0};
+        region.imageExtent = {level.width, std::min(count * block_height, level.height - row * block_height), 1};
+        fns_.vkCmdCopyBufferToImage(cmd(), ring_.buffer(), dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+      }
+    }
+  }
+
+  // called by flush() with graphics_cmd() before anything else is recorded at the end of the
+  // batch. a single hook, nullptr removes it
+  void on_flush(std::function<void(VkCommandBuffer)> hook) {
+    flush_hook_ = std::move(hook);
+  }
+
+  // release runs once the batch currently being recorded has completed on the GPU, for objects
+  // its commands use (descriptor pools, image views, ...). begins a new batch if needed
+  void release_after_batch(std::function<void()> release) {
+    begin_batch();
+    current_.releases.push_back(std::move(release));
+  }
+
+  // submits everything recorded so far. returns a ticket that can be passed to wait()
+  u64 flush() {
+    if (!recording_) {
+      return next_ticket_ - 1;
+    }
+
+    if (flush_hook_) {
+      flush_hook_(current_.graphics_cmd);
+    }
+
+    const VkAccessFlags consumer_access =
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+      VK_ACCESS_INDEX_READ_BIT |
+      VK_ACCESS_UNIFORM_READ_BIT |
+      VK_ACCESS_SHADER_READ_BIT;
+    const VkPipelineStageFlags consumer_stages =
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+      VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+    if (dedicated_transfer() && !buffer_releases_.empty()) {
+      // release: only the source access mask matters on the transfer queue side
+      for (auto &b: buffer_releases_) {
+        b.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        b.dstAccessMask = 0;
+      }
+
+      fns_.vkCmdPipelineBarrier(
+        current_.cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0,
+        0, nullptr,
+        (u32) buffer_releases_.size(), buffer_releases_.data(),
+        0, nullptr
+      );
+
+      // acquire: identical barrier on the graphics queue, only the destination access mask matters
+      for (auto &b: buffer_releases_) {
+        b.srcAccessMask = 0;
+        b.dstAccessMask = consumer_access;
+      }
+
+      fns_.vkCmdPipelineBarrier(
+        current_.graphics_cmd,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, consumer_stages,
+        0,
+        0, nullptr,
+        (u32) buffer_releases_.size(), buffer_releases_.data(),
+        0, nullptr
+      );
+    }
+
+    buffer_releases_.clear();
+
+    // make the uploaded data visible to anything that's submitted to the graphics queue after
+    // this batch (mostly relevant without a dedicated transfer queue, where it's the only barrier)
+    VkMemoryBarrier barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = consumer_access;
+    fns_.vkCmdPipelineBarrier(
+      current_.graphics_cmd,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      consumer_stages,
+      0,
+      1, &barrier,
+      0, nullptr,
+      0, nullptr
+    );
+
+    VK_CHECK(vkEndCommandBuffer(current_.cmd));
+
+    if (dedicated_transfer()) {
+      VK_CHECK(vkEndCommandBuffer(current_.graphics_cmd));
+
+      SubmitBatch transfer_submit(&arenas_.local());
+      transfer_submit.command_buffer(current_.cmd);
+      const u64 transfer_value = transfer_submit.signal(*transfer_.timeline);
+      transfer_submit.submit(transfer_.queue);
+
+      // the acquire barriers must not execute before the release barriers did
+      SubmitBatch graphics_submit(&arenas_.local());
+      graphics_submit.command_buffer(current_.graphics_cmd);
+      graphics_submit.wait(*transfer_.timeline, transfer_value, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+      current_.value = graphics_submit.signal(*graphics_.timeline);
+      graphics_submit.submit(graphics_.queue);
+    } else {
+      SubmitBatch submit(&arenas_.local());
+      submit.command_buffer(current_.cmd);
+      current_.value = submit.signal(*graphics_.timeline);
+      submit.submit(transfer_.queue);
+    }
+
+    current_.ring_end = ring_.head();
+    current_.ticket = next_ticket_++;
+    const u64 ticket = current_.ticket;
+    in_flight_.push_back(std::move(current_));
+    current_ = {};
+    recording_ = false;
+
+    return ticket;
+  }
+
+  // retires all batches the GPU is done with and recycles their ring space
+  void collect() {
+    while (!in_flight_.empty() && graphics_.timeline->is_complete(in_flight_.front().value)) {
+      auto &b = in_flight_.front();
+      ring_.retire(b.ring_end);
+      completed_ = b.ticket;
+      for (auto &release: b.releases) {
+        release();
+      }
+      b.releases.clear();
+      free_.push_back(std::move(b));
+      in_flight_.pop_front();
+    }
+  }
+
+  bool is_complete(u64 ticket) {
+    collect();
+    return ticket <= completed_;
+  }
+
+  void wait(u64 ticket) {
+    while (!in_flight_.empty() && in_flight_.front().ticket <= ticket) {
+      graphics_.timeline->wait(in_flight_.front().value);
+      collect();
+    }
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_UPLOAD_H
@@ -0,0 +1,225 @@
+#ifndef VULKAN_TUT_VERTEX_H
+#define VULKAN_TUT_VERTEX_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+
+// the GLM_FORCE_* defines in main.cpp change the layout of the glm types, they have to be set
+// before glm is included for the first time
+#include <glm/glm.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include "common.h"
+
+// hash function for Vertex (for unordered_map)
+// implemented by specifying template specialization for std::hash<T>
+
+
+struct Vertex {
+  glm::vec3 pos;
+  glm::vec3 color;
+  glm::vec2 texCoord;
+
+  // needed for unordered_map
+  bool operator==(const Vertex &other) const {
+    return pos == other.pos &&
+           color == other.color &&
+           texCoord == other.texCoord;
+
+  }
+
+  // why the following static methods are needed:
+  // we need to tell vulkan how to pass vertex data format to the vertex shader
+  // once it's been uploaded into GPU memory. both structures are needed to convey
+  // this information
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription {};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(Vertex);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    return bindingDescription;
+  }
+
+  // TODO(cpp): do I get a compile error if i use array<..., > and do arr[x] / arr[x+1]?
+  static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions {};
+
+    attributeDescriptions[0].binding = 0;
+    attributeDescriptions[0].location = 0;
+    attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[0].offset = offsetof(Vertex, pos);
+
+    attributeDescriptions[1].binding = 0;
+    attributeDescriptions[1].location = 1;
+    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[1].offset = offsetof(Vertex, color);
+
+    attributeDescriptions[2].binding = 0;
+    attributeDescriptions[2].location = 2;
+    attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+
+    return attributeDescriptions;
+  }
+};
+
+// per-instance data, read from a second vertex binding that advances once per instance
+// instead of once per vertex
+struct InstanceData {
+  glm::mat4 model;
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription {};
+    bindingDescription.binding = 1;
+    bindingDescription.stride = sizeof(InstanceData);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    return bindingDescription;
+  }
+
+  // a mat4 attribute takes up 4 consecutive locations, one per column
+  static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions {};
+
+    for (uint32_t i = 0; i < 4; ++i) {
+      attributeDescriptions[i].binding = 1;
+      attributeDescriptions[i].location = 3 + i;
+      attributeDescriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+      attributeDescriptions[i].offset = offsetof(InstanceData, model) + i * sizeof(glm::vec4);
+    }
+
+    return attributeDescriptions;
+  }
+};
+
+namespace std {
+template<>
+struct hash<Vertex> {
+  size_t operator()(Vertex const &vertex) const {
+    return ((hash<glm::vec3>()(vertex.pos) ^
+             (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
+           (hash<glm::vec2>()(vertex.texCoord) << 1);
+  }
+};
+}
+
+namespace vk {
+
+// 64 bit hash over the bit patterns of all attributes. unlike std::hash<Vertex>, which xors
+// and shifts the per-member glm hashes (so e.g. swapped or mirrored coordinates collide), every
+// input bit affects every output bit. -0.0f is folded into 0.0f because they compare equal
+inline u64 hash_vertex(const Vertex &v) {
+  const float values[] = {
+    v.pos.x, v.pos.y, v.pos.z,
+    v.color.x, v.color.y, v.color.z,
+    v.texCoord.x, v.texCoord.y
+  };
+
+  u64 h = 0x9e3779b97f4a7c15ull;
+  for (float f: values) {
+    u64 bits = std::bit_cast<u32>(f == 0.0f ? 0.0f : f);
+    h = (h ^ bits) * 0xff51afd7ed558ccdull;
+    h ^= h >> 32;
+  }
+
+  // murmur3 finalizer
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// builds a deduplicated vertex array + index array from a stream of (possibly repeated) vertices.
+//
+// open addressing with linear probing in a power of two sized table that is never more than half
+// full. a slot holds the index of the vertex in vertices_ and 32 bits of its hash, so a probe only
+// touches the vertex itself if the hashes match. insert() is a single lookup that either finds
+// the vertex or claims the empty slot it ended on.
+class VertexDedup {
+  struct Slot {
+    u32 hash;
+    u32 index;  // EMPTY if unused
+  };
+
+  static constexpr u32 EMPTY = std::numeric_limits<u32>::max();
+
+  vec<Vertex> vertices_;
+  vec<u32> indices_;
+  vec<Slot> slots_;
+  u64 mask_ = 0;
+
+  void rehash(size_t capacity) {
+    vec<Slot> old = std::move(slots_);
+    slots_.assign(capacity, Slot {0, EMPTY});
+    mask_ = capacity - 1;
+
+    for (const auto &s: old) {
+      if (s.index == EMPTY) {
+        continue;
+      }
+
+      u64 i = s.hash & mask_;
+      while (slots_[i].index != EMPTY) {
+        i = (i + 1) & mask_;
+      }
+      slots_[i] = s;
+    }
+  }
+
+public:
+  VertexDedup() { rehash(1024); }
+
+  // num_indices is an upper bound for the number of unique vertices, reserving for it means the
+  // table never grows while the vertices are added
+  void reserve(size_t num_indices) {
+    indices_.reserve(num_indices);
+    vertices_.reserve(num_indices);
+    if (2 * num_indices > slots_.size()) {
+      rehash(std::bit_ceil(2 * num_indices));
+    }
+  }
+
+  // appends the index of the vertex, adds the vertex if it wasn't seen before
+  u32 insert(const Vertex &v) {
+    if (2 * (vertices_.size() + 1) > slots_.size()) {
+      rehash(2 * slots_.size());
+    }
+
+    const u32 h = static_cast<u32>(hash_vertex(v));
+    u64 i = h & mask_;
+    for (;;) {
+      Slot &s = slots_[i];
+      if (s.index == EMPTY) {
+        s = Slot {h, static_cast<u32>(vertices_.size())};
+        vertices_.push_back(v);
+        break;
+      }
+
+      if (s.hash == h && vertices_[s.index] == v) {
+        break;
+      }
+
+      i = (i + 1) & mask_;
+    }
+
+    indices_.push_back(slots_[i].index);
+    return slots_[i].index;
+  }
+
+  size_t num_vertices() const { return vertices_.size(); }
+  size_t num_indices() const { return indices_.size(); }
+
+  // hands out the results, the table is left empty
+  vec<Vertex> take_vertices() {
+    // reserve() assumed every vertex could be unique
+    vertices_.shrink_to_fit();
+    return std::move(vertices_);
+  }
+
+  vec<u32> take_indices() { return std::move(indices_); }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_VERTEX_H
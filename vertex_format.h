@@ -0,0 +1,292 @@
+#ifndef VULKAN_TUT_VERTEX_FORMAT_H
+#define VULKAN_TUT_VERTEX_FORMAT_H
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <span>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "common.h"
+#include "vertex.h"
+#include "mesh.h"
+
+namespace vk {
+
+// Vertex is what the loader produces and what the mesh cache stores. on the GPU the vertices
+// can use a smaller layout that's described by a VertexFormat and produced by encode_vertices.
+//
+// the shader always sees floats: the input assembler converts UNORM/SFLOAT16 attributes, so
+// only a missing color attribute needs a different shader variant (see shaders/Makefile)
+
+enum class PositionFormat {
+  Float32,  // R32G32B32_SFLOAT, 12 bytes
+  Half,     // R16G16B16A16_SFLOAT, 8 bytes. usable for models of moderate size around the origin
+  Unorm16,  // R16G16B16A16_UNORM, 8 bytes, normalized to the mesh bounds
+};
+
+enum class TexCoordFormat {
+  Float32,  // R32G32_SFLOAT, 8 bytes
+  Half,     // R16G16_SFLOAT, 4 bytes
+  Unorm16,  // R16G16_UNORM, 4 bytes, clamped to [0, 1]
+};
+
+struct VertexFormat {
+  PositionFormat position = PositionFormat::Float32;
+  TexCoordFormat tex_coord = TexCoordFormat::Float32;
+
+  // R8G8B8A8_UNORM, 4 bytes. loadModel sets every vertex to white, so it can usually go
+  bool color = true;
+
+  // the layout of Vertex itself, the encoded data is a plain copy
+  static VertexFormat full() { return {}; }
+
+  // 12 bytes instead of 32
+  static VertexFormat compact() { return {PositionFormat::Unorm16, TexCoordFormat::Unorm16, false}; }
+
+  bool is_full() const {
+    return position == PositionFormat::Float32 && tex_coord == TexCoordFormat::Float32 && color;
+  }
+
+  u32 position_size() const { return position == PositionFormat::Float32 ? 12 : 8; }
+  u32 tex_coord_size() const { return tex_coord == TexCoordFormat::Float32 ? 8 : 4; }
+
+  // attribute order: position, tex coord, color. the attributes are sorted by size, which keeps
+  // every one of them aligned to its component size without padding
+  u32 tex_coord_offset() const { return position_size(); }
+  u32 color_offset() const { return position_size() + tex_coord_size(); }
+  u32 stride() const {
+    return is_full() ? sizeof(Vertex) : position_size() + tex_coord_size() + (color ? 4 : 0);
+  }
+
+  VkVertexInputBindingDescription binding_description() const {
+    if (is_full()) {
+      return Vertex::getBindingDescription();
+    }
+
+    VkVertexInputBindingDescription binding {};
+    binding.binding = 0;
+    binding.stride = stride();
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    return binding;
+  }
+
+  // locations match shader.ubo.vert: 0 = position, 1 = color, 2 = tex coord
+  vec<VkVertexInputAttributeDescription> attribute_descriptions() const {
+    if (is_full()) {
+      auto full = Vertex::getAttributeDescriptions();
+      return {full.begin(), full.end()};
+    }
+
+    vec<VkVertexInputAttributeDescription> res;
+
+    VkVertexInputAttributeDescription pos {};
+    pos.binding = 0;
+    pos.location = 0;
+    pos.offset = 0;
+    switch (position) {
+      case PositionFormat::Float32: pos.format = VK_FORMAT_R32G32B32_SFLOAT; break;
+      case PositionFormat::Half: pos.format = VK_FORMAT_R16G16B16A16_SFLOAT; break;
+      case PositionFormat::Unorm16: pos.format = VK_FORMAT_R16G16B16A16_UNORM; break;
+    }
+    res.push_back(pos);
+
+    if (color) {
+      VkVertexInputAttributeDescription col {};
+      col.binding = 0;
+      col.location = 1;
+      col.offset = color_offset();
+      col.format = VK_FORMAT_R8G8B8A8_UNORM;
+      res.push_back(col);
+    }
+
+    VkVertexInputAttributeDescription uv {};
+    uv.binding = 0;
+    uv.location = 2;
+    uv.offset = tex_coord_offset();
+    switch (tex_coord) {
+      case TexCoordFormat::Float32: uv.format = VK_FORMAT_R32G32_SFLOAT; break;
+      case TexCoordFormat::Half: uv.format = VK_FORMAT_R16G16_SFLOAT; break;
+      case TexCoordFormat::Unorm16: uv.format = VK_FORMAT_R16G16_UNORM; break;
+    }
+    res.push_back(uv);
+
+    return res;
+  }
+
+  // bindless: the variant that finds its uniforms through push constants, see BindlessDescriptors
+  const char *vertex_shader(bool bindless = false) const {
+    if (bindless) {
+      return color ? "shaders/vert.bindless.spv" : "shaders/vert.nocolor.bindless.spv";
+    }
+    return color ? "shaders/vert.spv" : "shaders/vert.nocolor.spv";
+  }
+};
+
+// IEEE 754 binary16, round to nearest even
+inline u16 float_to_half(float f) {
+  const u32 x = std::bit_cast<u32>(f);
+  const u32 sign = (x >> 16) & 0x8000;
+  const u32 biased = (x >> 23) & 0xff;
+  u32 mant = x & 0x7fffff;
+
+  // inf and nan (keeps nans quiet)
+  if (biased == 0xff) {
+    return static_cast<u16>(sign | 0x7c00 | (mant ? 0x200 : 0));
+  }
+
+  const int exp = int(biased) - 127 + 15;
+  if (exp >= 31) {
+    return static_cast<u16>(sign | 0x7c00);
+  }
+
+  // subnormal half, or too small even for that
+  if (exp <= 0) {
+    if (exp < -10) {
+      return static_cast<u16>(sign);
+    }
+
+    mant |= 0x800000;
+    const u32 shift = 14 - exp;
+    u32 h = mant >> shift;
+    const u32 rem = mant & ((1u << shift) - 1);
+    const u32 halfway = 1u << (shift - 1);
+    if (rem > halfway || (rem == halfway && (h & 1))) {
+      ++h;
+    }
+    return static_cast<u16>(sign | h);
+  }
+
+  u32 h = sign | (u32(exp) << 10) | (mant >> 13);
+  const u32 rem = mant & 0x1fff;
+
+  // a carry out of the mantissa correctly bumps the exponent
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+    ++h;
+  }
+  return static_cast<u16>(h);
+}
+
+inline u16 float_to_unorm16(float f) {
+  return static_cast<u16>(std::lround(std::clamp(f, 0.0f, 1.0f) * 65535.0f));
+}
+
+// the size of the bounds the positions are normalized to
+inline glm::vec3 encode_extent(const MeshBounds &bounds) {
+  glm::vec3 extent = bounds.max - bounds.min;
+  for (int i = 0; i < 3; ++i) {
+    // flat models: any scale works, avoid dividing by 0
+    if (extent[i] <= 0.0f) {
+      extent[i] = 1.0f;
+    }
+  }
+  return extent;
+}
+
+// maps the decoded position attribute of vertices encoded with the bounds back to model space:
+// identity unless positions are normalized to the bounds, has to be applied before the model matrix
+inline glm::mat4 vertex_dequantize(const VertexFormat &format, const MeshBounds &bounds) {
+  if (format.position != PositionFormat::Unorm16) {
+    return glm::mat4(1.0f);
+  }
+  return glm::scale(glm::translate(glm::mat4(1.0f), bounds.min), encode_extent(bounds));
+}
+
+// writes format.stride() bytes per vertex to dst, front to back without reading it back, so dst
+// can be the staging ring. the bounds have to be the ones of the whole mesh, the vertices can be
+// any part of it. returns how many texture coordinates were clamped
+inline size_t encode_vertices(std::span<const Vertex> vertices, const VertexFormat &format, const MeshBounds &bounds, std::byte *dst) {
+  const u32 stride = format.stride();
+
+  if (format.is_full()) {
+    memcpy(dst, vertices.data(), size_t(stride) * vertices.size());
+    return 0;
+  }
+
+  const glm::vec3 extent = encode_extent(bounds);
+  size_t clamped = 0;
+
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    const Vertex &v = vertices[i];
+    std::byte *out = dst + i * stride;
+
+    switch (format.position) {
+      case PositionFormat::Float32: {
+        memcpy(out, &v.pos, 12);
+        break;
+      }
+      case PositionFormat::Half: {
+        const u16 p[4] = {float_to_half(v.pos.x), float_to_half(v.pos.y), float_to_half(v.pos.z), float_to_half(1.0f)};
+        memcpy(out, p, sizeof(p));
+        break;
+      }
+      case PositionFormat::Unorm16: {
+        const glm::vec3 n = (v.pos - bounds.min) / extent;
+        const u16 p[4] = {float_to_unorm16(n.x), float_to_unorm16(n.y), float_to_unorm16(n.z), 65535};
+        memcpy(out, p, sizeof(p));
+        break;
+      }
+    }
+
+    std::byte *uv_out = out + format.tex_coord_offset();
+    switch (format.tex_coord) {
+      case TexCoordFormat::Float32: {
+        memcpy(uv_out, &v.texCoord, 8);
+        break;
+      }
+      case TexCoordFormat::Half: {
+        const u16 uv[2] = {float_to_half(v.texCoord.x), float_to_half(v.texCoord.y)};
+        memcpy(uv_out, uv, sizeof(uv));
+        break;
+      }
+      case TexCoordFormat::Unorm16: {
+        if (v.texCoord.x < 0.0f || v.texCoord.x > 1.0f || v.texCoord.y < 0.0f || v.texCoord.y > 1.0f) {
+          ++clamped;
+        }
+        const u16 uv[2] = {float_to_unorm16(v.texCoord.x), float_to_unorm16(v.texCoord.y)};
+        memcpy(uv_out, uv, sizeof(uv));
+        break;
+      }
+    }
+
+    if (format.color) {
+      const u8 c[4] = {
+        static_cast<u8>(std::lround(std::clamp(v.color.r, 0.0f, 1.0f) * 255.0f)),
+        static_cast<u8>(std::lround(std::clamp(v.color.g, 0.0f, 1.0f) * 255.0f)),
+        static_cast<u8>(std::lround(std::clamp(v.color.b, 0.0f, 1.0f) * 255.0f)),
+        255
+      };
+      memcpy(out + format.color_offset(), c, sizeof(c));
+    }
+  }
+
+  return clamped;
+}
+
+inline void warn_clamped(size_t clamped) {
+  if (clamped > 0) {
+    spdlog::warn(
+      "{} vertices have texture coordinates outside of [0, 1] that were clamped, use TexCoordFormat::Half for this model",
+      clamped
+    );
+  }
+}
+
+// 16 bit indices if every vertex can be addressed with them. 0xffff is left alone, it's the
+// primitive restart index
+inline bool fits_index16(size_t num_vertices) {
+  return num_vertices < 0xffff;
+}
+
+// dst can be the staging ring, it's only written
+inline void narrow_indices(std::span<const u32> indices, u16 *dst) {
+  for (size_t i = 0; i < indices.size(); ++i) {
+    dst[i] = static_cast<u16>(indices[i]);
+  }
+}
+
+} // namespace vk
+
+#endif //VULKAN_TUT_VERTEX_FORMAT_H
@@ -0,0 +1,110 @@
+#ifndef VULKAN_TUT_WATCH_H
+#define VULKAN_TUT_WATCH_H
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+
+#include "common.h"
+
+namespace vk {
+
+// polls the modification time and size of a set of files. there is no portable change
+// notification, and for a few dozen files a stat each every interval costs nothing.
+//
+// a change is only reported once the file has stayed the same for settle_time: tools write
+// their output in several steps, reading it in between would see half a file. a file that
+// disappears (e.g. deleted before it's written again) is reported once it's back.
+//
+// not thread safe, poll() runs the callbacks on the calling thread
+class FileWatcher {
+public:
+  using Callback = std::function<void(const str &path)>;
+
+private:
+  struct Stamp {
+    std::filesystem::file_time_type mtime {};
+    uintmax_t size = 0;
+    bool exists = false;
+
+    bool operator==(const Stamp &) const = default;
+  };
+
+  struct Watch {
+    str path;
+    Callback callback;
+    Stamp reported;  // what the last callback saw, or watch() if there was none yet
+    Stamp seen;      // of the last poll
+    std::chrono::steady_clock::time_point seen_at;
+  };
+
+  vec<Watch> watches_;
+  std::chrono::milliseconds interval_;
+  std::chrono::milliseconds settle_time_;
+  std::chrono::steady_clock::time_point last_poll_ {};
+
+  static Stamp stamp(const str &path) {
+    Stamp s;
+    std::error_code ec;
+    s.mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+      return {};
+    }
+    s.size = std::filesystem::file_size(path, ec);
+    s.exists = !ec;
+    return s;
+  }
+
+public:
+  explicit FileWatcher(
+    std::chrono::milliseconds interval = std::chrono::milliseconds(250),
+    std::chrono::milliseconds settle_time = std::chrono::milliseconds(100)
+  ) : interval_(interval), settle_time_(settle_time) {}
+
+  // a path can be watched by several callbacks, it doesn't have to exist yet
+  void watch(const str &path, Callback callback) {
+    Watch w;
+    w.path = path;
+    w.callback = std::move(callback);
+    w.reported = stamp(path);
+    w.seen = w.reported;
+    w.seen_at = std::chrono::steady_clock::now();
+    watches_.push_back(std::move(w));
+  }
+
+  size_t size() const { return watches_.size(); }
+
+  // cheap enough to call every frame, the files are only looked at every interval. the
+  // callbacks may watch() more files
+  void poll() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_poll_ < interval_) {
+      return;
+    }
+    last_poll_ = now;
+
+    for (size_t i = 0; i < watches_.size(); ++i) {
+      const Stamp s = stamp(watches_[i].path);
+      if (s != watches_[i].seen) {
+        watches_[i].seen = s;
+        watches_[i].seen_at = now;
+        continue;
+      }
+
+      if (!s.exists || s == watches_[i].reported || now - watches_[i].seen_at < settle_time_) {
+        continue;
+      }
+      watches_[i].reported = s;
+
+      // watch() may reallocate watches_
+      const str path = watches_[i].path;
+      Callback callback = watches_[i].callback;
+      spdlog::info("{} changed", path);
+      callback(path);
+    }
+  }
+};
+
+} // namespace vk
+
+#endif //VULKAN_TUT_WATCH_H